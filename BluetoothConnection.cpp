@@ -74,6 +74,10 @@ void BluetoothConnection::initializeConnection(BluetoothController *btController
     // lets setup a connection for this timer
     bt_connection_timer_.init(btController_); // so it will use the main device
     bt_connection_timer_.pointer = (void*)this; // but rememember us. 
+    l2cap_step_timer_.init(btController_);
+    l2cap_step_timer_.pointer = (void*)this;
+    connection_timer_.init(btController_);
+    connection_timer_.pointer = (void*)this;
 
 
     connection_rxid_ = 0;
@@ -83,6 +87,23 @@ void BluetoothConnection::initializeConnection(BluetoothController *btController
     connection_complete_ = 0;
     connection_started_ = false;
     connection_started_by_timer_ = false;
+    l2cap_step_pending_ = false;
+    acl_packets_outstanding_ = 0;
+    link_mode_ = LINK_MODE_ACTIVE;
+    link_mode_interval_ = 0;
+    qos_latency_us_ = 0;
+    connect_start_us_ = micros() | 1;
+    hid_descriptor_retries_ = 0;
+    le_connection_ = false;
+    le_interval_ = 0;
+    gatt_state_ = GATT_IDLE;
+    gatt_report_count_ = 0;
+    have_hid_descriptor_ = false;
+    descriptor_ = nullptr;
+    sdp_buffer_ = nullptr;
+    descsize_ = 0;
+    hid_fields_ = nullptr;
+    hid_report_count_ = 0;
     //if (!connection_started_) {
     //    connection_started_ = true;
     //    btController_->setTimer(nullptr, 0); // clear out timer
@@ -154,6 +175,22 @@ void BluetoothConnection::rx2_data(uint8_t *rx2buf) // called from rx2_data of B
     uint16_t dcid = rx2buf[6] + ((uint16_t)rx2buf[7] << 8);
     //DBGPrintf("@@@@@@ SDP MSG? %x %x %x @@@@@", dcid, sdp_dcid_, rx2buf[8]);
 
+    if (le_connection_) {
+        // LE only uses the fixed channels.
+        switch (dcid) {
+        case L2CAP_ATT_CID:
+            process_att_pdu(&rx2buf[8], data_len);
+            break;
+        case L2CAP_LE_SIGNALING_CID:
+            process_le_signaling(&rx2buf[8], data_len);
+            break;
+        case L2CAP_SMP_CID:
+            process_smp(&rx2buf[8], data_len);
+            break;
+        }
+        return;
+    }
+
     if (dcid == sdp_dcid_) {
         switch (rx2buf[8]) {
         case SDP_SERVICE_SEARCH_REQUEST:
@@ -217,40 +254,61 @@ void BluetoothConnection::tx_data(uint8_t *data, uint16_t length)
 #endif
     switch (pending_control_tx_) {
     case STATE_TX_SEND_CONNECT_INT:
-        delay(1);
+    case STATE_TX_SEND_CONECT_RSP_SUCCESS:
+    case STATE_TX_SEND_CONFIG_REQ:
+    case STATE_TX_SEND_CONECT_ISR_RSP_SUCCESS:
+    case STATE_TX_SEND_CONFIG_ISR_REQ:
+    case STATE_TX_SEND_CONECT_SDP_RSP_SUCCESS:
+    case STATE_TX_SEND_CONFIG_SDP_REQ:
+        if (!l2cap_step_pending_) scheduleL2CAPStep();
+        break;
+    }
+}
+
+//=============================================================================
+// The device wants a moment between our L2CAP commands.  Rather than spin in
+// delay(1) here in the USB interrupt, the step timer sends the next one.  It
+// is separate from bt_connection_timer_, which belongs to the HID driver.
+//=============================================================================
+void BluetoothConnection::scheduleL2CAPStep()
+{
+    l2cap_step_pending_ = true;
+    l2cap_step_timer_.stop();
+    l2cap_step_timer_.start(L2CAP_STEP_DELAY_US);
+}
+
+void BluetoothConnection::sendL2CAPStep()
+{
+    DBGPrintf("BluetoothConnection::sendL2CAPStep: %d\n", pending_control_tx_);
+    switch (pending_control_tx_) {
+    case STATE_TX_SEND_CONNECT_INT:
         connection_rxid_++;
         sendl2cap_ConnectionRequest(device_connection_handle_, connection_rxid_, interrupt_dcid_, HID_INTR_PSM);
         pending_control_tx_ = 0;
         break;
     case STATE_TX_SEND_CONECT_RSP_SUCCESS:
-        delay(1);
         // Tell the device we are ready
         sendl2cap_ConnectionResponse(device_connection_handle_, connection_rxid_++, control_dcid_, control_scid_, SUCCESSFUL);
         pending_control_tx_ = STATE_TX_SEND_CONFIG_REQ;
         break;
     case STATE_TX_SEND_CONFIG_REQ:
-        delay(1);
         sendl2cap_ConfigRequest(device_connection_handle_, connection_rxid_, control_scid_);
         pending_control_tx_ = 0;
         break;
     case STATE_TX_SEND_CONECT_ISR_RSP_SUCCESS:
-        delay(1);
         // Tell the device we are ready
         sendl2cap_ConnectionResponse(device_connection_handle_, connection_rxid_++, interrupt_dcid_, interrupt_scid_, SUCCESSFUL);
         pending_control_tx_ = STATE_TX_SEND_CONFIG_ISR_REQ;
         break;
     case STATE_TX_SEND_CONFIG_ISR_REQ:
-        delay(1);
         sendl2cap_ConfigRequest(device_connection_handle_, connection_rxid_, interrupt_scid_);
         pending_control_tx_ = 0;
         break;
     case STATE_TX_SEND_CONECT_SDP_RSP_SUCCESS:
-        delay(1);
         sendl2cap_ConnectionResponse(device_connection_handle_, connection_rxid_, sdp_dcid_, sdp_scid_, SUCCESSFUL);
         pending_control_tx_ = STATE_TX_SEND_CONFIG_SDP_REQ;
         break;
     case STATE_TX_SEND_CONFIG_SDP_REQ:
-        delay(1);
         sendl2cap_ConfigRequest(device_connection_handle_, connection_rxid_, sdp_scid_);
         pending_control_tx_ = 0;
         break;
@@ -261,6 +319,504 @@ void BluetoothConnection::tx_data(uint8_t *data, uint16_t length)
 // Moved handling of L2CAP and HID messages
 //=============================================================================
 // Experiment to see if we can get SDP connectin setup
+//=============================================================================
+// Link policy, sniff mode and QoS
+//=============================================================================
+bool BluetoothConnection::setLinkPolicy(uint16_t link_policy_settings)
+{
+    if (!btController_ || (device_connection_handle_ == 0xffff)) return false;
+    uint8_t hcibuf[4];
+    hcibuf[0] = device_connection_handle_ & 0xff;
+    hcibuf[1] = (device_connection_handle_ >> 8) & 0x0f;
+    hcibuf[2] = link_policy_settings & 0xff;
+    hcibuf[3] = link_policy_settings >> 8;
+    DBGPrintf("HCI_WRITE_LINK_POLICY_SETTINGS handle:%x policy:%x\n", device_connection_handle_, link_policy_settings);
+    btController_->sendHCICommand(HCI_WRITE_LINK_POLICY_SETTINGS, sizeof(hcibuf), hcibuf);
+    return true;
+}
+
+bool BluetoothConnection::setSniffMode(uint16_t max_interval, uint16_t min_interval, uint16_t attempt, uint16_t timeout)
+{
+    if (!btController_ || (device_connection_handle_ == 0xffff)) return false;
+    //  handle  max interval  min interval  attempt  timeout
+    uint8_t hcibuf[10];
+    hcibuf[0] = device_connection_handle_ & 0xff;
+    hcibuf[1] = (device_connection_handle_ >> 8) & 0x0f;
+    hcibuf[2] = max_interval & 0xff;
+    hcibuf[3] = max_interval >> 8;
+    hcibuf[4] = min_interval & 0xff;
+    hcibuf[5] = min_interval >> 8;
+    hcibuf[6] = attempt & 0xff;
+    hcibuf[7] = attempt >> 8;
+    hcibuf[8] = timeout & 0xff;
+    hcibuf[9] = timeout >> 8;
+    DBGPrintf("HCI_SNIFF_MODE handle:%x interval:%u-%u\n", device_connection_handle_, min_interval, max_interval);
+    btController_->sendHCICommand(HCI_SNIFF_MODE, sizeof(hcibuf), hcibuf);
+    return true;
+}
+
+bool BluetoothConnection::exitSniffMode()
+{
+    if (!btController_ || (device_connection_handle_ == 0xffff)) return false;
+    uint8_t hcibuf[2];
+    hcibuf[0] = device_connection_handle_ & 0xff;
+    hcibuf[1] = (device_connection_handle_ >> 8) & 0x0f;
+    DBGPrintf("HCI_EXIT_SNIFF_MODE handle:%x\n", device_connection_handle_);
+    btController_->sendHCICommand(HCI_EXIT_SNIFF_MODE, sizeof(hcibuf), hcibuf);
+    return true;
+}
+
+static void put_le32(uint8_t *p, uint32_t val)
+{
+    p[0] = val & 0xff;
+    p[1] = (val >> 8) & 0xff;
+    p[2] = (val >> 16) & 0xff;
+    p[3] = val >> 24;
+}
+
+// service_type: 0 no traffic, 1 best effort, 2 guaranteed.  Token rate and
+// peak bandwidth are left as don't care, only latency matters for HID.
+bool BluetoothConnection::setQoS(uint32_t latency_us, uint32_t delay_variation_us, uint8_t service_type)
+{
+    if (!btController_ || (device_connection_handle_ == 0xffff)) return false;
+    //  handle  flags  service  token rate  peak bandwidth  latency  delay variation
+    uint8_t hcibuf[20];
+    hcibuf[0] = device_connection_handle_ & 0xff;
+    hcibuf[1] = (device_connection_handle_ >> 8) & 0x0f;
+    hcibuf[2] = 0;
+    hcibuf[3] = service_type;
+    put_le32(&hcibuf[4], 0);
+    put_le32(&hcibuf[8], 0);
+    put_le32(&hcibuf[12], latency_us);
+    put_le32(&hcibuf[16], delay_variation_us);
+    DBGPrintf("HCI_QOS_SETUP handle:%x latency:%u\n", device_connection_handle_, latency_us);
+    btController_->sendHCICommand(HCI_QOS_SETUP, sizeof(hcibuf), hcibuf);
+    return true;
+}
+
+bool BluetoothConnection::setFlushTimeout(uint16_t timeout)
+{
+    if (!btController_ || (device_connection_handle_ == 0xffff)) return false;
+    uint8_t hcibuf[4];
+    hcibuf[0] = device_connection_handle_ & 0xff;
+    hcibuf[1] = (device_connection_handle_ >> 8) & 0x0f;
+    hcibuf[2] = timeout & 0xff;
+    hcibuf[3] = timeout >> 8;
+    DBGPrintf("HCI_WRITE_AUTOMATIC_FLUSH_TIMEOUT handle:%x timeout:%u\n", device_connection_handle_, timeout);
+    btController_->sendHCICommand(HCI_WRITE_AUTOMATIC_FLUSH_TIMEOUT, sizeof(hcibuf), hcibuf);
+    return true;
+}
+
+//=============================================================================
+// LE connection parameters
+//=============================================================================
+bool BluetoothConnection::updateLEConnection(uint16_t min_interval, uint16_t max_interval, uint16_t latency, uint16_t supervision_timeout)
+{
+    if (!btController_ || !le_connection_) return false;
+    //  handle  min interval  max interval  latency  timeout  min CE  max CE
+    uint8_t hcibuf[14];
+    hcibuf[0] = device_connection_handle_ & 0xff;
+    hcibuf[1] = (device_connection_handle_ >> 8) & 0x0f;
+    hcibuf[2] = min_interval & 0xff;
+    hcibuf[3] = min_interval >> 8;
+    hcibuf[4] = max_interval & 0xff;
+    hcibuf[5] = max_interval >> 8;
+    hcibuf[6] = latency & 0xff;
+    hcibuf[7] = latency >> 8;
+    hcibuf[8] = supervision_timeout & 0xff;
+    hcibuf[9] = supervision_timeout >> 8;
+    hcibuf[10] = 0;
+    hcibuf[11] = 0;
+    hcibuf[12] = 0;
+    hcibuf[13] = 0;
+    DBGPrintf("HCI_LE_CONNECTION_UPDATE handle:%x interval:%u-%u\n", device_connection_handle_, min_interval, max_interval);
+    btController_->sendHCICommand(HCI_LE_CONNECTION_UPDATE, sizeof(hcibuf), hcibuf);
+    return true;
+}
+
+// The device asks for other connection parameters, usually longer intervals
+// to save its battery.  We only agree if it stays within what connectLE
+// asked for.
+void BluetoothConnection::process_le_signaling(uint8_t *data, uint16_t length)
+{
+    //  code  id  len len  min min  max max  lat lat  to to
+    if (length < 4) return;  // not even a command header
+    DBGPrintf("LE signaling: code:%x id:%x\n", data[0], data[1]);
+    uint8_t rsp[6];
+    rsp[1] = data[1];
+    rsp[2] = 2;
+    rsp[3] = 0;
+    if ((data[0] == L2CAP_CMD_CONN_PARAM_UPDATE_REQUEST) && (length >= 12)) {
+        uint16_t min_interval = data[4] + (data[5] << 8);
+        uint16_t max_interval = data[6] + (data[7] << 8);
+        uint16_t latency = data[8] + (data[9] << 8);
+        uint16_t supervision_timeout = data[10] + (data[11] << 8);
+        bool accept = !le_max_interval_ || (min_interval <= le_max_interval_);
+        DBGPrintf("    Connection parameter update request: %u-%u %s\n", min_interval, max_interval, accept ? "accepted" : "rejected");
+        rsp[0] = L2CAP_CMD_CONN_PARAM_UPDATE_RESPONSE;
+        rsp[4] = accept ? 0 : 1;
+        rsp[5] = 0;
+        btController_->sendL2CapCommand(device_connection_handle_, rsp, sizeof(rsp), L2CAP_LE_SIGNALING_CID, 0);
+        if (accept) {
+            if (le_max_interval_ && (max_interval > le_max_interval_)) max_interval = le_max_interval_;
+            updateLEConnection(min_interval, max_interval, latency, supervision_timeout);
+        }
+    } else if ((data[0] & 1) == 0) {
+        // Requests we do not know get a command reject.
+        rsp[0] = L2CAP_CMD_COMMAND_REJECT;
+        rsp[4] = 0; // command not understood
+        rsp[5] = 0;
+        btController_->sendL2CapCommand(device_connection_handle_, rsp, sizeof(rsp), L2CAP_LE_SIGNALING_CID, 0);
+    }
+}
+
+// No LE security manager yet, tell the device we can not pair.
+void BluetoothConnection::process_smp(uint8_t *data, uint16_t length)
+{
+    DBGPrintf("SMP: code:%x - pairing not supported\n", data[0]);
+    if (data[0] == SMP_PAIRING_FAILED) return;
+    uint8_t rsp[2] = {SMP_PAIRING_FAILED, SMP_PAIRING_NOT_SUPPORTED};
+    btController_->sendL2CapCommand(device_connection_handle_, rsp, sizeof(rsp), L2CAP_SMP_CID, 0);
+}
+
+//=============================================================================
+// HID over GATT
+// Find the HID service, its Report Map and Report characteristics, read
+// the report map into descriptor_ and turn on notifications for the input
+// reports.  After that the notifications are parsed like classic reports.
+//=============================================================================
+void BluetoothConnection::sendATT(const uint8_t *pdu, uint8_t length)
+{
+    btController_->sendL2CapCommand(device_connection_handle_, (uint8_t *)pdu, length, L2CAP_ATT_CID, 0);
+}
+
+// Find Information, Find By Type Value (primary service) and Read By Type
+// all start with a handle range.
+void BluetoothConnection::sendATTHandleRange(uint8_t opcode, uint16_t start, uint16_t end, uint16_t uuid)
+{
+    uint8_t pdu[9];
+    pdu[0] = opcode;
+    pdu[1] = start & 0xff;
+    pdu[2] = start >> 8;
+    pdu[3] = end & 0xff;
+    pdu[4] = end >> 8;
+    uint8_t length = 5;
+    if (opcode == ATT_FIND_BY_TYPE_VALUE_REQ) {
+        pdu[length++] = GATT_PRIMARY_SERVICE_UUID & 0xff;
+        pdu[length++] = GATT_PRIMARY_SERVICE_UUID >> 8;
+    }
+    if (opcode != ATT_FIND_INFORMATION_REQ) {
+        pdu[length++] = uuid & 0xff;
+        pdu[length++] = uuid >> 8;
+    }
+    sendATT(pdu, length);
+}
+
+void BluetoothConnection::sendATTRead(uint16_t handle, uint16_t offset)
+{
+    uint8_t pdu[5];
+    pdu[0] = offset ? ATT_READ_BLOB_REQ : ATT_READ_REQ;
+    pdu[1] = handle & 0xff;
+    pdu[2] = handle >> 8;
+    pdu[3] = offset & 0xff;
+    pdu[4] = offset >> 8;
+    sendATT(pdu, offset ? 5 : 3);
+}
+
+void BluetoothConnection::startGATTDiscovery()
+{
+    DBGPrintf("BluetoothConnection::startGATTDiscovery handle:%x\n", device_connection_handle_);
+    att_mtu_ = 23;
+    gatt_report_count_ = 0;
+    gatt_report_map_handle_ = 0;
+    gatt_prev_report_ = 0xff;
+    gatt_state_ = GATT_EXCHANGE_MTU;
+    uint8_t pdu[3] = {ATT_EXCHANGE_MTU_REQ, ATT_MTU & 0xff, ATT_MTU >> 8};
+    sendATT(pdu, sizeof(pdu));
+}
+
+void BluetoothConnection::gattFailed(const char *reason)
+{
+    DBGPrintf("HID over GATT failed: %s\n", reason);
+    gatt_state_ = GATT_FAILED;
+    // Nothing will be parsed on this connection, another device can have
+    // the descriptor buffer while it stays connected.
+    if (descriptor_ && !have_hid_descriptor_) btController_->freeHIDDescriptorBuffer(this);
+}
+
+void BluetoothConnection::process_att_pdu(uint8_t *data, uint16_t length)
+{
+    if (length == 0) return;
+    uint8_t opcode = data[0];
+    switch (opcode) {
+    case ATT_HANDLE_VALUE_NTF:
+        handleGATTNotification(data, length);
+        break;
+    case ATT_HANDLE_VALUE_IND:
+        {
+            handleGATTNotification(data, length);
+            uint8_t pdu[1] = {ATT_HANDLE_VALUE_CFM};
+            sendATT(pdu, sizeof(pdu));
+        }
+        break;
+    case ATT_EXCHANGE_MTU_REQ:
+        {
+            // The device may ask us too, same answer as our request.
+            uint8_t pdu[3] = {ATT_EXCHANGE_MTU_RSP, ATT_MTU & 0xff, ATT_MTU >> 8};
+            sendATT(pdu, sizeof(pdu));
+        }
+        break;
+    default:
+        if (opcode & 0x40) break;  // commands need no answer
+        if ((opcode & 1) == 0) {
+            // Requests have even opcodes.  We have no GATT server, but they
+            // still have to be answered.
+            uint8_t pdu[5] = {ATT_ERROR_RSP, opcode, 0, 0, ATT_ERROR_REQUEST_NOT_SUPPORTED};
+            if (length >= 3) {
+                pdu[2] = data[1];
+                pdu[3] = data[2];
+            }
+            sendATT(pdu, sizeof(pdu));
+            break;
+        }
+        process_att_response(opcode, data, length);
+        break;
+    }
+}
+
+void BluetoothConnection::process_att_response(uint8_t opcode, const uint8_t *data, uint16_t length)
+{
+    VDBGPrintf("ATT response: %x state:%u len:%u\n", opcode, gatt_state_, length);
+    if (opcode == ATT_ERROR_RSP) {
+        //  01 <request opcode> <handle> <handle> <error>
+        if (length < 5) return;
+        DBGPrintf("ATT error: request:%x handle:%x error:%x\n", data[1], data[2] + (data[3] << 8), data[4]);
+        switch (data[4]) {
+        case ATT_ERROR_INSUFFICIENT_AUTHENTICATION:
+        case ATT_ERROR_INSUFFICIENT_AUTHORIZATION:
+        case ATT_ERROR_INSUFFICIENT_KEY_SIZE:
+        case ATT_ERROR_INSUFFICIENT_ENCRYPTION:
+            gattFailed("device requires LE pairing");
+            return;
+        }
+    }
+
+    switch (gatt_state_) {
+    case GATT_EXCHANGE_MTU:
+        if ((opcode == ATT_EXCHANGE_MTU_RSP) && (length >= 3)) {
+            uint16_t server_mtu = data[1] + (data[2] << 8);
+            att_mtu_ = (server_mtu < ATT_MTU) ? server_mtu : ATT_MTU;
+            if (att_mtu_ < 23) att_mtu_ = 23;
+        }
+        gatt_state_ = GATT_FIND_HID_SERVICE;
+        sendATTHandleRange(ATT_FIND_BY_TYPE_VALUE_REQ, 0x0001, 0xffff, GATT_HID_SERVICE_UUID);
+        break;
+
+    case GATT_FIND_HID_SERVICE:
+        //  07 [<found handle><group end handle>]...
+        if ((opcode != ATT_FIND_BY_TYPE_VALUE_RSP) || (length < 5)) {
+            gattFailed("no HID service");
+            break;
+        }
+        gatt_service_start_ = data[1] + (data[2] << 8);
+        gatt_service_end_ = data[3] + (data[4] << 8);
+        DBGPrintf("    HID service: %x-%x\n", gatt_service_start_, gatt_service_end_);
+        gatt_state_ = GATT_DISCOVER_CHARACTERISTICS;
+        gatt_next_handle_ = gatt_service_start_;
+        sendATTHandleRange(ATT_READ_BY_TYPE_REQ, gatt_next_handle_, gatt_service_end_, GATT_CHARACTERISTIC_UUID);
+        break;
+
+    case GATT_DISCOVER_CHARACTERISTICS:
+        //  09 <entry length> [<declaration handle><properties><value handle><uuid 2 or 16>]...
+        if ((opcode == ATT_READ_BY_TYPE_RSP) && (length >= 2) && (data[1] >= 7)) {
+            uint8_t entry_length = data[1];
+            for (uint16_t i = 2; (i + entry_length) <= length; i += entry_length) {
+                uint16_t declaration_handle = data[i] + (data[i + 1] << 8);
+                uint16_t value_handle = data[i + 3] + (data[i + 4] << 8);
+                uint16_t uuid = (entry_length == 7) ? data[i + 5] + (data[i + 6] << 8) : 0;
+                if (gatt_prev_report_ != 0xff) gatt_reports_[gatt_prev_report_].end_handle = declaration_handle - 1;
+                gatt_prev_report_ = 0xff;
+                if (uuid == GATT_HID_REPORT_MAP_UUID) {
+                    gatt_report_map_handle_ = value_handle;
+                } else if ((uuid == GATT_HID_REPORT_UUID) && (gatt_report_count_ < GATT_REPORTS_MAX)) {
+                    gatt_report_t *report = &gatt_reports_[gatt_report_count_];
+                    report->value_handle = value_handle;
+                    report->end_handle = gatt_service_end_;
+                    report->cccd_handle = 0;
+                    report->reference_handle = 0;
+                    report->properties = data[i + 2];
+                    report->report_id = 0;
+                    report->report_type = 1;
+                    gatt_prev_report_ = gatt_report_count_++;
+                }
+                gatt_next_handle_ = (uint32_t)declaration_handle + 1;
+            }
+            if (gatt_next_handle_ <= gatt_service_end_) {
+                sendATTHandleRange(ATT_READ_BY_TYPE_REQ, gatt_next_handle_, gatt_service_end_, GATT_CHARACTERISTIC_UUID);
+                break;
+            }
+        }
+        DBGPrintf("    HID service: report map:%x reports:%u\n", gatt_report_map_handle_, gatt_report_count_);
+        gatt_state_ = GATT_DISCOVER_DESCRIPTORS;
+        gatt_report_index_ = 0;
+        if (gatt_report_count_) gatt_next_handle_ = (uint32_t)gatt_reports_[0].value_handle + 1;
+        gattContinue();
+        break;
+
+    case GATT_DISCOVER_DESCRIPTORS:
+        //  05 <format 1: 16 bit UUIDs> [<handle><uuid>]...
+        if ((opcode == ATT_FIND_INFORMATION_RSP) && (length >= 2)) {
+            gatt_report_t *report = &gatt_reports_[gatt_report_index_];
+            uint8_t entry_length = (data[1] == 1) ? 4 : 18;
+            uint32_t next_handle = gatt_next_handle_;
+            for (uint16_t i = 2; (i + entry_length) <= length; i += entry_length) {
+                uint16_t handle = data[i] + (data[i + 1] << 8);
+                uint16_t uuid = (entry_length == 4) ? data[i + 2] + (data[i + 3] << 8) : 0;
+                if (uuid == GATT_CCCD_UUID) report->cccd_handle = handle;
+                else if (uuid == GATT_REPORT_REFERENCE_UUID) report->reference_handle = handle;
+                if (handle >= next_handle) next_handle = (uint32_t)handle + 1;
+            }
+            // No progress means we are done with this one.
+            gatt_next_handle_ = (next_handle > gatt_next_handle_) ? next_handle : (uint32_t)report->end_handle + 1;
+        } else {
+            gatt_next_handle_ = (uint32_t)gatt_reports_[gatt_report_index_].end_handle + 1;
+        }
+        gattContinue();
+        break;
+
+    case GATT_READ_REPORT_REFERENCE:
+        //  0B <report id><report type>
+        if ((opcode == ATT_READ_RSP) && (length >= 3)) {
+            gatt_reports_[gatt_report_index_].report_id = data[1];
+            gatt_reports_[gatt_report_index_].report_type = data[2];
+            DBGPrintf("    Report handle:%x ID:%u type:%u\n", gatt_reports_[gatt_report_index_].value_handle, data[1], data[2]);
+        }
+        gatt_report_index_++;
+        gattContinue();
+        break;
+
+    case GATT_READ_REPORT_MAP:
+        if ((opcode == ATT_READ_RSP) || (opcode == ATT_READ_BLOB_RSP)) {
+            uint16_t cb = length - 1;
+            if ((descsize_ + cb) > BluetoothController::HID_DESCRIPTOR_SIZE) cb = BluetoothController::HID_DESCRIPTOR_SIZE - descsize_;
+            memcpy(descriptor_ + descsize_, &data[1], cb);
+            descsize_ += cb;
+            // A full response means there may be more.
+            if (((length - 1) == (att_mtu_ - 1)) && (descsize_ < BluetoothController::HID_DESCRIPTOR_SIZE)) {
+                sendATTRead(gatt_report_map_handle_, descsize_);
+                break;
+            }
+        }
+        if (descsize_ == 0) {
+            btController_->freeHIDDescriptorBuffer(this);
+            gattFailed("could not read report map");
+            break;
+        }
+        gattReportMapComplete();
+        break;
+
+    case GATT_ENABLE_NOTIFICATIONS:
+        gatt_report_index_++;
+        gattContinue();
+        break;
+    }
+}
+
+// Send the next request of the current step, or move on to the next step.
+void BluetoothConnection::gattContinue()
+{
+    switch (gatt_state_) {
+    case GATT_DISCOVER_DESCRIPTORS:
+        while (gatt_report_index_ < gatt_report_count_) {
+            gatt_report_t *report = &gatt_reports_[gatt_report_index_];
+            if (gatt_next_handle_ <= report->end_handle) {
+                sendATTHandleRange(ATT_FIND_INFORMATION_REQ, gatt_next_handle_, report->end_handle, 0);
+                return;
+            }
+            gatt_report_index_++;
+            if (gatt_report_index_ < gatt_report_count_) gatt_next_handle_ = (uint32_t)gatt_reports_[gatt_report_index_].value_handle + 1;
+        }
+        gatt_state_ = GATT_READ_REPORT_REFERENCE;
+        gatt_report_index_ = 0;
+        // fall through
+    case GATT_READ_REPORT_REFERENCE:
+        while (gatt_report_index_ < gatt_report_count_) {
+            if (gatt_reports_[gatt_report_index_].reference_handle) {
+                sendATTRead(gatt_reports_[gatt_report_index_].reference_handle, 0);
+                return;
+            }
+            gatt_report_index_++;
+        }
+        if (!gatt_report_map_handle_) {
+            gattFailed("no report map");
+            return;
+        }
+        gatt_state_ = GATT_READ_REPORT_MAP;
+        descriptor_ = btController_->allocHIDDescriptorBuffer(this);
+        if (!descriptor_) {
+            gattFailed("no HID descriptor buffer");
+            return;
+        }
+        if (descsize_) {
+            // Cached from the last time this device was connected.
+            gattReportMapComplete();
+            return;
+        }
+        sendATTRead(gatt_report_map_handle_, 0);
+        return;
+    case GATT_ENABLE_NOTIFICATIONS:
+        while (gatt_report_index_ < gatt_report_count_) {
+            gatt_report_t *report = &gatt_reports_[gatt_report_index_];
+            if (report->cccd_handle && (report->report_type == 1) && (report->properties & 0x30)) {
+                // Client Characteristic Configuration: 1 notifications, 2 indications
+                uint16_t value = (report->properties & 0x10) ? 0x0001 : 0x0002;
+                uint8_t pdu[5] = {ATT_WRITE_REQ, (uint8_t)(report->cccd_handle & 0xff), (uint8_t)(report->cccd_handle >> 8),
+                                  (uint8_t)(value & 0xff), (uint8_t)(value >> 8)};
+                sendATT(pdu, sizeof(pdu));
+                return;
+            }
+            gatt_report_index_++;
+        }
+        DBGPrintf("HID over GATT ready\n");
+        gatt_state_ = GATT_READY;
+        connectionReady();
+        return;
+    }
+}
+
+// Remember how long this connection took to get its reports set up.
+void BluetoothConnection::connectionReady()
+{
+    if (!connect_start_us_) return;
+    btController_->stats_.connect_us = micros() - connect_start_us_;
+    connect_start_us_ = 0;
+    DBGPrintf("Connection ready in %u us\n", btController_->stats_.connect_us);
+}
+
+void BluetoothConnection::gattReportMapComplete()
+{
+    dumpHIDReportDescriptor();
+    have_hid_descriptor_ = true;
+    parse();
+    compileReportDescriptor();
+    gatt_state_ = GATT_ENABLE_NOTIFICATIONS;
+    gatt_report_index_ = 0;
+    gattContinue();
+}
+
+void BluetoothConnection::handleGATTNotification(const uint8_t *data, uint16_t length)
+{
+    //  1B <handle><handle><report data>
+    if (length < 3) return;
+    uint16_t handle = data[1] + (data[2] << 8);
+    for (uint8_t i = 0; i < gatt_report_count_; i++) {
+        if (gatt_reports_[i].value_handle != handle) continue;
+        VDBGPrintf("GATT report: ID:%u len:%u\n", gatt_reports_[i].report_id, length - 3);
+        if (have_hid_descriptor_) parse(0x0100 | gatt_reports_[i].report_id, &data[3], length - 3);
+        return;
+    }
+}
+
 void BluetoothConnection::connectToSDP() {
     DBGPrintf("$$$ BluetoothController::connectToSDP() Called\n");
     connection_rxid_++;
@@ -277,7 +833,7 @@ void  BluetoothConnection::process_l2cap_connection_request(uint8_t *data, uint1
     uint16_t psm = data[4] + ((uint16_t)data[5] << 8);
     uint16_t scid = data[6] + ((uint16_t)data[7] << 8);
     connection_started_ = true;
-    btController_->setTimer(nullptr, 0); // clear out timer
+    btController_->setTimer(this, 0); // clear out timer
     connection_rxid_ = data[1];
     DBGPrintf("    recv L2CAP Connection Request: ID: %d, PSM: %x, SCID: %x\n", connection_rxid_, psm, scid);
 
@@ -462,11 +1018,8 @@ void BluetoothConnection::process_l2cap_config_response(uint8_t *data, uint16_t
         // Could be cleaner
         if (((device_class_ & 0xC0) == 0) && (pending_control_tx_ == STATE_TX_SEND_CONNECT_INT)) {
             // if we are not mouse and keybboard and we need to send the connect int
-            // do it now.
-            delay(1);
-            connection_rxid_++;
-            sendl2cap_ConnectionRequest(device_connection_handle_, connection_rxid_, interrupt_dcid_, HID_INTR_PSM);
-            pending_control_tx_ = 0;
+            // do it now (well, in a moment).
+            scheduleL2CAPStep();
         }
     
         DBGPrintf("\tNew Pending control pair:%u driver:%p HID:%u TX: %x\n", btController_->do_pair_device_, device_driver_, check_for_hid_descriptor_, pending_control_tx_);
@@ -477,6 +1030,10 @@ void BluetoothConnection::process_l2cap_config_response(uint8_t *data, uint16_t
             DBGPrintf("   Connection started by timeout experiment continue to SDP\n");
         } else    
         if (!check_for_hid_descriptor_) connection_complete_ |= CCON_SDP;  // Don't force connect if no is asking for HID
+        else if (btController_->reserveCachedHIDDescriptor(this)) {
+            DBGPrintf("   Have HID descriptor for this device, skip SDP\n");
+            connection_complete_ |= CCON_SDP;
+        }
         if ((connection_complete_ & CCON_SDP) == 0) connectToSDP(); // temp to see if we can do this later...
 
         // Enable SCan to page mode
@@ -536,7 +1093,7 @@ void BluetoothConnection::handleHIDTHDRData(uint8_t *data) {
         // If we got to here and don't have driver or ... try once to get one
         DBGPrintf("\t $$$ No HID or Driver: See if one wants it now\n");
         // BUGBUG we initialize descriptor with name...
-        device_driver_ = find_driver(descriptor_, 1);
+        device_driver_ = find_driver(remote_name_, 1);
     }
     #endif
     if (device_driver_) {
@@ -568,22 +1125,48 @@ void BluetoothConnection::handle_HCI_WRITE_SCAN_ENABLE_complete(uint8_t *rxbuf)
     if (connection_complete_ == CCON_ALL) {    // We have a driver call their
         if (device_driver_) {
             device_driver_->connectionComplete();
+            connectionReady();
         } else if (check_for_hid_descriptor_) {
-            have_hid_descriptor_ = false;
-            sdp_buffer_ = descriptor_;
-            sdp_buffer_len_ = sizeof(descriptor_);
-
-            if (!startSDP_ServiceSearchAttributeRequest(0x206, 0x206, sdp_buffer_, sdp_buffer_len_)) {
-                // Maybe try to claim_driver as we won't get a HID report.
-                DBGPrintf("Failed to start SDP attribute request - so lets try again to find a driver");
-                device_driver_ = find_driver(descriptor_, 1);
-            }
+            hid_descriptor_retries_ = 0;
+            requestHIDDescriptor();
         }
         connection_complete_ = 0;  // only call once
     }
 
 }
 
+// Get the HID report descriptor into a buffer borrowed from the controller.
+// While all of them are lent out, try again now and then: they come back as
+// the other devices' descriptors are compiled.
+void BluetoothConnection::requestHIDDescriptor()
+{
+    have_hid_descriptor_ = false;
+    descriptor_ = btController_->allocHIDDescriptorBuffer(this);
+    sdp_buffer_ = descriptor_;
+    sdp_buffer_len_ = descriptor_ ? BluetoothController::HID_DESCRIPTOR_SIZE : 0;
+
+    if (!descriptor_ && (hid_descriptor_retries_ < HID_DESCRIPTOR_RETRIES)) {
+        hid_descriptor_retries_++;
+        btController_->setTimer(this, HID_DESCRIPTOR_RETRY_US);
+        return;
+    }
+    hid_descriptor_retries_ = 0;
+    if (descriptor_ && descsize_) {
+        // Cached from the last time this device was connected.
+        sdp_buffer_ = nullptr;
+        dumpHIDReportDescriptor();
+        have_hid_descriptor_ = true;
+        parse();
+        compileReportDescriptor();
+        connectionReady();
+    } else if (!descriptor_ || !startSDP_ServiceSearchAttributeRequest(0x206, 0x206, sdp_buffer_, sdp_buffer_len_)) {
+        // Maybe try to claim_driver as we won't get a HID report.
+        DBGPrintf("Failed to start SDP attribute request - so lets try again to find a driver");
+        btController_->freeHIDDescriptorBuffer(this);
+        device_driver_ = find_driver(remote_name_, 1);
+    }
+}
+
 void BluetoothConnection::handle_HCI_OP_ROLE_DISCOVERY_complete(uint8_t *rxbuf)
 {
     // PS4 looks something like: 0E 07 01 09 08 00 47 00 01
@@ -610,11 +1193,17 @@ void BluetoothConnection::timer_event(USBDriverTimer *whichTimer)
 {
     DBGPrintf("BluetoothConnection::timer_event(%p) : %u\n", this, connection_started_);
 
-    if (whichTimer == &bt_connection_timer_) {
-        if (device_driver_) {
-            device_driver_->bt_hid_timer_event(whichTimer);
+    if (whichTimer == &l2cap_step_timer_) {
+        // Our pacing of the L2CAP setup, see scheduleL2CAPStep
+        if (l2cap_step_pending_) {
+            l2cap_step_pending_ = false;
+            sendL2CAPStep();
         }
-    } else if (!connection_started_) {
+    } else if (whichTimer == &bt_connection_timer_) {
+        if (device_driver_) device_driver_->bt_hid_timer_event(whichTimer);
+    } else if ((whichTimer == &connection_timer_) && hid_descriptor_retries_) {
+        requestHIDDescriptor();
+    } else if ((whichTimer == &connection_timer_) && !connection_started_) {
         DBGPrintf("\t** Timed out now try issue connection requsts **\n ");
         connection_started_ = true;
         connection_started_by_timer_ = true;
@@ -947,7 +1536,10 @@ void BluetoothConnection::process_sdp_service_search_attribute_response(uint8_t
 bool BluetoothConnection::completeSDPRequest(bool success)
 {
 
-    if (!success) return false;
+    if (!success) {
+        btController_->freeHIDDescriptorBuffer(this);
+        return false;
+    }
     // Now real hack:
     // Lets see if we can now print out the report descriptor.
     uint32_t cb_left = sdp_request_buffer_used_cnt_;
@@ -963,17 +1555,23 @@ bool BluetoothConnection::completeSDPRequest(bool success)
         if ((sdpe.dtype == DU32) && (sdpe.data.uw == 0x206)) found_report_attribute = true;
 
         if (found_report_attribute && (sdpe.element_type == 4) && (sdpe.dtype == DPB)) {
+            // The descriptor is within the SDP response in the same buffer.
             descsize_ = sdpe.element_size;
-            memcpy(descriptor_, sdpe.data.pb, descsize_);
+            memmove(descriptor_, sdpe.data.pb, descsize_);
+            sdp_buffer_ = nullptr;
             dumpHIDReportDescriptor();
             have_hid_descriptor_ = true;
             parse();
+            compileReportDescriptor();
+            connectionReady();
             return true;
         }
 
         cb_left -= cb;
         pb += cb;
     }
+    // No report descriptor, so no need to keep the buffer.
+    btController_->freeHIDDescriptorBuffer(this);
     return false;
 }
 
@@ -1930,12 +2528,45 @@ BTHIDInput * BluetoothConnection::find_driver(uint32_t topusage)
     return NULL;
 }
 
-void BluetoothConnection::parse(uint16_t type_and_report_id, const uint8_t *data, uint32_t len)
+// The device is gone: the drivers that claimed its collections let go, so
+// they can be claimed again when it or another device connects.
+void BluetoothConnection::releaseCollectionDrivers()
+{
+    for (uint8_t i = 0; i < TOPUSAGE_LIST_LEN; i++) {
+        if (topusage_drivers[i]) topusage_drivers[i]->bt_disconnect_collection((Device_t*)btController_);
+        topusage_drivers[i] = nullptr;
+    }
+}
+
+
+// Add one driver call to a compiled report.
+static bool addHIDField(BluetoothConnection::hid_field_t *fields, uint8_t &field_count, uint8_t op,
+                        uint8_t driver_index, uint32_t bitindex, uint32_t size, uint8_t type, uint32_t usage,
+                        int32_t logical_min, int32_t logical_max)
+{
+    if (field_count >= BluetoothConnection::HID_FIELDS_MAX) return false;
+    BluetoothConnection::hid_field_t *field = &fields[field_count++];
+    field->op = op;
+    field->driver_index = driver_index;
+    field->size = size;
+    field->type = type;
+    field->bitindex = bitindex;
+    field->usage = usage;
+    field->logical_min = logical_min;
+    field->logical_max = logical_max;
+    return true;
+}
+
+// Walk the report descriptor for one input report.  With fields, nothing
+// is called: the calls the report would make are added to fields instead,
+// returns false if they do not fit.
+bool BluetoothConnection::parse(uint8_t report_id_filter, const uint8_t *data, hid_field_t *fields, uint8_t &field_count)
 {
     const bool use_report_id = true;
     const uint8_t *p = descriptor_;
     const uint8_t *end = p + descsize_;
     BTHIDInput *driver = NULL;
+    uint8_t driver_index = 0;
     // USBHIDInput *driver = hidi_; // hack for now everything feeds back to us...
     uint32_t topusage = 0;
     uint8_t topusage_index = 0;
@@ -2036,6 +2667,7 @@ void BluetoothConnection::parse(uint16_t type_and_report_id, const uint8_t *data
                 topusage = ((uint32_t)usage_page << 16) | usage[0];
                 driver = NULL;
                 if (topusage_index < TOPUSAGE_LIST_LEN) {
+                    driver_index = topusage_index;
                     driver = topusage_drivers[topusage_index++];
                 }
             }
@@ -2047,14 +2679,18 @@ void BluetoothConnection::parse(uint16_t type_and_report_id, const uint8_t *data
             if (collection_level > 0) {
                 collection_level--;
                 if (collection_level == 0 && driver != NULL) {
-                    driver->bt_hid_input_end();
+                    if (fields) {
+                        if (!addHIDField(fields, field_count, HID_OP_END, driver_index, 0, 0, 0, 0, 0, 0)) return false;
+                    } else {
+                        driver->bt_hid_input_end();
+                    }
                     //driver = NULL;
                 }
             }
             reset_local = true;
             break;
         case 0x80: // Input
-            if (use_report_id && (report_id != (type_and_report_id & 0xFF))) {
+            if (use_report_id && (report_id != report_id_filter)) {
                 // completely ignore and do not advance bitindex
                 // for descriptors of other report IDs
                 reset_local = true;
@@ -2072,7 +2708,11 @@ void BluetoothConnection::parse(uint16_t type_and_report_id, const uint8_t *data
                 println("       usage count=", usage_count);
                 println("       usage min max count=", usage_min_max_count);
 
-                driver->bt_hid_input_begin(topusage, val, logical_min, logical_max);
+                if (fields) {
+                    if (!addHIDField(fields, field_count, HID_OP_BEGIN, driver_index, 0, 0, val, topusage, logical_min, logical_max)) return false;
+                } else {
+                    driver->bt_hid_input_begin(topusage, val, logical_min, logical_max);
+                }
                 println("Input, total bits=", report_count * report_size);
                 if ((val & 2)) {
                     // ordinary variable format
@@ -2119,6 +2759,11 @@ void BluetoothConnection::parse(uint16_t type_and_report_id, const uint8_t *data
                         u |= (uint32_t)usage_page << 16;
                         print("  usage = ", u, HEX);
 
+                        if (fields) {
+                            if (!addHIDField(fields, field_count, HID_OP_DATA, driver_index, bitindex, report_size, 0, u, logical_min, logical_max)) return false;
+                            bitindex += report_size;
+                            continue;
+                        }
                         uint32_t n = bitfield(data, bitindex, report_size);
                         if (logical_min >= 0) {
                             println("  data = ", n);
@@ -2150,6 +2795,11 @@ void BluetoothConnection::parse(uint16_t type_and_report_id, const uint8_t *data
                             }
 
                             u |= (uint32_t)usage_page << 16;
+                            if (fields) {
+                                if (!addHIDField(fields, field_count, HID_OP_DATA, driver_index, bitindex, report_size, 0, u, logical_min, logical_max)) return false;
+                                bitindex += report_size;
+                                continue;
+                            }
                             uint32_t n = bitfield(data, bitindex, report_size);
                             if (logical_min >= 0) {
                                 println("  data = ", n);
@@ -2165,6 +2815,11 @@ void BluetoothConnection::parse(uint16_t type_and_report_id, const uint8_t *data
 
                     } else {
                         for (uint32_t i = 0; i < report_count; i++) {
+                            if (fields) {
+                                if (!addHIDField(fields, field_count, HID_OP_ARRAY, driver_index, bitindex, report_size, 0, (uint32_t)usage_page << 16, logical_min, logical_max)) return false;
+                                bitindex += report_size;
+                                continue;
+                            }
                             uint32_t u = bitfield(data, bitindex, report_size);
                             int n = u;
                             if (n >= logical_min && n <= logical_max) {
@@ -2219,4 +2874,108 @@ void BluetoothConnection::parse(uint16_t type_and_report_id, const uint8_t *data
             usage[1] = 0;
         }
     }
+    return true;
+}
+
+// Called for each input report.  Uses the compiled report when we have one.
+void BluetoothConnection::parse(uint16_t type_and_report_id, const uint8_t *data, uint32_t len)
+{
+    uint8_t report_id = type_and_report_id & 0xFF;
+    for (uint8_t r = 0; r < hid_report_count_; r++) {
+        if (hid_reports_[r].report_id != report_id) continue;
+
+        const hid_field_t *field = &hid_fields_[hid_reports_[r].first];
+        for (uint8_t i = 0; i < hid_reports_[r].count; i++, field++) {
+            // Fields are only compiled for claimed collections, but do not
+            // trust that the driver is still there.
+            BTHIDInput *driver = topusage_drivers[field->driver_index];
+            if (!driver) continue;
+            switch (field->op) {
+            case HID_OP_BEGIN:
+                driver->bt_hid_input_begin(field->usage, field->type, field->logical_min, field->logical_max);
+                break;
+            case HID_OP_DATA:
+            {
+                uint32_t n = bitfield(data, field->bitindex, field->size);
+                if (field->logical_min >= 0) driver->bt_hid_input_data(field->usage, n);
+                else driver->bt_hid_input_data(field->usage, signext(n, field->size));
+            }
+            break;
+            case HID_OP_ARRAY:
+            {
+                uint32_t u = bitfield(data, field->bitindex, field->size);
+                int n = u;
+                if (n >= field->logical_min && n <= field->logical_max) {
+                    driver->bt_hid_input_data(u | field->usage, 1);
+                }
+            }
+            break;
+            case HID_OP_END:
+                driver->bt_hid_input_end();
+                break;
+            }
+        }
+        return;
+    }
+
+    // Not compiled (no room or report ID we did not see), walk the descriptor.
+    // When it was compiled the descriptor is gone, and a report ID it did
+    // not have would not have matched anything anyway.
+    uint8_t field_count = 0;
+    parse(report_id, data, nullptr, field_count);
+}
+
+// Compile the report descriptor, once the drivers have claimed their top
+// level collections, into the calls parse() makes for each report ID.
+void BluetoothConnection::compileReportDescriptor()
+{
+    hid_report_count_ = 0;
+    if (!hid_fields_) return;
+
+    // Report IDs used, 0 is for items before any Report ID.
+    uint8_t report_ids[HID_REPORT_IDS_MAX];
+    uint8_t report_id_count = 1;
+    report_ids[0] = 0;
+    const uint8_t *p = descriptor_;
+    const uint8_t *end = p + descsize_;
+    while (p < end) {
+        uint8_t tag = *p;
+        if (tag == 0xFE) { // Long Item (unsupported)
+            p += p[1] + 3;
+            continue;
+        }
+        if (tag == 0x85) {
+            uint8_t i;
+            for (i = 0; i < report_id_count; i++) {
+                if (report_ids[i] == p[1]) break;
+            }
+            if (i == report_id_count) {
+                if (report_id_count == HID_REPORT_IDS_MAX) {
+                    DBGPrintf("HID report descriptor has too many report IDs, not compiled\n");
+                    return;
+                }
+                report_ids[report_id_count++] = p[1];
+            }
+        }
+        p += ((tag & 3) == 3) ? 5 : (tag & 3) + 1;
+    }
+
+    uint8_t field_count = 0;
+    for (uint8_t i = 0; i < report_id_count; i++) {
+        uint8_t first = field_count;
+        if (!parse(report_ids[i], nullptr, hid_fields_, field_count)) {
+            DBGPrintf("HID report descriptor too large to compile, walking it for each report\n");
+            hid_report_count_ = 0;
+            return;
+        }
+        hid_reports_[i].report_id = report_ids[i];
+        hid_reports_[i].first = first;
+        hid_reports_[i].count = field_count - first;
+    }
+    hid_report_count_ = report_id_count;
+    DBGPrintf("HID report descriptor compiled: %u report IDs, %u fields\n", report_id_count, field_count);
+
+    // The field table is all parse() needs now, let another device have
+    // the descriptor buffer.
+    btController_->releaseHIDDescriptorBuffer(this);
 }
@@ -140,7 +140,7 @@ bool USBDrive::claim(Device_t *dev, int type, const uint8_t *descriptors, uint32
 	msDriveInfo.initialized = false;
 	msDriveInfo.connected = true;
 	_drive_connect_fs_status = USBDRIVE_CONNECTED;
-	_cGPTParts = 0; // have not cached this yet GPT
+	invalidatePartitionCache(); // have not cached this yet
 
 #ifdef DBGprint
 	print("   connected = ");
@@ -153,6 +153,17 @@ bool USBDrive::claim(Device_t *dev, int type, const uint8_t *descriptors, uint32
 
 void USBDrive::disconnect()
 {
+	// The other LUNs of this drive go away with us.
+	while (_next_lun) {
+		USBDrive *plun = _next_lun;
+		_next_lun = plun->_next_lun;
+		plun->_next_lun = nullptr;
+		plun->disconnect();
+		plun->_lun_parent = nullptr;
+		plun->currentLUN = 0;
+		plun->device = nullptr;  // make it available to claim devices again
+	}
+
 	// We need to go through and release an patitions we are holding onto.
 	DBGPrintf("USBDrive::disconnect %p %p\n", this, device);
 	USBFSBase *usbfs = USBFSBase::s_first_fs; 
@@ -171,10 +182,14 @@ void USBDrive::disconnect()
 
 
 	deviceAvailable = false;
+	_coalesce_count = 0; // nowhere to write them anymore.
+	_coalesce_error = 0;
+	invalidatePartitionCache();
 	println("Device Disconnected...");
 	msDriveInfo.connected = false;
 	msDriveInfo.initialized = false;
 	memset(&msDriveInfo, 0, sizeof(msDriveInfo_t));
+	memset(&msBlockLimits, 0, sizeof(msBlockLimits_t));
 
 #ifdef DBGprint
 	print("   connected ");
@@ -186,15 +201,32 @@ void USBDrive::disconnect()
 
 void USBDrive::Task()
 {
+	// Don't leave coalesced writes sitting around for long.
+	for (USBDrive *pdrive = this; pdrive; pdrive = pdrive->_next_lun) {
+		// A failed flush keeps them and waits for the error to be picked
+		// up by writeSector() or syncDevice().
+		if (pdrive->_coalesce_count && !pdrive->_coalesce_error &&
+				(pdrive->_emlastCoalesce >= WRITE_COALESCE_TIMEOUT_MS)) {
+			if (!pdrive->flushCoalescedWrites()) pdrive->_coalesce_error = pdrive->m_errorCode;
+		}
+	}
 	if (s_when_to_update != UPDATE_TASK) return;
-	if (_drive_connect_fs_status == USBDRIVE_CONNECTED) {
-		DBGPrintf("\n === Task() Drive %p connected ===\n", this);
-		startFilesystems();
-		DBGPrintf("\nTry Partition list");
-
-		#ifdef DBGprint
-		printPartionTable(Serial);
-		#endif
+	// Mount a step at a time (start up, one Test Unit Ready, one partition
+	// table sector or one partition per call), so one Task() call does not
+	// hold up everything else for the whole mount.
+	for (USBDrive *pdrive = this; pdrive; pdrive = pdrive->_next_lun) {
+		if ((pdrive->_drive_connect_fs_status == USBDRIVE_CONNECTED) ||
+				(pdrive->_drive_connect_fs_status == USBDRIVE_MOUNTING)) {
+			DBGPrintf("\n === Task() Drive %p mount step %d ===\n", pdrive, pdrive->_mount_part);
+			bool file_system_claimed = false;
+			if (pdrive->mountStep(file_system_claimed) && pdrive->filesystemsStarted()) {
+				DBGPrintf("\nTry Partition list");
+
+				#ifdef DBGprint
+				pdrive->printPartionTable(Serial);
+				#endif
+			}
+		}
 	}
 }
 
@@ -231,14 +263,25 @@ void USBDrive::new_dataOut(const Transfer_t *transfer)
 {
 	uint32_t len = transfer->length - ((transfer->qtd.token >> 16) & 0x7FFF);
 	println("USBDrive dataOut (static)", len, DEC);
+	if (transfer->qtd.token & 0x40) msOutHalted = true; // STALL
 	print_hexbytes((uint8_t*)transfer->buffer, (len < 32)? len : 32 );
-	msOutCompleted = true; // Last out transaction is completed.
+	if (_write_sectors_callback) {
+		_emlastWrite = 0; // remember that the pipe is still draining.
+		_write_sectors_in_flight--;
+		if (_write_sectors_to_queue && !_write_sectors_aborted) queueNextWriteSector();
+		if (!_write_sectors_in_flight) {
+			_write_sectors_callback = nullptr;
+			msOutCompleted = true; // Last out transaction is completed.
+		}
+	}
+	else msOutCompleted = true; // Last out transaction is completed.
 }
 
 void USBDrive::new_dataIn(const Transfer_t *transfer)
 {
 	uint32_t len = transfer->length - ((transfer->qtd.token >> 16) & 0x7FFF);
 	println("USBDrive dataIn (static): ", len, DEC);
+	if (transfer->qtd.token & 0x40) msInHalted = true; // STALL
 	print_hexbytes((uint8_t*)transfer->buffer, (len < 32)? len : 32 );
 	if (_read_sectors_callback) {
 		_emlastRead = 0; // remember that we received something. 
@@ -274,23 +317,35 @@ uint8_t USBDrive::mscInit(void) {
 		yield();
 	} while(!available());
 
+	mscInitStart();
+	msResult = WaitMediaReady();
+	if(msResult)
+		return msResult;
+	return mscInitDriveInfo();
+}
+
+// First part of mscInit(), up to waiting for the medium.
+void USBDrive::mscInitStart(void) {
 // Uncommenting "msReset()" will cause certain USB flash drives to fail to init or read/write.
 // Several SanDisk devices have been proven to fail.
 // Possibly due to clearing default power on settings.
 //	msReset(); 
 	// delay(500); // Not needed any more.
 	maxLUN = msGetMaxLun();
+	if (!_lun_parent && maxLUN) attachLUNs();
 
 //	msResult = msReportLUNs(&maxLUN);
 //println("maxLUN = ");
 //println(maxLUN);
 //	delay(150);
 	//-------------------------------------------------------
-	msResult = msStartStopUnit(1);
-	msResult = WaitMediaReady();
-	if(msResult)
-		return msResult;
-		
+	msStartStopUnit(1);
+}
+
+// Last part of mscInit(), once the medium is ready.
+uint8_t USBDrive::mscInitDriveInfo(void) {
+	uint8_t msResult;
+
 	// Retrieve drive information.
 	msDriveInfo.initialized = true;
 	msDriveInfo.hubNumber = getHubNumber();			// Which HUB.
@@ -304,11 +359,55 @@ uint8_t USBDrive::mscInit(void) {
 	msResult = msReadDeviceCapacity(&msCapacity);	// Size Info.
 	if(msResult)
 		return msResult;
+	msReadBlockLimits(&msBlockLimits);				// UNMAP support, not required.
 	memcpy(&msDriveInfo.inquiry, &msInquiry, sizeof(msInquiryResponse_t));
 	memcpy(&msDriveInfo.capacity, &msCapacity, sizeof(msSCSICapacity_t));
 	return msResult;
 }
 
+//---------------------------------------------------------------------------
+// Multi-LUN devices (card readers): give each LUN after the first one its
+// own USBDrive object, taken from the USBDrive objects not bound to a device.
+// These share our pipes (the transport) and have their own partitions and
+// filesystems, so declare one USBDrive per LUN you wish to use.
+void USBDrive::attachLUNs() {
+	for (uint8_t lun = 1; lun <= maxLUN; lun++) {
+		USBDrive *plun;
+		for (plun = _next_lun; plun; plun = plun->_next_lun) {
+			if (plun->currentLUN == lun) break;
+		}
+		if (plun) continue; // already have this one.
+
+		NVIC_DISABLE_IRQ(IRQ_USBHS);	// don't let enumeration claim it while we do
+		for (plun = s_first_drive; plun; plun = plun->_next_drive) {
+			if ((plun->device == nullptr) && (plun->_lun_parent == nullptr)) break;
+		}
+		if (plun) plun->device = device;
+		NVIC_ENABLE_IRQ(IRQ_USBHS);
+		if (!plun) {
+			DBGPrintf("USBDrive %p: no free USBDrive for LUN %u\n", this, lun);
+			return;
+		}
+		DBGPrintf("USBDrive %p: LUN %u -> %p\n", this, lun, plun);
+		plun->_lun_parent = this;
+		plun->currentLUN = lun;
+		plun->maxLUN = maxLUN;
+		plun->idVendor = idVendor;
+		plun->idProduct = idProduct;
+		plun->hubNumber = hubNumber;
+		plun->hubPort = hubPort;
+		plun->deviceAddress = deviceAddress;
+		plun->deviceAvailable = true;
+		plun->m_initDone = false;
+		plun->msDriveInfo.initialized = false;
+		plun->msDriveInfo.connected = true;
+		plun->_drive_connect_fs_status = USBDRIVE_CONNECTED;
+		plun->invalidatePartitionCache();
+		plun->_next_lun = _next_lun;
+		_next_lun = plun;
+	}
+}
+
 //---------------------------------------------------------------------------
 // Perform Mass Storage Reset
 void USBDrive::msReset(void) {
@@ -316,18 +415,64 @@ void USBDrive::msReset(void) {
 	println("msReset()");
 #endif
 	DBGPrintf(">>msReset()\n"); DBGFlush();
+	if (_lun_parent) return _lun_parent->msReset(); // one reset for all LUNs
 	mk_setup(setup, 0x21, 0xff, 0, bInterfaceNumber, 0);
 	queue_Control_Transfer(device, &setup, NULL, this);
 	while (!msControlCompleted) yield();
 	msControlCompleted = false;
 }
 
+//---------------------------------------------------------------------------
+// Bulk-Only reset recovery, after giving up on a command part way through:
+// drop whatever is still queued on our pipes (so a late completion is not
+// taken for the next command's), reset the device and clear the halt on both
+// bulk endpoints.
+void USBDrive::msResetRecovery(void) {
+	DBGPrintf(">>msResetRecovery()\n"); DBGFlush();
+	if (_lun_parent) return _lun_parent->msResetRecovery();
+	cancel_Transfers(datapipeOut);
+	cancel_Transfers(datapipeIn);
+	msOutCompleted = false;
+	msInCompleted = false;
+	msReset();
+	msClearHalt(endpointIn);
+	msClearHalt(endpointOut);
+	msInHalted = false;
+	msOutHalted = false;
+}
+
+void USBDrive::msClearHalt(uint32_t endpoint) {
+	mk_setup(setup, 0x02, 1, 0, endpoint, 0);  // CLEAR_FEATURE(ENDPOINT_HALT)
+	queue_Control_Transfer(device, &setup, NULL, this);
+	while (!msControlCompleted) yield();
+	msControlCompleted = false;
+}
+
+// A device that can't finish a data stage (a read error, a command it
+// failed before the data) may STALL the bulk endpoint instead.  Clear the
+// halt, the CSW with the command's status still follows.  The STALL also
+// halted the pipe's queue head in the EHCI, which would never start the
+// CSW read, so reset it too (and its data toggle, as the device did).
+void USBDrive::msClearStalledEndpoints() {
+	if (msInHalted) {
+		msInHalted = false;
+		msClearHalt(endpointIn);
+		cancel_Transfers(datapipeIn);
+	}
+	if (msOutHalted) {
+		msOutHalted = false;
+		msClearHalt(endpointOut);
+		cancel_Transfers(datapipeOut);
+	}
+}
+
 //---------------------------------------------------------------------------
 // Get MAX LUN
 uint8_t USBDrive::msGetMaxLun(void) {
 #ifdef DBGprint
 	println("msGetMaxLun()");
 #endif
+	if (_lun_parent) return _lun_parent->maxLUN;
 	report[0] = 0;
 	mk_setup(setup, 0xa1, 0xfe, 0, bInterfaceNumber, 1);
 	queue_Control_Transfer(device, &setup, report, this);
@@ -337,22 +482,59 @@ uint8_t USBDrive::msGetMaxLun(void) {
 	return maxLUN;
 }
 
+//---------------------------------------------------------------------------
+// Poll Test Unit Ready until the medium is ready.  Between tries we back off
+// (1, 2, 4... MEDIA_READY_MAX_BACKOFF ms) instead of keeping the bus busy.
+// The sense data tells us when to give up early (no medium, as with an empty
+// card reader slot) or to try again right away (UNIT ATTENTION, which the
+// REQUEST SENSE itself clears).
 uint8_t USBDrive::WaitMediaReady() {
 	uint8_t msResult;
-	uint32_t start = millis();
 #ifdef DBGprint
 	println("WaitMediaReady()");
 #endif
-	do {
-		if((millis() - start) >= MEDIA_READY_TIMEOUT) {
-			return MS_UNIT_NOT_READY;  // Not Ready Error.
+	startMediaReady();
+	while (!mediaReadyStep(msResult)) {
+		while (_emMediaReady < _media_ready_wait) {
+			if (!available()) return MS_NO_MEDIA_ERR;  // Not connected Error.
+			yield();
 		}
-		msResult = msTestReady();
-		yield();
-	 } while(msResult == 1);
+	}
 	return msResult;
 }
 
+void USBDrive::startMediaReady() {
+	_media_ready_start = millis();
+	_media_ready_backoff = 1;
+	_media_ready_wait = 0;
+}
+
+// One Test Unit Ready of WaitMediaReady().  Returns true with the result
+// when done, or false to try again once _emMediaReady reaches _media_ready_wait.
+bool USBDrive::mediaReadyStep(uint8_t &msResult) {
+	msResult = msTestReady();
+	if (msResult != MS_CBW_FAIL) return true;
+	msFetchSense();
+	if ((msSense.SenseKey == MS_NOT_READY) &&
+			(msSense.AdditionalSenseCode == MS_MEDIUM_NOT_PRESENT)) {
+		DBGPrintf("USBDrive %p: LUN %u no medium\n", this, currentLUN);
+		msResult = MS_NO_MEDIA_ERR;
+		return true;
+	}
+	if((millis() - _media_ready_start) >= MEDIA_READY_TIMEOUT) {
+		msResult = MS_UNIT_NOT_READY;  // Not Ready Error.
+		return true;
+	}
+	_emMediaReady = 0;
+	if (msSense.SenseKey == MS_UNIT_ATTENTION) {
+		_media_ready_wait = 0;
+	} else {
+		_media_ready_wait = _media_ready_backoff;
+		if (_media_ready_backoff < MEDIA_READY_MAX_BACKOFF) _media_ready_backoff <<= 1;
+	}
+	return false;
+}
+
 // Check if drive is connected and Initialized.
 uint8_t USBDrive::checkConnectedInitialized(void) {
 	uint8_t msResult = MS_CBW_PASS;
@@ -371,32 +553,66 @@ uint8_t USBDrive::checkConnectedInitialized(void) {
 
 //---------------------------------------------------------------------------
 // Send SCSI Command
-// Do a complete 3 stage transfer.
+// A UNIT ATTENTION for a media change or power on/reset only reports the
+// event, the command itself was not run.  The sense data already tells us
+// so, retry it once instead of failing it back to the caller.  TEST UNIT
+// READY and START STOP UNIT return their CSW status without asking for the
+// sense data, so msSense is not theirs and they are not retried here.
 uint8_t USBDrive::msDoCommand(msCommandBlockWrapper_t *CBW,	void *buffer)
 {
-	uint8_t CSWResult = 0;
-	mscTransferComplete = false;
 #ifdef DBGprint
 	println("msDoCommand()");
 #endif	
-	if(CBWTag == 0xFFFFFFFF) CBWTag = 1;
+	uint8_t msResult = msTransferCommand(CBW, buffer);
+	if ((msResult == MS_CBW_FAIL) && (CBW->CommandData[0] != CMD_TEST_UNIT_READY) &&
+			(CBW->CommandData[0] != CMD_START_STOP_UNIT) && msSenseUnitAttentionEvent()) {
+		DBGPrintf("USBDrive %p: unit attention %x - retry\n", this, msSense.AdditionalSenseCode);
+		if (!_lun_parent) CBW->Tag = ++CBWTag;  // LUN proxies are retagged below
+		msResult = msTransferCommand(CBW, buffer);
+	}
+	return msResult;
+}
+
+bool USBDrive::msSenseUnitAttentionEvent() {
+	return (msSense.SenseKey == MS_UNIT_ATTENTION) &&
+		((msSense.AdditionalSenseCode == MS_MEDIA_CHANGED) ||
+		 (msSense.AdditionalSenseCode == MS_POWER_ON_RESET));
+}
+
+//---------------------------------------------------------------------------
+// Do a complete 3 stage transfer.
+uint8_t USBDrive::msTransferCommand(msCommandBlockWrapper_t *CBW,	void *buffer)
+{
+	uint8_t CSWResult = 0;
+	USBDrive *t = transport();
+	if (!t->msAcquireTransport()) return MS_TRANSPORT_BUSY;
+	elapsedMicros emCommand;
+	mscTransferComplete = false;
+	if (_lun_parent) CBW->Tag = ++t->CBWTag;
+	if(t->CBWTag == 0xFFFFFFFF) t->CBWTag = 1;
 	// digitalWriteFast(2, HIGH);
-	queue_Data_Transfer(datapipeOut, CBW, sizeof(msCommandBlockWrapper_t), this); // Command stage.
-	while(!msOutCompleted) yield();
+	queue_Data_Transfer(t->datapipeOut, CBW, sizeof(msCommandBlockWrapper_t), t); // Command stage.
+	while(!t->msOutCompleted) yield();
 	// digitalWriteFast(2, LOW);
-	msOutCompleted = false;
-	if((CBW->Flags == CMD_DIR_DATA_IN)) { // Data stage from device.
-		queue_Data_Transfer(datapipeIn, buffer, CBW->TransferLength, this);
-	while(!msInCompleted) yield();
+	t->msOutCompleted = false;
+	if (CBW->TransferLength == 0) {
+		// No data stage (Test Unit Ready, Start/Stop Unit...)
+	} else if((CBW->Flags == CMD_DIR_DATA_IN)) { // Data stage from device.
+		queue_Data_Transfer(t->datapipeIn, buffer, CBW->TransferLength, t);
+	while(!t->msInCompleted) yield();
 	// digitalWriteFast(2, HIGH);
-	msInCompleted = false;
+	t->msInCompleted = false;
 	} else {							  // Data stage to device.
-		queue_Data_Transfer(datapipeOut, buffer, CBW->TransferLength, this);
-	while(!msOutCompleted) yield();
+		queue_Data_Transfer(t->datapipeOut, buffer, CBW->TransferLength, t);
+	while(!t->msOutCompleted) yield();
 	// digitalWriteFast(2, LOW);
-	msOutCompleted = false;
+	t->msOutCompleted = false;
 	}
-	CSWResult = msGetCSW(); // Status stage.
+	t->msClearStalledEndpoints();
+	CSWResult = msCheckResidue(CBW, t->msGetCSW()); // Status stage.
+	t->_transport_busy = false;
+	mscTransferComplete = true;
+	msRecordStats(CBW, CSWResult, emCommand);
 	// All stages of this transfer have completed.
 	//Check for special cases. 
 	//If test for unit ready command is given then
@@ -411,6 +627,78 @@ uint8_t USBDrive::msDoCommand(msCommandBlockWrapper_t *CBW,	void *buffer)
 		return msProcessError(CSWResult);
 }
 
+//---------------------------------------------------------------------------
+// All of the LUNs of a drive share the one Bulk-Only transport, so only one
+// command can be in progress on it at a time.  A command for another LUN
+// (from another thread, or from yield() while a command waits on the pipes)
+// waits for its turn.  It only gives up if the transport stays busy for
+// MSC_TRANSPORT_WAIT_TIMEOUT, which happens when it was called from yield()
+// by the very command it waits on.
+bool USBDrive::msAcquireTransport() {
+	elapsedMillis emWait;
+	for (;;) {
+		__disable_irq();
+		bool was_busy = _transport_busy;
+		_transport_busy = true;
+		__enable_irq();
+		if (!was_busy) return true;
+		if (emWait >= MSC_TRANSPORT_WAIT_TIMEOUT) break;
+		yield();
+	}
+	DBGPrintf("USBDrive %p: transport still busy\n", this);
+	return false;
+}
+
+//---------------------------------------------------------------------------
+// Count a completed (or timed out) command in the I/O statistics.
+void USBDrive::msRecordStats(const msCommandBlockWrapper_t *CBW, uint8_t CSWResult, uint32_t us) {
+	msCommandStats_t *stats;
+	switch (CBW->CommandData[0]) {
+		case CMD_RD_10: stats = &_cmd_stats[STATS_READ]; break;
+		case CMD_WR_10: stats = &_cmd_stats[STATS_WRITE]; break;
+		case CMD_TEST_UNIT_READY: stats = &_cmd_stats[STATS_TEST_UNIT_READY]; break;
+		case CMD_REQUEST_SENSE: stats = &_cmd_stats[STATS_REQUEST_SENSE]; break;
+		default: stats = &_cmd_stats[STATS_OTHER]; break;
+	}
+	stats->count++;
+	if (CSWResult == MS_CBW_PASS) stats->bytes += CBW->TransferLength - _data_residue;
+	else stats->errors++;
+	if ((CSWResult == MS_CBW_PHASE_ERROR) || (CSWResult == MS_CSW_TAG_ERROR) ||
+			(CSWResult == MS_CSW_SIG_ERROR)) _transport_errors++;
+	if (us > stats->maxLatency) stats->maxLatency = us;
+	uint8_t bucket = 0;
+	while ((us >>= 1) && (bucket < (MS_STATS_LATENCY_BUCKETS - 1))) bucket++;
+	stats->latency[bucket]++;
+}
+
+//---------------------------------------------------------------------------
+// REQUEST SENSE into msSense (zeroed if that fails too) and count it.
+uint8_t USBDrive::msFetchSense() {
+	uint8_t msResult = msRequestSense(&msSense);
+	if (msResult) memset(&msSense, 0, sizeof(msSense));
+	else msRecordSense();
+	return msResult;
+}
+
+//---------------------------------------------------------------------------
+// Count the sense data of a failed command.
+void USBDrive::msRecordSense() {
+	for (uint8_t i = 0; i < MS_STATS_SENSE_ENTRIES; i++) {
+		msSenseStats_t *ss = &_sense_stats[i];
+		if (ss->count == 0) {
+			ss->senseKey = msSense.SenseKey;
+			ss->asc = msSense.AdditionalSenseCode;
+			ss->ascq = msSense.AdditionalSenseQualifier;
+		} else if ((ss->senseKey != msSense.SenseKey) || (ss->asc != msSense.AdditionalSenseCode) ||
+				(ss->ascq != msSense.AdditionalSenseQualifier)) {
+			continue;
+		}
+		ss->count++;
+		return;
+	}
+	_sense_stats_other++;
+}
+
 //---------------------------------------------------------------------------
 // Get Command Status Wrapper
 uint8_t USBDrive::msGetCSW(void) {
@@ -421,18 +709,36 @@ uint8_t USBDrive::msGetCSW(void) {
 	{
 		.Signature = CSW_SIGNATURE,
 		.Tag = 0,
-		.DataResidue = 0, // TODO: Proccess this if received.
+		.DataResidue = 0,
 		.Status = 0
 	};
+	_data_residue = 0;
 	queue_Data_Transfer(datapipeIn, &StatusBlockWrapper, sizeof(StatusBlockWrapper), this);
 	while(!msInCompleted) yield();
 	msInCompleted = false;
 	mscTransferComplete = true;
 	if(StatusBlockWrapper.Signature != CSW_SIGNATURE) return msProcessError(MS_CSW_SIG_ERROR); // Signature error
 	if(StatusBlockWrapper.Tag != CBWTag) return msProcessError(MS_CSW_TAG_ERROR); // Tag mismatch error
+	_data_residue = StatusBlockWrapper.DataResidue;
 	return StatusBlockWrapper.Status;
 }
 
+//---------------------------------------------------------------------------
+// Pick up the DataResidue of the CSW just read by the transport.  Commands
+// like INQUIRY or REQUEST SENSE may return less than asked for, but a READ or
+// WRITE that "passed" without moving all of its data did not really pass.
+uint8_t USBDrive::msCheckResidue(const msCommandBlockWrapper_t *CBW, uint8_t CSWResult) {
+	_data_residue = transport()->_data_residue;
+	if (_data_residue > CBW->TransferLength) _data_residue = CBW->TransferLength;
+	if ((CSWResult == MS_CBW_PASS) && _data_residue &&
+			((CBW->CommandData[0] == CMD_RD_10) || (CBW->CommandData[0] == CMD_WR_10))) {
+		DBGPrintf("USBDrive %p: short transfer %u of %u\n", this,
+			CBW->TransferLength - _data_residue, CBW->TransferLength);
+		return MS_SHORT_TRANSFER;
+	}
+	return CSWResult;
+}
+
 //---------------------------------------------------------------------------
 // Test Unit Ready
 uint8_t USBDrive::msTestReady() {
@@ -449,10 +755,7 @@ uint8_t USBDrive::msTestReady() {
 		.CommandLength      = 6,
 		.CommandData        = {CMD_TEST_UNIT_READY, 0x00, 0x00, 0x00, 0x00, 0x00}
 	};
-	queue_Data_Transfer(datapipeOut, &CommandBlockWrapper, sizeof(CommandBlockWrapper), this);
-	while(!msOutCompleted) yield();
-	msOutCompleted = false;
-	return msGetCSW();
+	return msDoCommand(&CommandBlockWrapper, nullptr);
 }
 
 //---------------------------------------------------------------------------
@@ -471,10 +774,7 @@ uint8_t USBDrive::msStartStopUnit(uint8_t mode) {
 		.CommandLength      = 6,
 		.CommandData        = {CMD_START_STOP_UNIT, 0x01, 0x00, 0x00, mode, 0x00}
 	};
-	queue_Data_Transfer(datapipeOut, &CommandBlockWrapper, sizeof(CommandBlockWrapper), this);
-	while(!msOutCompleted) yield();
-	msOutCompleted = false;
-	return msGetCSW();
+	return msDoCommand(&CommandBlockWrapper, nullptr);
 }
 
 //---------------------------------------------------------------------------
@@ -540,6 +840,81 @@ uint8_t USBDrive::msRequestSense(msRequestSenseResponse_t * const Sense)
 	return msDoCommand(&CommandBlockWrapper, Sense);
 }
 
+//---------------------------------------------------------------------------
+// Inquiry for a Vital Product Data page
+uint8_t USBDrive::msInquiryVPD(uint8_t page, void *Buffer, uint8_t len)
+{
+#ifdef DBGprint
+	println("msInquiryVPD()");
+#endif
+	msCommandBlockWrapper_t CommandBlockWrapper = (msCommandBlockWrapper_t)
+	{
+		.Signature          = CBW_SIGNATURE,
+		.Tag                = ++CBWTag,
+		.TransferLength     = len,
+		.Flags              = CMD_DIR_DATA_IN,
+		.LUN                = currentLUN,
+		.CommandLength      = 6,
+		.CommandData        = {CMD_INQUIRY, CMD_INQUIRY_EVPD, page, 0x00, len, 0x00}
+	};
+	return msDoCommand(&CommandBlockWrapper, Buffer);
+}
+
+//---------------------------------------------------------------------------
+// Find out if and how the drive supports UNMAP from the Block Limits and
+// Logical Block Provisioning VPD pages.  Only asked of drives claiming
+// SPC-3 or later, as many USB sticks do not handle VPD requests well.
+uint8_t USBDrive::msReadBlockLimits(msBlockLimits_t * const Limits)
+{
+	uint8_t vpd[64];
+	uint8_t msResult;
+	bool have_block_limits = false;
+	bool have_provisioning = false;
+
+	memset(Limits, 0, sizeof(msBlockLimits_t));
+	if (msInquiry.Version < 5) return MS_CMD_ERR;
+
+	memset(vpd, 0, sizeof(vpd));
+	msResult = msInquiryVPD(VPD_SUPPORTED_PAGES, vpd, sizeof(vpd));
+	if (msResult) return msResult;
+	for (uint8_t i = 4; i < (4 + vpd[3]) && (i < sizeof(vpd)); i++) {
+		if (vpd[i] == VPD_BLOCK_LIMITS) have_block_limits = true;
+		else if (vpd[i] == VPD_LOGICAL_BLOCK_PROVISIONING) have_provisioning = true;
+	}
+
+	if (have_provisioning) {
+		memset(vpd, 0, sizeof(vpd));
+		msResult = msInquiryVPD(VPD_LOGICAL_BLOCK_PROVISIONING, vpd, 8);
+		if (msResult) return msResult;
+		Limits->unmap = (vpd[5] & 0x80) != 0;
+		Limits->writeSame16Unmap = (vpd[5] & 0x40) != 0;
+		Limits->writeSame10Unmap = (vpd[5] & 0x20) != 0;
+		// LBPRZ (bits 4:2) 001b is zeros, 010b is the provisioning pattern,
+		// the rest are reserved.
+		Limits->unmapReadsZero = ((vpd[5] >> 2) & 0x07) == 1;
+	}
+	if (have_block_limits) {
+		memset(vpd, 0, sizeof(vpd));
+		msResult = msInquiryVPD(VPD_BLOCK_LIMITS, vpd, sizeof(vpd));
+		if (msResult) return msResult;
+		Limits->maxTransferLength = ((uint32_t)vpd[8] << 24) | ((uint32_t)vpd[9] << 16) | (vpd[10] << 8) | vpd[11];
+		Limits->optimalTransferLength = ((uint32_t)vpd[12] << 24) | ((uint32_t)vpd[13] << 16) | (vpd[14] << 8) | vpd[15];
+		Limits->maxUnmapLBACount = ((uint32_t)vpd[20] << 24) | ((uint32_t)vpd[21] << 16) | (vpd[22] << 8) | vpd[23];
+		Limits->maxUnmapDescriptorCount = ((uint32_t)vpd[24] << 24) | ((uint32_t)vpd[25] << 16) | (vpd[26] << 8) | vpd[27];
+		Limits->unmapGranularity = ((uint32_t)vpd[28] << 24) | ((uint32_t)vpd[29] << 16) | (vpd[30] << 8) | vpd[31];
+		for (uint8_t i = 36; i < 44; i++) Limits->maxWriteSameLength = (Limits->maxWriteSameLength << 8) | vpd[i];
+		// A drive that can't take any UNMAP descriptors does not do UNMAP.
+		if (!Limits->maxUnmapLBACount || !Limits->maxUnmapDescriptorCount) Limits->unmap = false;
+	}
+#ifdef DBGprint
+	Serial.printf("Block Limits: unmap:%u ws16:%u ws10:%u rz:%u max xfer:%u opt:%u unmap max:%u desc:%u ws max:%llu\n",
+		Limits->unmap, Limits->writeSame16Unmap, Limits->writeSame10Unmap, Limits->unmapReadsZero,
+		Limits->maxTransferLength, Limits->optimalTransferLength, Limits->maxUnmapLBACount,
+		Limits->maxUnmapDescriptorCount, Limits->maxWriteSameLength);
+#endif
+	return MS_CBW_PASS;
+}
+
 //---------------------------------------------------------------------------
 // Report LUNs
 uint8_t USBDrive::msReportLUNs(uint8_t *Buffer)
@@ -631,46 +1006,58 @@ uint8_t USBDrive::msReadSectorsWithCB(
 					   0x00, BlockHi, BlockLo, 0x00}
 	};
 
+	// The data comes in on the transport (parent drive for LUNs > 0)
+	USBDrive *t = transport();
+	if (!t->msAcquireTransport()) return MS_TRANSPORT_BUSY;
+	if (_lun_parent) CommandBlockWrapper.Tag = ++t->CBWTag;
+	elapsedMicros emCommand;
+
 	// We need to remember how many blocks and call back function
-	_read_sectors_callback = callback;
-	_read_sectors_remaining = Blocks;
-	_read_sectors_token = token;
-	_emlastRead = 0; // reset the timeout. 
+	t->_read_sectors_callback = callback;
+	t->_read_sectors_remaining = Blocks;
+	t->_read_sectors_token = token;
+	t->_emlastRead = 0; // reset the timeout. 
 
 	// lets unwrap the msDoCommand here...
 	uint8_t CSWResult = 0;
 	mscTransferComplete = false;
 
-	if(CBWTag == 0xFFFFFFFF) CBWTag = 1;
+	if(t->CBWTag == 0xFFFFFFFF) t->CBWTag = 1;
 	// digitalWriteFast(2, HIGH);
-	queue_Data_Transfer(datapipeOut, &CommandBlockWrapper, sizeof(msCommandBlockWrapper_t), this); // Command stage.
+	queue_Data_Transfer(t->datapipeOut, &CommandBlockWrapper, sizeof(msCommandBlockWrapper_t), t); // Command stage.
 
-	while(!msOutCompleted && (_emlastRead < READ_CALLBACK_TIMEOUT_MS)) yield();
+	while(!t->msOutCompleted && (t->_emlastRead < READ_CALLBACK_TIMEOUT_MS)) yield();
 	// digitalWriteFast(2, LOW);
 
-	msOutCompleted = false;
+	t->msOutCompleted = false;
 
-	queue_Data_Transfer(datapipeIn, _read_sector_buffer1, BlockSize, this);
-	if (_read_sectors_remaining > 1) {
-		queue_Data_Transfer(datapipeIn, _read_sector_buffer2, BlockSize, this);
+	queue_Data_Transfer(t->datapipeIn, t->_read_sector_buffer1, BlockSize, t);
+	if (t->_read_sectors_remaining > 1) {
+		queue_Data_Transfer(t->datapipeIn, t->_read_sector_buffer2, BlockSize, t);
 	}
 
-	while(!msInCompleted && (_emlastRead < READ_CALLBACK_TIMEOUT_MS)) ;
+	while(!t->msInCompleted && (t->_emlastRead < READ_CALLBACK_TIMEOUT_MS)) ;
 	// digitalWriteFast(2, HIGH);
 
-	if (!msInCompleted) {
+	if (!t->msInCompleted) {
 		// clear this out..
 		#ifdef DBGprint
-			Serial.printf("!!! msReadBlocks Timed Out(%u)\n", _read_sectors_remaining);
+			Serial.printf("!!! msReadBlocks Timed Out(%u)\n", t->_read_sectors_remaining);
 		#endif
-		_read_sectors_callback = nullptr;
-		_read_sectors_remaining = 0;
+		t->_read_sectors_callback = nullptr;
+		t->_read_sectors_remaining = 0;
+		t->msResetRecovery();
+		t->_transport_busy = false;
+		msRecordStats(&CommandBlockWrapper, MS_CBW_FAIL, emCommand);
 		return MS_CBW_FAIL;
 	}	
 
-	msInCompleted = false;
+	t->msInCompleted = false;
 
-	CSWResult = msGetCSW(); // Status stage.
+	CSWResult = msCheckResidue(&CommandBlockWrapper, t->msGetCSW()); // Status stage.
+	t->_transport_busy = false;
+	mscTransferComplete = true;
+	msRecordStats(&CommandBlockWrapper, CSWResult, emCommand);
 	#ifdef DBGprint
 	Serial.printf("  CSWResult: %x CD:%x\n", CSWResult, CommandBlockWrapper.CommandData[0] );
 	#endif
@@ -722,6 +1109,194 @@ uint8_t USBDrive::msWriteBlocks(
 	return msDoCommand(&CommandBlockWrapper, (void *)sectorBuffer);
 }
 
+//---------------------------------------------------------------------------
+// Write Sectors (Multi Sector Capable), pulling each sector from a callback
+// as the bulk out pipe drains.  Called with the USB interrupt disabled or
+// from the interrupt itself.
+bool USBDrive::queueNextWriteSector()
+{
+	const uint8_t *sectorBuffer = (*_write_sectors_callback)(_write_sectors_next, _write_sectors_context);
+	if (sectorBuffer == nullptr) {
+		_write_sectors_aborted = true;
+		return false;
+	}
+	#if defined(__IMXRT1062__)
+	if ((uint32_t)sectorBuffer >= 0x20200000u)  arm_dcache_flush((void*)sectorBuffer, 512);
+	#endif
+	_write_sectors_next++;
+	_write_sectors_to_queue--;
+	_write_sectors_in_flight++;
+	queue_Data_Transfer(datapipeOut, (void *)sectorBuffer, 512, this);
+	return true;
+}
+
+uint8_t USBDrive::msWriteSectorsWithCB(
+			const uint32_t BlockAddress,
+			const uint16_t Blocks,
+			const uint8_t * (*callback)(uint32_t, void *),
+			void *context)
+	{
+#if defined(DBGprint) && (DBGprint > 1)
+	Serial.printf(">>> msWriteSectorsWithCB(%x %u %x)\n", BlockAddress, Blocks, (uint32_t)callback);
+#endif
+	if ((callback == nullptr) || (!Blocks)) return MS_CBW_FAIL;
+
+	uint8_t BlockHi = (Blocks >> 8) & 0xFF;
+	uint8_t BlockLo = Blocks & 0xFF;
+	static const uint16_t BlockSize = 512;
+
+	msCommandBlockWrapper_t CommandBlockWrapper = (msCommandBlockWrapper_t)
+	{
+		.Signature          = CBW_SIGNATURE,
+		.Tag                = ++CBWTag,
+		.TransferLength     = (uint32_t)(Blocks * BlockSize),
+		.Flags              = CMD_DIR_DATA_OUT,
+		.LUN                = currentLUN,
+		.CommandLength      = 10,
+		.CommandData        = {CMD_WR_10, 0x00,
+					  (uint8_t)(BlockAddress >> 24),
+					  (uint8_t)(BlockAddress >> 16),
+					  (uint8_t)(BlockAddress >> 8),
+					  (uint8_t)(BlockAddress & 0xFF),
+					   0x00, BlockHi, BlockLo, 0x00}
+	};
+
+	// Like msReadSectorsWithCB, unwrap msDoCommand here.
+	USBDrive *t = transport();
+	if (!t->msAcquireTransport()) return MS_TRANSPORT_BUSY;
+	elapsedMicros emCommand;
+	if (_lun_parent) CommandBlockWrapper.Tag = ++t->CBWTag;
+	mscTransferComplete = false;
+	if(t->CBWTag == 0xFFFFFFFF) t->CBWTag = 1;
+	queue_Data_Transfer(t->datapipeOut, &CommandBlockWrapper, sizeof(msCommandBlockWrapper_t), t); // Command stage.
+	while(!t->msOutCompleted) yield();
+	t->msOutCompleted = false;
+
+	// Data stage: only now hook the callback, so the CBW completion above
+	// is not counted as a sector.  Keep WRITE_CALLBACK_QUEUE_DEPTH sectors
+	// queued so the pipe never idles waiting on the producer.
+	t->_write_sectors_context = context;
+	t->_write_sectors_next = BlockAddress;
+	t->_write_sectors_to_queue = Blocks;
+	t->_write_sectors_in_flight = 0;
+	t->_write_sectors_aborted = false;
+	t->_emlastWrite = 0;
+	NVIC_DISABLE_IRQ(IRQ_USBHS);
+	t->_write_sectors_callback = callback;
+	for (uint8_t i = 0; (i < WRITE_CALLBACK_QUEUE_DEPTH) && t->_write_sectors_to_queue; i++) {
+		if (!t->queueNextWriteSector()) break;
+	}
+	if (!t->_write_sectors_in_flight) t->_write_sectors_callback = nullptr;
+	NVIC_ENABLE_IRQ(IRQ_USBHS);
+
+	while (t->_write_sectors_callback && (t->_emlastWrite < WRITE_CALLBACK_TIMEOUT_MS)) yield();
+
+	if (t->_write_sectors_callback || t->_write_sectors_aborted) {
+		#ifdef DBGprint
+			Serial.printf("!!! msWriteSectorsWithCB %s(%u)\n", t->_write_sectors_aborted? "Aborted" : "Timed Out",
+				t->_write_sectors_to_queue);
+		#endif
+		// The device is still waiting on data we will not send, so do
+		// the Bulk-Only reset recovery to get back in sync.
+		t->_write_sectors_callback = nullptr;
+		t->_write_sectors_to_queue = 0;
+		t->_write_sectors_in_flight = 0;
+		t->msResetRecovery();
+		t->_transport_busy = false;
+		msRecordStats(&CommandBlockWrapper, MS_CBW_FAIL, emCommand);
+		return MS_CBW_FAIL;
+	}
+	t->msOutCompleted = false;
+
+	uint8_t CSWResult = msCheckResidue(&CommandBlockWrapper, t->msGetCSW()); // Status stage.
+	t->_transport_busy = false;
+	mscTransferComplete = true;
+	msRecordStats(&CommandBlockWrapper, CSWResult, emCommand);
+	return msProcessError(CSWResult);
+}
+
+//---------------------------------------------------------------------------
+// Unmap (TRIM) a range of blocks, one block descriptor per command.
+uint8_t USBDrive::msUnmap(const uint32_t BlockAddress, const uint32_t Blocks)
+{
+#ifdef DBGprint
+	println("msUnmap()");
+#endif
+	uint8_t paramList[24] __attribute__ ((aligned(32)));
+	memset(paramList, 0, sizeof(paramList));
+	paramList[1] = sizeof(paramList) - 2;	// UNMAP data length
+	paramList[3] = 16;						// block descriptor data length
+	paramList[12] = (uint8_t)(BlockAddress >> 24);
+	paramList[13] = (uint8_t)(BlockAddress >> 16);
+	paramList[14] = (uint8_t)(BlockAddress >> 8);
+	paramList[15] = (uint8_t)(BlockAddress & 0xFF);
+	paramList[16] = (uint8_t)(Blocks >> 24);
+	paramList[17] = (uint8_t)(Blocks >> 16);
+	paramList[18] = (uint8_t)(Blocks >> 8);
+	paramList[19] = (uint8_t)(Blocks & 0xFF);
+	msCommandBlockWrapper_t CommandBlockWrapper = (msCommandBlockWrapper_t)
+	{
+		.Signature          = CBW_SIGNATURE,
+		.Tag                = ++CBWTag,
+		.TransferLength     = sizeof(paramList),
+		.Flags              = CMD_DIR_DATA_OUT,
+		.LUN                = currentLUN,
+		.CommandLength      = 10,
+		.CommandData        = {CMD_UNMAP, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, sizeof(paramList), 0x00}
+	};
+	#if defined(__IMXRT1062__)
+	if ((uint32_t)paramList >= 0x20200000u)  arm_dcache_flush((void*)paramList, sizeof(paramList));
+	#endif
+	return msDoCommand(&CommandBlockWrapper, paramList);
+}
+
+//---------------------------------------------------------------------------
+// Write the one sector in sectorBuffer to each of the blocks, or unmap them.
+// Uses WRITE SAME(16) unless only WRITE SAME(10) with unmap is supported.
+uint8_t USBDrive::msWriteSame(const uint32_t BlockAddress, const uint32_t Blocks,
+								const void * sectorBuffer, bool unmap)
+{
+#ifdef DBGprint
+	println("msWriteSame()");
+#endif
+	if (!Blocks) return MS_CBW_FAIL;  // zero means to the end of the drive!
+	msCommandBlockWrapper_t CommandBlockWrapper = (msCommandBlockWrapper_t)
+	{
+		.Signature          = CBW_SIGNATURE,
+		.Tag                = ++CBWTag,
+		.TransferLength     = (uint32_t)msDriveInfo.capacity.BlockSize,
+		.Flags              = CMD_DIR_DATA_OUT,
+		.LUN                = currentLUN,
+		.CommandLength      = 16,
+		.CommandData        = {CMD_WRITE_SAME_16, (uint8_t)(unmap ? CMD_WRITE_SAME_UNMAP : 0),
+							  0x00, 0x00, 0x00, 0x00,
+							  (uint8_t)(BlockAddress >> 24),
+							  (uint8_t)(BlockAddress >> 16),
+							  (uint8_t)(BlockAddress >> 8),
+							  (uint8_t)(BlockAddress & 0xFF),
+							  (uint8_t)(Blocks >> 24),
+							  (uint8_t)(Blocks >> 16),
+							  (uint8_t)(Blocks >> 8),
+							  (uint8_t)(Blocks & 0xFF),
+							   0x00, 0x00}
+	};
+	if (unmap && !msBlockLimits.writeSame16Unmap && msBlockLimits.writeSame10Unmap) {
+		if (Blocks > 0xFFFF) return MS_CBW_FAIL;
+		uint8_t cdb10[16] = {CMD_WRITE_SAME_10, CMD_WRITE_SAME_UNMAP,
+							  (uint8_t)(BlockAddress >> 24),
+							  (uint8_t)(BlockAddress >> 16),
+							  (uint8_t)(BlockAddress >> 8),
+							  (uint8_t)(BlockAddress & 0xFF),
+							   0x00, (uint8_t)(Blocks >> 8), (uint8_t)(Blocks & 0xFF), 0x00};
+		memcpy(CommandBlockWrapper.CommandData, cdb10, sizeof(cdb10));
+		CommandBlockWrapper.CommandLength = 10;
+	}
+	#if defined(__IMXRT1062__)
+	if ((uint32_t)sectorBuffer >= 0x20200000u)  arm_dcache_flush((void*)sectorBuffer, CommandBlockWrapper.TransferLength);
+	#endif
+	return msDoCommand(&CommandBlockWrapper, (void *)sectorBuffer);
+}
+
 // Proccess Possible SCSI errors
 uint8_t USBDrive::msProcessError(uint8_t msStatus) {
 #ifdef DBGprint
@@ -748,12 +1323,17 @@ uint8_t USBDrive::msProcessError(uint8_t msStatus) {
 			return MS_CSW_SIG_ERROR;
 			break;
 		case MS_CBW_FAIL:
-			if((msResult = msRequestSense(&msSense))) {
+			if((msResult = msFetchSense())) {
 				print("Failed to get sense codes. Returned code: ");
 				println(msResult);
 			}
 			return MS_CBW_FAIL;
 			break;
+		case MS_SHORT_TRANSFER:
+			print("Short transfer, residue: ");
+			println(_data_residue);
+			return MS_SHORT_TRANSFER;
+			break;
 		default:
 			print("SCSI Error: ");
 			println(msStatus);
@@ -791,6 +1371,11 @@ bool USBDrive::readSectors(uint32_t sector, uint8_t* dst, size_t n) {
 	if (m_errorCode != MS_CBW_PASS) {
 		return false;
 	}
+	// Make sure we read back anything still held for coalescing.
+	if (_coalesce_count && (sector < (_coalesce_start + _coalesce_count))
+			&& ((sector + n) > _coalesce_start) && !flushCoalescedWrites()) {
+		return false;
+	}
 	m_errorCode = msReadBlocks(sector, n, (uint16_t)msDriveInfo.capacity.BlockSize, dst);
 	if (m_errorCode) {
 		return false;
@@ -807,6 +1392,10 @@ bool USBDrive::readSectorsWithCB(uint32_t sector, size_t ns,
 	if (m_errorCode != MS_CBW_PASS) {
 		return false;
 	}
+	if (_coalesce_count && (sector < (_coalesce_start + _coalesce_count))
+			&& ((sector + ns) > _coalesce_start) && !flushCoalescedWrites()) {
+		return false;
+	}
 	m_errorCode = msReadSectorsWithCB(sector, ns, callback, token);
 	if (m_errorCode) {
 		return false;
@@ -841,12 +1430,164 @@ bool USBDrive::writeSectors(uint32_t sector, const uint8_t* src, size_t n) {
 	if (m_errorCode != MS_CBW_PASS) {
 		return false;
 	}
+	if (_coalesce_error) {
+		m_errorCode = _coalesce_error;
+		_coalesce_error = 0;
+		return false;
+	}
+	checkPartitionTableWrite(sector, n);
+	if (_coalesce_enabled && (n == 1)) return coalesceWriteSector(sector, src);
+	if (_coalesce_count && !flushCoalescedWrites()) return false;
 	m_errorCode = msWriteBlocks(sector, n, (uint16_t)msDriveInfo.capacity.BlockSize, src);
 	if (m_errorCode) {
 		return false;
 	}
 	return true;
 }
+//------------------------------------------------------------------------------
+bool USBDrive::writeSectorsCallback(uint32_t sector, size_t numSectors,
+	const uint8_t * (*callback)(uint32_t sector, void *context), void *context)
+{
+	// Check if device is plugged in and initialized
+	m_errorCode = checkConnectedInitialized();
+	if (m_errorCode != MS_CBW_PASS) {
+		return false;
+	}
+	checkPartitionTableWrite(sector, numSectors);
+	if (_coalesce_count && !flushCoalescedWrites()) return false;
+	// WRITE(10) takes at most 65535 blocks, use more commands past that.
+	do {
+		uint16_t count = (numSectors > 0xFFFF) ? 0xFFFF : numSectors;
+		m_errorCode = msWriteSectorsWithCB(sector, count, callback, context);
+		if (m_errorCode) {
+			return false;
+		}
+		sector += count;
+		numSectors -= count;
+	} while (numSectors);
+	return true;
+}
+
+//------------------------------------------------------------------------------
+bool USBDrive::discard(uint32_t sector, uint32_t count) {
+	// Check if device is plugged in and initialized
+	m_errorCode = checkConnectedInitialized();
+	if (m_errorCode != MS_CBW_PASS) {
+		return false;
+	}
+	if (!discardSupported()) {
+		m_errorCode = MS_CMD_ERR;
+		return false;
+	}
+	checkPartitionTableWrite(sector, count);
+	// Don't let a held write land on top of what we discard.
+	if (_coalesce_count && !flushCoalescedWrites()) return false;
+
+	uint32_t max_chunk;
+	if (msBlockLimits.unmap) max_chunk = msBlockLimits.maxUnmapLBACount;
+	else if (msBlockLimits.writeSame16Unmap) max_chunk = msBlockLimits.maxWriteSameLength;
+	else max_chunk = 0xFFFF;
+	if ((max_chunk == 0) || (max_chunk > 0x400000)) max_chunk = 0x400000; // keep each command reasonably short.
+
+	static uint8_t zero_sector[512] __attribute__ ((aligned(32)));	// RAM, the USB DMA reads it
+	while (count) {
+		uint32_t chunk = (count < max_chunk) ? count : max_chunk;
+		if (msBlockLimits.unmap) m_errorCode = msUnmap(sector, chunk);
+		else m_errorCode = msWriteSame(sector, chunk, zero_sector, true);
+		if (m_errorCode) return false;
+		sector += chunk;
+		count -= chunk;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+bool USBDrive::writeSame(uint32_t sector, uint32_t count, const uint8_t* src) {
+	// Check if device is plugged in and initialized
+	m_errorCode = checkConnectedInitialized();
+	if (m_errorCode != MS_CBW_PASS) {
+		return false;
+	}
+	if (!writeSameSupported()) {
+		m_errorCode = MS_CMD_ERR;
+		return false;
+	}
+	checkPartitionTableWrite(sector, count);
+	if (_coalesce_count && !flushCoalescedWrites()) return false;
+
+	uint32_t max_chunk = (msBlockLimits.maxWriteSameLength > 0x400000) ? 0x400000 : (uint32_t)msBlockLimits.maxWriteSameLength;
+	while (count) {
+		uint32_t chunk = (count < max_chunk) ? count : max_chunk;
+		m_errorCode = msWriteSame(sector, chunk, src, false);
+		if (m_errorCode) return false;
+		sector += chunk;
+		count -= chunk;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Hold single sector writes in _coalesce_buffer while they are to consecutive
+// sectors (or rewrite one already held), and send them as one WRITE command.
+bool USBDrive::coalesceWriteSector(uint32_t sector, const uint8_t* src) {
+	if (_coalesce_count && ((sector < _coalesce_start)
+			|| (sector > (_coalesce_start + _coalesce_count))
+			|| ((sector == (_coalesce_start + _coalesce_count)) && (_coalesce_count == WRITE_COALESCE_SECTORS)))) {
+		if (!flushCoalescedWrites()) return false;
+	}
+	if (!_coalesce_count) _coalesce_start = sector;
+	uint32_t index = sector - _coalesce_start;
+	memcpy(&_coalesce_buffer[index * 512], src, 512);
+	if (index == _coalesce_count) _coalesce_count++;
+	_coalesce_sectors++;
+	_emlastCoalesce = 0;
+	if (_coalesce_count == WRITE_COALESCE_SECTORS) return flushCoalescedWrites();
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// On failure the held sectors are kept, so a later flush can try them again.
+bool USBDrive::flushCoalescedWrites() {
+	if (!_coalesce_count) return true;
+	m_errorCode = checkConnectedInitialized();
+	if (m_errorCode != MS_CBW_PASS) {
+		return false;
+	}
+	_coalesce_commands++;
+	m_errorCode = msWriteBlocks(_coalesce_start, _coalesce_count, (uint16_t)msDriveInfo.capacity.BlockSize, _coalesce_buffer);
+	if (m_errorCode) {
+		return false;
+	}
+	_coalesce_count = 0;
+	_coalesce_error = 0;
+	return true;
+}
+
+//------------------------------------------------------------------------------
+bool USBDrive::syncDevice() {
+	if (_coalesce_error) {
+		m_errorCode = _coalesce_error;
+		_coalesce_error = 0;
+		return false;
+	}
+	return flushCoalescedWrites();
+}
+
+//------------------------------------------------------------------------------
+bool USBDrive::writeCoalescing(bool enable) {
+	if (enable && !_coalesce_buffer_alloc) {
+		_coalesce_buffer_alloc = (uint8_t *)malloc(WRITE_COALESCE_SECTORS * 512 + 32);
+		if (!_coalesce_buffer_alloc) return false; // unable to allocate memory
+		_coalesce_buffer = (uint8_t *)(((uintptr_t)_coalesce_buffer_alloc + 31) & ~((uintptr_t)(31)));
+	} else if (!enable && _coalesce_buffer_alloc) {
+		if (!flushCoalescedWrites()) return false; // still holding them
+		free(_coalesce_buffer_alloc);
+		_coalesce_buffer_alloc = nullptr;
+		_coalesce_buffer = nullptr;
+	}
+	_coalesce_enabled = enable;
+	return true;
+}
 
 
 static const char *decodeSenseKey(uint8_t senseKey) {
@@ -898,6 +1639,47 @@ static void printMscAscError(print_t* pr, USBDrive *pDrive)
 #undef print
 #undef println
 
+//------------------------------------------------------------------------------
+void USBDrive::resetStats() {
+	memset(_cmd_stats, 0, sizeof(_cmd_stats));
+	memset(_sense_stats, 0, sizeof(_sense_stats));
+	_sense_stats_other = 0;
+	_transport_errors = 0;
+	resetCoalesceStats();
+}
+
+//------------------------------------------------------------------------------
+void USBDrive::printStats(Print &p) {
+	static const char * const command_names[STATS_COMMAND_TYPES] = {
+		"READ", "WRITE", "TEST UNIT READY", "REQUEST SENSE", "OTHER"};
+	for (uint8_t i = 0; i < STATS_COMMAND_TYPES; i++) {
+		const msCommandStats_t *stats = &_cmd_stats[i];
+		if (!stats->count) continue;
+		p.printf("%s: count:%u errors:%u max:%uus bytes:", command_names[i],
+			stats->count, stats->errors, stats->maxLatency);
+		p.println(stats->bytes);
+		p.print("  latency(us)");
+		for (uint8_t bucket = 0; bucket < MS_STATS_LATENCY_BUCKETS; bucket++) {
+			if (!stats->latency[bucket]) continue;
+			if (bucket == 0) p.print(" <2:");
+			else p.printf(" %u%s:", 1u << bucket, (bucket == (MS_STATS_LATENCY_BUCKETS - 1))? "+" : "");
+			p.print(stats->latency[bucket]);
+		}
+		p.println();
+	}
+	for (uint8_t i = 0; (i < MS_STATS_SENSE_ENTRIES) && _sense_stats[i].count; i++) {
+		const msSenseStats_t *ss = &_sense_stats[i];
+		p.printf("Sense %x/%02x/%02x count:%u --> Type: %s Cause: %s\n",
+			ss->senseKey, ss->asc, ss->ascq, ss->count,
+			decodeSenseKey(ss->senseKey), decodeAscAscq(ss->asc, ss->ascq));
+	}
+	if (_sense_stats_other) p.printf("Sense other: %u\n", _sense_stats_other);
+	if (_transport_errors) p.printf("Transport errors: %u\n", _transport_errors);
+	if (_coalesce_sectors) {
+		p.printf("Coalesced writes: %u sectors in %u commands\n", _coalesce_sectors, _coalesce_commands);
+	}
+}
+
 // Print error info and return.
 //
 
@@ -1225,6 +2007,205 @@ int USBDrive::findPartition(int partition, int &type, uint32_t &firstSector, uin
 		numSectors = msDriveInfo.capacity.Blocks;
 		return MBR_VOL;
 	}
+	if (!_partitions_cached) cachePartitions();
+	if (_partitions_cached) {
+		if (partition <= _cPartitions) {
+			cachedPartition_t *cp = &_partitions[partition - 1];
+			if (cp->voltype == INVALID_VOL) return INVALID_VOL;
+			type = cp->type;
+			firstSector = cp->firstSector;
+			numSectors = cp->numSectors;
+			mbrLBA = cp->mbrLBA;
+			mbrPart = cp->mbrPart;
+			if (guid && (cp->voltype == GPT_VOL)) memcpy(guid, cp->guid, 16);
+			return cp->voltype;
+		}
+		if (_partitions_complete) return INVALID_VOL;
+	}
+	// More partitions than we cache, go look for it.
+	return scanPartition(partition, type, firstSector, numSectors, mbrLBA, mbrPart, guid);
+}
+
+//=============================================================================
+// cachePartitions - walk the MBR and its EBR chain, or the GPT, once and
+// remember what findPartition would return for each partition number.  The
+// numbering is the same as scanPartition's: MBR slots first, with the logical
+// partitions numbered from the slot of the extended partition on.
+//=============================================================================
+void USBDrive::cachePartitions()
+{
+	while (!cachePartitionsStep()) ;
+}
+
+//=============================================================================
+// cachePartitionsStep - one step of cachePartitions(), which reads at most
+// one partition table sector, so Task() can build the cache a bit at a time.
+// returns - true when there is nothing more to read.
+//=============================================================================
+bool USBDrive::cachePartitionsStep()
+{
+	union {
+		MbrSector_t mbr;
+		GPTPartitionHeader_t gpthdr;
+		GPTPartitionEntrySector_t gptes;
+		uint8_t buffer[512];
+	} sector;
+
+	if (_partitions_cached) return true;
+
+	if (_pt_walk == PT_WALK_MBR) {
+		_cPartitions = 0;
+		_partitions_complete = false;
+		_partition_table_last = 0;
+		if (!readSector(0, (uint8_t*)&sector.mbr)) return true;  // try again next time
+		if (sector.mbr.part[0].type == 0xee) {
+			_pt_walk = PT_WALK_GPT_HEADER;
+			return false;
+		}
+		// Master Boot Record, keep its table while we read the EBRs.
+		memcpy(_pt_mbr_part, sector.mbr.part, sizeof(_pt_mbr_part));
+		_pt_ext_index = -1;
+		for (uint8_t index_part = 0; index_part < 4; index_part++) {
+			MbrPart_t *pt = &_pt_mbr_part[index_part];
+			if ((pt->boot != 0 && pt->boot != 0X80) || pt->type == 0) break;
+			if (pt->type == 0xf) {
+				_pt_ext_index = index_part;
+				break;
+			}
+		}
+		_pt_walk_sector = (_pt_ext_index >= 0) ? getLe32(_pt_mbr_part[_pt_ext_index].relativeSectors) : 0;
+		_pt_walk = PT_WALK_EBR;
+		return false;
+	}
+
+	if (_pt_walk == PT_WALK_GPT_HEADER) {
+		// GUID Partition Table, stop at the first empty entry.
+		if (!readSector(1, (uint8_t*)&sector.buffer)) {
+			_partitions_cached = true;
+			return true;
+		}
+		_partition_table_last = 1;
+		_cGPTParts = (int)getLe32(sector.gpthdr.numberPartitions);
+		DBGPrintf(">>Cache Partitions GPT cParts=%d\n", _cGPTParts);
+		_pt_walk = PT_WALK_GPT_ENTRIES;
+		return false;
+	}
+
+	if (_pt_walk == PT_WALK_GPT_ENTRIES) {
+		// One sector, four entries, per step.
+		int part = _cPartitions;
+		int first_part = part;
+		if ((part < _cGPTParts) && (part < MAX_CACHED_PARTITIONS)) {
+			if (!readSector(2 + (part >> 2), (uint8_t*)&sector.buffer)) {
+				_partitions_cached = true;
+				return true;
+			}
+			_partition_table_last = 2 + (part >> 2);
+		}
+		for (; (part < _cGPTParts) && (part < MAX_CACHED_PARTITIONS); part++) {
+			if (((part & 0x3) == 0) && (part != first_part)) return false;  // next sector
+			GPTPartitionEntryItem_t *entry = &sector.gptes.items[part & 0x3];
+			cachedPartition_t *cp = &_partitions[_cPartitions++];
+			cp->voltype = INVALID_VOL;
+			uint32_t *end_addr = (uint32_t*)((uint32_t)entry + sizeof(GPTPartitionEntryItem_t));
+			uint32_t *p = (uint32_t*)entry;
+			for (; p < end_addr; p++) {
+				if (*p) break; // found none-zero.
+			}
+			if (p == end_addr) {
+				_partitions_cached = true;  // empty, later ones are looked up by scanPartition
+				return true;
+			}
+			uint64_t first64 = getLe64(entry->firstLBA);
+			uint64_t last64 = getLe64(entry->lastLBA);
+			if ((first64 > 0x00000000FFFFFFFFull) || (last64 > 0x00000000FFFFFFFFull) ||
+					(first64 > last64)) continue;
+			cp->voltype = GPT_VOL;
+			cp->type = 6;
+			cp->firstSector = (uint32_t)first64;
+			cp->numSectors = (uint32_t)last64 - (uint32_t)first64 + 1;
+			cp->mbrLBA = 2 + (part >> 2);
+			cp->mbrPart = part & 0x3;
+			memcpy(cp->guid, entry->partitionTypeGUID, 16);
+		}
+		_partitions_complete = (_cPartitions == _cGPTParts);
+		_partitions_cached = true;
+		return true;
+	}
+
+	// MBR slots and the EBR chain, one EBR per step.
+	bool read_ebr = false;
+	while (_cPartitions < MAX_CACHED_PARTITIONS) {
+		int part = _cPartitions;
+		cachedPartition_t *cp = &_partitions[_cPartitions];
+		uint32_t ebr = 0;	// EBR of the logical partition for this number
+		cp->voltype = INVALID_VOL;
+		if ((_pt_ext_index >= 0) && (part >= _pt_ext_index) && _pt_walk_sector) {
+			if (read_ebr) return false;  // that is enough for this step
+			read_ebr = true;
+			if (readSector(_pt_walk_sector, (uint8_t*)&sector.mbr)) {
+				ebr = _pt_walk_sector;
+				// remember the link to the next one.
+				MbrPart_t *pt = &sector.mbr.part[1];
+				uint32_t relSec = getLe32(pt->relativeSectors);
+				_pt_walk_sector = ((pt->type == 5) && relSec) ? ebr + relSec : 0;
+			} else {
+				_pt_walk_sector = 0;
+			}
+		}
+		MbrPart_t *pt = (part <= 3) ? &_pt_mbr_part[part] : nullptr;
+		if (pt && ((pt->boot == 0) || (pt->boot == 0X80)) && (pt->type != 0) && (pt->type != 0xf)) {
+			cp->voltype = MBR_VOL;
+			cp->type = pt->type;
+			cp->firstSector = getLe32(pt->relativeSectors);
+			cp->numSectors = getLe32(pt->totalSectors);
+			cp->mbrLBA = 0;
+			cp->mbrPart = part; // zero based
+		} else if (ebr) {
+			pt = &sector.mbr.part[0];
+			cp->voltype = EXT_VOL;
+			cp->type = pt->type;
+			cp->firstSector = getLe32(pt->relativeSectors) + ebr;
+			cp->numSectors = getLe32(pt->totalSectors);
+			cp->mbrLBA = ebr;
+			cp->mbrPart = 0; // zero based
+		} else if (part >= 3) {
+			_partitions_complete = true;  // nothing after this one
+			break;
+		}
+		_cPartitions++;
+	}
+	DBGPrintf(">>Cache Partitions MBR cParts=%u complete:%u\n", _cPartitions, _partitions_complete);
+	_partitions_cached = true;
+	return true;
+}
+
+//=============================================================================
+// checkPartitionTableWrite - drop the partition cache if a write may change
+// the MBR, GPT or one of the EBRs it came from.
+//=============================================================================
+void USBDrive::checkPartitionTableWrite(uint32_t sector, uint32_t count)
+{
+	if (!_partitions_cached) return;
+	if (sector <= _partition_table_last) {
+		invalidatePartitionCache();
+		return;
+	}
+	for (uint8_t i = 0; i < _cPartitions; i++) {
+		if ((_partitions[i].voltype == EXT_VOL) && (_partitions[i].mbrLBA >= sector) &&
+				(_partitions[i].mbrLBA < (sector + count))) {
+			invalidatePartitionCache();
+			return;
+		}
+	}
+}
+
+//=============================================================================
+// scanPartition - find a partition by reading the partition tables
+//=============================================================================
+int USBDrive::scanPartition(int partition, int &type, uint32_t &firstSector, uint32_t &numSectors, 
+							uint32_t &mbrLBA, uint8_t &mbrPart, uint8_t *guid)
+{
 	union {
 		MbrSector_t mbr;
 		partitionBootSector pbs;
@@ -1338,48 +2319,123 @@ int USBDrive::findPartition(int partition, int &type, uint32_t &firstSector, uin
 //=============================================================================
 bool USBDrive::startFilesystems()
 {
-	// first repeat calling findPartition()
+	bool file_system_claimed = false;
+
+	DBGPrintf(">> USBDrive::startFilesystems called %p\n", this);
+
+	// first repeat calling findPartition(), finishing any mount Task() started
+	while (!mountStep(file_system_claimed)) yield();
+
+	// And the partitions on the other LUNs of this drive.
+	for (USBDrive *plun = _next_lun; plun; plun = plun->_next_lun) {
+		if ((plun->_drive_connect_fs_status == USBDRIVE_CONNECTED) ||
+				(plun->_drive_connect_fs_status == USBDRIVE_MOUNTING)) {
+			file_system_claimed |= plun->startFilesystems();
+		}
+	}
+	return file_system_claimed;
+} 
+
+//=============================================================================
+// mountStep - one step of startFilesystems: initialize the drive, or offer
+// the next partition to the filesystem objects.
+// returns - true when there is nothing more to do.
+//=============================================================================
+bool USBDrive::mountStep(bool &file_system_claimed)
+{
 	int type;
 	uint32_t firstSector;
 	uint32_t numSectors;
 	int voltype;
-	bool file_system_claimed = false;
 	uint32_t mbrLBA;
 	uint8_t mbrPart;
 
 	uint8_t guid[16];
 
-	DBGPrintf(">> USBDrive::startFilesystems called %p\n", this);
+	if (_drive_connect_fs_status == USBDRIVE_CONNECTED) {
+		// Start initializing, like begin() but without waiting for the medium.
+		_drive_connect_fs_status = USBDRIVE_MOUNTING;
+		_mount_part = 1;
+		if (msDriveInfo.initialized) {
+			m_initDone = true;
+			_mount_step = MOUNT_PARTITIONS;
+			return false;
+		}
+		m_errorCode = MS_CBW_PASS;
+		CBWTag = 0;
+		mscInitStart();
+		startMediaReady();
+		_mount_step = MOUNT_MEDIA_READY;
+		return false;
+	}
+	if (_drive_connect_fs_status != USBDRIVE_MOUNTING) return true;
+
+	if (_mount_step == MOUNT_MEDIA_READY) {
+		// One Test Unit Ready per step, none while backing off.
+		uint8_t msResult;
+		if (_emMediaReady < _media_ready_wait) return false;
+		if (!mediaReadyStep(msResult)) return false;
+		if (msResult == MS_CBW_PASS) msResult = mscInitDriveInfo();
+		m_errorCode = msResult;
+		m_initDone = (msResult == MS_CBW_PASS);
+		if (!m_initDone) {
+			DBGPrintf("\t >> init failed %x", msResult);
+			_mount_step = MOUNT_NO_MEDIUM;  // try again in a while
+			_emMediaReady = 0;
+			_media_ready_wait = MEDIA_POLL_INTERVAL;
+			return true;
+		}
+		_mount_step = MOUNT_PARTITIONS;
+		return false;
+	}
 
-	if (!begin()) { // make sure we are initialized
-		DBGPrintf("\t >> begin() failed");
+	if (_mount_step == MOUNT_NO_MEDIUM) {
+		// No medium (an empty card reader slot) or it never got ready: one
+		// Test Unit Ready every MEDIA_POLL_INTERVAL, until it passes or the
+		// sense data changes (UNIT ATTENTION when a medium is inserted).
+		if (_emMediaReady < _media_ready_wait) return true;
+		if (msTestReady() != MS_CBW_PASS) {
+			msFetchSense();
+			if ((msSense.SenseKey == MS_NOT_READY) &&
+					(msSense.AdditionalSenseCode == MS_MEDIUM_NOT_PRESENT)) {
+				_emMediaReady = 0;
+				return true;
+			}
+		}
+		startMediaReady();
+		_mount_step = MOUNT_MEDIA_READY;
 		return false;
 	}
 
-	for (int part = 1; ;part++) {
-		voltype = findPartition(part, type, firstSector, numSectors, mbrLBA, mbrPart, guid);
-		if (voltype == INVALID_VOL) break;
-		DBGPrintf("\t>>Partition %d VT:%u T:%U %u %u\n", part, voltype, type, firstSector, numSectors);
-		// Now see if there is any file systems that wish to claim this partition.
-		USBFSBase *usbfs = USBFSBase::s_first_fs;
+	// Then read the partition tables, a sector per step.
+	if (!_partitions_cached && !cachePartitionsStep()) return false;
 
-		while (usbfs) {
-			// If the usbfs is not claimed, try to claim it.
-			if ((usbfs->mydevice == nullptr) 
-				&& usbfs->claimPartition(this, part, voltype, type, firstSector, numSectors, guid)) break;
-			usbfs = usbfs->_next;
-		}
-		if (usbfs) {
-			// Mark it claimed by stashing back link to us in their mydevice
-			// and put a link to us 
-			usbfs->mydevice = device;
-			file_system_claimed = true;
-		 	s_connected_filesystems_changed = true;
-		}
+	int part = _mount_part;
+	voltype = findPartition(part, type, firstSector, numSectors, mbrLBA, mbrPart, guid);
+	if (voltype == INVALID_VOL) {
+		_drive_connect_fs_status = USBDRIVE_FS_STARTED;
+		return true;
 	}
-	_drive_connect_fs_status = USBDRIVE_FS_STARTED;
-	return file_system_claimed;
-} 
+	_mount_part++;
+	DBGPrintf("\t>>Partition %d VT:%u T:%U %u %u\n", part, voltype, type, firstSector, numSectors);
+	// Now see if there is any file systems that wish to claim this partition.
+	USBFSBase *usbfs = USBFSBase::s_first_fs;
+
+	while (usbfs) {
+		// If the usbfs is not claimed, try to claim it.
+		if ((usbfs->mydevice == nullptr) 
+			&& usbfs->claimPartition(this, part, voltype, type, firstSector, numSectors, guid)) break;
+		usbfs = usbfs->_next;
+	}
+	if (usbfs) {
+		// Mark it claimed by stashing back link to us in their mydevice
+		// and put a link to us 
+		usbfs->mydevice = device;
+		file_system_claimed = true;
+	 	s_connected_filesystems_changed = true;
+	}
+	return false;
+}
 
 
 //=============================================================================
@@ -1396,7 +2452,8 @@ bool USBDrive::updateConnectedFilesystems()
   bool file_system_started = false;
   USBDrive *pdrive = s_first_drive;
   while (pdrive) {
-  	if (pdrive->_drive_connect_fs_status == USBDRIVE_CONNECTED) {
+  	if ((pdrive->_drive_connect_fs_status == USBDRIVE_CONNECTED) ||
+  			(pdrive->_drive_connect_fs_status == USBDRIVE_MOUNTING)) {
 		DBGPrintf("\n === Drive %p connected ===\n", pdrive);
 		file_system_started |= pdrive->startFilesystems();
 		DBGPrintf("\nTry Partition list");
@@ -1535,6 +2592,7 @@ bool USBFilesystem::format(int type, char progressChar, Print& pr) {
 
 		uint8_t guid[16];
 
+		device->invalidatePartitionCache();
 		int voltype = device->findPartition(partition, type, firstSector, numSectors, mbrLBA, mbrPart, guid);
 		if (voltype == USBDrive::INVALID_VOL) return false;
 		pr.printf("\tPart:%d Type:%x First:%u num:%u\n", partition, type, firstSector, numSectors);
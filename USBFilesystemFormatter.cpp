@@ -1,10 +1,10 @@
 #include <Arduino.h>
 #include "utility/USBFilesystemFormatter.h"
+#include "utility/USBFilesystemUpcase.h"
 
 #ifndef DBG_FAIL_MACRO
 #define DBG_FAIL_MACRO
 #endif
-uint16_t toUpcase(uint16_t chr);
 
 //=============================================
 #define DBG_FILE "USBFilesystemFormatter.cpp"
@@ -45,7 +45,6 @@ const uint16_t FAT16_ROOT_SECTOR_COUNT =
 const uint32_t BOOT_BACKUP_OFFSET = 12;
 const uint16_t SECTOR_MASK = BYTES_PER_SECTOR - 1;
 const uint8_t  BYTES_PER_SECTOR_SHIFT = 9;
-const uint16_t MINIMUM_UPCASE_SKIP = 512;
 const uint32_t BITMAP_CLUSTER = 2;
 const uint32_t UPCASE_CLUSTER = 3;
 const uint32_t ROOT_CLUSTER = 4;
@@ -76,6 +75,9 @@ bool USBFilesystemFormatter::formatFAT(USBDrive &dev, USBFilesystem &fs, uint8_t
   bool rtn;
   m_secBuf = secBuf;
   m_pr = pr;
+  m_useWriteSame = dev.writeSameSupported();
+  m_emPhase = 0;
+  m_emFormat = 0;
   writeMsg("Begin format Fat File system\n");
   //m_dev = partVol.blockDevice();
   m_part = part-1;  // convert to 0 biased. 
@@ -160,6 +162,8 @@ bool USBFilesystemFormatter::formatFAT(USBDrive &dev, USBFilesystem &fs, uint8_t
   } else {
     rtn = false;
   }
+  dev.syncDevice();
+  if (rtn) writeMsgF("Format time: %u ms\n", (uint32_t)m_emFormat);
 
   return rtn;
 }
@@ -215,6 +219,7 @@ bool USBFilesystemFormatter::makeFat16(USBDrive &m_dev) {
   if (!writeFatMbr(m_dev)) {
     return false;
   }
+  reportPhase("MBR");
 
   initPbs();
   setLe16(pbs->bpb.bpb16.rootDirEntryCount, FAT16_ROOT_ENTRY_COUNT);
@@ -234,8 +239,15 @@ bool USBFilesystemFormatter::makeFat16(USBDrive &m_dev) {
   if (!writeSector(m_dev, m_relativeSectors, m_secBuf)) {
     return false;
   }
+  reportPhase("Boot sector");
   
-  return initFatDir(m_dev, 16, m_dataStart - m_fatStart);
+  if (!initFatDir(m_dev, 16, m_dataStart - m_fatStart)) {
+    return false;
+  }
+  reportPhase("FAT and root");
+  discardFreeSpace(m_dev, m_dataStart, m_relativeSectors + m_totalSectors - m_dataStart);
+  reportPhase("Discard");
+  return true;
   
 }
 
@@ -298,6 +310,7 @@ bool USBFilesystemFormatter::makeFat32(USBDrive &m_dev) {
     writeMsg("Failed to write MBR!!");
     return false;
   }
+  reportPhase("MBR");
   
   initPbs();  
   setLe32(pbs->bpb.bpb32.sectorsPerFat32, m_fatSize);
@@ -340,8 +353,17 @@ bool USBFilesystemFormatter::makeFat32(USBDrive &m_dev) {
       !writeSector(m_dev, m_relativeSectors + 7, m_secBuf)) {
     return false;
   }
+  reportPhase("Boot sectors");
   writeMsg("Writing FAT\n");
-  return initFatDir(m_dev, 32, 2*m_fatSize + m_sectorsPerCluster);
+  if (!initFatDir(m_dev, 32, 2*m_fatSize + m_sectorsPerCluster)) {
+    return false;
+  }
+  reportPhase("FAT and root");
+  // Root directory is the first cluster
+  discardFreeSpace(m_dev, m_dataStart + m_sectorsPerCluster,
+                   m_relativeSectors + m_totalSectors - m_dataStart - m_sectorsPerCluster);
+  reportPhase("Discard");
+  return true;
 
 }
 
@@ -387,53 +409,99 @@ bool USBFilesystemFormatter::writeFatMbr(USBDrive &m_dev) {
 
 //-----------------------------------------------------------------------------
 
-#define CSECTORS_PER_WRITE 32
+// Largest zero fill write: 128 sectors = 64KB, less if the drive's Block
+// Limits say so or we can't get that much memory.
+#define MAX_SECTORS_PER_WRITE 128
+bool USBFilesystemFormatter::zeroSectors(USBDrive &m_dev, uint32_t sector, uint32_t sectorCount) {
+  DBGPrintf("PFsFatFormatter::zeroSectors(%u, %u)\n", sector, sectorCount);
+  if (sectorCount == 0) return true;
+
+  // If the drive reads back discarded sectors as zeros, let it do the work.
+  if (m_dev.discardZeroes() && m_dev.discard(sector, sectorCount)) {
+    DBGPrintf("\tdiscarded\n");
+    return true;
+  }
+
+  // Else WRITE SAME, where we only send one sector of zeros.
+  memset(m_secBuf, 0, BYTES_PER_SECTOR);
+  if (m_useWriteSame) {
+    if (m_dev.writeSame(sector, sectorCount, m_secBuf)) {
+      DBGPrintf("\twrite same\n");
+      return true;
+    }
+    DBGPrintf("\twrite same failed(%x) - not using it\n", m_dev.errorCode());
+    m_useWriteSame = false;
+  }
+
+  // Else as large of writes as we can.
+  uint32_t sectors_per_write = MAX_SECTORS_PER_WRITE;
+  uint32_t max_transfer = m_dev.msBlockLimits.maxTransferLength;
+  if (max_transfer && (max_transfer < sectors_per_write)) sectors_per_write = max_transfer;
+  if (sectorCount < sectors_per_write) sectors_per_write = sectorCount;
+
+  uint8_t *large_buffer_alloc = nullptr;
+  for (; sectors_per_write > 1; sectors_per_write >>= 1) {
+    large_buffer_alloc = (uint8_t *)malloc(BYTES_PER_SECTOR * sectors_per_write + 32);
+    if (large_buffer_alloc) break;
+  }
+  uint8_t *buffer = m_secBuf;  // one sector if we could not allocate any more.
+  if (large_buffer_alloc) {
+    buffer = (uint8_t *)(((uintptr_t)large_buffer_alloc + 31) & ~((uintptr_t)(31)));
+    memset(buffer, 0, BYTES_PER_SECTOR * sectors_per_write);
+  } else {
+    sectors_per_write = 1;
+  }
+  DBGPrintf("\tbuffer:%p alligned:%p sectors:%u\n", large_buffer_alloc, buffer, sectors_per_write);
+
+  bool ret = true;
+  uint32_t loops_per_dot = sectorCount/(32*sectors_per_write);
+  uint32_t loop_count = 0;
+  while (sectorCount) {
+    uint32_t cnt = (sectorCount < sectors_per_write) ? sectorCount : sectors_per_write;
+    // sandbox support
+    if ((sector < m_minSector) || ((sector + cnt - 1) > m_maxSector)) {
+      DBGPrintf("!!! Sandbox Error: %u <= %u..%u <= %u\n", m_minSector, sector, sector + cnt - 1, m_maxSector);
+    }
+    if (!m_dev.writeSectors(sector, buffer, cnt)) {
+      ret = false;
+      break;
+    }
+    sector += cnt;
+    sectorCount -= cnt;
+    if (++loop_count == loops_per_dot) {
+      DBGPrintf(".");
+      loop_count = 0;
+    }
+  }
+  free(large_buffer_alloc);
+  return ret;
+}
+
+//------------------------------------------------------------------------------
+void USBFilesystemFormatter::reportPhase(const char *phase) {
+  writeMsgF("  %s: %u ms\n", phase, (uint32_t)m_emPhase);
+  m_emPhase = 0;
+}
+
+//------------------------------------------------------------------------------
+// The data area is all free after a format, let the drive know (TRIM).
+void USBFilesystemFormatter::discardFreeSpace(USBDrive &m_dev, uint32_t sector, uint32_t sectorCount) {
+  if (!m_dev.discardSupported() || (sectorCount == 0)) return;
+  writeMsg("Discarding free space\n");
+  if (!m_dev.discard(sector, sectorCount)) {
+    DBGPrintf("\tdiscard(%u, %u) failed: %x\n", sector, sectorCount, m_dev.errorCode());
+  }
+}
+
+//-----------------------------------------------------------------------------
 bool USBFilesystemFormatter::initFatDir(USBDrive &m_dev, uint8_t fatType, uint32_t sectorCount) {
   DBGPrintf("PFsFatFormatter::initFatDir(%u, %u)\n", fatType, sectorCount);
   size_t n;
-  uint32_t fat_sector = 1;
   DBGPrintf("Writing FAT ");
-  if (sectorCount >= CSECTORS_PER_WRITE) {
-    uint8_t *large_buffer_alloc = (uint8_t *)malloc(BYTES_PER_SECTOR * CSECTORS_PER_WRITE + 32);
-
-    if (large_buffer_alloc) {
-      uint8_t *large_buffer = (uint8_t *)(((uintptr_t)large_buffer_alloc + 31) & ~((uintptr_t)(31)));
-      DBGPrintf("\tbuffer:%p alligned:%p\n", large_buffer_alloc, large_buffer);
-      memset(large_buffer, 0, BYTES_PER_SECTOR * CSECTORS_PER_WRITE);
-      uint32_t sectors_remaining = sectorCount;
-      uint32_t loops_per_dot = sectorCount/(32*CSECTORS_PER_WRITE);
-      uint32_t loop_count = 0;
-      while (sectors_remaining >= CSECTORS_PER_WRITE) {
-        if (!m_dev.writeSectors(m_fatStart + fat_sector, large_buffer, CSECTORS_PER_WRITE)) {
-           return false;
-        }
-        fat_sector += CSECTORS_PER_WRITE;
-        sectors_remaining -= CSECTORS_PER_WRITE;
-        if (++loop_count == loops_per_dot) {
-          DBGPrintf(".");
-          loop_count = 0;
-        }
-      }
-      if (sectors_remaining) {
-        if (!m_dev.writeSectors(m_fatStart + fat_sector, large_buffer, sectors_remaining)) {
-           return false;
-        }
-        fat_sector += sectors_remaining;
-      }
-      free(large_buffer_alloc);
-    }
-  }
-  if (fat_sector < sectorCount) {
-    memset(m_secBuf, 0, BYTES_PER_SECTOR);
-    for (; fat_sector < sectorCount; fat_sector++) {
-      if (!writeSector(m_dev, m_fatStart + fat_sector, m_secBuf)) {
-         return false;
-      }
-      if ((fat_sector%(sectorCount/32)) == 0) {
-        DBGPrintf(".");
-      }
-    }
+  if (!zeroSectors(m_dev, m_fatStart + 1, sectorCount - 1)) {
+    return false;
   }
+  memset(m_secBuf, 0, BYTES_PER_SECTOR);
   DBGPrintf("\r\n");
   // Allocate reserved clusters and root for FAT32.
   m_secBuf[0] = 0XF8;
@@ -517,6 +585,9 @@ bool USBFilesystemFormatter::formatExFAT(USBDrive &dev, USBFilesystem &fs, uint8
 
   m_secBuf = secBuf;
   m_pr = pr;
+  m_useWriteSame = dev.writeSameSupported();
+  m_emPhase = 0;
+  m_emFormat = 0;
   writeMsg("Begin format ExFat File system\n");
   //m_dev = partVol.blockDevice();
   //m_part = partVol.part()-1;  // convert to 0 biased. 
@@ -645,6 +716,7 @@ bool USBFilesystemFormatter::formatExFAT(USBDrive &dev, USBFilesystem &fs, uint8
     DBG_FAIL_MACRO;
     goto fail;
   }  
+  reportPhase("MBR");
 
   // Debug Set the sand box 
   setWriteSandBox(firstLBA, firstLBA + sectorCount - 1);
@@ -759,6 +831,8 @@ bool USBFilesystemFormatter::formatExFAT(USBDrive &dev, USBFilesystem &fs, uint8
     goto fail;
   }
 
+  reportPhase("Boot region");
+
   // Initialize FAT.
   writeMsg( "Writing exFAT ");
   sector = partitionOffset + fatOffset;
@@ -779,19 +853,12 @@ bool USBFilesystemFormatter::formatExFAT(USBDrive &dev, USBFilesystem &fs, uint8
 	  for (size_t i = 1; i < 20; i++) {
 		secBuf[i] = 0XFF;
 	  }
-  for (uint32_t i = 0; i < ns; i++) {
-    if (i%(ns/32) == 0) {
-      writeMsg( ".");
-    }
-    if (!writeSector(dev, sector + i, secBuf)) {
-      DBG_FAIL_MACRO;
-      goto fail;
-    }
-    if (i == 0) {
-      memset(secBuf, 0, BYTES_PER_SECTOR);
-    }
+  if (!writeSector(dev, sector, secBuf) || !zeroSectors(dev, sector + 1, ns - 1)) {
+    DBG_FAIL_MACRO;
+    goto fail;
   }
   writeMsg( "\r\n");
+  reportPhase("FAT");
   
   //==================================================================
   writeMsg( "Write cluster two, bitmap\n");
@@ -812,15 +879,11 @@ bool USBFilesystemFormatter::formatExFAT(USBDrive &dev, USBFilesystem &fs, uint8
   memset(secBuf, 0, BYTES_PER_SECTOR);
   // Allocate clusters for bitmap, upcase, and root.
   secBuf[0] = 0X7;
-  for (uint32_t i = 1; i < ns; i++) {
-    if (!writeSector(dev, sector + i, secBuf)) {
-      DBG_FAIL_MACRO;
-      goto fail;
-    }
-    if (i == 0) {
-      secBuf[0] = 0;
-    }
+  if (!writeSector(dev, sector, secBuf) || !zeroSectors(dev, sector + 1, ns - 1)) {
+    DBG_FAIL_MACRO;
+    goto fail;
   }
+  reportPhase("Bitmap");
   
  
   // Write cluster three, upcase table.
@@ -832,10 +895,11 @@ bool USBFilesystemFormatter::formatExFAT(USBDrive &dev, USBFilesystem &fs, uint8
     DBG_FAIL_MACRO;
     goto fail;
   }
-  if (m_upcaseSize > BYTES_PER_SECTOR*sectorsPerCluster) {
+  if (UPCASE_TABLE_SIZE > BYTES_PER_SECTOR*sectorsPerCluster) {
     DBG_FAIL_MACRO;
     goto fail;
   }
+  reportPhase("Upcase table");
   
   // Initialize first sector of root.
   writeMsg( "Writing root\r\n");
@@ -859,9 +923,9 @@ bool USBFilesystemFormatter::formatExFAT(USBDrive &dev, USBFilesystem &fs, uint8
   // upcase directory entry.
   dup = reinterpret_cast<DirUpcase_t*>(secBuf +64);
   dup->type = EXFAT_TYPE_UPCASE;
-  setLe32(dup->checksum, m_upcaseChecksum);
+  setLe32(dup->checksum, UPCASE_TABLE_CHECKSUM);
   setLe32(dup->firstCluster, UPCASE_CLUSTER);
-  setLe64(dup->size, m_upcaseSize);
+  setLe64(dup->size, UPCASE_TABLE_SIZE);
 
   // Write root, cluster four.
   for (uint32_t i = 0; i < ns; i++) {
@@ -873,6 +937,11 @@ bool USBFilesystemFormatter::formatExFAT(USBDrive &dev, USBFilesystem &fs, uint8
       memset(secBuf, 0, BYTES_PER_SECTOR);
     }
   }
+  reportPhase("Root");
+  // Clusters after bitmap, upcase and root are free.
+  discardFreeSpace(dev, partitionOffset + clusterHeapOffset + 3*sectorsPerCluster,
+                   (clusterCount - 3) * sectorsPerCluster);
+  reportPhase("Discard");
   writeMsg( "Format done\r\n");
   // what happens if I tell the partion to begin again?
   //partVol.begin(dev, true, m_part+1);  // need to 1 bias again...
@@ -883,6 +952,7 @@ bool USBFilesystemFormatter::formatExFAT(USBDrive &dev, USBFilesystem &fs, uint8
   }
   dev.syncDevice();
   setWriteSandBox(0, 0xffffffff);
+  writeMsgF("Format time: %u ms\n", (uint32_t)m_emFormat);
   return true;
 
  fail:
@@ -925,76 +995,35 @@ bool USBFilesystemFormatter::writeExFatMbr(USBDrive &m_dev) {
 }
 
 //------------------------------------------------------------------------------
-bool USBFilesystemFormatter::syncUpcase(USBDrive &m_dev) {
-  uint16_t index = m_upcaseSize & SECTOR_MASK;
-  if (!index) {
-    return true;
-  }
-  for (size_t i = index; i < BYTES_PER_SECTOR; i++) {
-    m_secBuf[i] = 0;
-  }
-  return writeSector(m_dev, m_upcaseSector, m_secBuf);
-}
-
-//------------------------------------------------------------------------------
-bool USBFilesystemFormatter::writeUpcaseByte(USBDrive &m_dev, uint8_t b) {
-  uint16_t index = m_upcaseSize & SECTOR_MASK;
-  m_secBuf[index] = b;
-  m_upcaseChecksum = exFatChecksum(m_upcaseChecksum, b);
-  m_upcaseSize++;
-  if (index == SECTOR_MASK) {
-    return writeSector(m_dev, m_upcaseSector++, m_secBuf);
-  }
-  return true;
-}
-//------------------------------------------------------------------------------
-bool USBFilesystemFormatter::writeUpcaseUnicode(USBDrive &m_dev, uint16_t unicode) {
-  return writeUpcaseByte(m_dev, unicode) && writeUpcaseByte(m_dev, unicode >> 8);
-}
-//------------------------------------------------------------------------------
+// The table goes out in one WRITE, or a sector at a time through m_secBuf
+// if there's no RAM for the whole of it.
 bool USBFilesystemFormatter::writeUpcase(USBDrive &m_dev, uint32_t sector) {
-  uint32_t n;
+  uint8_t *upcase_buffer_alloc = (uint8_t *)malloc(UPCASE_TABLE_SECTORS*BYTES_PER_SECTOR + 32);
+  uint8_t *buf;
   uint32_t ns;
-  uint32_t ch = 0;
-  uint16_t uc;
-
-  m_upcaseSize = 0;
-  m_upcaseChecksum = 0;
-  m_upcaseSector = sector;
-
-  while (ch < 0X10000) {
-    uc = toUpcase(ch);
-    if (uc != ch) {
-      if (!writeUpcaseUnicode(m_dev, uc)) {
-        DBG_FAIL_MACRO;
-        goto fail;
-      }
-      ch++;
-    } else {
-      for (n = ch + 1; n < 0X10000 && n == toUpcase(n); n++) {}
-      ns = n - ch;
-      if (ns >= MINIMUM_UPCASE_SKIP) {
-        if (!writeUpcaseUnicode(m_dev, 0XFFFF) || !writeUpcaseUnicode(m_dev, ns)) {
-          DBG_FAIL_MACRO;
-          goto fail;
-        }
-        ch = n;
-      } else {
-        while (ch < n) {
-          if (!writeUpcaseUnicode(m_dev, ch++)) {
-            DBG_FAIL_MACRO;
-            goto fail;
-          }
-        }
-      }
+  bool ret = true;
+
+  if (upcase_buffer_alloc) {
+    buf = (uint8_t *)(((uintptr_t)upcase_buffer_alloc + 31) & ~((uintptr_t)(31)));
+    ns = UPCASE_TABLE_SECTORS;
+  } else {
+    buf = m_secBuf;
+    ns = 1;
+  }
+  for (uint32_t first = 0; ret && first < UPCASE_TABLE_SECTORS; first += ns) {
+    uint32_t count = min(ns, UPCASE_TABLE_SECTORS - first);
+    memset(buf, 0, count*BYTES_PER_SECTOR);
+    uint32_t begin = first*BYTES_PER_SECTOR/2;
+    uint32_t end = min((first + count)*BYTES_PER_SECTOR, UPCASE_TABLE_SIZE)/2;
+    for (uint32_t i = begin; i < end; i++) {
+      setLe16(buf + 2*(i - begin), upcaseTable[i]);
     }
+    ret = (count == 1) ? writeSector(m_dev, sector + first, buf)
+      : m_dev.writeSectors(sector + first, buf, count);
   }
-  if (!syncUpcase(m_dev)) {
+  free(upcase_buffer_alloc);
+  if (!ret) {
     DBG_FAIL_MACRO;
-    goto fail;
   }
-  return true;
-
- fail:
-  return false;
+  return ret;
 }
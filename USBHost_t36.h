@@ -285,6 +285,7 @@ protected:
                                     uint32_t len, USBDriver *driver);
     static Device_t * new_Device(uint32_t speed, uint32_t hub_addr, uint32_t hub_port);
     static void disconnect_Device(Device_t *dev);
+    static void cancel_Transfers(Pipe_t *pipe);
     static void enumeration(const Transfer_t *transfer);
     static void driver_ready_for_device(USBDriver *driver);
     static volatile bool enumeration_busy;
@@ -563,6 +564,7 @@ public:
     const uint8_t *manufacturer();
     const uint8_t *product();
     const uint8_t *serialNumber();
+    BluetoothConnection *bluetoothConnection() {return btconnect;}
 
 private:
     virtual bool claim_bluetooth(BluetoothController *driver, uint32_t bluetooth_class, uint8_t *remoteName) {return false;}
@@ -2037,8 +2039,10 @@ public:
 
     void parse(void);
     void parse(uint16_t type_and_report_id, const uint8_t *data, uint32_t len);
+    void compileReportDescriptor();
     BTHIDInput * find_driver(uint32_t topusage);
     BTHIDInput * find_driver(const uint8_t *remoteName, int type);
+    void releaseCollectionDrivers();
 
     void startTimer(uint32_t microseconds) {bt_connection_timer_.start(microseconds);}
     void stopTimer() {bt_connection_timer_.stop();}
@@ -2048,8 +2052,43 @@ public:
     void printUsageInfo(uint8_t usage_page, uint16_t usage);
     void useHIDProtocol(bool useHID) {use_hid_protocol_ = useHID;}
     void connectToSDP(); // temp to see if we can do this later...
+    void requestHIDDescriptor();
     void timer_event(USBDriverTimer *whichTimer);
 
+    // Link power mode and latency.  Intervals and timeouts are in 0.625ms
+    // slots.  The remote device may refuse, the mode it ends up in is
+    // reported by linkMode once the Mode Change event arrives.
+    enum {LINK_MODE_ACTIVE = 0, LINK_MODE_HOLD = 1, LINK_MODE_SNIFF = 2};
+    enum {LINK_POLICY_ROLE_SWITCH = 0x01, LINK_POLICY_HOLD = 0x02, LINK_POLICY_SNIFF = 0x04};
+    bool setLinkPolicy(uint16_t link_policy_settings);
+    bool setSniffMode(uint16_t max_interval, uint16_t min_interval, uint16_t attempt = 4, uint16_t timeout = 1);
+    bool exitSniffMode();
+    bool setQoS(uint32_t latency_us, uint32_t delay_variation_us = 0xffffffff, uint8_t service_type = 0x02);
+    bool setFlushTimeout(uint16_t timeout);     // 0 no automatic flush
+    uint8_t linkMode() {return link_mode_;}
+    uint16_t linkModeInterval() {return link_mode_interval_;}
+    uint32_t QoSLatency() {return qos_latency_us_;}  // as granted by the controller
+
+    // LE connections only, intervals in 1.25ms units (6 = 7.5ms), timeout in 10ms.
+    bool LEConnection() {return le_connection_;}
+    uint16_t LEConnectionInterval() {return le_interval_;}
+    bool updateLEConnection(uint16_t min_interval, uint16_t max_interval, uint16_t latency, uint16_t supervision_timeout);
+
+    // HID over GATT on LE connections
+    void startGATTDiscovery();
+    void process_att_pdu(uint8_t *data, uint16_t length);
+    void process_att_response(uint8_t opcode, const uint8_t *data, uint16_t length);
+    void process_le_signaling(uint8_t *data, uint16_t length);
+    void process_smp(uint8_t *data, uint16_t length);
+    void handleGATTNotification(const uint8_t *data, uint16_t length);
+    void gattContinue();
+    void gattReportMapComplete();
+    void gattFailed(const char *reason);
+    void connectionReady();
+    void sendATT(const uint8_t *pdu, uint8_t length);
+    void sendATTHandleRange(uint8_t opcode, uint16_t start, uint16_t end, uint16_t uuid);
+    void sendATTRead(uint16_t handle, uint16_t offset);
+
     // member variables
     BluetoothConnection *next_ = nullptr;
     BTHIDInput *    device_driver_ = nullptr;
@@ -2081,9 +2120,45 @@ public:
     bool            supports_SSP_ = false; 
     bool            connection_started_by_timer_ = false; 
     uint16_t        pending_control_tx_ = 0;
+    volatile bool   l2cap_step_pending_ = false;  // l2cap_step_timer_ will send pending_control_tx_
+    uint8_t         acl_packets_outstanding_ = 0; // ACL packets the controller has not completed yet
+    volatile uint8_t link_mode_ = LINK_MODE_ACTIVE;
+    volatile uint16_t link_mode_interval_ = 0;
+    uint32_t        qos_latency_us_ = 0;
+    uint32_t        connect_start_us_ = 0;  // 0 once the connection is ready
+    uint8_t         hid_descriptor_retries_ = 0;    // waiting for a descriptor buffer
+
+    // LE connection and the HID service found on it.
+    enum {GATT_REPORTS_MAX = 8};
+    enum {ATT_MTU = 64};    // what we ask for, fits one of our ACL buffers
+    typedef struct {
+        uint16_t    value_handle;
+        uint16_t    end_handle;         // last handle of the characteristic
+        uint16_t    cccd_handle;        // 0 if none
+        uint16_t    reference_handle;   // Report Reference descriptor, 0 if none
+        uint8_t     properties;
+        uint8_t     report_id;
+        uint8_t     report_type;        // 1 input, 2 output, 3 feature
+    } gatt_report_t;
+    bool            le_connection_ = false;
+    uint8_t         le_address_type_ = 0;
+    uint16_t        le_interval_ = 0;
+    uint16_t        le_max_interval_ = 0;   // longest interval we will accept from the device
+    uint8_t         gatt_state_ = 0;
+    uint16_t        att_mtu_ = 23;
+    uint16_t        gatt_service_start_ = 0;
+    uint16_t        gatt_service_end_ = 0;
+    uint16_t        gatt_report_map_handle_ = 0;
+    uint32_t        gatt_next_handle_ = 0;  // where the next discovery request starts
+    uint8_t         gatt_report_count_ = 0;
+    uint8_t         gatt_report_index_ = 0;
+    uint8_t         gatt_prev_report_ = 0xff;
+    gatt_report_t   gatt_reports_[GATT_REPORTS_MAX];
 
     enum {DUNKOWN=0xff, DNIL = 0, DU32, DS32, DU64, DS64, DPB, DLVL};
     enum {CONNECTION_TIMEOUT_US = 50000};
+    enum {L2CAP_STEP_DELAY_US = 1000};
+    enum {HID_DESCRIPTOR_RETRY_US = 50000, HID_DESCRIPTOR_RETRIES = 40};
     typedef struct {
         uint8_t  element_type;
         uint8_t dtype;
@@ -2103,7 +2178,7 @@ public:
     bool have_hid_descriptor_ = false;
     uint8_t *sdp_buffer_ = nullptr;
     uint16_t sdp_buffer_len_ = 0;
-    uint8_t descriptor_[800];
+    uint8_t *descriptor_ = nullptr;     // borrowed from the controller while we need it
     enum {REMOTE_NAME_SIZE = 32};
     uint8_t remote_name_[REMOTE_NAME_SIZE] = {0};
     uint16_t descsize_;
@@ -2112,6 +2187,30 @@ public:
     enum { USAGE_LIST_LEN = 24 };
     BTHIDInput *topusage_drivers[TOPUSAGE_LIST_LEN];
 
+    // The report descriptor compiled into the driver calls each input report
+    // makes, grouped by report ID, so reports do not re-walk descriptor_.
+    enum {HID_FIELDS_MAX = 64, HID_REPORT_IDS_MAX = 8};
+    enum {HID_OP_BEGIN = 0, HID_OP_DATA, HID_OP_ARRAY, HID_OP_END};
+    typedef struct {
+        uint8_t  op;            // HID_OP_...
+        uint8_t  driver_index;  // into topusage_drivers
+        uint8_t  size;          // bits
+        uint8_t  type;          // Input item flags, for HID_OP_BEGIN
+        uint16_t bitindex;
+        uint32_t usage;         // top usage for HID_OP_BEGIN, usage page for HID_OP_ARRAY
+        int32_t  logical_min;
+        int32_t  logical_max;
+    } hid_field_t;
+    typedef struct {
+        uint8_t  report_id;
+        uint8_t  first;         // index into hid_fields_
+        uint8_t  count;
+    } hid_report_t;
+    hid_field_t *hid_fields_ = nullptr;     // borrowed from the controller while connected
+    hid_report_t hid_reports_[HID_REPORT_IDS_MAX];
+    uint8_t hid_report_count_ = 0;
+    bool parse(uint8_t report_id, const uint8_t *data, hid_field_t *fields, uint8_t &field_count);
+
     static BluetoothConnection *s_first_;
 
     bool startSDP_ServiceSearchAttributeRequest(uint16_t range_low, uint16_t range_high, uint8_t *buffer, uint32_t cb);
@@ -2121,6 +2220,8 @@ public:
 
     // Allow each connection to have it's own timer
     USBDriverTimer  bt_connection_timer_;
+    USBDriverTimer  l2cap_step_timer_;  // paces the L2CAP setup, see scheduleL2CAPStep
+    USBDriverTimer  connection_timer_;  // setTimer: open the channels if the device does not
 
 protected:
     friend class BluetoothController;
@@ -2139,6 +2240,8 @@ protected:
     void sendl2cap_ConfigRequest(uint16_t handle, uint8_t rxid, uint16_t dcid);
     void sendl2cap_ConfigResponse(uint16_t handle, uint8_t rxid, uint16_t scid, uint16_t mtu);
     void sendl2cap_DisconnectResponse(uint16_t handle, uint8_t rxid, uint16_t dcid, uint16_t scid);
+    void scheduleL2CAPStep();
+    void sendL2CAPStep();
 
     void process_sdp_service_search_request(uint8_t *data);
     void process_sdp_service_search_response(uint8_t *data);
@@ -2173,6 +2276,34 @@ protected:
 
 };
 
+//=============================================================================
+// BLE advertising report, received while LE scanning
+//=============================================================================
+typedef struct {
+    uint8_t     event_type;     // 0 ADV_IND, 1 ADV_DIRECT_IND, 2 ADV_SCAN_IND, 3 ADV_NONCONN_IND, 4 SCAN_RSP
+    uint8_t     address_type;   // 0 public, 1 random, 2 public identity, 3 random static
+    uint8_t     bdaddr[6];
+    int8_t      rssi;           // dBm, 127 if not available
+    uint8_t     data_length;
+    uint8_t     data[31];       // AD structures: <length><type><data...>
+} BLEAdvertisingReport_t;
+
+//=============================================================================
+// Bluetooth receive path timing and transmit drops, from BluetoothController::getStatistics
+//=============================================================================
+typedef struct {
+    uint32_t    events;             // HCI events processed
+    uint32_t    event_cycles;       // CPU cycles (ARM_DWT_CYCCNT) spent on them
+    uint32_t    event_cycles_max;
+    uint32_t    acl_packets;        // L2CAP packets (HID reports...) processed by the connections
+    uint32_t    acl_cycles;
+    uint32_t    acl_cycles_max;
+    uint32_t    connect_us;         // last connection, from its start until its reports are set up
+    uint32_t    tx_cmd_dropped;     // HCI commands dropped, command ring full or too long
+    uint32_t    tx_acl_dropped;     // L2CAP packets dropped, ACL ring full, too long or link gone
+    uint32_t    rx_acl_dropped;     // L2CAP packets received for a handle with no connection
+} BluetoothStatistics_t;
+
 //=============================================================================
 // Bluetooth Pairing Callback class
 //=============================================================================
@@ -2214,12 +2345,14 @@ class BluetoothController: public USBDriver {
 public:
     enum { TOPUSAGE_LIST_LEN = 6 };
     enum { USAGE_LIST_LEN = 24 };
-    static const uint8_t DEFAULT_CONNECTIONS = 2;
+    // Connections are a pool shared by all controllers, more can be added by
+    // declaring BluetoothConnection objects in the sketch.
+    static const uint8_t DEFAULT_CONNECTIONS = 4;
 
 
 
 
-    BluetoothController(USBHost &host, bool pair = false, const char *pin = "0000", bool pair_ssp = false) : do_pair_device_(pair), pair_pincode_(pin), do_pair_ssp_(pair_ssp), timer_(this)
+    BluetoothController(USBHost &host, bool pair = false, const char *pin = "0000", bool pair_ssp = false) : do_pair_device_(pair), pair_pincode_(pin), do_pair_ssp_(pair_ssp)
     { init(); }
 
     enum {MAX_ENDPOINTS = 4, NUM_SERVICES = 4, }; // Max number of Bluetooth services - if you need more than 4 simply increase this number
@@ -2250,6 +2383,39 @@ public:
     bool setLEScanEnable(uint8_t enable, uint8_t filter_duplicates);
     bool setLEScanParameters(uint8_t scan_type, uint16_t scan_interval, uint16_t scan_window, uint8_t own_address_type, uint8_t filter_policy);
 
+    // Connect to a BLE HID device (HID over GATT) found while LE scanning.
+    // Its reports go to the BTHIDInput drivers as for classic devices.
+    // Intervals are in 1.25ms units (6 = 7.5ms), supervision timeout in 10ms.
+    bool connectLE(const uint8_t bdaddr[6], uint8_t address_type, uint16_t min_interval = 6, uint16_t max_interval = 12,
+                   uint16_t latency = 0, uint16_t supervision_timeout = 200);
+    void cancelConnectLE();
+
+    // Advertising reports that pass all of the filters go to the callback
+    // (called from the USB interrupt), or if there is none are queued for
+    // readLEAdvertisingReport.  When the queue is full reports are dropped.
+    void setLEAdvertisingAddressFilter(const uint8_t bdaddr[6]);   // nullptr for any address
+    void setLEAdvertisingUUIDFilter(uint16_t uuid16) {le_adv_filter_uuid16_ = uuid16;}    // 0 for any
+    void setLEAdvertisingManufacturerFilter(int32_t company_id) {le_adv_filter_company_id_ = company_id;}  // -1 for any
+    void attachLEAdvertisingReport(void (*f)(const BLEAdvertisingReport_t &report)) {le_adv_report_cb_ = f;}
+    int availableLEAdvertisingReports();
+    bool readLEAdvertisingReport(BLEAdvertisingReport_t &report);
+    uint32_t LEAdvertisingReportsDropped() {return le_adv_reports_dropped_;}
+    // Find an AD structure of the given type in the report, returns its data.
+    static const uint8_t *findLEAdvertisingData(const BLEAdvertisingReport_t &report, uint8_t ad_type, uint8_t &length);
+
+    // Capture of the HCI commands, events and ACL packets into a RAM buffer,
+    // written out as a btsnoop file (H4) that Wireshark can open.  Capture
+    // stops when the buffer is full, the packets that did not fit are counted.
+    void startHCICapture(void *buffer, uint32_t size);
+    void stopHCICapture() {hci_capture_enabled_ = false;}
+    uint32_t HCICaptureSize() {return hci_capture_used_;}
+    uint32_t HCICaptureDropped() {return hci_capture_dropped_;}
+    size_t writeHCICapture(Print &out);
+
+    // Receive path timing and transmit drops, to measure changes to the Bluetooth code.
+    void getStatistics(BluetoothStatistics_t &stats);
+    void resetStatistics();
+
 
     // BUGBUG version to allow some of the controlled objects to call?
     enum {CONTROL_SCID = -1, INTERRUPT_SCID = -2, SDP_SCID = -3};
@@ -2260,7 +2426,7 @@ public:
     void useHIDProtocol(bool useHID);
     void updateHIDProtocol(uint8_t protocol);
 
-    bool setTimer(BluetoothConnection *connection, uint32_t ms);  // set to NULL ptr will clear:
+    bool setTimer(BluetoothConnection *connection, uint32_t us);  // 0 us will clear
 
 
 protected:
@@ -2274,8 +2440,27 @@ protected:
 
     BluetoothConnection connections_[DEFAULT_CONNECTIONS];
     uint8_t count_connections_ = 0;
+
+    // HID report descriptors are only kept for connections that parse their
+    // own reports; those borrow one of these buffers until the descriptor is
+    // compiled into their field table, or while connected when it could not
+    // be.  Once given back the descriptor stays cached for the device's
+    // bdaddr, so a reconnect can skip SDP, until the buffer is needed for
+    // another device.  Every connection can hold a field table.
+    enum {HID_DESCRIPTOR_BUFFERS = 2, HID_DESCRIPTOR_SIZE = 800};
+    uint8_t hid_descriptor_buffers_[HID_DESCRIPTOR_BUFFERS][HID_DESCRIPTOR_SIZE];
+    BluetoothConnection *hid_descriptor_owners_[HID_DESCRIPTOR_BUFFERS] = {};
+    BluetoothConnection::hid_field_t hid_field_buffers_[DEFAULT_CONNECTIONS][BluetoothConnection::HID_FIELDS_MAX];
+    BluetoothConnection *hid_field_owners_[DEFAULT_CONNECTIONS] = {};
+    uint8_t hid_descriptor_bdaddr_[HID_DESCRIPTOR_BUFFERS][6];
+    uint16_t hid_descriptor_cached_size_[HID_DESCRIPTOR_BUFFERS] = {};    // 0 if nothing cached
+    uint32_t hid_descriptor_last_used_[HID_DESCRIPTOR_BUFFERS] = {};
+    uint32_t hid_descriptor_use_count_ = 0;
+    uint8_t *allocHIDDescriptorBuffer(BluetoothConnection *connection);
+    void releaseHIDDescriptorBuffer(BluetoothConnection *connection);
+    void freeHIDDescriptorBuffer(BluetoothConnection *connection);
+    bool reserveCachedHIDDescriptor(BluetoothConnection *connection);
     BluetoothConnection  *current_connection_ = nullptr;    // need to figure out when this changes and/or...
-    BluetoothConnection  *timer_connection_ = nullptr;    // need to figure out when this changes and/or...
     BluetoothPairingCB   *pairing_cb_ = nullptr;
 
 private:
@@ -2303,8 +2488,8 @@ private:
     void inline sendHCIAuthenticationRequested();
     void inline sendHCIAcceptConnectionRequest();
     void inline sendHCIRejectConnectionRequest(uint8_t bdaddr[6], uint8_t error);
-    void inline sendHCILinkKeyRequestReply(uint8_t link_key[16]);
-    void inline sendHCILinkKeyNegativeReply();
+    void inline sendHCILinkKeyRequestReply(uint8_t bdaddr[6], uint8_t link_key[16]);
+    void inline sendHCILinkKeyNegativeReply(uint8_t bdaddr[6]);
     void inline sendHCIPinCodeReply();
     void inline sendResetHCI();
     void inline sendHDCWriteClassOfDev();
@@ -2324,7 +2509,7 @@ private:
 	void inline sendHCISimplePairingMode();
 	void inline sendHCIReadSimplePairingMode();
     bool inline sendHCIReadStoredLinkKey(uint8_t link_key[16]);
-    void inline sendHCIWriteStoredLinkKey(uint8_t link_key[16]);
+    void inline sendHCIWriteStoredLinkKey(uint8_t bdaddr[6], uint8_t link_key[16]);
 
 	void handle_hci_encryption_change_complete();
 	void sendHCISetConnectionEncryption();
@@ -2346,7 +2531,24 @@ private:
     void handle_hci_link_key_request();
     void handle_hci_return_link_keys();
     void handle_ev_meta_event(); // 0x3e
+    void handle_le_advertising_report();
+    void handle_le_connection_complete(bool enhanced);
+    void handle_le_connection_update_complete();
+    void handle_hci_mode_change();
+    void handle_hci_qos_setup_complete();
+    void captureHCIPacket(uint8_t type, bool received, const uint8_t *data, uint16_t captured, uint16_t length);
+    bool leAdvertisingFilterMatch(const uint8_t bdaddr[6], const uint8_t *data, uint8_t data_length);
     void queue_next_hci_command();
+    void update_hci_command_credits(uint8_t credits, uint16_t hci_command);
+    void send_queued_hci_commands();
+    void send_queued_acl_packets();
+    void handle_hci_num_completed_packets();
+    void selectEventConnection();
+    BluetoothConnection *connectionForBdaddr(const uint8_t *bdaddr);
+    BluetoothConnection *connectionForHandle(uint16_t handle);
+    void addConnectionHandle(BluetoothConnection *connection, uint16_t handle);
+    void removeConnectionHandle(BluetoothConnection *connection);
+    void clearConnectionHandles();
 
     void handle_HCI_IO_CAPABILITY_REQUEST_REPLY();
     void handle_hci_io_capability_request();
@@ -2356,9 +2558,18 @@ private:
     void setHIDProtocol(uint8_t protocol);
     static BTHIDInput *available_bthid_drivers_list;
 
+    // Transmit rings: HCI commands and ACL packets are built in the next free
+    // buffer and stay there until their transfer completes, so more can be
+    // queued behind them.  HCI commands wait in their ring until the
+    // controller grants a command credit (Num_HCI_Command_Packets).
+    // ACL packets likewise wait for a controller buffer (HCI_Read_Buffer_Size,
+    // returned by Number Of Completed Packets).
+    enum {TX_ACL_QUEUE_DEPTH = 8, TX_ACL_BUFFER_SIZE = 256, TX_CMD_QUEUE_DEPTH = 8, TX_CMD_BUFFER_SIZE = 128};
+    enum {TX_SLOT_FREE = 0, TX_SLOT_QUEUED, TX_SLOT_SENDING};
+
     setup_t setup;
     Pipe_t mypipes[4] __attribute__ ((aligned(32)));
-    Transfer_t mytransfers[7] __attribute__ ((aligned(32)));
+    Transfer_t mytransfers[7 + (TX_ACL_QUEUE_DEPTH - 1) + 3 * (TX_CMD_QUEUE_DEPTH - 1)] __attribute__ ((aligned(32)));
     strbuf_t mystring_bufs[2];      // 2 string buffers - one for our device - one for remote device...
     uint16_t        pending_control_ = 0;
     uint16_t        rx_size_ = 0;
@@ -2367,27 +2578,133 @@ private:
     Pipe_t          *rxpipe_;
     Pipe_t          *rx2pipe_;
     Pipe_t          *txpipe_;
-    uint8_t         rxbuf_[256];    // used to receive data from RX, which may come with several packets...
-    uint8_t         rx_packet_data_remaining_ = 0; // how much data remaining
-    uint8_t         txbuf_[256];    // buffer to use to send commands to bluetooth
+    // Events are up to 257 bytes (Remote Name Request Complete) and are read
+    // in whole rx_size_ packets, so leave room for the last packet's tail.
+    uint8_t         rxbuf_[320];    // used to receive data from RX, which may come with several packets...
+    uint16_t        rx_packet_data_remaining_ = 0; // how much data remaining
+    uint8_t         tx_acl_bufs_[TX_ACL_QUEUE_DEPTH][TX_ACL_BUFFER_SIZE];
+    volatile uint8_t tx_acl_state_[TX_ACL_QUEUE_DEPTH] = {};  // TX_SLOT_FREE/QUEUED/SENDING
+    uint8_t         tx_acl_next_ = 0;   // next slot to fill
+    uint8_t         tx_acl_send_ = 0;   // next queued slot to send
+    bool            acl_flow_control_ = false;  // true once we know the controller's buffer count
+    uint16_t        acl_credits_ = 0;   // ACL buffers free in the controller
+    uint16_t        acl_max_packet_length_ = 0;
+    // LE links have their own buffers if HCI_LE_Read_Buffer_Size says so,
+    // else they share the ones above.
+    bool            le_acl_flow_control_ = false;
+    uint16_t        le_acl_credits_ = 0;
+    uint16_t        le_acl_max_packet_length_ = 0;
+    uint16_t        le_connect_max_interval_ = 0;
+    uint8_t         tx_cmd_bufs_[TX_CMD_QUEUE_DEPTH][TX_CMD_BUFFER_SIZE];
+    setup_t         tx_cmd_setups_[TX_CMD_QUEUE_DEPTH];
+    volatile uint8_t tx_cmd_state_[TX_CMD_QUEUE_DEPTH] = {};
+    uint8_t         tx_cmd_next_ = 0;   // next slot to fill
+    uint8_t         tx_cmd_send_ = 0;   // next queued slot to hand to the controller
+    uint8_t         hci_cmd_credits_ = 1;   // commands the controller will accept now
+    uint8_t         hci_cmds_outstanding_ = 0;  // sent, waiting for Command Complete/Status
     uint8_t         rx2buf_[64];    // receive buffer from Bulk end point
-    uint8_t         rx2buf2_[256];   // receive buffer from Bulk end point
-    uint8_t         rx2_packet_data_remaining_ = 0; // how much data remaining
-    uint8_t         rx2_continue_packet_expected_ = 0; // Are we expecting a continue packet. 
+
+    // Connections by their 12 bit HCI handle: open addressed on the low bits
+    // of the handle, which controllers hand out close to sequentially.
+    enum {CONNECTION_HANDLE_TABLE_SIZE = 16};   // power of 2
+    typedef struct {
+        uint16_t            handle;
+        BluetoothConnection *connection;    // nullptr when free
+    } connection_handle_t;
+    connection_handle_t connection_handles_[CONNECTION_HANDLE_TABLE_SIZE];
+
+    // L2CAP packets are put back together here from their HCI ACL fragments,
+    // one slot per connection handle that is part way through a packet.
+    enum {L2CAP_REASSEMBLY_SLOTS = DEFAULT_CONNECTIONS, L2CAP_REASSEMBLY_SIZE = 1024};
+    typedef struct {
+        uint16_t    handle;     // 0xffff when free
+        uint16_t    count;      // bytes in buffer, including the 4 byte HCI header
+        bool        overflow;   // packet did not fit, drop it when complete
+        uint8_t     buffer[L2CAP_REASSEMBLY_SIZE];
+    } l2cap_reassembly_t;
+    l2cap_reassembly_t rx2_reassembly_[L2CAP_REASSEMBLY_SLOTS];
+    l2cap_reassembly_t *rx2_current_ = nullptr; // where the rest of this HCI packet goes
+    uint16_t        rx2_hci_remaining_ = 0;     // bytes of this HCI packet still to read
+    l2cap_reassembly_t *l2capReassemblySlot(uint16_t handle, bool start);
+    void l2capReassemblyAppend(const uint8_t *data, uint16_t cb);
     uint8_t         hciVersion;     // what version of HCI do we have?
 
     bool            do_pair_device_;    // Should we do a pair for a new device?
     const char      *pair_pincode_; // What pin code to use for the pairing
     bool            do_pair_ssp_;   // pair device using SSP
-    USBDriverTimer  timer_;
     uint8_t         my_bdaddr_[6];  // The bluetooth dongles Bluetooth address.
     uint8_t         features[8];    // remember our local features.
 	
+    // LE advertising reports
+    enum {LE_ADV_REPORT_QUEUE_SIZE = 16};
+    BLEAdvertisingReport_t le_adv_reports_[LE_ADV_REPORT_QUEUE_SIZE];
+    volatile uint8_t le_adv_report_head_ = 0;   // written by the USB interrupt
+    volatile uint8_t le_adv_report_tail_ = 0;   // read by readLEAdvertisingReport
+    volatile uint32_t le_adv_reports_dropped_ = 0;
+    void            (*le_adv_report_cb_)(const BLEAdvertisingReport_t &report) = nullptr;
+    bool            le_adv_filter_address_ = false;
+    uint8_t         le_adv_filter_bdaddr_[6];
+    uint16_t        le_adv_filter_uuid16_ = 0;
+    int32_t         le_adv_filter_company_id_ = -1;
+
+    // Devices seen by inquiry, so each is only acted on once per inquiry and
+    // a later connect or name request can use its page scan mode and clock offset.
+    typedef struct {
+        uint8_t     bdaddr[6];
+        uint8_t     page_scan_repetition_mode;
+        int8_t      rssi;           // 127 if not reported
+        uint16_t    clock_offset;   // bit 15 set, valid
+        bool        handled;        // acted on during this inquiry
+        uint32_t    class_of_device;
+        uint32_t    last_seen;      // millis()
+    } inquiry_result_t;
+    enum {INQUIRY_RESULTS_MAX = 16};
+    inquiry_result_t inquiry_results_[INQUIRY_RESULTS_MAX];
+    uint8_t         inquiry_result_count_ = 0;
+    inquiry_result_t *findInquiryResult(const uint8_t *bdaddr);
+    inquiry_result_t *updateInquiryResult(const uint8_t *bdaddr, uint8_t page_scan_repetition_mode, 
+            uint32_t class_of_device, uint16_t clock_offset, int8_t rssi);
+
+    // HCI capture, records are 4 byte aligned in the buffer.
+    typedef struct {
+        uint32_t    timestamp;      // micros()
+        uint16_t    length;         // length of the packet
+        uint16_t    captured;       // bytes of it that follow the record
+        uint8_t     type;           // H4 packet type: 1 command, 2 ACL, 4 event
+        uint8_t     received;
+        uint8_t     reserved[2];
+    } hci_capture_record_t;
+    enum {HCI_CAPTURE_CMD = 1, HCI_CAPTURE_ACL = 2, HCI_CAPTURE_EVENT = 4};
+    uint8_t         *hci_capture_buffer_ = nullptr;
+    uint32_t        hci_capture_size_ = 0;
+    volatile uint32_t hci_capture_used_ = 0;
+    volatile uint32_t hci_capture_dropped_ = 0;
+    volatile bool   hci_capture_enabled_ = false;
+
+    BluetoothStatistics_t stats_ = {};
+
     // key storage info
     FS              *pairing_keys_fs_ = nullptr;
     int             pairing_keys_eeprom_start_index_ = -1;
     int             pairing_keys_max_ = 5;
 
+    // Stored link keys, read once from the FS or EEPROM and looked up here by
+    // bdaddr.  Changes are written through to the storage.
+    enum {LINK_KEY_CACHE_SIZE = 16};    // power of 2
+    typedef struct {
+        bool        used;
+        uint8_t     bdaddr[6];
+        uint8_t     link_key[16];
+    } link_key_entry_t;
+    link_key_entry_t link_key_cache_[LINK_KEY_CACHE_SIZE];
+    bool            link_key_cache_loaded_ = false;
+    bool            link_key_cache_complete_ = false;   // holds every stored key
+    void setupPairingKeysEEPROM();
+    void loadLinkKeyCache();
+    link_key_entry_t *findLinkKey(const uint8_t bdaddr[6]);
+    bool cacheLinkKey(const uint8_t bdaddr[6], const uint8_t link_key[16]);
+    void uncacheLinkKey(const uint8_t bdaddr[6]);
+
     typedef struct {
         uint16_t    idVendor;
         uint16_t    idProduct;
@@ -2512,13 +2829,19 @@ public:
     msInquiryResponse_t msInquiry;
     msRequestSenseResponse_t msSense;
     msDriveInfo_t msDriveInfo;
+    msBlockLimits_t msBlockLimits;
 
     bool mscTransferComplete = false;
     uint8_t mscInit(void);
     void msReset(void);
+    void msResetRecovery(void);
     uint8_t msGetMaxLun(void);
     void msCurrentLun(uint8_t lun) {currentLUN = lun;}
     uint8_t msCurrentLun() {return currentLUN;}
+    // Multi-LUN drives: LUNs after the first one are given their own
+    // (otherwise unused) USBDrive object sharing this drive's transport.
+    USBDrive *lunParent() { return _lun_parent; }
+    USBDrive *nextLUN() { return _next_lun; }
     bool available() { delay(0); return deviceAvailable; }
     uint8_t checkConnectedInitialized(void);
     uint16_t getIDVendor() {return idVendor; }
@@ -2533,14 +2856,27 @@ public:
     uint8_t msReadDeviceCapacity(msSCSICapacity_t * const Capacity);
     uint8_t msDeviceInquiry(msInquiryResponse_t * const Inquiry);
     uint8_t msProcessError(uint8_t msStatus);
+    // DataResidue from the last command's CSW: bytes of the data stage not
+    // transferred.  READ/WRITE with a residue fail with MS_SHORT_TRANSFER.
+    uint32_t msDataResidue() { return _data_residue; }
+    // msSense holds the sense data from the last failed command (zeroed if
+    // REQUEST SENSE failed), so callers can look at it without another command.
+    bool msSenseUnitAttentionEvent();
     uint8_t msRequestSense(msRequestSenseResponse_t * const Sense);
     uint8_t msRequestSense(void *Sense);
+    uint8_t msInquiryVPD(uint8_t page, void *Buffer, uint8_t len);
+    uint8_t msReadBlockLimits(msBlockLimits_t * const Limits);
+    uint8_t msUnmap(const uint32_t BlockAddress, const uint32_t Blocks);
+    uint8_t msWriteSame(const uint32_t BlockAddress, const uint32_t Blocks,
+                        const void * sectorBuffer, bool unmap);
 
     uint8_t msReadBlocks(const uint32_t BlockAddress, const uint16_t Blocks,
                          const uint16_t BlockSize, void * sectorBuffer);
     uint8_t msReadSectorsWithCB(const uint32_t BlockAddress, const uint16_t Blocks, void (*callback)(uint32_t token, uint8_t* data), uint32_t token);
     uint8_t msWriteBlocks(const uint32_t BlockAddress, const uint16_t Blocks,
                           const uint16_t BlockSize,   const void * sectorBuffer);
+    uint8_t msWriteSectorsWithCB(const uint32_t BlockAddress, const uint16_t Blocks,
+                                 const uint8_t * (*callback)(uint32_t sector, void *context), void *context);
 
     bool begin();
     // Not sure of good name here.
@@ -2566,6 +2902,9 @@ public:
     enum {INVALID_VOL = 0, MBR_VOL, EXT_VOL, GPT_VOL}; // what type of volume did the mapping return
     int findPartition(int partition, int &type, uint32_t &firstSector, uint32_t &numSectors,
                       uint32_t &mbrLBA, uint8_t &mbrPart, uint8_t *guid = nullptr);
+    // findPartition() works from a copy of the MBR/EBR/GPT layout read once.
+    // It is dropped on disconnect, format and writes to the partition tables.
+    void invalidatePartitionCache() { _partitions_cached = false; _cPartitions = 0; _cGPTParts = 0; _pt_walk = PT_WALK_MBR; }
 
 
 public:
@@ -2598,7 +2937,8 @@ public:
     // return USB MSC drive status.
     uint32_t status() { return m_errorCode; }
     // return success if sync successful. Not for user apps.
-    bool syncDevice() { return true; }
+    // Flushes any single sector writes still held for coalescing.
+    bool syncDevice();
     // Writes a 512 byte sector to an USB MSC drive.
     bool writeSector(uint32_t sector, const uint8_t* src);
     // Write multiple 512 byte sectors to an USB MSC drive.
@@ -2609,8 +2949,54 @@ public:
                            void (*callback)(uint32_t, uint8_t *), uint32_t token);
     bool readSectorsCallback(uint32_t sector, uint8_t* dst, size_t numSectors,
                              void (*callback)(uint32_t sector, uint8_t *buf, void *context), void *context);
-    //bool writeSectorsCallback(uint32_t sector, size_t numSectors,
-    //  const uint8_t * (*callback)(uint32_t sector, void *context), void *context);
+    // Write multiple 512 byte sectors to an USB MSC drive, with one WRITE
+    // command, asking the callback for each sector as the pipe drains.
+    // The callback is called from the USB interrupt and the buffer it returns
+    // must stay valid until the callback is called two more times (or the
+    // write completes).  Returning nullptr aborts the write.  More than
+    // 65535 sectors are sent as several WRITE commands.
+    bool writeSectorsCallback(uint32_t sector, size_t numSectors,
+                              const uint8_t * (*callback)(uint32_t sector, void *context), void *context);
+
+    // Tell the drive the sectors are no longer in use (TRIM), using UNMAP or
+    // WRITE SAME with the UNMAP bit, if the drive says it supports them.
+    // WRITE SAME sends one 512 byte sector, so only with 512 byte blocks.
+    bool discard(uint32_t sector, uint32_t count);
+    bool discardSupported() { return msBlockLimits.unmap || ((msDriveInfo.capacity.BlockSize == 512) &&
+        (msBlockLimits.writeSame16Unmap || msBlockLimits.writeSame10Unmap)); }
+    // True if discarded sectors will read back as zeros.
+    bool discardZeroes() { return discardSupported() && msBlockLimits.unmapReadsZero; }
+    // Write the one 512 byte sector in src to count sectors with WRITE SAME,
+    // only offered by drives with 512 byte blocks reporting a Maximum Write
+    // Same Length.
+    bool writeSameSupported() { return (msBlockLimits.maxWriteSameLength != 0) && (msDriveInfo.capacity.BlockSize == 512); }
+    bool writeSame(uint32_t sector, uint32_t count, const uint8_t* src);
+
+    // Optional: single sector writes to consecutive sectors are held and merged
+    // into one multi-block WRITE.  writeSector() then returns before the data
+    // reaches the drive, so call syncDevice() before relying on it.  They are
+    // flushed on a non-adjacent write, a read that overlaps them, syncDevice(),
+    // or from Task() after WRITE_COALESCE_TIMEOUT_MS.  Held writes that fail to
+    // flush are kept, and the error is returned by the next writeSector() or
+    // syncDevice().  Enabling allocates a WRITE_COALESCE_SECTORS buffer.
+    bool writeCoalescing(bool enable);
+    bool writeCoalescing() { return _coalesce_enabled; }
+    bool flushCoalescedWrites();
+    // Stats: sectors passed in as single sector writes and the WRITE commands
+    // used to send them.  The merge ratio is sectors / commands.
+    uint32_t coalescedSectors() { return _coalesce_sectors; }
+    uint32_t coalescedWriteCommands() { return _coalesce_commands; }
+    void resetCoalesceStats() { _coalesce_sectors = 0; _coalesce_commands = 0; }
+
+    // I/O statistics: count, errors, bytes and a latency histogram for each
+    // kind of command, and failed commands by sense key/ASC/ASCQ.
+    enum {STATS_READ = 0, STATS_WRITE, STATS_TEST_UNIT_READY, STATS_REQUEST_SENSE, STATS_OTHER, STATS_COMMAND_TYPES};
+    const msCommandStats_t &commandStats(uint8_t command_type) { return _cmd_stats[command_type]; }
+    const msSenseStats_t &senseStats(uint8_t index) { return _sense_stats[index]; }
+    uint32_t senseStatsOther() { return _sense_stats_other; }  // did not fit in the table
+    uint32_t transportErrors() { return _transport_errors; }   // phase, CSW tag and signature errors
+    void resetStats();
+    void printStats(Print &p);
 
 protected:
     virtual bool claim(Device_t *device, int type, const uint8_t *descriptors, uint32_t len);
@@ -2622,8 +3008,22 @@ protected:
     void new_dataIn(const Transfer_t *transfer);
     void new_dataOut(const Transfer_t *transfer);
     void init();
+    void mscInitStart(void);
+    uint8_t mscInitDriveInfo(void);
+    void startMediaReady();
+    bool mediaReadyStep(uint8_t &msResult);
+    void attachLUNs();
+    USBDrive *transport() { return _lun_parent ? _lun_parent : this; }
+    bool msAcquireTransport();
     uint8_t msDoCommand(msCommandBlockWrapper_t *CBW, void *buffer);
+    uint8_t msTransferCommand(msCommandBlockWrapper_t *CBW, void *buffer);
     uint8_t msGetCSW(void);
+    void msClearHalt(uint32_t endpoint);
+    void msClearStalledEndpoints();
+    uint8_t msCheckResidue(const msCommandBlockWrapper_t *CBW, uint8_t CSWResult);
+    void msRecordStats(const msCommandBlockWrapper_t *CBW, uint8_t CSWResult, uint32_t us);
+    uint8_t msFetchSense();
+    void msRecordSense();
 private:
     Pipe_t mypipes[3] __attribute__ ((aligned(32)));
     Transfer_t mytransfers[7] __attribute__ ((aligned(32)));
@@ -2650,8 +3050,18 @@ private:
     volatile bool msOutCompleted = false;
     volatile bool msInCompleted = false;
     volatile bool msControlCompleted = false;
+    volatile bool msInHalted = false;   // the device STALLed a bulk endpoint
+    volatile bool msOutHalted = false;
     uint32_t CBWTag = 0;
+    uint32_t _data_residue = 0;
+    msCommandStats_t _cmd_stats[STATS_COMMAND_TYPES] = {};
+    msSenseStats_t _sense_stats[MS_STATS_SENSE_ENTRIES] = {};
+    uint32_t _sense_stats_other = 0;
+    uint32_t _transport_errors = 0;
     bool deviceAvailable = false;
+    volatile bool _transport_busy = false;  // a command is using the pipes
+    USBDrive *_lun_parent = nullptr;        // drive whose pipes we use (LUN > 0)
+    USBDrive *_next_lun = nullptr;          // list of our other LUNs
     // experiment with transfers with callbacks.
     void (*_read_sectors_callback)(uint32_t token, uint8_t* data) = nullptr;
     uint32_t _read_sectors_token = 0;
@@ -2660,13 +3070,70 @@ private:
     elapsedMillis _emlastRead;
     uint8_t _read_sector_buffer1[512];
     uint8_t _read_sector_buffer2[512];
+    // producer callback writes, see writeSectorsCallback()
+    const uint8_t * (*_write_sectors_callback)(uint32_t sector, void *context) = nullptr;
+    void *_write_sectors_context = nullptr;
+    uint32_t _write_sectors_next = 0;         // next sector to ask the callback for
+    uint16_t _write_sectors_to_queue = 0;     // sectors not yet handed to the pipe
+    volatile uint16_t _write_sectors_in_flight = 0;
+    volatile bool _write_sectors_aborted = false;
+    enum {WRITE_CALLBACK_QUEUE_DEPTH = 2, WRITE_CALLBACK_TIMEOUT_MS = 250};
+    elapsedMillis _emlastWrite;
+    bool queueNextWriteSector();
+    // single sector write coalescing, see writeCoalescing()
+    enum {WRITE_COALESCE_SECTORS = 8, WRITE_COALESCE_TIMEOUT_MS = 50};
+    bool coalesceWriteSector(uint32_t sector, const uint8_t* src);
+    bool _coalesce_enabled = false;
+    uint32_t _coalesce_start = 0;
+    uint8_t _coalesce_count = 0;
+    uint8_t _coalesce_error = 0;  // failed flush from Task(), not reported yet
+    uint32_t _coalesce_sectors = 0;
+    uint32_t _coalesce_commands = 0;
+    elapsedMillis _emlastCoalesce;
+    uint8_t *_coalesce_buffer = nullptr;  // 32 byte aligned in _coalesce_buffer_alloc
+    uint8_t *_coalesce_buffer_alloc = nullptr;
     bool m_initDone = false;
     uint8_t m_errorCode = MS_NO_MEDIA_ERR;
     uint32_t m_errorLine = 0;
     USBFSBase *claimed_filesystem_list = nullptr;
-    enum {USBDRIVE_NOT_CONNECTED = 0, USBDRIVE_CONNECTED = 1, USBDRIVE_FS_STARTED = 2};
+    enum {USBDRIVE_NOT_CONNECTED = 0, USBDRIVE_CONNECTED = 1, USBDRIVE_FS_STARTED = 2, USBDRIVE_MOUNTING = 3};
     int _drive_connect_fs_status = USBDRIVE_NOT_CONNECTED;
+    int _mount_part = 0;  // next partition to offer the filesystems while USBDRIVE_MOUNTING
+    enum {MOUNT_MEDIA_READY = 0, MOUNT_PARTITIONS, MOUNT_NO_MEDIUM};
+    uint8_t _mount_step = MOUNT_MEDIA_READY;
+    bool mountStep(bool &file_system_claimed);
+    // Test Unit Ready polling, see WaitMediaReady()
+    uint32_t _media_ready_start = 0;
+    uint32_t _media_ready_backoff = 1;
+    uint32_t _media_ready_wait = 0;
+    elapsedMillis _emMediaReady;
     int _cGPTParts = 0;  // if GPT cache of parts.
+    enum {MAX_CACHED_PARTITIONS = 16};
+    typedef struct {
+        uint8_t voltype;
+        uint8_t type;
+        uint8_t mbrPart;
+        uint32_t firstSector;
+        uint32_t numSectors;
+        uint32_t mbrLBA;
+        uint8_t guid[16];
+    } cachedPartition_t;
+    cachedPartition_t _partitions[MAX_CACHED_PARTITIONS];
+    uint8_t _cPartitions = 0;            // entries in _partitions, invalid ones included
+    bool _partitions_cached = false;
+    bool _partitions_complete = false;   // partitions past _cPartitions are all invalid
+    uint32_t _partition_table_last = 0;  // last MBR/GPT table sector we read
+    // where cachePartitionsStep() is in the partition tables
+    enum {PT_WALK_MBR = 0, PT_WALK_GPT_HEADER, PT_WALK_GPT_ENTRIES, PT_WALK_EBR};
+    uint8_t _pt_walk = PT_WALK_MBR;
+    int8_t _pt_ext_index = -1;        // MBR slot of the extended partition
+    uint32_t _pt_walk_sector = 0;     // next EBR to read, 0 at the end of the chain
+    MbrPart_t _pt_mbr_part[4];        // MBR table while we read the EBRs
+    void cachePartitions();
+    bool cachePartitionsStep();
+    int scanPartition(int partition, int &type, uint32_t &firstSector, uint32_t &numSectors,
+                      uint32_t &mbrLBA, uint8_t &mbrPart, uint8_t *guid);
+    void checkPartitionTableWrite(uint32_t sector, uint32_t count);
 
     static USBDrive *s_first_drive;
     static bool s_connected_filesystems_changed;
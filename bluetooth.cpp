@@ -235,9 +235,25 @@ bool BluetoothController::claim(Device_t *dev, int type, const uint8_t *descript
     queue_Data_Transfer_Debug(rxpipe_, rxbuf_, rx_size_, this, __LINE__);
 
     rx2pipe_->callback_function = rx2_callback;
+    clearConnectionHandles();
+    for (uint8_t i = 0; i < L2CAP_REASSEMBLY_SLOTS; i++) rx2_reassembly_[i].handle = 0xffff;
+    rx2_current_ = nullptr;
+    rx2_hci_remaining_ = 0;
     queue_Data_Transfer_Debug(rx2pipe_, rx2buf_, rx2_size_, this, __LINE__);
 
     txpipe_->callback_function = tx_callback;
+    for (uint8_t i = 0; i < TX_ACL_QUEUE_DEPTH; i++) tx_acl_state_[i] = TX_SLOT_FREE;
+    for (uint8_t i = 0; i < TX_CMD_QUEUE_DEPTH; i++) tx_cmd_state_[i] = TX_SLOT_FREE;
+    tx_acl_next_ = 0;
+    tx_acl_send_ = 0;
+    acl_flow_control_ = false;  // until HCI_Read_Buffer_Size tells us
+    acl_credits_ = 0;
+    le_acl_flow_control_ = false;
+    le_acl_credits_ = 0;
+    tx_cmd_next_ = 0;
+    tx_cmd_send_ = 0;
+    hci_cmd_credits_ = 1;   // Controller accepts one command until it tells us otherwise
+    hci_cmds_outstanding_ = 0;
 
     // Send out the reset
     device = dev; // yes this is normally done on return from this but should not hurt if we do it here.
@@ -262,13 +278,20 @@ void BluetoothController::disconnect()
                 current_connection_->remote_name_[0] = 0;
                 current_connection_->device_driver_ = nullptr;
             }
+            current_connection_->releaseCollectionDrivers();
             current_connection_->btController_ = nullptr;
         }
         current_connection_ = current_connection_->next_;
     }
     // Maybe leave it pointing to first one just in case.
+    clearConnectionHandles();
+    for (uint8_t i = 0; i < HID_DESCRIPTOR_BUFFERS; i++) {
+        if (hid_descriptor_owners_[i]) freeHIDDescriptorBuffer(hid_descriptor_owners_[i]);
+    }
+    for (uint8_t i = 0; i < DEFAULT_CONNECTIONS; i++) {
+        if (hid_field_owners_[i]) freeHIDDescriptorBuffer(hid_field_owners_[i]);
+    }
     count_connections_ = 0;
-    timer_connection_ = nullptr;
     current_connection_ = BluetoothConnection::s_first_;
     USBHDBGSerial.printf("Bluetooth Disconnect complete"); USBHDBGSerial.flush();
 }
@@ -276,10 +299,9 @@ void BluetoothController::disconnect()
 void BluetoothController::timer_event(USBDriverTimer *whichTimer)
 {
     DBGPrintf("BT::Timer_event(%p)->%p\n", whichTimer, whichTimer->pointer);DBGFlush();
-    if (whichTimer == &timer_) {
-        if (timer_connection_) timer_connection_->timer_event(whichTimer);
-    } else if (whichTimer->pointer) {
+    if (whichTimer->pointer) {
         BluetoothConnection* btc = (BluetoothConnection*)(whichTimer->pointer);
+        current_connection_ = btc;  // what it sends goes to its own device
         btc->timer_event(whichTimer);
     }
 
@@ -289,6 +311,10 @@ void BluetoothController::timer_event(USBDriverTimer *whichTimer)
 void BluetoothController::control(const Transfer_t *transfer)
 {
     println("    control callback (bluetooth) ", pending_control_, HEX);
+    // HCI command sent, its ring buffer is free again.
+    for (uint8_t i = 0; i < TX_CMD_QUEUE_DEPTH; i++) {
+        if (transfer->buffer == tx_cmd_bufs_[i]) tx_cmd_state_[i] = TX_SLOT_FREE;
+    }
 #ifdef DEBUG_BT_VERBOSE
     DBGPrintf("    Control callback (bluetooth): %d : ", pending_control_);
     uint8_t *buffer = (uint8_t*)transfer->buffer;
@@ -297,22 +323,18 @@ void BluetoothController::control(const Transfer_t *transfer)
 #endif
 }
 
-bool BluetoothController::setTimer(BluetoothConnection *connection, uint32_t us)  // set to NULL ptr will clear:
+// Each connection has its own timer, so devices connecting at the same time
+// do not take it from each other.
+bool BluetoothController::setTimer(BluetoothConnection *connection, uint32_t us)  // 0 us will clear
 {
     static uint32_t millis_last = 0;
     DBGPrintf("BluetoothController::setTimer(%p, %u) TO:%u, dt:%u\n", connection, us,
         millis(), millis()-millis_last);
     millis_last = millis();
-    if (connection == nullptr) {
-        timer_connection_ = nullptr;
-        timer_.stop();
-        return true;
-    } else if ((timer_connection_ == nullptr) || (connection == timer_connection_)) {
-        timer_connection_ = connection;
-        timer_.start(us);
-        return true;
-    }
-    return false;
+    if (connection == nullptr) return false;
+    connection->connection_timer_.stop();
+    if (us) connection->connection_timer_.start(us);
+    return true;
 }
 
 
@@ -477,6 +499,9 @@ void BluetoothController::rx_data(const Transfer_t *transfer)
     rx_packet_data_remaining_ -= len;   // remove the length of this packet from length
 
     if (rx_packet_data_remaining_ == 0) {   // read started at beginning of packet so get the total length of packet
+        if (hci_capture_enabled_) captureHCIPacket(HCI_CAPTURE_EVENT, true, rxbuf_, rxbuf_[1] + 2, rxbuf_[1] + 2);
+        uint32_t start_cycles = ARM_DWT_CYCCNT;
+        selectEventConnection();
         switch (rxbuf_[0]) { // Switch on event type
         case EV_COMMAND_COMPLETE: //0x0e
             handle_hci_command_complete();// Check if command succeeded
@@ -581,6 +606,12 @@ void BluetoothController::rx_data(const Transfer_t *transfer)
 		case EV_MAX_SLOTS_CHANGE:
 			USBHDBGSerial.printf("Received Max Slot change Msg\n");
 			break;
+        case EV_MODE_CHANGE:    // 0x14
+            handle_hci_mode_change();
+            break;
+        case EV_QOS_SETUP_COMPLETE: // 0x0d
+            handle_hci_qos_setup_complete();
+            break;
 		case EV_USER_CONFIRMATION_REQUEST:
 			handle_hci_user_confirmation_request_reply();
 			break;
@@ -615,8 +646,7 @@ void BluetoothController::rx_data(const Transfer_t *transfer)
                 rxbuf_[9], rxbuf_[9]?  "Peripheral" : "Central" );
             break;
         case EV_NUM_COMPLETE_PKT: //13 05 01 47 00 01 00 
-            VDBGPrintf("    NUM_COMPLETE_PKT: ch:%u fh:%04x comp:%u\n",
-                rxbuf_[2], rxbuf_[3] + (rxbuf_[4] << 8), rxbuf_[rxbuf_[1]] + (rxbuf_[rxbuf_[1] + 1] << 8) );
+            handle_hci_num_completed_packets();
             break;
         case EV_LE_META_EVENT:
             handle_ev_meta_event(); // 0x3e
@@ -624,6 +654,10 @@ void BluetoothController::rx_data(const Transfer_t *transfer)
         default:
             break;
         }
+        uint32_t cycles = ARM_DWT_CYCCNT - start_cycles;
+        stats_.events++;
+        stats_.event_cycles += cycles;
+        if (cycles > stats_.event_cycles_max) stats_.event_cycles_max = cycles;
         // Start read at start of buffer.
         queue_Data_Transfer_Debug(rxpipe_, rxbuf_, rx_size_, this, __LINE__);
     } else {
@@ -796,8 +830,10 @@ void print_supported_features(uint8_t *cmd_data) {
 // Called when an HCI command completes.
 void BluetoothController::handle_hci_command_complete()
 {
+    // <event type><param count><num packets allowed to be sent><CMD><CMD><status>...
     uint16_t hci_command = rxbuf_[3] + (rxbuf_[4] << 8);
     uint8_t buffer_index;
+    update_hci_command_credits(rxbuf_[2], hci_command);
     #ifdef DEBUG_BT_VERBOSE
     if (!rxbuf_[5]) {
         VDBGPrintf("    Command Completed! \n");
@@ -864,6 +900,13 @@ void BluetoothController::handle_hci_command_complete()
         }
         break;
     case HCI_Read_Buffer_Size:  // 0x1005
+        // <status><ACL len><ACL len><SCO len><ACL cnt><ACL cnt><SCO cnt><SCO cnt>
+        if (!rxbuf_[5]) {
+            acl_max_packet_length_ = rxbuf_[6] + (rxbuf_[7] << 8);
+            acl_credits_ = rxbuf_[9] + (rxbuf_[10] << 8);
+            acl_flow_control_ = (acl_credits_ != 0);
+            DBGPrintf("    ACL Buffer Size: Size:%u, cnt:%u\n", acl_max_packet_length_, acl_credits_);
+        }
         break;
     case HCI_Read_BD_ADDR:  //0x1009
     {
@@ -881,9 +924,15 @@ void BluetoothController::handle_hci_command_complete()
 		}
         break;
     case HCI_LE_Read_Buffer_Size:   //0x2002
+        // <status><LE ACL len><LE ACL len><LE ACL cnt>, 0 if shared with BR/EDR
         {
             DBGPrintf("LE Buffer Size: Size:%u, cnt:%u\n",
                 rxbuf_[6] + (rxbuf_[7] << 8), rxbuf_[8]);
+            if (!rxbuf_[5] && rxbuf_[8] && (rxbuf_[6] || rxbuf_[7])) {
+                le_acl_max_packet_length_ = rxbuf_[6] + (rxbuf_[7] << 8);
+                le_acl_credits_ = rxbuf_[8];
+                le_acl_flow_control_ = true;
+            }
         }
         break;
     case HCI_LE_Read_Local_supported_Features:  //0x2003
@@ -921,7 +970,14 @@ void BluetoothController::handle_hci_command_complete()
     case HCI_WRITE_LOCAL_NAME:              //0x0c13
         break;
     case HCI_WRITE_SCAN_ENABLE:             //0x0c1a
-        current_connection_->handle_HCI_WRITE_SCAN_ENABLE_complete(rxbuf_);
+        // Sent by whichever connection finished its channels last, maybe
+        // not the current one: let every connection that is waiting go on.
+        for (BluetoothConnection *connection = BluetoothConnection::s_first_; connection; connection = connection->next_) {
+            if ((connection->btController_ == this) && (connection->connection_complete_ == CCON_ALL)) {
+                current_connection_ = connection;
+                connection->handle_HCI_WRITE_SCAN_ENABLE_complete(rxbuf_);
+            }
+        }
         break;
 	case HCI_READ_SIMPLE_PAIRING_MODE:                    //0x0c55
 		break;
@@ -942,7 +998,7 @@ void BluetoothController::handle_hci_command_complete()
         break;
 
     case HCI_OP_ROLE_DISCOVERY: // 0x0809
-        current_connection_->handle_HCI_OP_ROLE_DISCOVERY_complete(rxbuf_);
+        if (current_connection_) current_connection_->handle_HCI_OP_ROLE_DISCOVERY_complete(rxbuf_);
         break;
 
     case HCI_INQUIRY_CANCEL: // 0x0402
@@ -970,6 +1026,48 @@ void BluetoothController::handle_hci_command_complete()
     }
     // And queue up the next command
     queue_next_hci_command();
+
+    // The first part of the init sequence does not depend on the results,
+    // so use any extra credits the controller gave us to run it ahead.
+    while ((pending_control_ > PC_RESET) && (pending_control_ < PC_READ_LOCAL_VERSION)
+            && (hci_cmd_credits_ > 0)) {
+        queue_next_hci_command();
+    }
+}
+
+//===================================================================
+// Command Complete and Command Status both tell us how many more
+// commands the controller will take.  Opcode 0 is a NOP that only
+// updates the credits.
+void BluetoothController::update_hci_command_credits(uint8_t credits, uint16_t hci_command)
+{
+    if (hci_command && hci_cmds_outstanding_) hci_cmds_outstanding_--;
+    hci_cmd_credits_ = credits;
+    VDBGPrintf("    HCI command credits:%u outstanding:%u\n", hci_cmd_credits_, hci_cmds_outstanding_);
+    send_queued_hci_commands();
+}
+
+//===================================================================
+// Hand queued HCI commands to the controller while it has credits.
+// Called with the queue filled by sendHCICommand.
+void BluetoothController::send_queued_hci_commands()
+{
+    bool irq_was_enabled = NVIC_IS_ENABLED(IRQ_USBHS);
+    NVIC_DISABLE_IRQ(IRQ_USBHS);
+    while (hci_cmd_credits_ && (tx_cmd_state_[tx_cmd_send_] == TX_SLOT_QUEUED)) {
+        uint8_t index = tx_cmd_send_;
+        tx_cmd_send_ = (index + 1) % TX_CMD_QUEUE_DEPTH;
+        if (!queue_Control_Transfer(device, &tx_cmd_setups_[index], tx_cmd_bufs_[index], this)) {
+            tx_cmd_state_[index] = TX_SLOT_FREE;
+            println("sendHCICommand failed");
+            continue;
+        }
+        tx_cmd_state_[index] = TX_SLOT_SENDING;
+        if (hci_capture_enabled_) captureHCIPacket(HCI_CAPTURE_CMD, false, tx_cmd_bufs_[index], tx_cmd_bufs_[index][2] + 3, tx_cmd_bufs_[index][2] + 3);
+        hci_cmd_credits_--;
+        hci_cmds_outstanding_++;
+    }
+    if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
 }
 
 void BluetoothController::queue_next_hci_command()
@@ -1009,6 +1107,11 @@ void BluetoothController::queue_next_hci_command()
         sendHCICommand(HCI_LE_Read_Buffer_Size, 0, nullptr);
         pending_control_++;
         break;
+    case PC_READ_BUFFER_SIZE:
+        DBGPrintf("HCI_Read_Buffer_Size\n");
+        sendHCICommand(HCI_Read_Buffer_Size, 0, nullptr);
+        pending_control_++;
+        break;
     case PC_WRITE_CLASS_DEVICE:
         sendHDCWriteClassOfDev();
         pending_control_++;
@@ -1036,6 +1139,9 @@ void BluetoothController::queue_next_hci_command()
         break;
 
     case PC_READ_LOCAL_VERSION:
+        // Its completion picks the next step, so let the pipelined
+        // commands ahead of it finish first.
+        if (hci_cmds_outstanding_) break;
         sendHCIReadLocalVersionInfo();
         pending_control_++;
         break;
@@ -1090,6 +1196,7 @@ void BluetoothController::handle_hci_command_status()
 {
     // <event type><param count><status><num packets allowed to be sent><CMD><CMD>
     uint16_t hci_command = rxbuf_[4] + (rxbuf_[5] << 8);
+    update_hci_command_credits(rxbuf_[3], hci_command);
     #ifdef DEBUG_BT_VERBOSE
     DBGPrintf("    Command %x(", hci_command);
     switch (hci_command) {
@@ -1106,7 +1213,11 @@ void BluetoothController::handle_hci_command_status()
         case 0x041b: DBGPrintf("HCI_OP_READ_REMOTE_FEATURES"); break;
         case 0x041c: DBGPrintf("HCI_OP_READ_REMOTE_EXTENDED_FEATURE"); break;
         case 0x041D: DBGPrintf("HCI_OP_READ_REMOTE_VERSION_INFORMATION"); break;
+        case 0x0803: DBGPrintf("HCI_SNIFF_MODE"); break;
+        case 0x0804: DBGPrintf("HCI_EXIT_SNIFF_MODE"); break;
+        case 0x0807: DBGPrintf("HCI_QOS_SETUP"); break;
         case 0x0809: DBGPrintf("HCI_OP_ROLE_DISCOVERY"); break;
+        case 0x080d: DBGPrintf("HCI_WRITE_LINK_POLICY_SETTINGS"); break;
         case 0x080f: DBGPrintf("HCI_Write_Default_Link_Policy_Settings"); break;
         case 0x0c01: DBGPrintf("HCI_Set_Event_Mask"); break;
         case 0x0c03: DBGPrintf("HCI_RESET"); break;
@@ -1121,6 +1232,7 @@ void BluetoothController::handle_hci_command_status()
         case 0x0c23: DBGPrintf("HCI_READ_CLASS_OF_DEVICE"); break;
         case 0x0C24: DBGPrintf("HCI_WRITE_CLASS_OF_DEV"); break;
         case 0x0c25: DBGPrintf("HCI_Read_Voice_Setting"); break;
+        case 0x0c28: DBGPrintf("HCI_WRITE_AUTOMATIC_FLUSH_TIMEOUT"); break;
         case 0x0c38: DBGPrintf("HCI_Read_Number_Of_Supported_IAC"); break;
         case 0x0c39: DBGPrintf("HCI_Read_Current_IAC_LAP"); break;
         case 0x0c45: DBGPrintf("HCI_WRITE_INQUIRY_MODE"); break;
@@ -1180,19 +1292,32 @@ void BluetoothController::handle_hci_inquiry_result(bool fRSSI)
     // Wondered if multiple items if all of the BDADDR are first then next field...
     // looks like it is that way...
     // Section 7.7.2
-    if (fRSSI) DBGPrintf("    Inquiry Result with RSSI - Count: %d\n", rxbuf_[2]);
-    else DBGPrintf("    Inquiry Result - Count: %d\n", rxbuf_[2]);
-    for (uint8_t i = 0; i < rxbuf_[2]; i++) {
-        uint8_t index_bd = 3 + (i * 6);
-        uint8_t index_ps = 3 + (6 * rxbuf_[2]) + i;
-        uint8_t index_class = 3 + (9 * rxbuf_[2]) + i;
-        uint8_t index_clock_offset = 3 + (12 * rxbuf_[2]) + i;
+    // The same device is usually reported many times during an inquiry, it
+    // is only acted on the first time, later results just update the table.
+    uint8_t count = rxbuf_[2];
+    if (fRSSI) DBGPrintf("    Inquiry Result with RSSI - Count: %d\n", count);
+    else DBGPrintf("    Inquiry Result - Count: %d\n", count);
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t index_bd = 3 + (i * 6);
+        uint16_t index_ps = 3 + (6 * count) + i;
+        uint16_t index_class = 3 + (9 * count) + (i * 3);
+        uint16_t index_clock_offset = 3 + (12 * count) + (i * 2);
+        int8_t rssi = 127;
         if (fRSSI) {
             // Handle the differences in offsets here...
-            index_class = 3 + (8 * rxbuf_[2]) + i;
-            index_clock_offset = 3 + (11 * rxbuf_[2]) + i;
+            index_class = 3 + (8 * count) + (i * 3);
+            index_clock_offset = 3 + (11 * count) + (i * 2);
+            rssi = (int8_t)rxbuf_[3 + (13 * count) + i];
         }
         uint32_t bluetooth_class = rxbuf_[index_class] + ((uint32_t)rxbuf_[index_class + 1] << 8) + ((uint32_t)rxbuf_[index_class + 2] << 16);
+        uint16_t clock_offset = rxbuf_[index_clock_offset] + ((uint16_t)rxbuf_[index_clock_offset + 1] << 8);
+        inquiry_result_t *result = updateInquiryResult(&rxbuf_[index_bd], rxbuf_[index_ps], bluetooth_class, clock_offset, rssi);
+        if (result->handled) {
+            VDBGPrintf("      BD:%x:%x:%x:%x:%x:%x already seen RSSI:%d\n",
+                  rxbuf_[index_bd], rxbuf_[index_bd + 1], rxbuf_[index_bd + 2], rxbuf_[index_bd + 3], rxbuf_[index_bd + 4], rxbuf_[index_bd + 5], rssi);
+            continue;
+        }
+        result->handled = true;
         DBGPrintf("      BD:%x:%x:%x:%x:%x:%x, PS:%d, class: %x\n",
                   rxbuf_[index_bd], rxbuf_[index_bd + 1], rxbuf_[index_bd + 2], rxbuf_[index_bd + 3], rxbuf_[index_bd + 4], rxbuf_[index_bd + 5],
                   rxbuf_[index_ps], bluetooth_class);
@@ -1226,9 +1351,9 @@ void BluetoothController::handle_hci_inquiry_result(bool fRSSI)
             count_connections_++;
 
             // BUGBUG, lets hard code to go to new state...
-            current_connection_->device_ps_repetion_mode_ = rxbuf_[index_ps]; // mode
-            current_connection_->device_clock_offset_[0] = rxbuf_[index_clock_offset];
-            current_connection_->device_clock_offset_[1] = rxbuf_[index_clock_offset + 1];
+            current_connection_->device_ps_repetion_mode_ = result->page_scan_repetition_mode; // mode
+            current_connection_->device_clock_offset_[0] = result->clock_offset & 0xff;
+            current_connection_->device_clock_offset_[1] = result->clock_offset >> 8;
 
             current_connection_->initializeConnection(this, &rxbuf_[index_bd], bluetooth_class, true);
 
@@ -1249,6 +1374,72 @@ void BluetoothController::handle_hci_inquiry_result(bool fRSSI)
         }
     }
 }
+//=============================================================================
+// Link mode and QoS events for a connection
+//=============================================================================
+void BluetoothController::handle_hci_mode_change()
+{
+    //       ST  handle  mode  interval
+    // 14 06 00  47 00   02    12 00
+    uint16_t handle = rxbuf_[3] + ((uint16_t)rxbuf_[4] << 8);
+    DBGPrintf("    Mode Change - ST:%x handle:%x mode:%u interval:%u\n", rxbuf_[2], handle, rxbuf_[5],
+              rxbuf_[6] + (rxbuf_[7] << 8));
+    if (rxbuf_[2]) return;
+    BluetoothConnection *connection = connectionForHandle(handle);
+    if (!connection) return;
+    connection->link_mode_ = rxbuf_[5];
+    connection->link_mode_interval_ = rxbuf_[6] + (rxbuf_[7] << 8);
+}
+
+void BluetoothController::handle_hci_qos_setup_complete()
+{
+    //       ST  handle  flags  service  token rate  peak bandwidth  latency  delay variation
+    // 0d 15 00  47 00   00     02       ...
+    uint16_t handle = rxbuf_[3] + ((uint16_t)rxbuf_[4] << 8);
+    uint32_t latency = rxbuf_[15] + ((uint32_t)rxbuf_[16] << 8) + ((uint32_t)rxbuf_[17] << 16) + ((uint32_t)rxbuf_[18] << 24);
+    DBGPrintf("    QoS Setup Complete - ST:%x handle:%x service:%u latency:%u\n", rxbuf_[2], handle, rxbuf_[6], latency);
+    if (rxbuf_[2]) return;
+    BluetoothConnection *connection = connectionForHandle(handle);
+    if (connection) connection->qos_latency_us_ = latency;
+}
+
+//=============================================================================
+// Inquiry result table
+//=============================================================================
+BluetoothController::inquiry_result_t *BluetoothController::findInquiryResult(const uint8_t *bdaddr)
+{
+    for (uint8_t i = 0; i < inquiry_result_count_; i++) {
+        if (memcmp(inquiry_results_[i].bdaddr, bdaddr, 6) == 0) return &inquiry_results_[i];
+    }
+    return nullptr;
+}
+
+// Returns the entry for bdaddr updated with this result, a new entry
+// replaces the one seen least recently when the table is full.
+BluetoothController::inquiry_result_t *BluetoothController::updateInquiryResult(const uint8_t *bdaddr, 
+        uint8_t page_scan_repetition_mode, uint32_t class_of_device, uint16_t clock_offset, int8_t rssi)
+{
+    inquiry_result_t *result = findInquiryResult(bdaddr);
+    if (!result) {
+        if (inquiry_result_count_ < INQUIRY_RESULTS_MAX) {
+            result = &inquiry_results_[inquiry_result_count_++];
+        } else {
+            result = &inquiry_results_[0];
+            for (uint8_t i = 1; i < INQUIRY_RESULTS_MAX; i++) {
+                if ((int32_t)(inquiry_results_[i].last_seen - result->last_seen) < 0) result = &inquiry_results_[i];
+            }
+        }
+        memcpy(result->bdaddr, bdaddr, 6);
+        result->handled = false;
+    }
+    result->page_scan_repetition_mode = page_scan_repetition_mode;
+    result->class_of_device = class_of_device;
+    result->clock_offset = clock_offset | 0x8000;   // Clock_Offset_Valid_Flag
+    result->rssi = rssi;
+    result->last_seen = millis();
+    return result;
+}
+
 #if 0
 void BluetoothController::handle_hci_extended_inquiry_result()
 {
@@ -1400,7 +1591,7 @@ void BluetoothController::handle_hci_connection_complete() {
     //  0  1  2  3  4  5  6  7  8 9  10 11 12
     //       ST CH CH BD BD BD BD BD BD LT EN
     // 03 0b 04 00 00 40 25 00 58 4b 00 01 00
-    current_connection_->device_connection_handle_ = rxbuf_[3] + (uint16_t)(rxbuf_[4] << 8);
+    addConnectionHandle(current_connection_, rxbuf_[3] + (uint16_t)(rxbuf_[4] << 8));
 
 
     DBGPrintf("    Connection Complete - ST:%x LH:%x\n", rxbuf_[2], current_connection_->device_connection_handle_);
@@ -1495,10 +1686,12 @@ void BluetoothController::handle_hci_incoming_connect() {
         }
         count_connections_++;
 
-        // Lets reinitialize some of the fields of this back to startup settings.
-        current_connection_->device_ps_repetion_mode_ = 1; // mode we were always using?
-        current_connection_->device_clock_offset_[0] = 0;
-        current_connection_->device_clock_offset_[1] = 0;
+        // Lets reinitialize some of the fields of this back to startup settings,
+        // or to what we know of the device from an earlier inquiry.
+        inquiry_result_t *result = findInquiryResult(&rxbuf_[2]);
+        current_connection_->device_ps_repetion_mode_ = result? result->page_scan_repetition_mode : 1; // mode we were always using?
+        current_connection_->device_clock_offset_[0] = result? (result->clock_offset & 0xff) : 0;
+        current_connection_->device_clock_offset_[1] = result? (result->clock_offset >> 8) : 0;
         current_connection_->initializeConnection(this, &rxbuf_[2], class_of_device, false);
 
         sendHCIRemoteNameRequest();
@@ -1532,20 +1725,20 @@ void BluetoothController::handle_hci_link_key_request() {
     bool send_link_key_reply = false;
     uint8_t link_key[16];
     if (!do_pair_ssp_) {
-        send_link_key_reply = readLinkKey(current_connection_->device_bdaddr_, link_key);
+        send_link_key_reply = readLinkKey(&rxbuf_[2], link_key);
     }
 
     if (send_link_key_reply) { 
-        sendHCILinkKeyRequestReply(link_key);
+        sendHCILinkKeyRequestReply(&rxbuf_[2], link_key);
         pending_control_ = 0; // NOT sure what this should be?
 
     } else {
-        sendHCILinkKeyNegativeReply();
+        sendHCILinkKeyNegativeReply(&rxbuf_[2]);
         pending_control_ = PC_LINK_KEY_NEGATIVE;
     }
 
     #else    
-    sendHCILinkKeyNegativeReply();
+    sendHCILinkKeyNegativeReply(&rxbuf_[2]);
     pending_control_ = PC_LINK_KEY_NEGATIVE;
     #endif
 }
@@ -1560,7 +1753,7 @@ void BluetoothController::handle_hci_link_key_notification() {
 
 #if 1
     // Should we always try to save away the key? 
-    sendHCIWriteStoredLinkKey(&rxbuf_[8]);
+    sendHCIWriteStoredLinkKey(&rxbuf_[2], &rxbuf_[8]);
     has_key = true;
     //pending_control_ ???
 
@@ -1602,6 +1795,20 @@ void BluetoothController::handle_hci_disconnect_complete()
 
     // bail if no current connection
     if (!current_connection_) return;
+    removeConnectionHandle(current_connection_);
+    freeHIDDescriptorBuffer(current_connection_);
+
+    // Nothing left to pace or time on this link.
+    current_connection_->l2cap_step_timer_.stop();
+    current_connection_->connection_timer_.stop();
+    current_connection_->l2cap_step_pending_ = false;
+
+    // The controller flushes whatever it still had for this link, so those
+    // buffers are ours again.
+    if (le_acl_flow_control_ && current_connection_->le_connection_) le_acl_credits_ += current_connection_->acl_packets_outstanding_;
+    else if (acl_flow_control_) acl_credits_ += current_connection_->acl_packets_outstanding_;
+    current_connection_->acl_packets_outstanding_ = 0;
+    send_queued_acl_packets();
 
     if (current_connection_->device_driver_) {
         current_connection_->device_driver_->release_bluetooth();
@@ -1612,6 +1819,7 @@ void BluetoothController::handle_hci_disconnect_complete()
         current_connection_->control_dcid_ = 0x70;
         current_connection_->interrupt_dcid_ = 0x71;
     }
+    current_connection_->releaseCollectionDrivers();
     // Probably should clear out connection data.
 #if 0
     current_connection_->device_connection_handle_ = 0;
@@ -1742,139 +1950,190 @@ void BluetoothController::handle_hci_remote_version_information_complete() {
 void BluetoothController::rx2_data(const Transfer_t *transfer)
 {
     uint32_t len = transfer->length - ((transfer->qtd.token >> 16) & 0x7FFF);
+    uint8_t *buffer = (uint8_t*)transfer->buffer;
     #ifdef DEBUG_BT
-    if (rx2_continue_packet_expected_) DBGPrintf("<<P(02 %u %u):", (uint32_t)em_rx_tx2, len);
-    else if (rx2_packet_data_remaining_) DBGPrintf("<<C(02 %u %u):", (uint32_t)em_rx_tx2, len);
+    if (rx2_hci_remaining_) DBGPrintf("<<C(02 %u %u):", (uint32_t)em_rx_tx2, len);
     else DBGPrintf("\n=====================\n<<(02 %u %u):", (uint32_t)em_rx_tx2, len);
     em_rx_tx2 = 0;
-    uint8_t *buffer = (uint8_t*)transfer->buffer;
     for (uint8_t i = 0; i < len; i++) DBGPrintf("%02X ", buffer[i]);
     DBGPrintf("\n");
     #endif
 
-    // Note the logical packets returned from the device may be larger
-    // than can fit in one of our packets, so we will detect this and
-    // the next read will be continue in or rx_buf_ in the next logical 
-    // location.  We will only go into process the next logical state
-    // when we have the full response read in... 
-
-    // Note two types of continue data. One where the device
-    // gives us a full return packet, but that packet won't fit into 
-    // one of our own packets. (PS4 response for example)
-
-
-    uint16_t hci_length = rx2buf_[2] + ((uint16_t)rx2buf_[3] << 8);
-    uint16_t l2cap_length = rx2buf_[4] + ((uint16_t)rx2buf_[5] << 8);
-
-
-    // call backs.  See if this is an L2CAP reply. example
-    //  HCI       | l2cap
-    //48 20 10 00 | 0c 00 10 00 | 3 0 8 0 44 0 70 0 0 0 0 0
-    // BUGBUG need to do more verification, like the handle
-    // Note: we also need to handle cases where are message is split up into
-    // multiple.  Example: we request attribute search first line
-    // next couple of lines shows two messages coming back
-    // followed by the message received on Linux
-    //>>(02):48 20 18 00 14 00 41 00 06 00 01 00 0F 35 03 19 01 00 FF FF 35 05 0A 00 00 FF FF 00
-
+    // Two levels of splitting: an HCI ACL packet may take several reads of
+    // the bulk end point, and an L2CAP packet may be split over several HCI
+    // ACL packets (PB flag: start, then continuing fragments). Example, SDP
+    // response split in two:
     //        0  1  2  3  4  5  6  7  8  9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31 32 ...
     //<<(02):48 20 1B 00 30 00 40 00 07 00 01 00 2B 00 26 36 03 AD 36 00 8E 09 00 00 0A 00 00 00 00 09 00
     //<<(02):48 10 19 00 01 35 03 19 10 00 09 00 04 35 0D 35 06 19 01 00 09 00 01 35 03 19 02 00 26
-
-    //linux :47 20 34 00 30 00 40 00 07 00 00 00 2b 00 26 36 03 ad 36 00 8e 09 00 00 0a 00 00 00 00 09 00 $$
-    //...                01 35 03 19 10 00 09 00 04 35 0d 35 06 19 01 00 09 00 01 35 03 19 02 00 26
-    // first attempt... combine by memcpy and update count...
-    
-    if (rx2_continue_packet_expected_) {
-
-        // Combine...
-        if ((rx2buf2_[1] & 0x10) == 0) DBGPrintf("Expected continue in Packet Boundary (PB flag)");
-        uint16_t hci_copy_length = rx2buf2_[2] + ((uint16_t)rx2buf2_[3] << 8);
-        memcpy(&rx2buf_[hci_length + 4], &rx2buf2_[4], hci_copy_length);
-        rx2buf_[2] += rx2buf2_[2]; // update the size here...
-        hci_length = rx2buf_[2] + ((uint16_t)rx2buf_[3] << 8);
-
-        rx2_packet_data_remaining_ = 0; // I am asuming only two for all of this
-        DBGPrintf("<<(2 comb):");
-        for (uint8_t i = 0; i < (hci_length + 4); i++) DBGPrintf("%02X ", rx2buf_[i]);
-        DBGPrintf("\n");
-        rx2_packet_data_remaining_ = 0;
-        rx2_continue_packet_expected_ = 0; // don't expect another one. 
+    // We collect the L2CAP packet per connection handle and hand it on, with
+    // an HCI header covering the whole packet, when all of it has arrived.
+    if (rx2_hci_remaining_ == 0) {
+        if (len >= 4) {
+            //  HCI: <handle><handle + PB flag><length><length>
+            uint16_t handle = (buffer[0] + ((uint16_t)buffer[1] << 8)) & 0xfff;
+            bool start = ((buffer[1] & 0x30) != 0x10);
+            rx2_current_ = l2capReassemblySlot(handle, start);
+            rx2_hci_remaining_ = buffer[2] + ((uint16_t)buffer[3] << 8);
+            // Only the first read of the HCI packet is captured, the rest of
+            // a longer packet shows as truncated.
+            if (hci_capture_enabled_) {
+                uint16_t hci_length = rx2_hci_remaining_ + 4;
+                captureHCIPacket(HCI_CAPTURE_ACL, true, buffer, (len < hci_length)? len : hci_length, hci_length);
+            }
+            l2capReassemblyAppend(&buffer[4], len - 4);
+        }
     } else {
-        if (rx2_packet_data_remaining_ == 0) {    // Previous command was fully handled
-            rx2_packet_data_remaining_ = hci_length + 4;   // length plus size of hci header
-        }       
-        // Now see if the data 
-        rx2_packet_data_remaining_ -= len;    // remove the length of this packet from length
-    }
-
-    //
-    //  uint16_t rsp_packet_length = rx2buf_[10] + ((uint16_t)rx2buf_[11]<<8);
-    if (rx2_packet_data_remaining_ == 0) {    // read started at beginning of packet so get the total length of packet
-        if ((hci_length == (l2cap_length + 4)) /*&& (hci_length == (rsp_packet_length+8))*/) {
-            // All the lengths appear to be correct...  need to do more...
-            // See if we should set the current_connection...
-
-            if (!current_connection_ || (current_connection_->device_connection_handle_ != rx2buf_[0])) {
-                BluetoothConnection  *previous_connection = current_connection_;    // need to figure out when this changes and/or...
-                current_connection_ = BluetoothConnection::s_first_;
-                while (current_connection_) {
-                    if (current_connection_->device_connection_handle_ == rx2buf_[0]) break;
-                    current_connection_ = current_connection_->next_;
+        l2capReassemblyAppend(buffer, len);
+    }
+
+    l2cap_reassembly_t *slot = rx2_current_;
+    if ((rx2_hci_remaining_ == 0) && slot && (slot->count >= 8)) {
+        uint16_t l2cap_length = slot->buffer[4] + ((uint16_t)slot->buffer[5] << 8);
+        if (slot->count >= (l2cap_length + 8)) {
+            rx2_current_ = nullptr;
+            if (slot->overflow) {
+                DBGPrintf("??? L2CAP packet too large (%u) dropped Handle: %x\n", l2cap_length, slot->handle);
+            } else {
+                uint16_t hci_length = slot->count - 4;
+                slot->buffer[0] = slot->handle & 0xff;
+                slot->buffer[1] = ((slot->handle >> 8) & 0x0f) | 0x20;
+                slot->buffer[2] = hci_length & 0xff;
+                slot->buffer[3] = hci_length >> 8;
+                if (hci_length > rx2_size_) {
+                    DBGPrintf("<<(2 comb):");
+                    for (uint16_t i = 0; i < slot->count; i++) DBGPrintf("%02X ", slot->buffer[i]);
+                    DBGPrintf("\n");
                 }
-                if (current_connection_ == nullptr) {
-                    current_connection_ = previous_connection;
+
+                // Only the connection with this handle gets it, a packet for
+                // a handle we don't know (a link already gone) is dropped.
+                if (!current_connection_ || (current_connection_->device_connection_handle_ != slot->handle)) {
+                    BluetoothConnection *connection = connectionForHandle(slot->handle);
+                    if (connection) current_connection_ = connection;
+                }
+
+                // Let the connection processes the message:
+                if (current_connection_ && (current_connection_->device_connection_handle_ == slot->handle)) {
+                    uint32_t start_cycles = ARM_DWT_CYCCNT;
+                    current_connection_->rx2_data(slot->buffer);
+                    uint32_t cycles = ARM_DWT_CYCCNT - start_cycles;
+                    stats_.acl_packets++;
+                    stats_.acl_cycles += cycles;
+                    if (cycles > stats_.acl_cycles_max) stats_.acl_cycles_max = cycles;
+                } else {
+                    DBGPrintf("??? No connection for Handle: %x packet dropped\n", slot->handle);
+                    stats_.rx_acl_dropped++;
                 }
             }
+            slot->handle = 0xffff;
+        }
+    }
 
-            // Let the connection processes the message:
-            if (current_connection_) current_connection_->rx2_data(rx2buf_);
-            else DBGPrintf("??? There are no device Connections ignore packet Handle: %x\n", rx2buf_[0]);
+    // Queue up for next read...
+    queue_Data_Transfer_Debug(rx2pipe_, rx2buf_, rx2_size_, this, __LINE__);
+}
 
-            // Queue up for next read...
-            queue_Data_Transfer_Debug(rx2pipe_, rx2buf_, rx2_size_, this, __LINE__);
-        } else {
-            // size issue?
-            rx2_packet_data_remaining_ = (l2cap_length + 4) - hci_length;
-            rx2_continue_packet_expected_ = 1;
-            //DBGPrintf("?? expect continue packet ?? len:%u, hci_len=%u l2cap_len=%u expect=%u\n", len, hci_length, l2cap_length, rx2_packet_data_remaining_);
-            // Queue up for next read secondary buffer.
-            queue_Data_Transfer_Debug(rx2pipe_, rx2buf2_, rx2_size_, this, __LINE__);
+//*******************************************************************
+// Find where an L2CAP fragment for handle goes.  A start fragment begins a
+// new packet, taking over a free slot (or the oldest one if they are all
+// busy); a continuing fragment must match a packet already started.
+BluetoothController::l2cap_reassembly_t *BluetoothController::l2capReassemblySlot(uint16_t handle, bool start)
+{
+    l2cap_reassembly_t *slot = nullptr;
+    for (uint8_t i = 0; i < L2CAP_REASSEMBLY_SLOTS; i++) {
+        if (rx2_reassembly_[i].handle == handle) {
+            slot = &rx2_reassembly_[i];
+            break;
         }
-    } else {
-        // Need to retrieve the last few bytes of data.
-        //
-        //DBGPrintf("?? RX2_Read continue on 2nd packet ?? len:%u, hci_len=%u l2cap_len=%u expect=%u\n", len, hci_length, l2cap_length, rx2_packet_data_remaining_);
-        //queue_Data_Transfer_Debug(rx2pipe_, rx2buf2_, rx2_size_, this, __LINE__);
-        queue_Data_Transfer_Debug(rx2pipe_, (uint8_t*)transfer->buffer + rx2_size_, rx2_size_, this, __LINE__);
-        rx2_continue_packet_expected_ = 0;
-        return;     // Don't process the message yet as we still have data to receive. 
+    }
+    if (!start) {
+        if (!slot) DBGPrintf("??? L2CAP continue fragment without start Handle: %x\n", handle);
+        return slot;
     }
 
+    if (slot) {
+        DBGPrintf("??? L2CAP packet incomplete, dropped Handle: %x\n", handle);
+    } else {
+        for (uint8_t i = 0; i < L2CAP_REASSEMBLY_SLOTS; i++) {
+            if (rx2_reassembly_[i].handle == 0xffff) {
+                slot = &rx2_reassembly_[i];
+                break;
+            }
+        }
+        if (!slot) {
+            slot = &rx2_reassembly_[0];
+            DBGPrintf("??? L2CAP packet incomplete, dropped Handle: %x\n", slot->handle);
+        }
+    }
+    slot->handle = handle;
+    slot->count = 4;    // leave room for the HCI header
+    slot->overflow = false;
+    return slot;
+}
 
+void BluetoothController::l2capReassemblyAppend(const uint8_t *data, uint16_t cb)
+{
+    if (cb > rx2_hci_remaining_) cb = rx2_hci_remaining_;
+    rx2_hci_remaining_ -= cb;
+    l2cap_reassembly_t *slot = rx2_current_;
+    if (!slot) return;  // no packet to put it in, skip the data.
+    if ((slot->count + cb) > L2CAP_REASSEMBLY_SIZE) {
+        slot->overflow = true;
+        slot->count += cb;  // keep counting so we know when it is done
+        return;
+    }
+    if (!slot->overflow) memcpy(&slot->buffer[slot->count], data, cb);
+    slot->count += cb;
 }
 
 
 void BluetoothController::sendHCICommand(uint16_t hciCommand, uint16_t cParams, const uint8_t* data)
 {
-    txbuf_[0] = hciCommand & 0xff;
-    txbuf_[1] = (hciCommand >> 8) & 0xff;
-    txbuf_[2] = cParams;
-    if (cParams) {
-        memcpy(&txbuf_[3], data, cParams);  // copy in the commands parameters.
-    }
-    uint8_t nbytes = cParams + 3;
-    DBGPrintf(">>(00, %u):", (uint32_t)em_rx_tx);
-    em_rx_tx = 0;
-    for (uint8_t i = 0; i < nbytes; i++) DBGPrintf("%02X ", txbuf_[i]);
-    DBGPrintf("\n");
-    mk_setup(setup, 0x20, 0x0, 0, 0, nbytes);
     if (device == nullptr) {
         // something wrong:
         USBHDBGSerial.printf("\n !!!!!!!!!!! BluetoothController::sendHCICommand called with device == nullptr\n");
         return; // don't send it. 
     }
-    queue_Control_Transfer(device, &setup, txbuf_, this);
+    uint8_t nbytes = cParams + 3;
+    // We may be called from the USB interrupt, so no printing here unless
+    // debugging; drops are counted in the statistics instead.
+    bool irq_was_enabled = NVIC_IS_ENABLED(IRQ_USBHS);
+    NVIC_DISABLE_IRQ(IRQ_USBHS);
+    if (nbytes > TX_CMD_BUFFER_SIZE) {
+        stats_.tx_cmd_dropped++;
+        if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+        DBGPrintf("\n !!!!!!!!!!! BluetoothController::sendHCICommand %x too long: %u\n", hciCommand, cParams);
+        return;
+    }
+
+    // Take the next buffer of the ring, the USB interrupt frees them.
+    uint8_t index = tx_cmd_next_;
+    if (tx_cmd_state_[index] != TX_SLOT_FREE) {
+        stats_.tx_cmd_dropped++;
+        if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+        DBGPrintf("\n !!!!!!!!!!! BluetoothController::sendHCICommand %x queue full\n", hciCommand);
+        return;
+    }
+    tx_cmd_next_ = (index + 1) % TX_CMD_QUEUE_DEPTH;
+    uint8_t *txbuf = tx_cmd_bufs_[index];
+
+    txbuf[0] = hciCommand & 0xff;
+    txbuf[1] = (hciCommand >> 8) & 0xff;
+    txbuf[2] = cParams;
+    if (cParams) {
+        memcpy(&txbuf[3], data, cParams);  // copy in the commands parameters.
+    }
+    DBGPrintf(">>(00, %u):", (uint32_t)em_rx_tx);
+    em_rx_tx = 0;
+    for (uint8_t i = 0; i < nbytes; i++) DBGPrintf("%02X ", txbuf[i]);
+    DBGPrintf("\n");
+    mk_setup(tx_cmd_setups_[index], 0x20, 0x0, 0, 0, nbytes);
+    tx_cmd_state_[index] = TX_SLOT_QUEUED;
+
+    // Goes out now if the controller has a credit for it.
+    send_queued_hci_commands();
+    if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
 }
 
 //---------------------------------------------
@@ -1911,7 +2170,8 @@ void BluetoothController::sendHCISetEventMask() {
 			// Default: 0x0000 1FFF FFFF FFFF
             //0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x1F, 0xFF, 0x00
             // turned off max slot changing event
-            0xFF, 0xFF, 0xFF, 0xFB, 0xFF, 0x1F, 0xFF, 0x00
+            // plus LE meta events
+            0xFF, 0xFF, 0xFF, 0xFB, 0xFF, 0x1F, 0xFF, 0x20
 		};  // default plus extended inquiry mode
 		sendHCICommand(HCI_Set_Event_Mask, sizeof(hci_event_mask_data_ssp), hci_event_mask_data_ssp);
 	} else {
@@ -1930,6 +2190,8 @@ void BluetoothController::sendHCISetEventMask() {
 void BluetoothController::sendHCI_INQUIRY() {
     // Start unlimited inqury, set timeout to max and
     DBGPrintf("HCI_INQUIRY\n");
+    // Devices already known are considered again in this inquiry.
+    for (uint8_t i = 0; i < inquiry_result_count_; i++) inquiry_results_[i].handled = false;
     static const uint8_t hci_inquiry_data[ ] = {
         0x33, 0x8B, 0x9E,   // Bluetooth assigned number LAP 0x9E8B33 General/unlimited inquiry Access mode
         0x30, 0xa
@@ -1958,8 +2220,8 @@ void BluetoothController::sendHCICreateConnection() {
     connection_data[7] = 0xcc; //
     connection_data[8] = current_connection_->device_ps_repetion_mode_;  // from device
     connection_data[9] = 0; //
-    connection_data[10] = 0;  // clock offset
-    connection_data[11] = 0;  // clock offset
+    connection_data[10] = current_connection_->device_clock_offset_[0];  // clock offset, from inquiry if known
+    connection_data[11] = current_connection_->device_clock_offset_[1];
     connection_data[12] = 0;  // allow role swith no
     sendHCICommand(HCI_CREATE_CONNECTION, sizeof(connection_data), connection_data);
 }
@@ -1999,23 +2261,22 @@ void BluetoothController::sendHCIAuthenticationRequested() {
 }
 
 //---------------------------------------------
-void BluetoothController::sendHCILinkKeyRequestReply(uint8_t link_key[16]) {
+void BluetoothController::sendHCILinkKeyRequestReply(uint8_t bdaddr[6], uint8_t link_key[16]) {
     DBGPrintf("HCI_LINK_KEY_REQUEST_REPLY: bdaddr: %02x:%02x:%02x:%02x:%02x:%02x key: ",
-        current_connection_->device_bdaddr_[0],current_connection_->device_bdaddr_[1],current_connection_->device_bdaddr_[2],
-        current_connection_->device_bdaddr_[3],current_connection_->device_bdaddr_[4],current_connection_->device_bdaddr_[5]);
+        bdaddr[0], bdaddr[1], bdaddr[2], bdaddr[3], bdaddr[4], bdaddr[5]);
     for (uint8_t i = 0; i < 16; i++) DBGPrintf(" %02X", link_key[i]);
     DBGPrintf("\n");
     uint8_t connection_data[22];
-    for (uint8_t i = 0; i < 6; i++) connection_data[i] = current_connection_->device_bdaddr_[i];
+    for (uint8_t i = 0; i < 6; i++) connection_data[i] = bdaddr[i];
     for(uint8_t i = 0; i < 16; i++) connection_data[i + 6] = link_key[i]; // 16 octet link_key
     sendHCICommand(HCI_LINK_KEY_REQUEST_REPLY, sizeof(connection_data), connection_data);
 }
 
 //---------------------------------------------
-void BluetoothController::sendHCILinkKeyNegativeReply() {
+void BluetoothController::sendHCILinkKeyNegativeReply(uint8_t bdaddr[6]) {
     DBGPrintf("HCI_LINK_KEY_NEG_REPLY\n");
     uint8_t connection_data[6];
-    for (uint8_t i = 0; i < 6; i++) connection_data[i] = current_connection_->device_bdaddr_[i];
+    for (uint8_t i = 0; i < 6; i++) connection_data[i] = bdaddr[i];
     sendHCICommand(HCI_LINK_KEY_NEG_REPLY, sizeof(connection_data), connection_data);
 }
 
@@ -2037,6 +2298,7 @@ void BluetoothController::setPairingKeyStorageLocation(FS *pfs, int eeprom_index
     pairing_keys_fs_ = pfs;
     pairing_keys_eeprom_start_index_ = eeprom_index;
     pairing_keys_max_ = max_keys;
+    link_key_cache_loaded_ = false; // read the keys from the new place
 }
 
 //---------------------------------------------
@@ -2052,6 +2314,23 @@ bool BluetoothController::writeLinkKey(uint8_t bdaddr[6], uint8_t link_key[16])
             return true;
         }
     }
+
+    // Keep the cache up to date, and don't rewrite a key we already have.
+    if (!link_key_cache_loaded_) loadLinkKeyCache();
+    if (bdaddr == nullptr) {
+        memset(link_key_cache_, 0, sizeof(link_key_cache_));
+        link_key_cache_complete_ = true;
+    } else if (link_key == nullptr) {
+        uncacheLinkKey(bdaddr);
+    } else {
+        link_key_entry_t *entry = findLinkKey(bdaddr);
+        if (entry && (memcmp(entry->link_key, link_key, 16) == 0)) {
+            DBGPrintf("\tkey unchanged\n");
+            return true;
+        }
+        if (!cacheLinkKey(bdaddr, link_key)) link_key_cache_complete_ = false;
+    }
+
     // We will store the data either in FS or EEPROM
     if (pairing_keys_fs_) {
         if (bdaddr == nullptr) {
@@ -2099,11 +2378,7 @@ bool BluetoothController::writeLinkKey(uint8_t bdaddr[6], uint8_t link_key[16])
             pairingFile.close();
         }
     } else {
-        if (pairing_keys_max_ < 0) pairing_keys_max_ = 5;
-        if (pairing_keys_eeprom_start_index_ < 0) {
-             pairing_keys_eeprom_start_index_ = EEPROM.length() - (pairing_keys_max_ * 22 - pairing_keys_eeprom_start_index_);
-        } 
-        DBGPrintf("\tEEPROM start addr: %u, max_keys: %u\n", pairing_keys_eeprom_start_index_, pairing_keys_max_);
+        setupPairingKeysEEPROM();
 
         if (bdaddr == nullptr) {
             // passed in nullptr here.. we will assume that the user is asking us to erase the eeprom area of the link keys
@@ -2129,7 +2404,17 @@ bool BluetoothController::writeLinkKey(uint8_t bdaddr[6], uint8_t link_key[16])
                     }
                 }
             }
-            if (key_empty) {
+            if (link_key == nullptr) {
+                // Asked to delete this key, wipe out the slot.
+                if (key_matched) {
+                    addr = pairing_keys_eeprom_start_index_ + (i * 22);
+                    for (uint8_t j=0; j < 22; j++) EEPROM.write(addr++, 0xff);
+                    DBGPrintf("\tremoved key in slot: %u\n", i);
+                    break;
+                }
+                continue;
+            }
+            if (key_empty && !key_matched) {
                 addr = pairing_keys_eeprom_start_index_ + (i * 22); // bddr plus link_key
                 for (uint8_t j=0; j < 6; j++) EEPROM.write(addr++, bdaddr[j]);
             }
@@ -2160,9 +2445,17 @@ bool BluetoothController::readLinkKey(uint8_t bdaddr[6], uint8_t link_key[16]) {
         else if (ret < 0) return false;
     }
 
-    // else use one of our built in versions
-    // We will store the data either in FS or EEPROM
+    // else use one of our built in versions, from RAM once they are loaded.
+    if (!link_key_cache_loaded_) loadLinkKeyCache();
+    link_key_entry_t *entry = findLinkKey(bdaddr);
+    if (entry) {
+        DBGPrintf("\tFound in cache\n");
+        memcpy(link_key, entry->link_key, 16);
+        return true;
+    }
+    if (link_key_cache_complete_) return false;
 
+    // More keys stored than we cache, look in the FS or EEPROM.
     // First see of we are using FS version
     if (pairing_keys_fs_) {
         File pairingFile;
@@ -2173,7 +2466,7 @@ bool BluetoothController::readLinkKey(uint8_t bdaddr[6], uint8_t link_key[16]) {
         // append it. 
         uint8_t bdaddr_link_key_item[6];
         for (int key_index = 0; ;key_index++) {
-            pairingFile.seek(key_index * sizeof(bdaddr_link_key_item), SEEK_SET);  // make sure right place 
+            pairingFile.seek(key_index * 22, SEEK_SET);  // records are the bdaddr and the link key
             if (pairingFile.read(bdaddr_link_key_item, sizeof(bdaddr_link_key_item)) != sizeof(bdaddr_link_key_item)) {
                 break; // did not find it
             }
@@ -2187,11 +2480,7 @@ bool BluetoothController::readLinkKey(uint8_t bdaddr[6], uint8_t link_key[16]) {
         }
         pairingFile.close();
     } else {
-        if (pairing_keys_max_ < 0) pairing_keys_max_ = 5;
-        if (pairing_keys_eeprom_start_index_ < 0) {
-             pairing_keys_eeprom_start_index_ = EEPROM.length() - (pairing_keys_max_ * 22 - pairing_keys_eeprom_start_index_);
-        } 
-        DBGPrintf("\tEEPROM start addr: %u, max_keys: %u\n", pairing_keys_eeprom_start_index_, pairing_keys_max_);
+        setupPairingKeysEEPROM();
         for (uint8_t i = 0; i < pairing_keys_max_; i++) {
             uint16_t addr = pairing_keys_eeprom_start_index_ + (i * 22); // bddr plus link_key
             send_link_key_reply = true;
@@ -2209,24 +2498,108 @@ bool BluetoothController::readLinkKey(uint8_t bdaddr[6], uint8_t link_key[16]) {
             }
         }
     }
+    if (send_link_key_reply) cacheLinkKey(bdaddr, link_key);
     return send_link_key_reply;
 }
 
 //---------------------------------------------
-void BluetoothController::sendHCIWriteStoredLinkKey(uint8_t link_key[16]) {
+// Link key storage helpers
+//---------------------------------------------
+void BluetoothController::setupPairingKeysEEPROM() {
+    if (pairing_keys_max_ < 0) pairing_keys_max_ = 5;
+    if (pairing_keys_eeprom_start_index_ < 0) {
+         pairing_keys_eeprom_start_index_ = EEPROM.length() - (pairing_keys_max_ * 22 - pairing_keys_eeprom_start_index_);
+    } 
+    DBGPrintf("\tEEPROM start addr: %u, max_keys: %u\n", pairing_keys_eeprom_start_index_, pairing_keys_max_);
+}
+
+// Read all of the stored keys (22 byte records: bdaddr then link key, all
+// 0xff when unused) into the cache.
+void BluetoothController::loadLinkKeyCache() {
+    memset(link_key_cache_, 0, sizeof(link_key_cache_));
+    link_key_cache_loaded_ = true;
+    link_key_cache_complete_ = true;
+
+    static const uint8_t empty_bdaddr[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    uint8_t bdaddr_link_key_item[22];
+    uint16_t keys = 0;
+    if (pairing_keys_fs_) {
+        File pairingFile = pairing_keys_fs_->open(s_PairingFileName, FILE_READ);
+        if (!pairingFile) return;
+        while (pairingFile.read(bdaddr_link_key_item, sizeof(bdaddr_link_key_item)) == sizeof(bdaddr_link_key_item)) {
+            if (memcmp(bdaddr_link_key_item, empty_bdaddr, 6) == 0) continue;
+            if (!cacheLinkKey(bdaddr_link_key_item, &bdaddr_link_key_item[6])) link_key_cache_complete_ = false;
+            keys++;
+        }
+        pairingFile.close();
+    } else {
+        setupPairingKeysEEPROM();
+        for (uint8_t i = 0; i < pairing_keys_max_; i++) {
+            uint16_t addr = pairing_keys_eeprom_start_index_ + (i * 22);
+            for (uint8_t j = 0; j < 22; j++) bdaddr_link_key_item[j] = EEPROM.read(addr++);
+            if (memcmp(bdaddr_link_key_item, empty_bdaddr, 6) == 0) continue;
+            if (!cacheLinkKey(bdaddr_link_key_item, &bdaddr_link_key_item[6])) link_key_cache_complete_ = false;
+            keys++;
+        }
+    }
+    DBGPrintf("\tLink keys loaded: %u complete:%u\n", keys, link_key_cache_complete_);
+}
+
+// The cache is open addressed on the low bytes of the bdaddr, removing an
+// entry re-inserts the ones after it so lookups don't stop short.
+BluetoothController::link_key_entry_t *BluetoothController::findLinkKey(const uint8_t bdaddr[6]) {
+    uint8_t index = (bdaddr[0] ^ bdaddr[1] ^ bdaddr[2]) & (LINK_KEY_CACHE_SIZE - 1);
+    for (uint8_t i = 0; i < LINK_KEY_CACHE_SIZE; i++) {
+        link_key_entry_t *entry = &link_key_cache_[index];
+        if (!entry->used) break;
+        if (memcmp(entry->bdaddr, bdaddr, 6) == 0) return entry;
+        index = (index + 1) & (LINK_KEY_CACHE_SIZE - 1);
+    }
+    return nullptr;
+}
+
+bool BluetoothController::cacheLinkKey(const uint8_t bdaddr[6], const uint8_t link_key[16]) {
+    uint8_t index = (bdaddr[0] ^ bdaddr[1] ^ bdaddr[2]) & (LINK_KEY_CACHE_SIZE - 1);
+    for (uint8_t i = 0; i < LINK_KEY_CACHE_SIZE; i++) {
+        link_key_entry_t *entry = &link_key_cache_[index];
+        if (!entry->used || (memcmp(entry->bdaddr, bdaddr, 6) == 0)) {
+            entry->used = true;
+            memcpy(entry->bdaddr, bdaddr, 6);
+            memcpy(entry->link_key, link_key, 16);
+            return true;
+        }
+        index = (index + 1) & (LINK_KEY_CACHE_SIZE - 1);
+    }
+    return false;   // full
+}
+
+void BluetoothController::uncacheLinkKey(const uint8_t bdaddr[6]) {
+    link_key_entry_t *entry = findLinkKey(bdaddr);
+    if (!entry) return;
+    entry->used = false;
+    uint8_t index = entry - link_key_cache_;
+    for (index = (index + 1) & (LINK_KEY_CACHE_SIZE - 1); link_key_cache_[index].used;
+            index = (index + 1) & (LINK_KEY_CACHE_SIZE - 1)) {
+        link_key_entry_t moved = link_key_cache_[index];
+        link_key_cache_[index].used = false;
+        cacheLinkKey(moved.bdaddr, moved.link_key);
+    }
+}
+
+//---------------------------------------------
+void BluetoothController::sendHCIWriteStoredLinkKey(uint8_t bdaddr[6], uint8_t link_key[16]) {
 
     DBGPrintf("sendHCIWriteStoredLinkKey: bdaddr: %02x:%02x:%02x:%02x:%02x:%02x key: ",
-        current_connection_->device_bdaddr_[0],current_connection_->device_bdaddr_[1],current_connection_->device_bdaddr_[2],
-        current_connection_->device_bdaddr_[3],current_connection_->device_bdaddr_[4],current_connection_->device_bdaddr_[5]);
+        bdaddr[0], bdaddr[1], bdaddr[2], bdaddr[3], bdaddr[4], bdaddr[5]);
     for (uint8_t i = 0; i < 16; i++) DBGPrintf(" %02X", link_key[i]);
     DBGPrintf("\n");
 #if 1 
-    writeLinkKey(current_connection_->device_bdaddr_, link_key); // could probably have simply renamed
+    writeLinkKey(bdaddr, link_key); // could probably have simply renamed
 #else 
     // You can not query the data back so not sure how much it helps  
     uint8_t link_key_data[23];
     link_key_data[0] = 1; // only store 1 key
-    for (uint8_t i = 0; i < 6; i++) link_key_data[i+1] = current_connection_->device_bdaddr_[i];
+    for (uint8_t i = 0; i < 6; i++) link_key_data[i+1] = bdaddr[i];
     for(uint8_t i = 0; i < 16; i++) link_key_data[i + 7] = link_key[i]; // 16 octet link_key
     sendHCICommand(HCI_WRITE_STORED_LINK_KEY, sizeof(link_key_data), link_key_data);
 #endif
@@ -2393,7 +2766,7 @@ void BluetoothController::sendInfoRequest() {
 	
     DBGPrintf("sendInfoRequest \n");
 	
-	current_connection_->device_connection_handle_ = rxbuf_[3] + (uint16_t)(rxbuf_[4]>>8);
+	addConnectionHandle(current_connection_, rxbuf_[3] + (uint16_t)(rxbuf_[4] << 8));
 	DBGPrintf("device_connection_handle_ = %x\n", current_connection_->device_connection_handle_);
     sendL2CapCommand(current_connection_->device_connection_handle_, l2capbuf, sizeof(l2capbuf));
 
@@ -2405,6 +2778,11 @@ void BluetoothController::tx_data(const Transfer_t *transfer)
 {
     // We assume the current connection should process this but lets make sure.
     uint8_t *buffer = (uint8_t*)transfer->buffer;
+
+    // This ring buffer is free again.
+    for (uint8_t i = 0; i < TX_ACL_QUEUE_DEPTH; i++) {
+        if (buffer == tx_acl_bufs_[i]) tx_acl_state_[i] = TX_SLOT_FREE;
+    }
     #if 0
     // device connection handle is only valid for data packets not command packets.
     if (!current_connection_ || (current_connection_->device_connection_handle_ != buffer[0])) {
@@ -2423,8 +2801,9 @@ void BluetoothController::tx_data(const Transfer_t *transfer)
     }
     #endif
 
-    // Let the connection processes the message:
-    if (current_connection_) current_connection_->tx_data(buffer, transfer->length);
+    // Let the connection the packet was for process the message:
+    BluetoothConnection *connection = connectionForHandle(buffer[0] + ((buffer[1] & 0x0f) << 8));
+    if (connection) connection->tx_data(buffer, transfer->length);
 }
 
 
@@ -2462,26 +2841,312 @@ void BluetoothController::sendL2CapCommand(uint8_t* data, uint8_t nbytes, int ch
 
 void BluetoothController::sendL2CapCommand(uint16_t handle, uint8_t* data, uint8_t nbytes, uint8_t channelLow, uint8_t channelHigh)
 {
-    txbuf_[0] = handle & 0xff; // HCI handle with PB,BC flag
-    txbuf_[1] = (((handle >> 8) & 0x0f) | 0x20);
-    txbuf_[2] = (uint8_t)((4 + nbytes) & 0xff); // HCI ACL total data length
-    txbuf_[3] = (uint8_t)((4 + nbytes) >> 8);
-    txbuf_[4] = (uint8_t)(nbytes & 0xff); // L2CAP header: Length
-    txbuf_[5] = (uint8_t)(nbytes >> 8);
-    txbuf_[6] = channelLow;
-    txbuf_[7] = channelHigh;
+    // Same as sendHCICommand, drops are counted rather than printed.
+    if ((nbytes + 8) > TX_ACL_BUFFER_SIZE) {
+        bool irq_was_enabled = NVIC_IS_ENABLED(IRQ_USBHS);
+        NVIC_DISABLE_IRQ(IRQ_USBHS);
+        stats_.tx_acl_dropped++;
+        if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+        DBGPrintf("\n !!!!!!!!!!! BluetoothController::sendL2CapCommand too long: %u\n", nbytes);
+        return;
+    }
+
+    if (acl_max_packet_length_ && ((nbytes + 4) > acl_max_packet_length_)) {
+        DBGPrintf("sendL2CapCommand: %u bytes larger than controller ACL buffer %u\n", nbytes + 4, acl_max_packet_length_);
+    }
+
+    // Take the next buffer of the ring, tx_data frees them as they go out.
+    bool irq_was_enabled = NVIC_IS_ENABLED(IRQ_USBHS);
+    NVIC_DISABLE_IRQ(IRQ_USBHS);
+    uint8_t index = tx_acl_next_;
+    if (tx_acl_state_[index] != TX_SLOT_FREE) {
+        stats_.tx_acl_dropped++;
+        if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+        DBGPrintf("\n !!!!!!!!!!! BluetoothController::sendL2CapCommand queue full\n");
+        return;
+    }
+    tx_acl_next_ = (index + 1) % TX_ACL_QUEUE_DEPTH;
+    uint8_t *txbuf = tx_acl_bufs_[index];
+
+    // LE links only take the non flushable start of packet PB flag.
+    BluetoothConnection *connection = connectionForHandle(handle);
+    txbuf[0] = handle & 0xff; // HCI handle with PB,BC flag
+    txbuf[1] = (((handle >> 8) & 0x0f) | ((connection && connection->le_connection_) ? 0x00 : 0x20));
+    txbuf[2] = (uint8_t)((4 + nbytes) & 0xff); // HCI ACL total data length
+    txbuf[3] = (uint8_t)((4 + nbytes) >> 8);
+    txbuf[4] = (uint8_t)(nbytes & 0xff); // L2CAP header: Length
+    txbuf[5] = (uint8_t)(nbytes >> 8);
+    txbuf[6] = channelLow;
+    txbuf[7] = channelHigh;
     if (nbytes) {
-        memcpy(&txbuf_[8], data, nbytes);   // copy in the commands parameters.
+        memcpy(&txbuf[8], data, nbytes);   // copy in the commands parameters.
     }
-    nbytes = nbytes + 8;
+    uint16_t cb = nbytes + 8;
     DBGPrintf(">>(02 %u):", (uint32_t)em_rx_tx2);
     em_rx_tx2 = 0;
-    for (uint8_t i = 0; i < nbytes; i++) DBGPrintf("%02X ", txbuf_[i]);
+    for (uint16_t i = 0; i < cb; i++) DBGPrintf("%02X ", txbuf[i]);
     DBGPrintf("\n");
+    tx_acl_state_[index] = TX_SLOT_QUEUED;
 
-    if (!queue_Data_Transfer_Debug(txpipe_, txbuf_, nbytes, this, __LINE__)) {
-        println("sendL2CapCommand failed");
+    // Goes out now if the controller has a buffer for it.
+    send_queued_acl_packets();
+    if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+}
+
+//*******************************************************************
+// Send queued ACL packets while the controller has buffers for them,
+// counting them against their connection.
+void BluetoothController::send_queued_acl_packets()
+{
+    bool irq_was_enabled = NVIC_IS_ENABLED(IRQ_USBHS);
+    NVIC_DISABLE_IRQ(IRQ_USBHS);
+    while (tx_acl_state_[tx_acl_send_] == TX_SLOT_QUEUED) {
+        uint8_t index = tx_acl_send_;
+        uint8_t *txbuf = tx_acl_bufs_[index];
+        BluetoothConnection *connection = connectionForHandle(txbuf[0] + ((txbuf[1] & 0x0f) << 8));
+        if (!connection) {
+            // The link went while this waited.  The controller would only
+            // flush it, and nothing would give its buffer back.
+            tx_acl_send_ = (index + 1) % TX_ACL_QUEUE_DEPTH;
+            tx_acl_state_[index] = TX_SLOT_FREE;
+            stats_.tx_acl_dropped++;
+            continue;
+        }
+        bool le_buffers = le_acl_flow_control_ && connection->le_connection_;
+        if (le_buffers ? !le_acl_credits_ : (acl_flow_control_ && !acl_credits_)) break;
+        tx_acl_send_ = (index + 1) % TX_ACL_QUEUE_DEPTH;
+        uint16_t cb = txbuf[2] + (txbuf[3] << 8) + 4;
+        if (!queue_Data_Transfer_Debug(txpipe_, txbuf, cb, this, __LINE__)) {
+            tx_acl_state_[index] = TX_SLOT_FREE;
+            println("sendL2CapCommand failed");
+            continue;
+        }
+        tx_acl_state_[index] = TX_SLOT_SENDING;
+        if (hci_capture_enabled_) captureHCIPacket(HCI_CAPTURE_ACL, false, txbuf, cb, cb);
+        if (le_buffers) {
+            le_acl_credits_--;
+            connection->acl_packets_outstanding_++;
+        } else if (acl_flow_control_) {
+            acl_credits_--;
+            connection->acl_packets_outstanding_++;
+        }
+    }
+    if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+}
+
+//*******************************************************************
+// Number Of Completed Packets: the controller is done with some of the
+// ACL packets of one or more connections.
+void BluetoothController::handle_hci_num_completed_packets()
+{
+    // <event type><param count><num handles>[<handle><handle><count><count>]...
+    uint8_t num_handles = rxbuf_[2];
+    for (uint8_t i = 0; i < num_handles; i++) {
+        uint16_t handle = (rxbuf_[3 + i * 4] + (rxbuf_[4 + i * 4] << 8)) & 0xfff;
+        uint16_t completed = rxbuf_[5 + i * 4] + (rxbuf_[6 + i * 4] << 8);
+        VDBGPrintf("    NUM_COMPLETE_PKT: fh:%04x comp:%u\n", handle, completed);
+        BluetoothConnection *connection = connectionForHandle(handle);
+        if (connection) {
+            if (completed > connection->acl_packets_outstanding_) completed = connection->acl_packets_outstanding_;
+            connection->acl_packets_outstanding_ -= completed;
+        }
+        if (le_acl_flow_control_ && connection && connection->le_connection_) le_acl_credits_ += completed;
+        else if (acl_flow_control_) acl_credits_ += completed;
+    }
+    send_queued_acl_packets();
+}
+
+//*******************************************************************
+// Connection events say which connection they are for, by handle or by
+// bdaddr.  Make it the current connection, which the handlers and the
+// commands they reply with use, so that devices connecting at the same
+// time each get their own replies.
+void BluetoothController::selectEventConnection()
+{
+    BluetoothConnection *connection = nullptr;
+    switch (rxbuf_[0]) {
+    case EV_CONNECT_COMPLETE:
+        connection = connectionForBdaddr(&rxbuf_[5]);
+        break;
+    case EV_REMOTE_NAME_COMPLETE:
+    case EV_SIMPLE_PAIRING_COMPLETE:
+        connection = connectionForBdaddr(&rxbuf_[3]);
+        break;
+    case EV_PIN_CODE_REQUEST:
+    case EV_LINK_KEY_REQUEST:
+    case EV_LINK_KEY_NOTIFICATION:
+    case EV_IO_CAPABILITY_REQUEST:
+    case EV_IO_CAPABILITY_RESPONSE:
+    case EV_USER_CONFIRMATION_REQUEST:
+        connection = connectionForBdaddr(&rxbuf_[2]);
+        break;
+    case EV_AUTHENTICATION_COMPLETE:
+    case EV_ENCRYPTION_CHANGE:
+    case EV_READ_REMOTE_SUPPORTED_FEATURES_COMPLETE:
+    case EV_READ_REMOTE_EXTENDED_FEATURES_COMPLETE:
+    case EV_READ_REMOTE_VERSION_INFORMATION_COMPLETE:
+    case EV_DISCONNECT_COMPLETE:
+        connection = connectionForHandle(rxbuf_[3] + (rxbuf_[4] << 8));
+        break;
+    }
+    if (connection) current_connection_ = connection;
+}
+
+BluetoothConnection *BluetoothController::connectionForBdaddr(const uint8_t *bdaddr)
+{
+    for (BluetoothConnection *connection = BluetoothConnection::s_first_; connection; connection = connection->next_) {
+        if ((connection->btController_ == this) && (memcmp(connection->device_bdaddr_, bdaddr, 6) == 0)) return connection;
+    }
+    return nullptr;
+}
+
+//*******************************************************************
+// Connection handle table.  Lookups start at the handle's home slot and
+// stop at the first free one, so removing an entry re-inserts the ones
+// that follow it.
+BluetoothConnection *BluetoothController::connectionForHandle(uint16_t handle)
+{
+    handle &= 0xfff;
+    uint8_t index = handle & (CONNECTION_HANDLE_TABLE_SIZE - 1);
+    for (uint8_t i = 0; i < CONNECTION_HANDLE_TABLE_SIZE; i++) {
+        connection_handle_t *entry = &connection_handles_[index];
+        if (entry->connection == nullptr) break;
+        if (entry->handle == handle) return entry->connection;
+        index = (index + 1) & (CONNECTION_HANDLE_TABLE_SIZE - 1);
+    }
+    return nullptr;
+}
+
+void BluetoothController::addConnectionHandle(BluetoothConnection *connection, uint16_t handle)
+{
+    handle &= 0xfff;
+    removeConnectionHandle(connection);
+    connection->device_connection_handle_ = handle;
+    uint8_t index = handle & (CONNECTION_HANDLE_TABLE_SIZE - 1);
+    for (uint8_t i = 0; i < CONNECTION_HANDLE_TABLE_SIZE; i++) {
+        connection_handle_t *entry = &connection_handles_[index];
+        if ((entry->connection == nullptr) || (entry->handle == handle)) {
+            entry->handle = handle;
+            entry->connection = connection;
+            return;
+        }
+        index = (index + 1) & (CONNECTION_HANDLE_TABLE_SIZE - 1);
+    }
+    DBGPrintf("??? Connection handle table full, handle: %x\n", handle);
+}
+
+void BluetoothController::removeConnectionHandle(BluetoothConnection *connection)
+{
+    uint8_t index;
+    for (index = 0; index < CONNECTION_HANDLE_TABLE_SIZE; index++) {
+        if (connection_handles_[index].connection == connection) break;
+    }
+    if (index == CONNECTION_HANDLE_TABLE_SIZE) return;
+    connection_handles_[index].connection = nullptr;
+
+    for (index = (index + 1) & (CONNECTION_HANDLE_TABLE_SIZE - 1); connection_handles_[index].connection;
+            index = (index + 1) & (CONNECTION_HANDLE_TABLE_SIZE - 1)) {
+        connection_handle_t entry = connection_handles_[index];
+        connection_handles_[index].connection = nullptr;
+        addConnectionHandle(entry.connection, entry.handle);
+    }
+}
+
+//*******************************************************************
+// HID descriptor buffers, lent to connections that need to keep their
+// report descriptor.
+uint8_t *BluetoothController::allocHIDDescriptorBuffer(BluetoothConnection *connection)
+{
+    int8_t index = -1;
+    for (uint8_t i = 0; i < HID_DESCRIPTOR_BUFFERS; i++) {
+        if (hid_descriptor_owners_[i] == connection) return hid_descriptor_buffers_[i];
+    }
+    // Best is the descriptor we cached for this device, then an empty
+    // buffer, else the one cached longest ago.
+    for (uint8_t i = 0; i < HID_DESCRIPTOR_BUFFERS; i++) {
+        if (hid_descriptor_owners_[i]) continue;
+        if (hid_descriptor_cached_size_[i] && (memcmp(hid_descriptor_bdaddr_[i], connection->device_bdaddr_, 6) == 0)) {
+            index = i;
+            break;
+        }
+        if ((index < 0) || (hid_descriptor_cached_size_[i] == 0)
+                || (hid_descriptor_cached_size_[index] && (hid_descriptor_last_used_[i] < hid_descriptor_last_used_[index]))) {
+            index = i;
+        }
+    }
+    if (index < 0) {
+        DBGPrintf("??? No free HID descriptor buffer for connection %p\n", connection);
+        return nullptr;
+    }
+
+    hid_descriptor_owners_[index] = connection;
+    connection->hid_report_count_ = 0;
+    if (!connection->hid_fields_) {
+        for (uint8_t i = 0; i < DEFAULT_CONNECTIONS; i++) {
+            if (hid_field_owners_[i]) continue;
+            hid_field_owners_[i] = connection;
+            connection->hid_fields_ = hid_field_buffers_[i];
+            break;
+        }
+    }
+    if (hid_descriptor_cached_size_[index] && (memcmp(hid_descriptor_bdaddr_[index], connection->device_bdaddr_, 6) == 0)) {
+        DBGPrintf("Using cached HID descriptor (%u bytes)\n", hid_descriptor_cached_size_[index]);
+        connection->descsize_ = hid_descriptor_cached_size_[index];
+    } else {
+        memcpy(hid_descriptor_bdaddr_[index], connection->device_bdaddr_, 6);
+        connection->descsize_ = 0;
+    }
+    hid_descriptor_cached_size_[index] = 0;
+    return hid_descriptor_buffers_[index];
+}
+
+// The descriptor has been compiled, so the connection only needs its field
+// table.  The buffer goes back to the pool, still cached for the device.
+void BluetoothController::releaseHIDDescriptorBuffer(BluetoothConnection *connection)
+{
+    for (uint8_t i = 0; i < HID_DESCRIPTOR_BUFFERS; i++) {
+        if (hid_descriptor_owners_[i] == connection) {
+            hid_descriptor_owners_[i] = nullptr;
+            // Remember the descriptor in case this device comes back.
+            if (connection->have_hid_descriptor_ && connection->descsize_) {
+                hid_descriptor_cached_size_[i] = connection->descsize_;
+                hid_descriptor_last_used_[i] = ++hid_descriptor_use_count_;
+            }
+        }
     }
+    connection->descriptor_ = nullptr;
+    connection->sdp_buffer_ = nullptr;
+    connection->descsize_ = 0;
+}
+
+void BluetoothController::freeHIDDescriptorBuffer(BluetoothConnection *connection)
+{
+    releaseHIDDescriptorBuffer(connection);
+    for (uint8_t i = 0; i < DEFAULT_CONNECTIONS; i++) {
+        if (hid_field_owners_[i] == connection) hid_field_owners_[i] = nullptr;
+    }
+    connection->have_hid_descriptor_ = false;
+    connection->hid_fields_ = nullptr;
+    connection->hid_report_count_ = 0;
+}
+
+// If we have this device's descriptor cached, take its buffer now, so it
+// can not be handed to another device before the connection uses it.
+bool BluetoothController::reserveCachedHIDDescriptor(BluetoothConnection *connection)
+{
+    for (uint8_t i = 0; i < HID_DESCRIPTOR_BUFFERS; i++) {
+        if (!hid_descriptor_owners_[i] && hid_descriptor_cached_size_[i]
+                && (memcmp(hid_descriptor_bdaddr_[i], connection->device_bdaddr_, 6) == 0)) {
+            connection->descriptor_ = allocHIDDescriptorBuffer(connection);
+            return true;
+        }
+    }
+    return false;
+}
+
+void BluetoothController::clearConnectionHandles()
+{
+    for (uint8_t i = 0; i < CONNECTION_HANDLE_TABLE_SIZE; i++) connection_handles_[i].connection = nullptr;
 }
 
 
@@ -2531,70 +3196,110 @@ bool BluetoothController::setLEScanParameters(uint8_t scan_type, uint16_t scan_i
     return true;
 }
 
+//=============================================================================
+// LE connections, HID over GATT runs on them once connected
+//=============================================================================
+bool BluetoothController::connectLE(const uint8_t bdaddr[6], uint8_t address_type, uint16_t min_interval, uint16_t max_interval,
+                                    uint16_t latency, uint16_t supervision_timeout)
+{
+    DBGPrintf("HCI_LE_CREATE_CONNECTION %02X:%02X:%02X:%02X:%02X:%02X interval:%u-%u\n", bdaddr[5], bdaddr[4], bdaddr[3],
+              bdaddr[2], bdaddr[1], bdaddr[0], min_interval, max_interval);
+    // Some controllers can not scan and initiate at the same time.
+    setLEScanEnable(false, false);
+    le_connect_max_interval_ = max_interval;
+
+    //  0    1    2    3    4    5  ... 10   11   12 13   14 15   16 17   18 19   20 21   22 23
+    // SI   SI   SW   SW   FP   AT  BD*6  OAT  MIN MIN  MAX MAX  LAT LAT  TO TO  CE CE   CE CE
+    uint8_t hci_data[25];
+    hci_data[0] = 0x60; // scan interval 60ms
+    hci_data[1] = 0x00;
+    hci_data[2] = 0x30; // scan window 30ms
+    hci_data[3] = 0x00;
+    hci_data[4] = 0;    // use the peer address, not the white list
+    hci_data[5] = address_type;
+    memcpy(&hci_data[6], bdaddr, 6);
+    hci_data[12] = 0;   // own address public
+    hci_data[13] = min_interval & 0xff;
+    hci_data[14] = min_interval >> 8;
+    hci_data[15] = max_interval & 0xff;
+    hci_data[16] = max_interval >> 8;
+    hci_data[17] = latency & 0xff;
+    hci_data[18] = latency >> 8;
+    hci_data[19] = supervision_timeout & 0xff;
+    hci_data[20] = supervision_timeout >> 8;
+    hci_data[21] = 0;   // min/max connection event length
+    hci_data[22] = 0;
+    hci_data[23] = 0;
+    hci_data[24] = 0;
+    sendHCICommand(HCI_LE_CREATE_CONNECTION, sizeof(hci_data), hci_data);
+    return true;
+}
+
+void BluetoothController::cancelConnectLE()
+{
+    DBGPrintf("HCI_LE_CREATE_CONNECTION_CANCEL\n");
+    sendHCICommand(HCI_LE_CREATE_CONNECTION_CANCEL, 0, nullptr);
+}
+
+void BluetoothController::handle_le_connection_complete(bool enhanced)
+{
+    //             ST  handle  role  AT  BD*6  (enhanced: local RPA*6 peer RPA*6)  interval  latency  timeout  CA
+    // 3E 13 01    00  40 00   00    00  ...                                        06 00     00 00    C8 00    00
+    uint16_t handle = rxbuf_[4] + ((uint16_t)rxbuf_[5] << 8);
+    uint8_t index_interval = enhanced ? 26 : 14;
+    uint16_t interval = rxbuf_[index_interval] + (rxbuf_[index_interval + 1] << 8);
+    DBGPrintf("    LE Connection Complete - ST:%x handle:%x role:%u BD:%02X:%02X:%02X:%02X:%02X:%02X interval:%u\n",
+              rxbuf_[3], handle, rxbuf_[6], rxbuf_[13], rxbuf_[12], rxbuf_[11], rxbuf_[10], rxbuf_[9], rxbuf_[8], interval);
+    if (rxbuf_[3]) return;
+
+    BluetoothConnection *connection = BluetoothConnection::s_first_;
+    while (connection) {
+        if (connection->btController_ == nullptr) break;
+        connection = connection->next_;
+    }
+    if (connection == nullptr) {
+        DBGPrintf("\tError no free BluetoothConnection object\n");
+        return;
+    }
+    count_connections_++;
+    current_connection_ = connection;
+    connection->initializeConnection(this, &rxbuf_[8], 0, false);
+    connection->le_connection_ = true;
+    connection->le_address_type_ = rxbuf_[7];
+    connection->le_interval_ = interval;
+    connection->le_max_interval_ = le_connect_max_interval_;
+    addConnectionHandle(connection, handle);
+    connection->startGATTDiscovery();
+}
+
+void BluetoothController::handle_le_connection_update_complete()
+{
+    //             ST  handle  interval  latency  timeout
+    // 3E 0A 03    00  40 00   06 00     00 00    C8 00
+    uint16_t handle = rxbuf_[4] + ((uint16_t)rxbuf_[5] << 8);
+    uint16_t interval = rxbuf_[6] + (rxbuf_[7] << 8);
+    DBGPrintf("    LE Connection Update Complete - ST:%x handle:%x interval:%u latency:%u\n", rxbuf_[3], handle,
+              interval, rxbuf_[8] + (rxbuf_[9] << 8));
+    if (rxbuf_[3]) return;
+    BluetoothConnection *connection = connectionForHandle(handle);
+    if (connection) connection->le_interval_ = interval;
+}
+
 void BluetoothController::handle_ev_meta_event() { // 0x3e
 //<<(01, 74):3E 2B 02 | 01 03 01 90 A4 0E 8F BA 20 1F 1E FF 06 00 01 09 20 22 1E 4D 54 BF 0B 07 41 F7 D8 91 12 A9 A0 76 00 A6 74 19 26 2B F5 82 EF BC 
-    USBHDBGSerial.printf("handle_ev_meta_event SubEvent: %u", rxbuf_[2]);
+    VDBGPrintf("handle_ev_meta_event SubEvent: %u\n", rxbuf_[2]);
     switch (rxbuf_[2]) {
     case EV_LE_Connection_Complete:
+        handle_le_connection_complete(false);
+        break;
+    case EV_LE_ENHANCED_CONNECTION_COMPLETE:
+        handle_le_connection_complete(true);
         break;
     case EV_LE_ADVERTISING_REPORT:
-        {
-            uint8_t cnt_reports = rxbuf_[3];
-            USBHDBGSerial.printf(" Advertise Report: Num reports: %u ET:",  rxbuf_[3]);
-            uint8_t index = 4;
-            for (uint8_t i = 0; i < cnt_reports; i++) {
-                USBHDBGSerial.printf(" %u", rxbuf_[index]);
-                switch (rxbuf_[index]) {
-                case 0: USBHDBGSerial.printf("(ADV_IND)"); break;
-                case 1: USBHDBGSerial.printf("(ADV_DIRECT_IND)"); break; 
-                case 2: USBHDBGSerial.printf("(ADV_SCAN_IND)"); break; 
-                case 3: USBHDBGSerial.printf("(ADV_NONCONN_IND)"); break; 
-                case 4: USBHDBGSerial.printf("(SCAN_RSP)"); break; 
-                }
-                index++;
-            }
-            USBHDBGSerial.printf(" AT:");
-            for (uint8_t i = 0; i < cnt_reports; i++) {
-                USBHDBGSerial.printf(" %u", rxbuf_[index]);
-                switch (rxbuf_[index]) {
-                case 0: USBHDBGSerial.printf("(Public Device Address)"); break;
-                case 1: USBHDBGSerial.printf("(Random Device Address)"); break; 
-                case 2: USBHDBGSerial.printf("(Public Identity Address)"); break; 
-                case 3: USBHDBGSerial.printf("(Random static)"); break; 
-                }
-                index++;
-            }
-            for (uint8_t i = 0; i < cnt_reports; i++) {
-                USBHDBGSerial.printf("%02X:%02X:%02X:%02X:%02X:%02X", rxbuf_[index+5], rxbuf_[index+4],
-                    rxbuf_[index+3], rxbuf_[index+2], rxbuf_[index+1], rxbuf_[index+0]);
-                index += 6;
-            }
-            // lets loop in the data:
-            USBHDBGSerial.printf("\n");
-            uint8_t data_index = index + cnt_reports;
-            for (uint8_t i = 0; i < cnt_reports; i++) {
-                USBHDBGSerial.printf("\t(%u):", i);
-                uint8_t data_length = rxbuf_[index++];
-                uint8_t ad_start = 0;
-                while (ad_start < data_length) {
-                    uint8_t ads_len = rxbuf_[data_index + ad_start];
-                    uint8_t ads_type = rxbuf_[data_index + ad_start+1];
-                    USBHDBGSerial.printf(" || len:%u type:%x data:", ads_len, ads_type);
-                    if ((ads_type == 0x9) || (ads_type == 0x08)) {
-                        USBHDBGSerial.printf("'");
-                        USBHDBGSerial.write(&rxbuf_[data_index + ad_start+2], ads_len-1);
-                        USBHDBGSerial.printf("'");
-                    } else {
-                        for (uint8_t j=1; j < ads_len; j++ ) USBHDBGSerial.printf(" %02X", rxbuf_[data_index + ad_start+1+j]);
-                    }
-                    ad_start += ads_len + 1;
-                }
-                USBHDBGSerial.printf("\n");
-                data_index += data_length;
-            }
-        }
+        handle_le_advertising_report();
         break;
     case EV_LE_CONNECTION_UPDATE_COMPLETE:
+        handle_le_connection_update_complete();
         break;
     case EV_LE_READ_REMOTE_FEATURES_COMPLETE:
         break;
@@ -2604,3 +3309,210 @@ void BluetoothController::handle_ev_meta_event() { // 0x3e
     }
 }
 
+//=============================================================================
+// HCI capture
+//=============================================================================
+void BluetoothController::startHCICapture(void *buffer, uint32_t size)
+{
+    bool irq_was_enabled = NVIC_IS_ENABLED(IRQ_USBHS);
+    NVIC_DISABLE_IRQ(IRQ_USBHS);
+    hci_capture_buffer_ = (uint8_t *)buffer;
+    hci_capture_size_ = buffer? size : 0;
+    hci_capture_used_ = 0;
+    hci_capture_dropped_ = 0;
+    hci_capture_enabled_ = (buffer != nullptr);
+    if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+}
+
+// Called from the USB interrupt or with it disabled, so the records are
+// appended one at a time.
+void BluetoothController::captureHCIPacket(uint8_t type, bool received, const uint8_t *data, uint16_t captured, uint16_t length)
+{
+    uint32_t used = hci_capture_used_;
+    uint32_t record_size = (sizeof(hci_capture_record_t) + captured + 3) & ~3;
+    if ((used + record_size) > hci_capture_size_) {
+        hci_capture_dropped_++;
+        return;
+    }
+    hci_capture_record_t *record = (hci_capture_record_t *)(hci_capture_buffer_ + used);
+    record->timestamp = micros();
+    record->length = length;
+    record->captured = captured;
+    record->type = type;
+    record->received = received;
+    memcpy(record + 1, data, captured);
+    hci_capture_used_ = used + record_size;
+}
+
+static void write_be32(Print &out, uint32_t val)
+{
+    uint8_t buf[4] = {(uint8_t)(val >> 24), (uint8_t)(val >> 16), (uint8_t)(val >> 8), (uint8_t)val};
+    out.write(buf, 4);
+}
+
+// btsnoop: "btsnoop\0", version 1, datalink 1002 (H4) then per packet
+// <original length><included length><flags><drops><timestamp 64>, all big
+// endian, followed by the H4 type byte and the packet.  The timestamp is in
+// microseconds since year 0, here the time since the Teensy started.
+size_t BluetoothController::writeHCICapture(Print &out)
+{
+    static const uint8_t btsnoop_header[8] = {'b', 't', 's', 'n', 'o', 'o', 'p', 0};
+    const uint64_t btsnoop_epoch_delta = 0x00dcddb30f2f8000ull;
+    if (!hci_capture_buffer_) return 0;
+
+    size_t cb = out.write(btsnoop_header, sizeof(btsnoop_header));
+    write_be32(out, 1);
+    write_be32(out, 1002);
+    cb += 8;
+
+    // records are only appended, so everything up to used is complete.
+    uint32_t used = hci_capture_used_;
+    uint32_t offset = 0;
+    uint32_t prev_timestamp = 0;
+    uint64_t timestamp = btsnoop_epoch_delta;
+    while (offset < used) {
+        const hci_capture_record_t *record = (const hci_capture_record_t *)(hci_capture_buffer_ + offset);
+        if (offset == 0) prev_timestamp = record->timestamp;
+        timestamp += (uint32_t)(record->timestamp - prev_timestamp);    // handles micros() wrapping
+        prev_timestamp = record->timestamp;
+
+        uint32_t flags = (record->received ? 0x01 : 0) | ((record->type != HCI_CAPTURE_ACL) ? 0x02 : 0);
+        write_be32(out, record->length + 1);
+        write_be32(out, record->captured + 1);
+        write_be32(out, flags);
+        write_be32(out, 0);
+        write_be32(out, timestamp >> 32);
+        write_be32(out, (uint32_t)timestamp);
+        out.write(record->type);
+        out.write((const uint8_t *)(record + 1), record->captured);
+        cb += 24 + 1 + record->captured;
+        offset += (sizeof(hci_capture_record_t) + record->captured + 3) & ~3;
+    }
+    return cb;
+}
+
+//=============================================================================
+// Statistics
+//=============================================================================
+void BluetoothController::getStatistics(BluetoothStatistics_t &stats)
+{
+    bool irq_was_enabled = NVIC_IS_ENABLED(IRQ_USBHS);
+    NVIC_DISABLE_IRQ(IRQ_USBHS);
+    stats = stats_;
+    if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+}
+
+void BluetoothController::resetStatistics()
+{
+    bool irq_was_enabled = NVIC_IS_ENABLED(IRQ_USBHS);
+    NVIC_DISABLE_IRQ(IRQ_USBHS);
+    memset(&stats_, 0, sizeof(stats_));
+    if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+}
+
+//=============================================================================
+// LE advertising reports
+//=============================================================================
+void BluetoothController::handle_le_advertising_report() {
+    // <3E><len><02><num reports> then for each report:
+    // <event type><address type><bdaddr 6><data length><data...><rssi>
+    uint8_t cnt_reports = rxbuf_[3];
+    uint16_t index = 4;
+    uint16_t end = rxbuf_[1] + 2;
+    for (uint8_t i = 0; i < cnt_reports; i++) {
+        const uint8_t *report = &rxbuf_[index];
+        if ((index + 10) > end) break;
+        uint8_t data_length = report[8];
+        if ((data_length > sizeof(BLEAdvertisingReport_t::data)) || ((index + 10 + data_length) > end)) break;
+        index += 10 + data_length;
+
+        VDBGPrintf("    LE Adv(%u) ET:%u AT:%u %02X:%02X:%02X:%02X:%02X:%02X len:%u rssi:%d\n", i, report[0], report[1],
+                   report[7], report[6], report[5], report[4], report[3], report[2], data_length, (int8_t)report[9 + data_length]);
+        if (!leAdvertisingFilterMatch(&report[2], &report[9], data_length)) continue;
+
+        BLEAdvertisingReport_t *adv;
+        BLEAdvertisingReport_t adv_cb;
+        uint8_t head = le_adv_report_head_;
+        uint8_t next_head = (head + 1) % LE_ADV_REPORT_QUEUE_SIZE;
+        if (le_adv_report_cb_) {
+            adv = &adv_cb;
+        } else if (next_head == le_adv_report_tail_) {
+            le_adv_reports_dropped_++;
+            continue;
+        } else {
+            adv = &le_adv_reports_[head];
+        }
+        adv->event_type = report[0];
+        adv->address_type = report[1];
+        memcpy(adv->bdaddr, &report[2], 6);
+        adv->data_length = data_length;
+        memcpy(adv->data, &report[9], data_length);
+        adv->rssi = (int8_t)report[9 + data_length];
+        if (le_adv_report_cb_) (*le_adv_report_cb_)(adv_cb);
+        else le_adv_report_head_ = next_head;
+    }
+}
+
+bool BluetoothController::leAdvertisingFilterMatch(const uint8_t bdaddr[6], const uint8_t *data, uint8_t data_length) {
+    if (le_adv_filter_address_ && (memcmp(bdaddr, le_adv_filter_bdaddr_, 6) != 0)) return false;
+    if ((le_adv_filter_uuid16_ == 0) && (le_adv_filter_company_id_ < 0)) return true;
+
+    bool uuid_match = (le_adv_filter_uuid16_ == 0);
+    bool company_match = (le_adv_filter_company_id_ < 0);
+    uint8_t ad_start = 0;
+    while ((ad_start + 1) < data_length) {
+        uint8_t ad_len = data[ad_start];
+        if ((ad_len == 0) || ((ad_start + 1 + ad_len) > data_length)) break;
+        uint8_t ad_type = data[ad_start + 1];
+        const uint8_t *ad_data = &data[ad_start + 2];
+        switch (ad_type) {
+        case 0x02:  // Incomplete list of 16-bit service UUIDs
+        case 0x03:  // Complete list of 16-bit service UUIDs
+            for (uint8_t i = 0; (i + 1) < ad_len - 1; i += 2) {
+                if ((ad_data[i] + (ad_data[i + 1] << 8)) == le_adv_filter_uuid16_) uuid_match = true;
+            }
+            break;
+        case 0x16:  // Service data - 16-bit UUID
+            if ((ad_len >= 3) && ((ad_data[0] + (ad_data[1] << 8)) == le_adv_filter_uuid16_)) uuid_match = true;
+            break;
+        case 0xFF:  // Manufacturer specific data, starts with the company ID
+            if ((ad_len >= 3) && ((ad_data[0] + (ad_data[1] << 8)) == le_adv_filter_company_id_)) company_match = true;
+            break;
+        }
+        ad_start += ad_len + 1;
+    }
+    return uuid_match && company_match;
+}
+
+void BluetoothController::setLEAdvertisingAddressFilter(const uint8_t bdaddr[6]) {
+    le_adv_filter_address_ = (bdaddr != nullptr);
+    if (bdaddr) memcpy(le_adv_filter_bdaddr_, bdaddr, 6);
+}
+
+int BluetoothController::availableLEAdvertisingReports() {
+    return (le_adv_report_head_ + LE_ADV_REPORT_QUEUE_SIZE - le_adv_report_tail_) % LE_ADV_REPORT_QUEUE_SIZE;
+}
+
+bool BluetoothController::readLEAdvertisingReport(BLEAdvertisingReport_t &report) {
+    uint8_t tail = le_adv_report_tail_;
+    if (tail == le_adv_report_head_) return false;
+    report = le_adv_reports_[tail];
+    le_adv_report_tail_ = (tail + 1) % LE_ADV_REPORT_QUEUE_SIZE;
+    return true;
+}
+
+const uint8_t *BluetoothController::findLEAdvertisingData(const BLEAdvertisingReport_t &report, uint8_t ad_type, uint8_t &length) {
+    uint8_t ad_start = 0;
+    while ((ad_start + 1) < report.data_length) {
+        uint8_t ad_len = report.data[ad_start];
+        if ((ad_len == 0) || ((ad_start + 1 + ad_len) > report.data_length)) break;
+        if (report.data[ad_start + 1] == ad_type) {
+            length = ad_len - 1;
+            return &report.data[ad_start + 2];
+        }
+        ad_start += ad_len + 1;
+    }
+    length = 0;
+    return nullptr;
+}
+
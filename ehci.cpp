@@ -1466,3 +1466,65 @@ void USBHost::delete_Pipe(Pipe_t *pipe)
 }
 
 
+// Forget all unfinished transfers on a bulk pipe, without doing their
+// callbacks, so a driver can resync with a device that stopped taking or
+// giving data (Bulk-Only Mass Storage reset recovery).  The pipe stays in
+// place, with its data toggle back at DATA0, ready for new transfers.
+void USBHost::cancel_Transfers(Pipe_t *pipe)
+{
+	println("cancel_Transfers ", (uint32_t)pipe, HEX);
+	if (pipe->type != 2) return;
+	bool irq_was_enabled = NVIC_IS_ENABLED(IRQ_USBHS);
+	NVIC_DISABLE_IRQ(IRQ_USBHS);
+
+	// take the QH off the async schedule, the same way delete_Pipe does,
+	// so the EHCI is not using it while we change it
+	Pipe_t *prev = NULL;
+	Pipe_t *next = (Pipe_t *)(pipe->qh.horizontal_link & 0xFFFFFFE0);
+	if (next == pipe) {
+		USBHS_USBCMD &= ~USBHS_USBCMD_ASE; // disable async schedule
+		while (USBHS_USBSTS & USBHS_USBSTS_AS) ; // busy loop wait
+	} else {
+		prev = next;
+		while (1) {
+			Pipe_t *n = (Pipe_t *)(prev->qh.horizontal_link & 0xFFFFFFE0);
+			if (n == pipe) break;
+			prev = n;
+		}
+		if (pipe->qh.capabilities[0] & 0x8000) {
+			prev->qh.capabilities[0] |= 0x8000; // set H bit
+			pipe->qh.capabilities[0] &= ~0x8000;
+		}
+		prev->qh.horizontal_link = pipe->qh.horizontal_link;
+		USBHS_USBCMD |= USBHS_USBCMD_IAA;
+		while (!(USBHS_USBSTS & USBHS_USBSTS_AAI)) ; // busy loop wait
+		USBHS_USBSTS = USBHS_USBSTS_AAI;
+	}
+
+	// the halt qTD ends the chain, everything queued before it goes
+	Transfer_t *halt = (Transfer_t *)(pipe->qh.next & ~0x1F);
+	while (halt->qtd.next != 1) halt = (Transfer_t *)(halt->qtd.next);
+	Transfer_t *t = async_followup_first;
+	while (t && (t->pipe != pipe)) t = t->next_followup;
+	while (t && (t != halt)) {
+		Transfer_t *next = (Transfer_t *)(t->qtd.next);
+		remove_from_async_followup_list(t);
+		free_Transfer(t);
+		t = next;
+	}
+	pipe->qh.next = (uint32_t)halt;
+	pipe->qh.alt_next = 1;
+	pipe->qh.current = 0;
+	pipe->qh.token = 0;
+
+	// and put it back
+	if (prev) {
+		pipe->qh.horizontal_link = prev->qh.horizontal_link;
+		prev->qh.horizontal_link = (uint32_t)&(pipe->qh) | 2;
+	} else {
+		USBHS_USBCMD |= USBHS_USBCMD_ASE; // enable async schedule
+	}
+	if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+}
+
+
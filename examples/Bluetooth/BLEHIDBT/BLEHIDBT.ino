@@ -0,0 +1,72 @@
+// BLEHIDBT - use a BLE (HID over GATT) keyboard, mouse or gamepad.
+//
+// Scans for devices advertising the HID service and connects to the first
+// one found, asking for a 7.5ms connection interval.  The device needs to be
+// in pairing mode the first time.  Devices that insist on LE pairing
+// (encryption) are not supported yet.
+//
+// This example is in the public domain
+#include <USBHost_t36.h>
+
+USBHost myusb;
+USBHub hub1(myusb);
+BluetoothController bluet(myusb);
+KeyboardController keyboard1(myusb);
+MouseController mouse1(myusb);
+JoystickController joystick1(myusb);
+
+bool connecting = false;
+
+void OnPress(int key)
+{
+  Serial.printf("key '%c' (%d)\n", (key >= ' ' && key < 0x7f) ? key : ' ', key);
+}
+
+void startScan()
+{
+  connecting = false;
+  bluet.setLEAdvertisingUUIDFilter(0x1812);  // HID service
+  bluet.setLEScanParameters(0x1, 0x20, 0x20, 0x0, 0x0);
+  bluet.setLEScanEnable(true, true);
+  Serial.println("Scanning for BLE HID devices...");
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  while (!Serial) ; // wait for Arduino Serial Monitor
+  myusb.begin();
+  keyboard1.attachPress(OnPress);
+  Serial.println("\nBLEHIDBT - press any key to scan for devices");
+}
+
+void loop()
+{
+  myusb.Task();
+
+  if (Serial.available()) {
+    while (Serial.read() != -1) ;
+    startScan();
+  }
+
+  BLEAdvertisingReport_t report;
+  while (bluet.readLEAdvertisingReport(report)) {
+    if (connecting) continue;
+    Serial.printf("Connecting to %02X:%02X:%02X:%02X:%02X:%02X rssi:%d\n", report.bdaddr[5], report.bdaddr[4],
+                  report.bdaddr[3], report.bdaddr[2], report.bdaddr[1], report.bdaddr[0], report.rssi);
+    connecting = bluet.connectLE(report.bdaddr, report.address_type, 6, 12);
+  }
+
+  if (mouse1.available()) {
+    Serial.printf("Mouse: buttons:%x x:%d y:%d wheel:%d\n", mouse1.getButtons(), mouse1.getMouseX(),
+                  mouse1.getMouseY(), mouse1.getWheel());
+    mouse1.mouseDataClear();
+  }
+
+  if (joystick1.available()) {
+    Serial.printf("Joystick: buttons:%x", joystick1.getButtons());
+    for (uint8_t i = 0; i < 6; i++) Serial.printf(" %d", joystick1.getAxis(i));
+    Serial.println();
+    joystick1.joystickDataClear();
+  }
+}
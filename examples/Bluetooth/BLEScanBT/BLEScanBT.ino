@@ -0,0 +1,94 @@
+// BLEScanBT - scan for BLE advertisers with a Bluetooth dongle.
+//
+// Prints each advertising report that passes the filters, and once a
+// second the report rate and how many reports were dropped because the
+// sketch did not read them fast enough.
+//
+// Commands from the Serial Monitor:
+//   s - start/stop scanning
+//   u - toggle a 16-bit service UUID filter (0x180F battery service)
+//   m - toggle a manufacturer filter (0x004C)
+//   q - toggle printing the reports (the rate is still shown)
+//
+// This example is in the public domain
+#include <USBHost_t36.h>
+
+USBHost myusb;
+USBHub hub1(myusb);
+BluetoothController bluet(myusb);
+
+bool scanning = false;
+bool print_reports = true;
+uint32_t report_count = 0;
+elapsedMillis em_rate;
+
+void printReport(const BLEAdvertisingReport_t &report) {
+  Serial.printf("%02X:%02X:%02X:%02X:%02X:%02X type:%u rssi:%4d", report.bdaddr[5], report.bdaddr[4],
+                report.bdaddr[3], report.bdaddr[2], report.bdaddr[1], report.bdaddr[0], report.event_type, report.rssi);
+  uint8_t length;
+  const uint8_t *name = BluetoothController::findLEAdvertisingData(report, 0x09, length);  // Complete local name
+  if (!name) name = BluetoothController::findLEAdvertisingData(report, 0x08, length);  // Shortened local name
+  if (name) Serial.printf(" name:%.*s", length, (const char *)name);
+  Serial.println();
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  while (!Serial) ; // wait for Arduino Serial Monitor
+  myusb.begin();
+  Serial.println("\nBLEScanBT - press s to start/stop scanning");
+}
+
+void loop()
+{
+  myusb.Task();
+
+  if (Serial.available()) {
+    int ch = Serial.read();
+    while (Serial.read() != -1) ;
+    switch (ch) {
+      case 's':
+        scanning = !scanning;
+        if (scanning) {
+          bluet.setLEScanParameters(0x1, 0x20, 0x20, 0x0, 0x0);
+          bluet.setLEScanEnable(true, false);
+        } else {
+          bluet.setLEScanEnable(false, true);
+        }
+        Serial.printf("Scanning %s\n", scanning ? "on" : "off");
+        break;
+      case 'u':
+        {
+          static bool uuid_filter = false;
+          uuid_filter = !uuid_filter;
+          bluet.setLEAdvertisingUUIDFilter(uuid_filter ? 0x180F : 0);
+          Serial.printf("UUID filter %s\n", uuid_filter ? "on" : "off");
+        }
+        break;
+      case 'm':
+        {
+          static bool company_filter = false;
+          company_filter = !company_filter;
+          bluet.setLEAdvertisingManufacturerFilter(company_filter ? 0x004C : -1);
+          Serial.printf("Manufacturer filter %s\n", company_filter ? "on" : "off");
+        }
+        break;
+      case 'q':
+        print_reports = !print_reports;
+        break;
+    }
+  }
+
+  BLEAdvertisingReport_t report;
+  while (bluet.readLEAdvertisingReport(report)) {
+    report_count++;
+    if (print_reports) printReport(report);
+  }
+
+  if (scanning && (em_rate >= 1000)) {
+    Serial.printf("*** %u reports/s, %u dropped ***\n", report_count, bluet.LEAdvertisingReportsDropped());
+    report_count = 0;
+    em_rate = 0;
+  }
+}
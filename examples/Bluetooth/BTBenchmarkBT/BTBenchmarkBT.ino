@@ -0,0 +1,66 @@
+// BTBenchmarkBT - measure the cost of the Bluetooth receive path.
+//
+// Pair or connect a Bluetooth keyboard, mouse or joystick and keep it busy
+// (move the mouse, hold the sticks...).  Once a second this prints the
+// reports per second, the CPU cycles the host code spent per HCI event and
+// per report (average and max), and how long the last connection took from
+// its start until its reports were set up.
+//
+// Run it before and after a change to the Bluetooth code, with the same
+// device doing the same thing.  HCICaptureBT can record the traffic as well.
+//
+// This example is in the public domain
+#include <USBHost_t36.h>
+
+USBHost myusb;
+USBHub hub1(myusb);
+BluetoothController bluet(myusb);   // version assumed keyboard
+//BluetoothController bluet(myusb, true, "0000");   // Version does pairing to device
+KeyboardController keyboard1(myusb);
+MouseController mouse1(myusb);
+JoystickController joystick1(myusb);
+
+elapsedMillis em;
+uint32_t connect_us = 0;
+
+void setup()
+{
+  Serial.begin(9600);
+  while (!Serial) ; // wait for Arduino Serial Monitor
+
+  // Cycle counter used for the timings.
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+
+  myusb.begin();
+  Serial.println("\nBTBenchmarkBT - press any key to reset the statistics");
+  Serial.println(" reports/s  cyc/report  max  events/s  cyc/event  max  connect ms  tx drops");
+}
+
+void loop()
+{
+  myusb.Task();
+  if (mouse1.available()) mouse1.mouseDataClear();
+  if (joystick1.available()) joystick1.joystickDataClear();
+
+  if (Serial.available()) {
+    while (Serial.read() != -1) ;
+    bluet.resetStatistics();
+    em = 0;
+  }
+
+  if (em >= 1000) {
+    BluetoothStatistics_t stats;
+    bluet.getStatistics(stats);
+    bluet.resetStatistics();
+    if (stats.connect_us) connect_us = stats.connect_us;
+    uint32_t ms = em;
+    em = 0;
+    Serial.printf("%10u %11u %5u %9u %10u %5u %11u %9u\n",
+                  stats.acl_packets * 1000 / ms,
+                  stats.acl_packets ? stats.acl_cycles / stats.acl_packets : 0, stats.acl_cycles_max,
+                  stats.events * 1000 / ms,
+                  stats.events ? stats.event_cycles / stats.events : 0, stats.event_cycles_max,
+                  connect_us / 1000, stats.tx_cmd_dropped + stats.tx_acl_dropped);
+  }
+}
@@ -0,0 +1,53 @@
+// HCICaptureBT - capture the Bluetooth HCI traffic and save it as a btsnoop
+// file on the SD card, which can be opened with Wireshark.
+//
+// Capture runs from startup so pairing and connecting are included.  Press
+// any key in the Serial Monitor to stop the capture and write HCI.LOG.
+//
+// This example is in the public domain
+#include <USBHost_t36.h>
+#include <SD.h>
+
+USBHost myusb;
+USBHub hub1(myusb);
+USBHIDParser hid1(myusb);
+USBHIDParser hid2(myusb);
+BluetoothController bluet(myusb);   // version assumes it already was paired
+KeyboardController keyboard1(myusb);
+MouseController mouse1(myusb);
+JoystickController joystick1(myusb);
+
+#define CAPTURE_FILE_NAME "HCI.LOG"
+DMAMEM uint8_t capture_buffer[64 * 1024];
+
+void setup()
+{
+  Serial.begin(9600);
+  while (!Serial) ; // wait for Arduino Serial Monitor
+
+  bluet.startHCICapture(capture_buffer, sizeof(capture_buffer));
+  myusb.begin();
+  if (!SD.begin(BUILTIN_SDCARD)) Serial.println("*** SD card not found ***");
+  Serial.println("\nHCICaptureBT - press any key to save the capture to " CAPTURE_FILE_NAME);
+}
+
+void loop()
+{
+  myusb.Task();
+
+  if (Serial.available()) {
+    while (Serial.read() != -1) ;
+    bluet.stopHCICapture();
+    SD.remove(CAPTURE_FILE_NAME);
+    File file = SD.open(CAPTURE_FILE_NAME, FILE_WRITE);
+    if (file) {
+      size_t cb = bluet.writeHCICapture(file);
+      file.close();
+      Serial.printf("Wrote %u bytes to " CAPTURE_FILE_NAME ", %u packets did not fit\n", cb, bluet.HCICaptureDropped());
+    } else {
+      Serial.println("*** Could not create " CAPTURE_FILE_NAME " ***");
+    }
+    bluet.startHCICapture(capture_buffer, sizeof(capture_buffer));
+    Serial.println("Capture restarted");
+  }
+}
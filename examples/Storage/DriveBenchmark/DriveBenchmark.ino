@@ -0,0 +1,182 @@
+// DriveBenchmark - measure USB drive throughput and latency.
+//
+// Sequential and random reads/writes at several transfer sizes, through
+// the raw sector API (USBDrive::readSectors/writeSectors) and through the
+// filesystem (USBFilesystem/SdFat).  Reports MB/s, IOPS and latency
+// percentiles.
+//
+// The raw sector tests only touch the sectors of the test file, which is
+// preallocated contiguous, so nothing else on the drive is overwritten.
+// The test file is removed at the end.
+#include <USBHost_t36.h>
+
+// Setup USBHost_t36 and as many HUB ports as needed.
+USBHost myusb;
+USBHub hub1(myusb);
+
+// Instances for one drive
+USBDrive myDrive(myusb);
+
+// Instances for accessing the files on the drive
+USBFilesystem myFiles(myusb);
+
+#define TEST_FILE_NAME "bench.dat"
+#define TEST_FILE_SIZE (8ul * 1024 * 1024)
+#define MAX_TRANSFER_SIZE (32ul * 1024)
+#define RANDOM_OPS 256
+
+const uint32_t transfer_sizes[] = {512, 4096, 32768};
+
+uint8_t buffer[MAX_TRANSFER_SIZE] __attribute__((aligned(32)));
+uint32_t latencies[RANDOM_OPS];
+
+uint32_t first_sector;  // raw sector range of the test file
+uint32_t last_sector;
+
+//=============================================================================
+int compareLatency(const void *a, const void *b) {
+  uint32_t la = *(const uint32_t *)a;
+  uint32_t lb = *(const uint32_t *)b;
+  return (la > lb) - (la < lb);
+}
+
+// Print one result line, sorts latencies[0..ops-1].
+void printResult(const char *api, const char *test, uint32_t size, uint32_t ops,
+                 uint32_t total_us, bool ok) {
+  Serial.printf("%-4s %-10s %6u ", api, test, size);
+  if (!ok) {
+    Serial.printf("FAILED  error:%x\n", myDrive.errorCode());
+    return;
+  }
+  if (total_us == 0) total_us = 1;
+  float mbs = (float)size * ops / total_us;  // bytes/us == MB/s
+  float iops = (float)ops * 1000000.0f / total_us;
+  qsort(latencies, ops, sizeof(latencies[0]), compareLatency);
+  Serial.printf("%8.2f %8.0f %7u %7u %7u %7u\n", mbs, iops,
+                latencies[ops / 2], latencies[(ops * 90) / 100],
+                latencies[(ops * 99) / 100], latencies[ops - 1]);
+}
+
+void printHeader() {
+  Serial.println("API  Test         Size     MB/s     IOPS  p50 us  p90 us  p99 us  max us");
+}
+
+uint32_t testOps(uint32_t size) {
+  uint32_t ops = TEST_FILE_SIZE / size;
+  if (ops > RANDOM_OPS) ops = RANDOM_OPS;
+  return ops;
+}
+
+//=============================================================================
+// Raw sector API
+//=============================================================================
+void rawTest(const char *test, uint32_t size, bool write, bool random_access) {
+  uint32_t sectors = size / 512;
+  uint32_t range = last_sector - first_sector + 1 - sectors;
+  uint32_t ops = testOps(size);
+  bool ok = true;
+  memset(buffer, 0xA5, size);
+  elapsedMicros em_total;
+  for (uint32_t i = 0; i < ops; i++) {
+    uint32_t sector = random_access ? first_sector + random(range + 1) : first_sector + i * sectors;
+    elapsedMicros em;
+    if (write) ok = myDrive.writeSectors(sector, buffer, sectors);
+    else ok = myDrive.readSectors(sector, buffer, sectors);
+    latencies[i] = em;
+    if (!ok) break;
+  }
+  if (write) ok &= myDrive.syncDevice();
+  printResult("raw", test, size, ops, em_total, ok);
+}
+
+//=============================================================================
+// Filesystem
+//=============================================================================
+void fileTest(FsFile &file, const char *test, uint32_t size, bool write, bool random_access) {
+  uint32_t ops = testOps(size);
+  uint32_t range = TEST_FILE_SIZE / size;
+  bool ok = true;
+  memset(buffer, 0x5A, size);
+  file.seekSet(0);
+  elapsedMicros em_total;
+  for (uint32_t i = 0; i < ops; i++) {
+    elapsedMicros em;
+    if (random_access) file.seekSet((uint64_t)random(range) * size);
+    if (write) ok = (file.write(buffer, size) == size);
+    else ok = (file.read(buffer, size) == (int)size);
+    latencies[i] = em;
+    if (!ok) break;
+  }
+  if (write) ok &= file.sync();
+  printResult("fs", test, size, ops, em_total, ok);
+}
+
+//=============================================================================
+void runBenchmark() {
+  FsFile file = myFiles.mscfs.open(TEST_FILE_NAME, O_RDWR | O_CREAT | O_TRUNC);
+  if (!file) {
+    Serial.println("*** Could not create " TEST_FILE_NAME " ***");
+    return;
+  }
+  if (!file.preAllocate(TEST_FILE_SIZE)) {
+    Serial.println("*** Could not preallocate " TEST_FILE_NAME " ***");
+    file.close();
+    return;
+  }
+  bool raw_ok = file.contiguousRange(&first_sector, &last_sector);
+  Serial.printf("\nTest file: %lu bytes, sectors %u - %u\n", TEST_FILE_SIZE, first_sector, last_sector);
+  Serial.printf("Write coalescing: %s\n\n", myDrive.writeCoalescing() ? "on" : "off");
+  printHeader();
+
+  if (raw_ok) {
+    for (uint8_t i = 0; i < (sizeof(transfer_sizes) / sizeof(transfer_sizes[0])); i++) {
+      rawTest("seq write", transfer_sizes[i], true, false);
+      rawTest("seq read", transfer_sizes[i], false, false);
+    }
+    rawTest("rand write", 4096, true, true);
+    rawTest("rand read", 4096, false, true);
+  } else {
+    Serial.println("*** Test file is not contiguous, skipping raw sector tests ***");
+  }
+
+  for (uint8_t i = 0; i < (sizeof(transfer_sizes) / sizeof(transfer_sizes[0])); i++) {
+    fileTest(file, "seq write", transfer_sizes[i], true, false);
+    fileTest(file, "seq read", transfer_sizes[i], false, false);
+  }
+  fileTest(file, "rand write", 4096, true, true);
+  fileTest(file, "rand read", 4096, false, true);
+
+  file.close();
+  myFiles.mscfs.remove(TEST_FILE_NAME);
+  Serial.println("\nDone");
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  while (!Serial) {
+    ; // wait for Arduino Serial Monitor to connect.
+  }
+
+  myusb.begin();
+  Serial.println("\nWaiting for Drive to initialize...");
+
+  // Wait for the drive to start.
+  while (!myFiles) {
+    myusb.Task();
+  }
+  Serial.printf("Drive: %8.8s %16.16s, %u sectors\n", myDrive.msDriveInfo.inquiry.VendorID,
+                myDrive.msDriveInfo.inquiry.ProductID, myDrive.msDriveInfo.capacity.Blocks);
+  Serial.println("Press any key to run the benchmark (writes an 8MB test file)");
+}
+
+
+void loop(void) {
+  myusb.Task();
+  if (Serial.available()) {
+    while (Serial.read() != -1) ;
+    if (myFiles) runBenchmark();
+    else Serial.println("*** No filesystem ***");
+    Serial.println("Press any key to run the benchmark again");
+  }
+}
@@ -1605,6 +1605,7 @@ bool JoystickController::process_bluetooth_HID_data(const uint8_t *data, uint16_
         if (sw_handle_bt_init_of_joystick(data, length, false))
             return true;
 
+        connected_ = true;      // remember that hardware is actually connected...
         return sw_process_HID_data(data, length);
     }
     
@@ -1936,6 +1937,7 @@ hidclaim_t JoystickController::bt_claim_collection(BluetoothConnection *btconnec
     // only claim from one physical device
 
     USBHDBGSerial.printf("\tJoystickController claim collection\n");
+    collections_claimed++;
     btconnect = btconnection;
     btdevice = (Device_t*)btconnect->btController_; // remember this way 
 
@@ -1946,6 +1948,7 @@ hidclaim_t JoystickController::bt_claim_collection(BluetoothConnection *btconnec
 
 void JoystickController::bt_hid_input_begin(uint32_t topusage, uint32_t type, int lgmin, int lgmax)
 {
+    connected_ = true;      // remember that hardware is actually connected...
     hid_input_begin(topusage, type, lgmin, lgmax);  
 }
 
@@ -1962,6 +1965,10 @@ void JoystickController::bt_hid_input_end()
 void JoystickController::bt_disconnect_collection(Device_t *dev)
 {
     disconnect_collection(dev);
+    if (collections_claimed == 0) {
+        btconnect = nullptr;
+        release_bluetooth();
+    }
 }
 
 bool JoystickController::mapNameToJoystickType(const uint8_t *remoteName)
@@ -1993,6 +2000,7 @@ bool JoystickController::mapNameToJoystickType(const uint8_t *remoteName)
         joystickType_ = SWITCH;
     } else {
         DBGPrintf("  JoystickController::mapNameToJoystickType %s - Unknown\n", remoteName);
+        joystickType_ = UNKNOWN;    // not what the last device on this object was
     }
     DBGPrintf("  Joystick Type: %d\n", joystickType_);
     return true;
@@ -2026,7 +2034,8 @@ void JoystickController::connectionComplete()
         packet[0] = 0x43; // HID BT Get_report (0x40) | Report Type (Feature 0x03)
         packet[1] = 0x02; // Report ID
         DBGPrintf("Set PS4 report\n");
-        delay(1);
+        // Called from the USB interrupt, the ACL ring queues this behind
+        // the L2CAP setup so there is nothing to wait for.
         btdriver_->sendL2CapCommand(packet, sizeof(packet), BluetoothController::CONTROL_SCID /*0x40*/);
     }
     break;
@@ -2041,7 +2050,6 @@ void JoystickController::connectionComplete()
         packet[5] = 0x00;
 
         DBGPrintf("enable six axis\n");
-        delay(1);
         btdriver_->sendL2CapCommand(packet, sizeof(packet), BluetoothController::CONTROL_SCID);
     }
     break;
@@ -302,7 +302,6 @@ void KeyboardController::updateLEDS() {
         packet[0] = 0xA2; // HID BT DATA_request (0xA0) | Report Type (Output 0x02)
         packet[1] = 0x01; // Report ID
         packet[2] = leds_.byte;
-        delay(1);
      	btdriver_->sendL2CapCommand(packet, sizeof(packet), BluetoothController::INTERRUPT_SCID);
 
 	}
@@ -452,7 +451,6 @@ void KeyboardController::hid_input_begin(uint32_t topusage, uint32_t type, int l
 void KeyboardController::hid_input_data(uint32_t usage, int32_t value)
 {
 	// Hack ignore 0xff00 high words as these are user values... 
-	USBHDBGSerial.printf("KeyboardController: topusage= %x usage=%X, value=%d\n", topusage_, usage, value);
 	if ((usage & 0xffff0000) == 0xff000000) return; 
 	// If this is the TOPUSAGE_KEYBOARD do in it's own function
 	if (process_hid_keyboard_data(usage, value))
@@ -660,6 +658,7 @@ hidclaim_t KeyboardController::bt_claim_collection(BluetoothConnection *btconnec
 			USBHDBGSerial.printf("\tKeyboardController claim collection\n");
 			btconnect = btconnection;
 			btdevice = (Device_t*)btconnect->btController_;	// remember this way 
+			btdriver_ = btconnect->btController_;	// for the LEDs
 			return CLAIM_REPORT;
 	}
 	return CLAIM_NO;
@@ -682,7 +681,12 @@ void KeyboardController::bt_hid_input_end()
 
 void KeyboardController::bt_disconnect_collection(Device_t *dev)
 {
+	btdriver_ = nullptr;
 	disconnect_collection(dev);
+	if (collections_claimed_ == 0) {
+		btconnect = nullptr;
+		btdevice = nullptr;
+	}
 }
 
 bool KeyboardController::remoteNameComplete(const uint8_t *remoteName) 
@@ -728,6 +732,7 @@ bool KeyboardController::process_bluetooth_HID_data(const uint8_t *data, uint16_
 void KeyboardController::release_bluetooth() 
 {
 	btdevice = nullptr;
+	btdriver_ = nullptr;
 }
 
 
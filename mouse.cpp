@@ -196,6 +196,7 @@ hidclaim_t MouseController::bt_claim_collection(BluetoothConnection *btconnectio
 	if ((topusage != 0x10002) && (topusage != 0x10001)) return CLAIM_NO;
 
 	USBHDBGSerial.printf("\tMouseController claim collection\n");
+	collections_claimed++;
 	btconnect = btconnection;
 	btdevice = (Device_t*)btconnect->btController_;	// remember this way 
 	return CLAIM_REPORT;
@@ -219,4 +220,8 @@ void MouseController::bt_hid_input_end()
 void MouseController::bt_disconnect_collection(Device_t *dev)
 {
 	disconnect_collection(dev);
+	if (collections_claimed == 0) {
+		btconnect = nullptr;
+		btdevice = nullptr;
+	}
 }
@@ -0,0 +1,120 @@
+/* Bluetooth receive path benchmark through the simulated dongle.
+ *
+ * Each device connects, is timed from its connection until its reports are
+ * set up (BluetoothStatistics_t.connect_us, simulated time), then streams
+ * input reports while the controller's statistics time the ACL packets.
+ * In these builds ARM_DWT_CYCCNT counts host nanoseconds, so the per report
+ * numbers are host ns, only good for comparing paths with each other.
+ *
+ * The gamepads send the same DS4 style 0x01 report through the report
+ * descriptor instead of a driver: once compiled into the field table, and
+ * once with a descriptor that has too many report IDs to compile, so each
+ * report walks the descriptor.
+ *
+ * Usage: bench_bt [reports per device]
+ */
+
+#include <stdlib.h>
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+JoystickController joystick1(myusb);
+JoystickController joystick2(myusb);
+KeyboardController keyboard1(myusb);
+
+static const uint8_t ds4_addr[6] = {0x11, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t switch_addr[6] = {0x12, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t keyboard_addr[6] = {0x13, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t gamepad_addr[6] = {0x14, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t walked_addr[6] = {0x15, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+static sim::HCIController dongle;
+static sim::DS4Peer ds4(ds4_addr);
+static sim::SwitchProPeer switch_pro(switch_addr);
+static sim::KeyboardPeer keyboard_peer(keyboard_addr);
+static sim::GamepadPeer gamepad(gamepad_addr);
+static sim::GamepadPeer walked(walked_addr);
+
+typedef struct {
+	const char *name;
+	sim::HIDPeer *peer;
+	uint32_t interval_us;
+	std::function<bool()> ready;    // device set up and in its streaming mode
+} bench_case_t;
+
+static void run_case(const bench_case_t &c, uint32_t reports)
+{
+	BluetoothStatistics_t stats;
+	bluet.resetStatistics();
+	CHECK(dongle.connect_in(c.peer));
+	bool ready = sim::run_until([&c]() {
+		BluetoothStatistics_t s;
+		bluet.getStatistics(s);
+		return s.connect_us && c.ready();
+	}, 5000000);
+	CHECK(ready);
+	bluet.getStatistics(stats);
+	uint32_t connect_us = stats.connect_us;
+	sim::run_us(100000);   // let the drivers finish their own setup
+
+	bluet.resetStatistics();
+	sim::reset_counters();
+	uint32_t sent = c.peer->reports_sent;
+	c.peer->stream(reports, c.interval_us);
+	sim::run_us((uint64_t)reports * c.interval_us + 100000);
+	bluet.getStatistics(stats);
+	CHECK_EQ(c.peer->reports_sent - sent, reports);
+	CHECK_EQ(stats.acl_packets, reports);
+
+	printf("%-28s %9u %8u %10u %10u %9u\n", c.name, connect_us, stats.acl_packets,
+		stats.acl_packets ? stats.acl_cycles / stats.acl_packets : 0, stats.acl_cycles_max,
+		sim::counters.isr_calls);
+
+	dongle.disconnect(c.peer);
+	sim::run_us(100000);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t reports = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 2000;
+
+	// Report IDs 0x10-0x17 are never sent, they only keep the descriptor
+	// from compiling.
+	std::vector<uint8_t> &d = walked.descriptor;
+	for (uint8_t id = 0x10; id < 0x18; id++) {
+		static const uint8_t pad[] = {0x85, 0x00, 0x75, 0x08, 0x95, 0x01, 0x81, 0x01};
+		d.insert(d.end() - 1, pad, pad + sizeof(pad));
+		d[d.size() - 1 - sizeof(pad) + 1] = id;
+	}
+
+	for (sim::HIDPeer *peer : std::initializer_list<sim::HIDPeer *>{&ds4, &switch_pro, &keyboard_peer, &gamepad, &walked}) {
+		dongle.add_peer(peer);
+	}
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+
+	const bench_case_t cases[] = {
+		{"DS4 0x11, driver", &ds4, 1250,
+			[]() { return ds4.extended_reports && ds4.interrupt_open(); }},
+		{"Switch Pro 0x30, driver", &switch_pro, 15000,
+			[]() { return switch_pro.report_mode == 0x30; }},
+		{"Keyboard, compiled", &keyboard_peer, 10000,
+			[]() { return keyboard_peer.interrupt_open(); }},
+		{"Gamepad 0x01, compiled", &gamepad, 1250,
+			[]() { return gamepad.interrupt_open(); }},
+		{"Gamepad 0x01, walked", &walked, 1250,
+			[]() { return walked.interrupt_open(); }},
+	};
+	printf("%-28s %9s %8s %10s %10s %9s\n", "stream", "connect", "reports", "ns/report", "max ns", "isr calls");
+	printf("%-28s %9s\n", "", "us");
+	for (const bench_case_t &c : cases) run_case(c, reports);
+
+	CHECK_EQ(dongle.acl_overruns, 0);
+	CHECK_EQ(dongle.command_overruns, 0);
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,192 @@
+/* LE advertising report parser benchmark through the simulated dongle.
+ *
+ * A few hundred beacons are packed into LE Advertising Report meta events,
+ * as many reports to an event as fit, and sent at a rate a dense
+ * environment reaches.  Each case sets up the filters and either the
+ * callback or the queue, the sketch (this loop) reads the queue every
+ * millisecond where it is used.  Event times come from
+ * BluetoothStatistics_t and are host ns in these builds, only good for
+ * comparing the cases with each other.
+ *
+ * Usage: bench_bt_le_adv [events]
+ */
+
+#include <stdlib.h>
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+
+#define BEACONS 300
+#define EVENT_INTERVAL_US 1000
+
+static sim::HCIController dongle;
+
+typedef struct {
+	uint8_t bdaddr[6];
+	std::vector<uint8_t> data;
+	uint8_t kind;
+} beacon_t;
+enum {IBEACON, EDDYSTONE, SENSOR};
+static std::vector<beacon_t> beacons;
+static std::vector<std::vector<uint8_t>> events;
+static std::vector<uint32_t> event_beacons;     // first beacon of each event
+
+static void make_beacons()
+{
+	for (uint32_t i = 0; i < BEACONS; i++) {
+		beacon_t b = {{(uint8_t)i, (uint8_t)(i >> 8), 0xB0, 0xA0, 0x1D, 0xC0}, {0x02, 0x01, 0x06}, (uint8_t)(i % 3)};
+		switch (b.kind) {
+		case IBEACON:   // Apple, iBeacon
+			b.data.insert(b.data.end(), {0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15});
+			for (uint8_t j = 0; j < 16; j++) b.data.push_back(0xE2 + j);
+			b.data.insert(b.data.end(), {0x00, (uint8_t)i, 0x00, 0x01, 0xC5});
+			break;
+		case EDDYSTONE: // UID frame
+			b.data.insert(b.data.end(), {0x03, 0x03, 0xAA, 0xFE, 0x0B, 0x16, 0xAA, 0xFE, 0x00, 0xEE});
+			for (uint8_t j = 0; j < 6; j++) b.data.push_back((uint8_t)(i + j));
+			break;
+		case SENSOR:    // battery and environmental sensing services, and a name
+			b.data.insert(b.data.end(), {0x05, 0x03, 0x0F, 0x18, 0x1A, 0x18, 0x07, 0x09, 'S', 'e', 'n', 's', 'o', 'r'});
+			break;
+		}
+		beacons.push_back(b);
+	}
+}
+
+// Meta events of as many reports as fit in 255 parameter bytes, round
+// robin over the beacons.
+static void make_events(uint32_t count)
+{
+	uint32_t next = 0;
+	for (uint32_t e = 0; e < count; e++) {
+		std::vector<uint8_t> ev = {0x02, 0};
+		event_beacons.push_back(next);
+		while (ev.size() + 10 + beacons[next % BEACONS].data.size() <= 255) {
+			const beacon_t &b = beacons[next++ % BEACONS];
+			ev.push_back(b.kind == SENSOR ? 0x00 : 0x03);   // ADV_IND, ADV_NONCONN_IND
+			ev.push_back(0x01);     // random address
+			ev.insert(ev.end(), b.bdaddr, b.bdaddr + 6);
+			ev.push_back(b.data.size());
+			ev.insert(ev.end(), b.data.begin(), b.data.end());
+			ev.push_back((uint8_t)(-40 - (next % 50)));
+			ev[1]++;
+		}
+		events.push_back(ev);
+	}
+	event_beacons.push_back(next);
+}
+
+static uint32_t callbacks;
+static void OnAdvertisingReport(const BLEAdvertisingReport_t &report)
+{
+	callbacks++;
+}
+
+typedef struct {
+	const char *name;
+	bool use_callback;
+	bool drain;             // the sketch reads the queue
+	std::function<void()> filters;
+	std::function<bool(const beacon_t &)> matches;
+} bench_case_t;
+
+static void run_case(const bench_case_t &c)
+{
+	bluet.setLEAdvertisingAddressFilter(nullptr);
+	bluet.setLEAdvertisingUUIDFilter(0);
+	bluet.setLEAdvertisingManufacturerFilter(-1);
+	if (c.filters) c.filters();
+	bluet.attachLEAdvertisingReport(c.use_callback ? OnAdvertisingReport : nullptr);
+	BLEAdvertisingReport_t report;
+	while (bluet.readLEAdvertisingReport(report)) ;
+	uint32_t dropped = bluet.LEAdvertisingReportsDropped();
+	callbacks = 0;
+
+	uint32_t reports = event_beacons.back() - event_beacons.front();
+	uint32_t expected = 0;
+	for (uint32_t i = event_beacons.front(); i < event_beacons.back(); i++) {
+		if (c.matches(beacons[i % BEACONS])) expected++;
+	}
+
+	bluet.resetStatistics();
+	for (uint32_t e = 0; e < events.size(); e++) {
+		sim::schedule((uint64_t)e * EVENT_INTERVAL_US, [e]() { dongle.send_event(0x3E, events[e]); });
+	}
+	uint32_t queued = 0;
+	uint32_t wrong = 0;     // should have been filtered out, or garbled
+	for (uint32_t ms = 0; ms < events.size() * EVENT_INTERVAL_US / 1000 + 100; ms++) {
+		sim::run_us(1000);
+		while (c.drain && bluet.readLEAdvertisingReport(report)) {
+			const beacon_t &b = beacons[(report.bdaddr[0] + (report.bdaddr[1] << 8)) % BEACONS];
+			if (!c.matches(b) || (report.data_length != b.data.size()) ||
+					(memcmp(report.data, b.data.data(), b.data.size()) != 0)) wrong++;
+			queued++;
+		}
+	}
+	if (!c.drain) {
+		while (bluet.readLEAdvertisingReport(report)) queued++;
+	}
+	dropped = bluet.LEAdvertisingReportsDropped() - dropped;
+	BluetoothStatistics_t stats;
+	bluet.getStatistics(stats);
+
+	uint32_t delivered = c.use_callback ? callbacks : queued;
+	CHECK_EQ(stats.events, events.size());
+	CHECK_EQ(delivered + dropped, expected);
+	CHECK_EQ(wrong, 0);
+	if (c.use_callback || c.drain) CHECK_EQ(dropped, 0);
+	printf("%-30s %8u %9u %8u %9u %10u\n", c.name, reports, delivered, dropped,
+		stats.events ? stats.event_cycles / stats.events : 0, reports ? stats.event_cycles / reports : 0);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t count = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 2000;
+	make_beacons();
+	make_events(count);
+
+	// Whole events in a few interrupt packets
+	dongle.event_packet_size = 64;
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+	bluet.setLEScanParameters(0, 0x10, 0x10, 0, 0);
+	bluet.setLEScanEnable(1, 0);
+	CHECK(sim::run_until([]() { return dongle.le_scanning; }, 100000));
+	sim::run_us(10000);
+
+	static const uint8_t one_bdaddr[6] = {42, 0, 0xB0, 0xA0, 0x1D, 0xC0};
+	const bench_case_t cases[] = {
+		{"callback, no filter", true, false, nullptr,
+			[](const beacon_t &) { return true; }},
+		{"callback, company 0x004C", true, false,
+			[]() { bluet.setLEAdvertisingManufacturerFilter(0x004C); },
+			[](const beacon_t &b) { return b.kind == IBEACON; }},
+		{"callback, UUID 0xFEAA", true, false,
+			[]() { bluet.setLEAdvertisingUUIDFilter(0xFEAA); },
+			[](const beacon_t &b) { return b.kind == EDDYSTONE; }},
+		{"callback, UUID 0x181A", true, false,
+			[]() { bluet.setLEAdvertisingUUIDFilter(0x181A); },
+			[](const beacon_t &b) { return b.kind == SENSOR; }},
+		{"callback, one address", true, false,
+			[]() { bluet.setLEAdvertisingAddressFilter(one_bdaddr); },
+			[](const beacon_t &b) { return memcmp(b.bdaddr, one_bdaddr, 6) == 0; }},
+		{"queue, read every ms", false, true, nullptr,
+			[](const beacon_t &) { return true; }},
+		{"queue, company 0x004C", false, true,
+			[]() { bluet.setLEAdvertisingManufacturerFilter(0x004C); },
+			[](const beacon_t &b) { return b.kind == IBEACON; }},
+		{"queue, never read", false, false, nullptr,
+			[](const beacon_t &) { return true; }},
+	};
+	printf("%d events of %.1f reports on average, one every %u us\n", (int)events.size(),
+		(double)(event_beacons.back() - event_beacons.front()) / events.size(), EVENT_INTERVAL_US);
+	printf("%-30s %8s %9s %8s %9s %10s\n", "case", "reports", "delivered", "dropped", "ns/event", "ns/report");
+	for (const bench_case_t &c : cases) run_case(c);
+
+	CHECK_EQ(dongle.command_overruns, 0);
+	return TEST_MAIN_RESULT();
+}
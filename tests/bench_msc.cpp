@@ -0,0 +1,326 @@
+/* USBDrive benchmark on a simulated Bulk-Only Transport disk: the host
+ * build of examples/Storage/DriveBenchmark.
+ *
+ * A 64MB disk, in RAM or in the image file named, is formatted FAT16 with
+ * USBFilesystemFormatter and mounted by USBFilesystem.  An 8MB contiguous
+ * test file is then written and read sequentially and at random, at
+ * several transfer sizes, through the raw sector API and through the file
+ * system.  MB/s, IOPS and the latency percentiles are in simulated time,
+ * so they follow from the device model's latencies and bandwidth and the
+ * commands the driver sends.  Every sector read is checked.
+ *
+ * Then the errors: a UNIT ATTENTION the driver retries, a STALLed data
+ * stage that fails its one command and leaves the drive working, a short
+ * read failing with MS_SHORT_TRANSFER, and a random read run with the
+ * device failing every few commands.
+ *
+ * Usage: bench_msc [random ops] [disk image file, formatted again]
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+#include <USBHost_t36.h>
+#include <utility/USBFilesystemFormatter.h>
+#include "sim_msc.h"
+#include "test_util.h"
+
+USBHost myusb;
+USBDrive myDrive(myusb);
+USBFilesystem myFiles(myusb);
+
+#define DISK_BLOCKS (64ul * 1024 * 2)
+#define PARTITION_START 8192
+#define TEST_FILE_NAME "bench.dat"
+#define TEST_FILE_SIZE (8ul * 1024 * 1024)
+#define MAX_TRANSFER_SIZE (32ul * 1024)
+
+static const uint32_t transfer_sizes[] = {512, 4096, 32768};
+
+static sim::MassStorage disk(DISK_BLOCKS);
+static uint8_t buffer[MAX_TRANSFER_SIZE] __attribute__((aligned(32)));
+static std::vector<uint32_t> latencies;
+static uint32_t random_ops = 256;
+static uint32_t first_sector;   // raw sector range of the test file
+static uint32_t last_sector;
+
+// Each sector's contents follow from its number
+static uint8_t pattern(uint32_t sector, uint32_t i)
+{
+	return (uint8_t)(sector * 13 + i * 7 + (i >> 8));
+}
+
+static void fill(uint8_t *data, uint32_t sector, uint32_t count)
+{
+	for (uint32_t i = 0; i < count * 512; i++) data[i] = pattern(sector + i / 512, i % 512);
+}
+
+static bool check(const uint8_t *data, uint32_t sector, uint32_t count)
+{
+	for (uint32_t i = 0; i < count * 512; i++) {
+		if (data[i] != pattern(sector + i / 512, i % 512)) return false;
+	}
+	return true;
+}
+
+static void print_header()
+{
+	printf("API  Test         Size     MB/s     IOPS  p50 us  p90 us  p99 us  max us\n");
+}
+
+// One result line from latencies, which it sorts
+static void print_result(const char *api, const char *test, uint32_t size, uint32_t total_us, bool ok)
+{
+	printf("%-4s %-10s %6u ", api, test, size);
+	if (!ok || latencies.empty()) {
+		printf("FAILED  error:%x\n", myDrive.errorCode());
+		return;
+	}
+	uint32_t ops = latencies.size();
+	if (!total_us) total_us = 1;
+	std::sort(latencies.begin(), latencies.end());
+	printf("%8.2f %8.0f %7u %7u %7u %7u\n", (double)size * ops / total_us, ops * 1000000.0 / total_us,
+		latencies[ops / 2], latencies[(ops * 90) / 100], latencies[(ops * 99) / 100], latencies[ops - 1]);
+}
+
+static uint32_t test_ops(uint32_t size)
+{
+	return std::min<uint32_t>(TEST_FILE_SIZE / size, random_ops);
+}
+
+static void raw_test(const char *test, uint32_t size, bool write, bool random_access)
+{
+	uint32_t sectors = size / 512;
+	uint32_t range = last_sector - first_sector + 1 - sectors;
+	uint32_t ops = test_ops(size);
+	bool ok = true, data_ok = true;
+	latencies.clear();
+	elapsedMicros em_total;
+	for (uint32_t i = 0; ok && (i < ops); i++) {
+		uint32_t sector = random_access ? first_sector + rand() % (range + 1) : first_sector + i * sectors;
+		if (write) fill(buffer, sector, sectors);
+		elapsedMicros em;
+		if (write) ok = myDrive.writeSectors(sector, buffer, sectors);
+		else ok = myDrive.readSectors(sector, buffer, sectors);
+		latencies.push_back(em);
+		if (ok && !write && !check(buffer, sector, sectors)) data_ok = false;
+	}
+	if (write) ok &= myDrive.syncDevice();
+	uint32_t total_us = em_total;
+	CHECK(ok);
+	CHECK(data_ok);
+	print_result("raw", test, size, total_us, ok);
+}
+
+static void file_test(FsFile &file, const char *test, uint32_t size, bool write, bool random_access)
+{
+	uint32_t ops = test_ops(size);
+	uint32_t range = TEST_FILE_SIZE / size;
+	bool ok = true, data_ok = true;
+	latencies.clear();
+	file.seekSet(0);
+	elapsedMicros em_total;
+	for (uint32_t i = 0; ok && (i < ops); i++) {
+		elapsedMicros em;
+		if (random_access) file.seekSet((uint64_t)(rand() % range) * size);
+		uint32_t sector = first_sector + file.curPosition() / 512;
+		if (write) {
+			fill(buffer, sector, size / 512);
+			ok = (file.write(buffer, size) == size);
+		} else {
+			ok = (file.read(buffer, size) == size);
+			if (ok && !check(buffer, sector, size / 512)) data_ok = false;
+		}
+		latencies.push_back(em);
+	}
+	if (write) ok &= file.sync();
+	uint32_t total_us = em_total;
+	CHECK(ok);
+	CHECK(data_ok);
+	print_result("fs", test, size, total_us, ok);
+}
+
+static void run_benchmark(FsFile &file)
+{
+	printf("\nTest file: %lu bytes, sectors %u - %u\n", TEST_FILE_SIZE, first_sector, last_sector);
+	printf("Device: command %u us, read %u us + %.1f MB/s, write %u us + %.1f MB/s, up to %u us more\n\n",
+		disk.command_latency_us, disk.read_latency_us, disk.read_bandwidth / 1e6,
+		disk.write_latency_us, disk.write_bandwidth / 1e6, disk.jitter_us);
+	// Every sector of the file holds its pattern before any of them is read
+	bool filled = true;
+	for (uint32_t sector = first_sector; sector <= last_sector; sector += 64) {
+		fill(buffer, sector, 64);
+		if (!myDrive.writeSectors(sector, buffer, 64)) filled = false;
+	}
+	CHECK(filled);
+
+	print_header();
+	for (uint32_t size : transfer_sizes) {
+		raw_test("seq write", size, true, false);
+		raw_test("seq read", size, false, false);
+	}
+	raw_test("rand write", 4096, true, true);
+	raw_test("rand read", 4096, false, true);
+
+	for (uint32_t size : transfer_sizes) {
+		file_test(file, "seq write", size, true, false);
+		file_test(file, "seq read", size, false, false);
+	}
+	file_test(file, "rand write", 4096, true, true);
+	file_test(file, "rand read", 4096, false, true);
+
+	// All of it is on the disk
+	bool on_disk = true;
+	for (uint32_t sector = first_sector; sector <= last_sector; sector += 64) {
+		disk.read_blocks(sector, 64, buffer);
+		if (!check(buffer, sector, 64)) on_disk = false;
+	}
+	CHECK(on_disk);
+}
+
+static void test_faults()
+{
+	typedef sim::MassStorage M;
+	uint32_t sector = first_sector + 1000;
+
+	// UNIT ATTENTION: REQUEST SENSE and the READ again, the caller never
+	// knows
+	disk.reset_counters();
+	disk.inject(0x28, M::FAULT_UNIT_ATTENTION);
+	CHECK(myDrive.readSectors(sector, buffer, 8));
+	CHECK(check(buffer, sector, 8));
+	CHECK_EQ(disk.counters.unit_attentions, 1);
+	CHECK_EQ(disk.opcodes[0x03], 1);
+	CHECK_EQ(disk.opcodes[0x28], 2);
+
+	// A READ whose data stage is STALLed: the halt is cleared, the command
+	// fails with the medium error from the sense data, the next one works
+	disk.reset_counters();
+	disk.inject(0x28, M::FAULT_STALL);
+	CHECK(!myDrive.readSectors(sector, buffer, 8));
+	CHECK_EQ(disk.clear_halts, 1);
+	CHECK_EQ(myDrive.msSense.SenseKey, 0x03);
+	CHECK_EQ(myDrive.msSense.AdditionalSenseCode, 0x11);
+	CHECK(myDrive.readSectors(sector, buffer, 8));
+	CHECK(check(buffer, sector, 8));
+
+	// ... a WRITE whose data is refused, nothing written
+	disk.inject(0x2A, M::FAULT_STALL);
+	memset(buffer, 0xEE, 8 * 512);
+	CHECK(!myDrive.writeSectors(sector, buffer, 8));
+	CHECK_EQ(disk.clear_halts, 2);
+	CHECK_EQ(myDrive.msSense.SenseKey, 0x03);
+	CHECK_EQ(myDrive.msSense.AdditionalSenseCode, 0x0C);
+	CHECK(myDrive.readSectors(sector, buffer, 8));
+	CHECK(check(buffer, sector, 8));
+	CHECK_EQ(disk.counters.resets, 0);
+
+	// Half the data and a CSW that says so
+	disk.inject(0x28, M::FAULT_SHORT_READ);
+	CHECK(!myDrive.readSectors(sector, buffer, 8));
+	CHECK_EQ(myDrive.errorCode(), MS_SHORT_TRANSFER);
+	CHECK_EQ(myDrive.msDataResidue(), 4 * 512);
+	CHECK(myDrive.readSectors(sector, buffer, 8));
+	CHECK(check(buffer, sector, 8));
+
+	// Random reads from a device failing every few commands, each failed
+	// one read again
+	disk.reset_counters();
+	disk.stall_every = 37;
+	disk.unit_attention_every = 29;
+	disk.short_read_every = 23;
+	uint32_t range = last_sector - first_sector + 1 - 8;
+	uint32_t failed = 0;
+	bool ok = true;
+	latencies.clear();
+	elapsedMicros em_total;
+	for (uint32_t i = 0; i < random_ops; i++) {
+		uint32_t sector = first_sector + rand() % (range + 1);
+		elapsedMicros em;
+		bool read = myDrive.readSectors(sector, buffer, 8);
+		for (int retry = 0; !read && (retry < 3); retry++) {
+			failed++;
+			read = myDrive.readSectors(sector, buffer, 8);
+		}
+		latencies.push_back(em);
+		if (!read || !check(buffer, sector, 8)) ok = false;
+	}
+	uint32_t total_us = em_total;
+	disk.stall_every = 0;
+	disk.unit_attention_every = 0;
+	disk.short_read_every = 0;
+	CHECK(ok);
+	CHECK_EQ(failed, disk.counters.stalls + disk.counters.short_reads);
+	CHECK_EQ(disk.counters.bad_cbws, 0);
+	printf("\nRandom reads with a STALL every 37, UNIT ATTENTION every 29 and short read every 23 READ(10)s\n");
+	print_header();
+	print_result("raw", "rand read", 4096, total_us, ok);
+	printf("%u stalls, %u unit attentions retried by the driver, %u short reads, %u reads failed and retried\n",
+		disk.counters.stalls, disk.counters.unit_attentions, disk.counters.short_reads, failed);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1) random_ops = strtoul(argv[1], nullptr, 0);
+	if ((argc > 2) && !disk.open_image(argv[2])) {
+		printf("can't open %s\n", argv[2]);
+		return 1;
+	}
+	srand(1);
+	disk.jitter_us = 200;
+
+	// One empty FAT16 partition for the formatter to fill in
+	uint8_t mbr[512] = {0};
+	MbrSector_t *m = (MbrSector_t *)mbr;
+	m->part[0].type = 0x06;
+	setLe32(m->part[0].relativeSectors, PARTITION_START);
+	setLe32(m->part[0].totalSectors, DISK_BLOCKS - PARTITION_START);
+	setLe16(m->signature, MBR_SIGNATURE);
+	disk.write_blocks(0, 1, mbr);
+
+	myusb.begin();
+	sim::attach(&disk, 2);
+	CHECK(task_until(myusb, []() { return myDrive.filesystemsStarted(); }, 2000));
+	CHECK(!myFiles || (argc > 2));     // an image file may be formatted already
+	printf("Drive: %8.8s %16.16s, %u sectors\n", myDrive.msDriveInfo.inquiry.VendorID,
+		myDrive.msDriveInfo.inquiry.ProductID, myDrive.msDriveInfo.capacity.Blocks);
+
+	USBFilesystemFormatter formatter;
+	uint32_t format_us = micros();
+	CHECK(formatter.formatFAT(myDrive, myFiles, 1, 16, buffer, &Serial));
+	format_us = micros() - format_us;
+	sim::detach();
+	sim::run_us(100000);
+	sim::attach(&disk, 2);
+	CHECK(task_until(myusb, []() { return (bool)myFiles; }, 2000));
+	if (!myFiles) return TEST_MAIN_RESULT();
+	printf("Formatted FAT%u in %u us, %u clusters of %u bytes\n", myFiles.mscfs.fatType(), format_us,
+		myFiles.mscfs.clusterCount(), myFiles.mscfs.bytesPerCluster());
+	CHECK_EQ(myFiles.mscfs.fatType(), 16);
+	uint32_t free_clusters = myFiles.mscfs.freeClusterCount();
+	CHECK_EQ(free_clusters, myFiles.mscfs.clusterCount());
+
+	FsFile file = myFiles.mscfs.open(TEST_FILE_NAME, O_RDWR | O_CREAT | O_TRUNC);
+	CHECK(file);
+	CHECK(file.preAllocate(TEST_FILE_SIZE));
+	CHECK(file.contiguousRange(&first_sector, &last_sector));
+	CHECK_EQ(last_sector - first_sector + 1, TEST_FILE_SIZE / 512);
+	CHECK_EQ(myFiles.mscfs.freeClusterCount(), free_clusters - TEST_FILE_SIZE / myFiles.mscfs.bytesPerCluster());
+	if (!file || !last_sector) return TEST_MAIN_RESULT();
+	run_benchmark(file);
+	test_faults();
+	file.close();
+
+	// The file as a sketch sees it
+	File f = myFiles.open(TEST_FILE_NAME);
+	CHECK(f);
+	CHECK_EQ(f.size(), TEST_FILE_SIZE);
+	CHECK(f.seek(4096));
+	CHECK_EQ(f.read(buffer, 1024), 1024);
+	CHECK(check(buffer, first_sector + 8, 2));
+	f.close();
+	CHECK(myFiles.mscfs.remove(TEST_FILE_NAME));
+	CHECK(!myFiles.exists(TEST_FILE_NAME));
+	CHECK_EQ(myFiles.mscfs.freeClusterCount(), free_clusters);
+	CHECK_EQ(disk.counters.bad_cbws, 0);
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,154 @@
+/* Host build of the USBHost_t36 library, for the simulated USB host tests.
+ *
+ * Just enough of the Teensyduino core for the library sources to compile
+ * and run on Linux.  Time is simulated: micros() and millis() only move
+ * when the simulation runs or something calls delay() or yield().  The USB
+ * interrupt is enabled and disabled through NVIC_*_IRQ as on the Teensy, and
+ * the simulation only calls it while it is enabled.
+ */
+
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HEX 16
+#define DEC 10
+#define OCT 8
+#define BIN 2
+#define F(x) x
+#define PROGMEM
+#define FLASHMEM
+#define DMAMEM
+#define FASTRUN
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+
+// Templates rather than macros, as in the Teensy 4 core, so the C++
+// library headers still compile.
+template <class A, class B>
+constexpr auto min(A &&a, B &&b) -> decltype(a < b ? a : b) { return (a < b) ? a : b; }
+template <class A, class B>
+constexpr auto max(A &&a, B &&b) -> decltype(a < b ? a : b) { return (a < b) ? b : a; }
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+template <class T, class A, class B, class C, class D>
+long map(T _x, A _in_min, B _in_max, C _out_min, D _out_max)
+{
+	return (_x - _in_min) * (_out_max - _out_min) / (_in_max - _in_min) + _out_min;
+}
+
+// Simulated time, see host.cpp
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t msec);
+void delayMicroseconds(uint32_t usec);
+void yield();
+
+static inline void digitalWriteFast(int pin, int val) { }
+static inline void digitalWrite(int pin, int val) { }
+static inline void pinMode(int pin, int mode) { }
+static inline void arm_dcache_flush(void *addr, uint32_t size) { }
+static inline void arm_dcache_delete(void *addr, uint32_t size) { }
+static inline void arm_dcache_flush_delete(void *addr, uint32_t size) { }
+
+// Interrupts.  Only the USB host interrupt exists here.
+#define IRQ_USB2 112
+bool host_nvic_is_enabled(int irq);
+void host_nvic_enable(int irq);
+void host_nvic_disable(int irq);
+void host_disable_irq();
+void host_enable_irq();
+void attachInterruptVector(int irq, void (*function)(void));
+#define NVIC_IS_ENABLED(n) host_nvic_is_enabled(n)
+#define NVIC_ENABLE_IRQ(n) host_nvic_enable(n)
+#define NVIC_DISABLE_IRQ(n) host_nvic_disable(n)
+#define NVIC_SET_PRIORITY(n, p)
+#define __disable_irq() host_disable_irq()
+#define __enable_irq() host_enable_irq()
+
+// The cycle counter counts host nanoseconds, so the "cycles" reported by
+// the library's statistics are host nanoseconds in these builds.
+uint32_t host_cycle_count();
+#define ARM_DWT_CYCCNT (host_cycle_count())
+extern uint32_t F_CPU_ACTUAL;
+
+class Print {
+public:
+	virtual ~Print() { }
+	virtual size_t write(uint8_t b) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+	size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+	virtual void flush() { }
+	int printf(const char *format, ...) __attribute__ ((format (printf, 2, 3)));
+	size_t print(const char *s) { return write(s); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(int n, int base = DEC) { return print((long)n, base); }
+	size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+	size_t print(long n, int base = DEC);
+	size_t print(unsigned long n, int base = DEC);
+	size_t print(long long n, int base = DEC);
+	size_t print(unsigned long long n, int base = DEC);
+	size_t print(double n, int digits = 2);
+	size_t println() { return write("\r\n"); }
+	template <typename T> size_t println(T arg) { size_t n = print(arg); return n + println(); }
+	template <typename T> size_t println(T arg, int base) { size_t n = print(arg, base); return n + println(); }
+};
+
+class Stream : public Print {
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+};
+
+// Serial prints to stdout when USBHOST_SIM_VERBOSE is set in the
+// environment, otherwise the library's debug output goes nowhere.
+class HardwareSerial : public Stream {
+public:
+	size_t write(uint8_t b);
+	using Print::write;
+	int available() { return 0; }
+	int read() { return -1; }
+	int peek() { return -1; }
+	operator bool() { return true; }
+	void begin(uint32_t baud) { }
+};
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+class elapsedMillis {
+private:
+	uint32_t ms;
+public:
+	elapsedMillis() { ms = millis(); }
+	elapsedMillis(uint32_t val) { ms = millis() - val; }
+	operator uint32_t() const { return millis() - ms; }
+	elapsedMillis & operator = (uint32_t val) { ms = millis() - val; return *this; }
+};
+
+class elapsedMicros {
+private:
+	uint32_t us;
+public:
+	elapsedMicros() { us = micros(); }
+	elapsedMicros(uint32_t val) { us = micros() - val; }
+	operator uint32_t() const { return micros() - us; }
+	elapsedMicros & operator = (uint32_t val) { us = micros() - val; return *this; }
+};
+
+class EventResponder { };
+
+#endif
@@ -0,0 +1,42 @@
+/* Host build of the USBHost_t36 library: RAM backed EEPROM.
+ *
+ * Erased to 0xFF like a fresh Teensy 4.x.  Counts every read and write so
+ * the tests can check how often the link key store touches it.
+ */
+
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <stdint.h>
+#include <string.h>
+
+#define E2END 0x10BB
+
+class EEPROMClass {
+public:
+	EEPROMClass() { clear(); }
+	uint8_t read(int idx) { read_count++; return data[idx]; }
+	void write(int idx, uint8_t val) { write_count++; data[idx] = val; }
+	void update(int idx, uint8_t val) { if (read(idx) != val) write(idx, val); }
+	uint16_t length() { return E2END + 1; }
+	template <typename T> T &get(int idx, T &t) {
+		uint8_t *ptr = (uint8_t *)&t;
+		for (size_t count = sizeof(T); count; --count) *ptr++ = read(idx++);
+		return t;
+	}
+	template <typename T> const T &put(int idx, const T &t) {
+		const uint8_t *ptr = (const uint8_t *)&t;
+		for (size_t count = sizeof(T); count; --count) update(idx++, *ptr++);
+		return t;
+	}
+
+	// host only
+	void clear() { memset(data, 0xff, sizeof(data)); read_count = 0; write_count = 0; }
+	uint8_t data[E2END + 1];
+	uint32_t read_count;
+	uint32_t write_count;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
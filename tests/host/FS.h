@@ -0,0 +1,170 @@
+/* Host build of the USBHost_t36 library: the Teensyduino FS and File API.
+ *
+ * Same shape as the Teensy core, so the library's MSC classes compile and
+ * the tests can hand BluetoothController a FS of their own for the link
+ * key store.  File keeps a reference counted FileImpl, as on the Teensy.
+ */
+
+#ifndef FS_H
+#define FS_H
+
+#include <Arduino.h>
+
+#define FILE_READ  0
+#define FILE_WRITE 1
+#define FILE_WRITE_BEGIN 2
+
+enum SeekMode {
+	SeekSet = 0,
+	SeekCur = 1,
+	SeekEnd = 2
+};
+
+typedef struct {
+	uint8_t sec;
+	uint8_t min;
+	uint8_t hour;
+	uint8_t wday;
+	uint8_t mday;
+	uint8_t mon;
+	uint8_t year;
+} DateTimeFields;
+
+class File;
+
+class FileImpl {
+protected:
+	virtual ~FileImpl() { }
+	virtual size_t read(void *buf, size_t nbyte) = 0;
+	virtual size_t write(const void *buf, size_t size) = 0;
+	virtual int available() = 0;
+	virtual int peek() = 0;
+	virtual void flush() = 0;
+	virtual bool truncate(uint64_t size=0) = 0;
+	virtual bool seek(uint64_t pos, int mode) = 0;
+	virtual uint64_t position() = 0;
+	virtual uint64_t size() = 0;
+	virtual void close() = 0;
+	virtual bool isOpen() = 0;
+	virtual const char * name() = 0;
+	virtual bool isDirectory() = 0;
+	virtual File openNextFile(uint8_t mode=0) = 0;
+	virtual void rewindDirectory(void) = 0;
+	virtual bool getCreateTime(DateTimeFields &tm) { return false; }
+	virtual bool getModifyTime(DateTimeFields &tm) { return false; }
+	virtual bool setCreateTime(const DateTimeFields &tm) { return false; }
+	virtual bool setModifyTime(const DateTimeFields &tm) { return false; }
+	unsigned int getRefcount() { return refcount; }
+private:
+	friend class File;
+	unsigned int refcount = 0;
+};
+
+class File final : public Stream {
+public:
+	constexpr File() : f(nullptr) { }
+	File(FileImpl *file) {
+		f = file;
+		if (f) f->refcount++;
+	}
+	File(const File &file) {
+		f = file.f;
+		if (f) f->refcount++;
+	}
+	File & operator = (const File &file) {
+		if (file.f) file.f->refcount++;
+		if (f) dec_refcount();
+		f = file.f;
+		return *this;
+	}
+	virtual ~File() {
+		if (f) dec_refcount();
+	}
+	size_t read(void *buf, size_t nbyte) {
+		return (f) ? f->read(buf, nbyte) : 0;
+	}
+	size_t write(const void *buf, size_t size) {
+		return (f) ? f->write(buf, size) : 0;
+	}
+	int available() {
+		return (f) ? f->available() : 0;
+	}
+	int peek() {
+		return (f) ? f->peek() : -1;
+	}
+	void flush() {
+		if (f) f->flush();
+	}
+	bool truncate(uint64_t size=0) {
+		return (f) ? f->truncate(size) : false;
+	}
+	bool seek(uint64_t pos, int mode = SeekSet) {
+		return (f) ? f->seek(pos, mode) : false;
+	}
+	uint64_t position() {
+		return (f) ? f->position() : 0;
+	}
+	uint64_t size() {
+		return (f) ? f->size() : 0;
+	}
+	void close() {
+		if (f) {
+			f->close();
+			dec_refcount();
+		}
+	}
+	operator bool() {
+		return (f) ? f->isOpen() : false;
+	}
+	const char * name() {
+		return (f) ? f->name() : "";
+	}
+	bool isDirectory() {
+		return (f) ? f->isDirectory() : false;
+	}
+	File openNextFile(uint8_t mode=0) {
+		return (f) ? f->openNextFile(mode) : File();
+	}
+	void rewindDirectory(void) {
+		if (f) f->rewindDirectory();
+	}
+	int read() {
+		uint8_t b;
+		return (read(&b, 1) == 1) ? b : -1;
+	}
+	size_t write(uint8_t b) {
+		return write((const void *)&b, 1);
+	}
+	size_t write(const uint8_t *buf, size_t size) {
+		return write((const void *)buf, size);
+	}
+	using Print::write;
+private:
+	void dec_refcount() {
+		if (--(f->refcount) == 0) {
+			f->close();
+			delete f;
+		}
+		f = nullptr;
+	}
+	FileImpl *f;
+};
+
+class FS {
+public:
+	FS() { }
+	virtual ~FS() { }
+	virtual File open(const char *filename, uint8_t mode = FILE_READ) = 0;
+	virtual bool exists(const char *filepath) = 0;
+	virtual bool mkdir(const char *filepath) = 0;
+	virtual bool rename(const char *oldfilepath, const char *newfilepath) = 0;
+	virtual bool remove(const char *filepath) = 0;
+	virtual bool rmdir(const char *filepath) = 0;
+	virtual uint64_t usedSize() = 0;
+	virtual uint64_t totalSize() = 0;
+	virtual bool format(int type=0, char progressChar=0, Print& pr=Serial) { return false; }
+	virtual bool mediaPresent() { return true; }
+	virtual const char * name() { return nullptr; }
+};
+
+#endif
@@ -0,0 +1,643 @@
+/* Host build of the USBHost_t36 library: a small FAT16/FAT32 file system
+ * behind the SdFat names.  Files are in the root directory, with 8.3 names
+ * and no timestamps.  As in SdFat, directory and file data go through one
+ * sector cache and the FAT through another, and whole sectors of file data
+ * go straight to the drive, as many at once as lie contiguous on it.
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include <SdFat.h>
+
+#define NO_ENTRY 0xFFFFFFFF
+#define NO_SECTOR 0xFFFFFFFF
+
+// Largest direct transfer, 64KB like USBFilesystemFormatter's writes
+#define MAX_DIRECT_SECTORS 128
+
+#define ATTR_READ_ONLY 0x01
+#define ATTR_VOLUME_ID 0x08
+#define ATTR_DIRECTORY 0x10
+#define ATTR_ARCHIVE 0x20
+
+// "/name.ext" as the 11 bytes of a directory entry, false for a path into
+// a subdirectory or a name that doesn't fit 8.3
+static bool fatName(const char *path, uint8_t name[11])
+{
+	while (*path == '/') path++;
+	memset(name, ' ', 11);
+	int i = 0, limit = 8;
+	for (; *path; path++) {
+		char c = *path;
+		if ((c == '.') && (limit == 8) && (i > 0)) {
+			i = 8;
+			limit = 11;
+			continue;
+		}
+		if ((c == '/') || (c == '.') || (c == '\\') || (c <= ' ') || (i >= limit)) return false;
+		name[i++] = toupper(c);
+	}
+	return i > 0;
+}
+
+static bool isRoot(const char *path)
+{
+	while (*path == '/') path++;
+	return *path == 0;
+}
+
+//=============================================================================
+// FsVolume
+//=============================================================================
+bool FsVolume::begin(FsBlockDeviceInterface *blockDev, bool setCwv, uint32_t firstSector, uint32_t numSectors)
+{
+	dev_ = nullptr;
+	fat_type_ = 0;
+	cache_sector_ = NO_SECTOR;
+	cache_dirty_ = false;
+	fat_cache_index_ = NO_SECTOR;
+	fat_cache_dirty_ = false;
+	if (!blockDev->readSector(firstSector, cache_)) return false;
+
+	const PbsFat_t *pbs = (const PbsFat_t *)cache_;
+	const BpbFat32_t *bpb = &pbs->bpb.bpb32;
+	if ((getLe16(pbs->signature) != PBR_SIGNATURE) || (getLe16(bpb->bytesPerSector) != 512)) return false;
+	sectors_per_cluster_ = bpb->sectorsPerCluster;
+	if (!sectors_per_cluster_ || (sectors_per_cluster_ & (sectors_per_cluster_ - 1))) return false;
+	fat_count_ = bpb->fatCount;
+	if ((fat_count_ < 1) || (fat_count_ > 2)) return false;
+	fat_size_ = getLe16(bpb->sectorsPerFat16);
+	if (!fat_size_) fat_size_ = getLe32(bpb->sectorsPerFat32);
+	uint32_t total = getLe16(bpb->totalSectors16);
+	if (!total) total = getLe32(bpb->totalSectors32);
+	root_entries_ = getLe16(bpb->rootDirEntryCount);
+	fat_start_ = firstSector + getLe16(bpb->reservedSectorCount);
+	root_start_ = fat_start_ + fat_count_ * fat_size_;
+	data_start_ = root_start_ + (root_entries_ * 32 + 511) / 512;
+	if (!fat_size_ || (data_start_ - firstSector >= total)) return false;
+	cluster_count_ = (total - (data_start_ - firstSector)) / sectors_per_cluster_;
+
+	if (cluster_count_ < 4085) {
+		return false;       // FAT12
+	} else if (cluster_count_ < 65525) {
+		fat_type_ = 16;
+		if (!root_entries_) return false;
+	} else {
+		fat_type_ = 32;
+		root_cluster_ = getLe32(bpb->fat32RootCluster);
+	}
+	if ((uint64_t)fat_size_ * 512 / (fat_type_ / 8) < cluster_count_ + 2) {
+		fat_type_ = 0;
+		return false;
+	}
+	dev_ = blockDev;
+	alloc_start_ = 2;
+	free_clusters_ = -1;
+	return true;
+}
+
+void FsVolume::end()
+{
+	if (dev_) sync();
+	dev_ = nullptr;
+	fat_type_ = 0;
+}
+
+bool FsVolume::sync()
+{
+	if (!dev_) return false;
+	return cacheFlush() && fatCacheFlush() && dev_->syncDevice();
+}
+
+uint8_t *FsVolume::cacheSector(uint32_t sector, bool dirty)
+{
+	if (!dev_) return nullptr;
+	if (sector != cache_sector_) {
+		if (!cacheFlush()) return nullptr;
+		if (!dev_->readSector(sector, cache_)) {
+			cache_sector_ = NO_SECTOR;
+			return nullptr;
+		}
+		cache_sector_ = sector;
+	}
+	if (dirty) cache_dirty_ = true;
+	return cache_;
+}
+
+bool FsVolume::cacheFlush()
+{
+	if (!cache_dirty_) return true;
+	if (!dev_->writeSector(cache_sector_, cache_)) return false;
+	cache_dirty_ = false;
+	return true;
+}
+
+// Sector index within the FAT, written to every copy of it on a flush
+uint8_t *FsVolume::fatCacheSector(uint32_t index, bool dirty)
+{
+	if (!dev_) return nullptr;
+	if (index != fat_cache_index_) {
+		if (!fatCacheFlush()) return nullptr;
+		if (!dev_->readSector(fat_start_ + index, fat_cache_)) {
+			fat_cache_index_ = NO_SECTOR;
+			return nullptr;
+		}
+		fat_cache_index_ = index;
+	}
+	if (dirty) fat_cache_dirty_ = true;
+	return fat_cache_;
+}
+
+bool FsVolume::fatCacheFlush()
+{
+	if (!fat_cache_dirty_) return true;
+	for (uint32_t i = 0; i < fat_count_; i++) {
+		if (!dev_->writeSector(fat_start_ + i * fat_size_ + fat_cache_index_, fat_cache_)) return false;
+	}
+	fat_cache_dirty_ = false;
+	return true;
+}
+
+// Around the cache: what it holds is newer than the drive for a read, and
+// older than the drive after a write.
+bool FsVolume::readDirect(uint32_t sector, uint8_t *dst, uint32_t count)
+{
+	if (!dev_) return false;
+	if ((cache_sector_ >= sector) && (cache_sector_ < sector + count) && !cacheFlush()) return false;
+	return dev_->readSectors(sector, dst, count);
+}
+
+bool FsVolume::writeDirect(uint32_t sector, const uint8_t *src, uint32_t count)
+{
+	if (!dev_) return false;
+	if ((cache_sector_ >= sector) && (cache_sector_ < sector + count)) {
+		cache_sector_ = NO_SECTOR;
+		cache_dirty_ = false;
+	}
+	return dev_->writeSectors(sector, src, count);
+}
+
+bool FsVolume::fatGet(uint32_t cluster, uint32_t *value)
+{
+	if (!validCluster(cluster)) return false;
+	uint32_t offset = cluster * (fat_type_ / 8);
+	uint8_t *fat = fatCacheSector(offset / 512, false);
+	if (!fat) return false;
+	if (fat_type_ == 16) *value = getLe16(fat + offset % 512);
+	else *value = getLe32(fat + offset % 512) & 0x0FFFFFFF;
+	return true;
+}
+
+bool FsVolume::fatPut(uint32_t cluster, uint32_t value)
+{
+	if (!validCluster(cluster)) return false;
+	uint32_t offset = cluster * (fat_type_ / 8);
+	uint8_t *fat = fatCacheSector(offset / 512, true);
+	if (!fat) return false;
+	if (fat_type_ == 16) setLe16(fat + offset % 512, value);
+	else setLe32(fat + offset % 512, (getLe32(fat + offset % 512) & 0xF0000000) | value);
+	return true;
+}
+
+// count free clusters in a row, chained together
+bool FsVolume::allocate(uint32_t count, uint32_t *first)
+{
+	uint32_t begin = 0, run = 0;
+	uint32_t cluster = alloc_start_;
+	for (uint32_t n = 0; n < cluster_count_; n++, cluster++) {
+		if (!validCluster(cluster)) {
+			cluster = 2;
+			run = 0;
+		}
+		uint32_t value;
+		if (!fatGet(cluster, &value)) return false;
+		if (value) {
+			run = 0;
+			continue;
+		}
+		if (!run++) begin = cluster;
+		if (run < count) continue;
+		for (uint32_t i = 0; i < count; i++) {
+			if (!fatPut(begin + i, (i + 1 < count) ? begin + i + 1 : endOfChain())) return false;
+		}
+		alloc_start_ = begin + count;
+		if (free_clusters_ >= 0) free_clusters_ -= count;
+		*first = begin;
+		return true;
+	}
+	return false;
+}
+
+bool FsVolume::freeChain(uint32_t cluster)
+{
+	while (validCluster(cluster)) {
+		uint32_t next;
+		if (!fatGet(cluster, &next) || !fatPut(cluster, 0)) return false;
+		if (free_clusters_ >= 0) free_clusters_++;
+		if (cluster < alloc_start_) alloc_start_ = cluster;
+		cluster = next;
+	}
+	return true;
+}
+
+uint32_t FsVolume::freeClusterCount()
+{
+	if (free_clusters_ < 0) {
+		int32_t count = 0;
+		for (uint32_t cluster = 2; validCluster(cluster); cluster++) {
+			uint32_t value;
+			if (!fatGet(cluster, &value)) return 0;
+			if (!value) count++;
+		}
+		free_clusters_ = count;
+	}
+	return free_clusters_;
+}
+
+// Root directory entry, through the cache; null past the end of the
+// directory.  A FAT32 root directory is not made any longer.
+uint8_t *FsVolume::dirEntry(uint32_t index, bool dirty)
+{
+	if (!dev_) return nullptr;
+	uint32_t sector = index / 16;
+	if (fat_type_ == 16) {
+		if (index >= root_entries_) return nullptr;
+		sector += root_start_;
+	} else {
+		uint32_t cluster = root_cluster_;
+		for (uint32_t n = sector / sectors_per_cluster_; n; n--) {
+			if (!fatGet(cluster, &cluster) || !validCluster(cluster)) return nullptr;
+		}
+		sector = clusterSector(cluster) + sector % sectors_per_cluster_;
+	}
+	uint8_t *data = cacheSector(sector, dirty);
+	return data ? data + (index % 16) * 32 : nullptr;
+}
+
+bool FsVolume::findEntry(const uint8_t name[11], uint32_t *index, uint32_t *free_index)
+{
+	*free_index = NO_ENTRY;
+	for (uint32_t i = 0; ; i++) {
+		const uint8_t *entry = dirEntry(i, false);
+		if (!entry) return false;
+		if ((entry[0] == 0x00) || (entry[0] == 0xE5)) {
+			if (*free_index == NO_ENTRY) *free_index = i;
+			if (entry[0] == 0x00) return false;
+			continue;
+		}
+		if (!(entry[11] & ATTR_VOLUME_ID) && (memcmp(entry, name, 11) == 0)) {
+			*index = i;
+			return true;
+		}
+	}
+}
+
+bool FsVolume::getVolumeLabel(char *volume_label, size_t cb)
+{
+	for (uint32_t i = 0; ; i++) {
+		const uint8_t *entry = dirEntry(i, false);
+		if (!entry || (entry[0] == 0x00)) return false;
+		if ((entry[0] == 0xE5) || (entry[11] != ATTR_VOLUME_ID)) continue;
+		size_t n = 11;
+		while (n && (entry[n - 1] == ' ')) n--;
+		if (n >= cb) n = cb - 1;
+		memcpy(volume_label, entry, n);
+		volume_label[n] = 0;
+		return true;
+	}
+}
+
+FsFile FsVolume::open(const char *path, oflag_t oflag)
+{
+	FsFile file;
+	if (!dev_) return file;
+	if (isRoot(path)) {
+		file.vol_ = this;
+		file.directory_ = true;
+		return file;
+	}
+	uint8_t name[11];
+	uint32_t index, free_index;
+	if (!fatName(path, name)) return file;
+	bool writable = (oflag & O_ACCMODE) != O_RDONLY;
+	if (findEntry(name, &index, &free_index)) {
+		if ((oflag & O_CREAT) && (oflag & O_EXCL)) return file;
+	} else {
+		if (!(oflag & O_CREAT) || !writable || (free_index == NO_ENTRY)) return file;
+		uint8_t *entry = dirEntry(free_index, true);
+		if (!entry) return file;
+		memset(entry, 0, 32);
+		memcpy(entry, name, 11);
+		entry[11] = ATTR_ARCHIVE;
+		index = free_index;
+	}
+	if (!file.openEntry(this, index, oflag)) return file;
+	if (writable && (oflag & O_TRUNC) && !file.truncate(0)) {
+		file.vol_ = nullptr;
+		return file;
+	}
+	if (oflag & O_AT_END) file.position_ = file.size_;
+	return file;
+}
+
+bool FsVolume::exists(const char *path)
+{
+	uint8_t name[11];
+	uint32_t index, free_index;
+	if (!dev_) return false;
+	if (isRoot(path)) return true;
+	return fatName(path, name) && findEntry(name, &index, &free_index);
+}
+
+bool FsVolume::remove(const char *path)
+{
+	uint8_t name[11];
+	uint32_t index, free_index;
+	if (!dev_ || !fatName(path, name) || !findEntry(name, &index, &free_index)) return false;
+	uint8_t *entry = dirEntry(index, false);
+	if (!entry || (entry[11] & (ATTR_DIRECTORY | ATTR_READ_ONLY))) return false;
+	uint32_t cluster = getLe16(entry + 26);
+	if (fat_type_ == 32) cluster |= (uint32_t)getLe16(entry + 20) << 16;
+	if (!freeChain(cluster) || !(entry = dirEntry(index, true))) return false;
+	entry[0] = 0xE5;
+	return sync();
+}
+
+bool FsVolume::rename(const char *oldPath, const char *newPath)
+{
+	uint8_t old_name[11], new_name[11];
+	uint32_t index, new_index, free_index;
+	if (!dev_ || !fatName(oldPath, old_name) || !fatName(newPath, new_name)) return false;
+	if (!findEntry(old_name, &index, &free_index) || findEntry(new_name, &new_index, &free_index)) return false;
+	uint8_t *entry = dirEntry(index, true);
+	if (!entry) return false;
+	memcpy(entry, new_name, 11);
+	return sync();
+}
+
+//=============================================================================
+// FsFile
+//=============================================================================
+bool FsFile::openEntry(FsVolume *vol, uint32_t index, oflag_t oflag)
+{
+	const uint8_t *entry = vol->dirEntry(index, false);
+	if (!entry || (entry[11] & (ATTR_DIRECTORY | ATTR_VOLUME_ID))) return false;
+	if (((oflag & O_ACCMODE) != O_RDONLY) && (entry[11] & ATTR_READ_ONLY)) return false;
+	*this = FsFile();
+	vol_ = vol;
+	flags_ = oflag;
+	entry_ = index;
+	first_cluster_ = getLe16(entry + 26);
+	if (vol->fat_type_ == 32) first_cluster_ |= (uint32_t)getLe16(entry + 20) << 16;
+	size_ = getLe32(entry + 28);
+	return true;
+}
+
+bool FsFile::close()
+{
+	bool ok = sync();
+	vol_ = nullptr;
+	return ok;
+}
+
+bool FsFile::sync()
+{
+	if (!isOpen()) return false;
+	if (dirty_) {
+		uint8_t *entry = vol_->dirEntry(entry_, true);
+		if (!entry) return false;
+		setLe16(entry + 26, first_cluster_);
+		setLe16(entry + 20, (vol_->fat_type_ == 32) ? first_cluster_ >> 16 : 0);
+		setLe32(entry + 28, size_);
+		entry[11] |= ATTR_ARCHIVE;
+		dirty_ = false;
+	}
+	return vol_->sync();
+}
+
+size_t FsFile::getName(char *name, size_t len)
+{
+	if (!len) return 0;
+	char fat_name[13];
+	size_t n = 0;
+	if (directory_) {
+		fat_name[n++] = '/';
+	} else if (isOpen()) {
+		const uint8_t *entry = vol_->dirEntry(entry_, false);
+		for (int i = 0; entry && (i < 11); i++) {
+			if (entry[i] == ' ') continue;
+			if ((i >= 8) && !memchr(fat_name, '.', n)) fat_name[n++] = '.';
+			fat_name[n++] = entry[i];
+		}
+	}
+	if (n >= len) n = len - 1;
+	memcpy(name, fat_name, n);
+	name[n] = 0;
+	return n;
+}
+
+FsFile FsFile::openNextFile()
+{
+	FsFile file;
+	if (!isDirectory()) return file;
+	for (;;) {
+		const uint8_t *entry = vol_->dirEntry(next_entry_, false);
+		if (!entry || (entry[0] == 0x00)) return file;
+		uint32_t index = next_entry_++;
+		// deleted, dot entries, long names, the label and subdirectories
+		if ((entry[0] == 0xE5) || (entry[0] == '.') || (entry[11] & (ATTR_VOLUME_ID | ATTR_DIRECTORY))) continue;
+		if (file.openEntry(vol_, index, O_RDONLY)) return file;
+	}
+}
+
+bool FsFile::seekSet(uint64_t pos)
+{
+	if (!isOpen() || directory_ || (pos > size_)) return false;
+	position_ = pos;
+	return true;
+}
+
+int FsFile::peek()
+{
+	uint8_t b;
+	uint32_t pos = position_;
+	if (read(&b, 1) != 1) return -1;
+	position_ = pos;
+	return b;
+}
+
+int FsFile::available()
+{
+	if (!isOpen() || directory_) return 0;
+	uint32_t n = size_ - position_;
+	return (n > 0x7FFFFFFF) ? 0x7FFFFFFF : n;
+}
+
+// The cluster with position_ in it, in cluster_, growing the chain up to
+// it when writing.
+bool FsFile::seekCluster(bool allocate)
+{
+	uint32_t index = position_ / vol_->bytesPerCluster();
+	if (!first_cluster_) {
+		if (!allocate || !vol_->allocate(1, &first_cluster_)) return false;
+		contiguous_clusters_ = 1;
+		dirty_ = true;
+	}
+	if (index < contiguous_clusters_) {
+		cluster_ = first_cluster_ + index;
+		cluster_index_ = index;
+		return true;
+	}
+	if (!cluster_ || (cluster_index_ > index)) {
+		cluster_ = first_cluster_;
+		cluster_index_ = 0;
+	}
+	while (cluster_index_ < index) {
+		uint32_t next;
+		if (!vol_->fatGet(cluster_, &next)) return false;
+		if (!vol_->validCluster(next)) {
+			if (!allocate || !vol_->allocate(1, &next) || !vol_->fatPut(cluster_, next)) return false;
+		}
+		cluster_ = next;
+		cluster_index_++;
+	}
+	return true;
+}
+
+// Whole sectors from position_ on, up to max, one after the other on the
+// drive and already in the file's chain
+uint32_t FsFile::contiguousSectors(uint32_t max)
+{
+	uint32_t spc = vol_->sectorsPerCluster();
+	uint32_t count = spc - (position_ / 512) % spc;
+	uint32_t cluster = cluster_, index = cluster_index_;
+	if (max > MAX_DIRECT_SECTORS) max = MAX_DIRECT_SECTORS;
+	while (count < max) {
+		uint32_t next;
+		if (index + 1 < contiguous_clusters_) next = cluster + 1;
+		else if (!vol_->fatGet(cluster, &next)) break;
+		if (next != cluster + 1) break;
+		cluster = next;
+		index++;
+		count += spc;
+	}
+	return (count < max) ? count : max;
+}
+
+size_t FsFile::read(void *buf, size_t n)
+{
+	if (!isOpen() || directory_) return 0;
+	uint8_t *dst = (uint8_t *)buf;
+	if (n > size_ - position_) n = size_ - position_;
+	size_t done = 0;
+	while (done < n) {
+		if (!seekCluster(false)) break;
+		uint32_t offset = position_ % 512;
+		uint32_t sector = vol_->clusterSector(cluster_) + (position_ / 512) % vol_->sectorsPerCluster();
+		size_t chunk;
+		if (!offset && (n - done >= 512)) {
+			uint32_t count = contiguousSectors((n - done) / 512);
+			if (!vol_->readDirect(sector, dst + done, count)) break;
+			chunk = count * 512;
+		} else {
+			const uint8_t *data = vol_->cacheSector(sector, false);
+			if (!data) break;
+			chunk = 512 - offset;
+			if (chunk > n - done) chunk = n - done;
+			memcpy(dst + done, data + offset, chunk);
+		}
+		done += chunk;
+		position_ += chunk;
+	}
+	return done;
+}
+
+size_t FsFile::write(const void *buf, size_t n)
+{
+	if (!writable()) return 0;
+	const uint8_t *src = (const uint8_t *)buf;
+	if (n > 0xFFFFFFFF - position_) n = 0xFFFFFFFF - position_;
+	size_t done = 0;
+	while (done < n) {
+		if (!seekCluster(true)) break;
+		uint32_t offset = position_ % 512;
+		uint32_t sector = vol_->clusterSector(cluster_) + (position_ / 512) % vol_->sectorsPerCluster();
+		size_t chunk;
+		if (!offset && (n - done >= 512)) {
+			uint32_t count = contiguousSectors((n - done) / 512);
+			if (!vol_->writeDirect(sector, src + done, count)) break;
+			chunk = count * 512;
+		} else {
+			uint8_t *data = vol_->cacheSector(sector, true);
+			if (!data) break;
+			chunk = 512 - offset;
+			if (chunk > n - done) chunk = n - done;
+			memcpy(data + offset, src + done, chunk);
+		}
+		done += chunk;
+		position_ += chunk;
+		if (position_ > size_) size_ = position_;
+		dirty_ = true;
+	}
+	return done;
+}
+
+bool FsFile::truncate(uint64_t length)
+{
+	if (!writable() || (length > size_)) return false;
+	if (first_cluster_) {
+		uint32_t bytes_per_cluster = vol_->bytesPerCluster();
+		uint32_t keep = (length + bytes_per_cluster - 1) / bytes_per_cluster;
+		if (!keep) {
+			if (!vol_->freeChain(first_cluster_)) return false;
+			first_cluster_ = 0;
+		} else {
+			uint32_t pos = position_;
+			position_ = (keep - 1) * bytes_per_cluster;
+			bool found = seekCluster(false);
+			position_ = pos;
+			uint32_t next;
+			if (!found || !vol_->fatGet(cluster_, &next)) return false;
+			if (vol_->validCluster(next) &&
+				(!vol_->fatPut(cluster_, vol_->endOfChain()) || !vol_->freeChain(next))) return false;
+		}
+		if (contiguous_clusters_ > keep) contiguous_clusters_ = keep;
+		cluster_ = 0;
+		cluster_index_ = 0;
+	}
+	size_ = length;
+	if (position_ > size_) position_ = size_;
+	dirty_ = true;
+	return true;
+}
+
+// As SdFat: only for a file without clusters yet, which then has length
+// bytes, of whatever the clusters held, in one contiguous run.
+bool FsFile::preAllocate(uint64_t length)
+{
+	if (!writable() || first_cluster_ || !length || (length > 0xFFFFFFFF)) return false;
+	uint32_t bytes_per_cluster = vol_->bytesPerCluster();
+	uint32_t count = (length + bytes_per_cluster - 1) / bytes_per_cluster;
+	if (!vol_->allocate(count, &first_cluster_)) return false;
+	contiguous_clusters_ = count;
+	size_ = length;
+	dirty_ = true;
+	return true;
+}
+
+bool FsFile::contiguousRange(uint32_t *bgnSector, uint32_t *endSector)
+{
+	if (!isOpen() || directory_ || !first_cluster_) return false;
+	uint32_t clusters = 1;
+	for (uint32_t cluster = first_cluster_; ; cluster++, clusters++) {
+		uint32_t next;
+		if (!vol_->fatGet(cluster, &next)) return false;
+		if (!vol_->validCluster(next)) break;
+		if (next != cluster + 1) return false;
+	}
+	contiguous_clusters_ = clusters;
+	uint32_t first = vol_->clusterSector(first_cluster_);
+	if (bgnSector) *bgnSector = first;
+	if (endSector) *endSector = first + clusters * vol_->sectorsPerCluster() - 1;
+	return true;
+}
@@ -0,0 +1,185 @@
+/* Host build of the USBHost_t36 library: the parts of SdFat that the
+ * USBHost_t36 mass storage classes name.  FsVolume and FsFile are a small
+ * FAT16/FAT32 file system (SdFat.cpp) over the USBDrive, enough to mount
+ * what USBFilesystemFormatter writes and move file data through it the
+ * way SdFat does; the rest only lets the shared header compile.
+ */
+
+#ifndef SdFat_h
+#define SdFat_h
+
+#include <Arduino.h>
+
+typedef Print print_t;
+typedef int oflag_t;
+#define O_RDONLY 0
+#define O_READ O_RDONLY
+#define O_WRONLY 1
+#define O_RDWR 2
+#define O_ACCMODE 3
+#define O_CREAT 0x40
+#define O_EXCL 0x80
+#define O_TRUNC 0x200
+#define O_AT_END 0x400
+#define T_CREATE 1
+#define T_WRITE 2
+#define LS_R 1
+#define LS_DATE 2
+#define LS_SIZE 4
+#define FAT_TYPE_EXFAT 64
+#define FAT_TYPE_FAT12 12
+#define FAT_TYPE_FAT16 16
+#define FAT_TYPE_FAT32 32
+#define FS_SECOND(x) (x)
+#define FS_MINUTE(x) (x)
+#define FS_HOUR(x) (x)
+#define FS_DAY(x) (x)
+#define FS_MONTH(x) (x)
+#define FS_YEAR(x) (x)
+const uint8_t EXTENDED_BOOT_SIGNATURE = 0X29; const uint32_t FSINFO_LEAD_SIGNATURE=1, FSINFO_STRUCT_SIGNATURE=2, FSINFO_TRAIL_SIGNATURE=3; const uint16_t MBR_SIGNATURE=0xAA55, PBR_SIGNATURE=0xAA55;
+const uint8_t EXFAT_TYPE_LABEL=0x83, EXFAT_TYPE_BITMAP=0x81, EXFAT_TYPE_UPCASE=0x82;
+class FsBlockDeviceInterface { public: virtual ~FsBlockDeviceInterface(){}
+ virtual bool isBusy() = 0; virtual bool readSector(uint32_t sector, uint8_t* dst) = 0; virtual bool readSectors(uint32_t sector, uint8_t* dst, size_t ns) = 0;
+ virtual uint32_t sectorCount() = 0; virtual bool syncDevice() = 0; virtual bool writeSector(uint32_t sector, const uint8_t* src) = 0; virtual bool writeSectors(uint32_t sector, const uint8_t* src, size_t ns) = 0; };
+typedef struct { uint8_t boot; uint8_t beginCHS[3]; uint8_t type; uint8_t endCHS[3]; uint8_t relativeSectors[4]; uint8_t totalSectors[4]; } MbrPart_t;
+typedef struct { uint8_t bootCode[446]; MbrPart_t part[4]; uint8_t signature[2]; } MbrSector_t;
+typedef struct { uint8_t jmp[3]; char oem[8]; uint8_t bpb[109]; uint8_t bootCode[390]; uint8_t sig[2]; } partitionBootSector;
+typedef struct { uint8_t signature[8]; uint8_t revision[4]; uint8_t headerSize[4]; uint8_t crc32[4]; uint8_t reserved[4]; uint8_t currentLBA[8]; uint8_t backupLBA[8]; uint8_t firstLBA[8]; uint8_t lastLBA[8]; uint8_t diskGUID[16]; uint8_t startLBAArray[8]; uint8_t numberPartitions[4]; uint8_t sizePartitionEntry[4]; uint8_t crc32PartitionEntries[4]; uint8_t unused[420]; } GPTPartitionHeader_t;
+typedef struct { uint8_t partitionTypeGUID[16]; uint8_t uniqueGUID[16]; uint8_t firstLBA[8]; uint8_t lastLBA[8]; uint8_t attributeFlags[8]; uint16_t name[36]; } GPTPartitionEntryItem_t;
+typedef struct { GPTPartitionEntryItem_t items[4]; } GPTPartitionEntrySector_t;
+typedef struct { uint8_t bytesPerSector[2]; uint8_t sectorsPerCluster; uint8_t reservedSectorCount[2]; uint8_t fatCount; uint8_t rootDirEntryCount[2]; uint8_t totalSectors16[2]; uint8_t mediaType; uint8_t sectorsPerFat16[2]; uint8_t sectorsPerTrack[2]; uint8_t headCount[2]; uint8_t hidddenSectors[4]; uint8_t totalSectors32[4]; uint8_t physicalDriveNumber; uint8_t extReserved; uint8_t extSignature; uint8_t volumeSerialNumber[4]; uint8_t volumeLabel[11]; uint8_t volumeType[8]; } BpbFat16_t;
+typedef struct { uint8_t bytesPerSector[2]; uint8_t sectorsPerCluster; uint8_t reservedSectorCount[2]; uint8_t fatCount; uint8_t rootDirEntryCount[2]; uint8_t totalSectors16[2]; uint8_t mediaType; uint8_t sectorsPerFat16[2]; uint8_t sectorsPerTrack[2]; uint8_t headCount[2]; uint8_t hidddenSectors[4]; uint8_t totalSectors32[4]; uint8_t sectorsPerFat32[4]; uint8_t fat32Flags[2]; uint8_t fat32Version[2]; uint8_t fat32RootCluster[4]; uint8_t fat32FSInfoSector[2]; uint8_t fat32BackBootSector[2]; uint8_t fat32Reserved[12]; uint8_t physicalDriveNumber; uint8_t extReserved; uint8_t extSignature; uint8_t volumeSerialNumber[4]; uint8_t volumeLabel[11]; uint8_t volumeType[8]; } BpbFat32_t;
+typedef struct { uint8_t jmpInstruction[3]; char oemName[8]; union { uint8_t bpb[109]; BpbFat16_t bpb16; BpbFat32_t bpb32; } bpb; uint8_t bootCode[390]; uint8_t signature[2]; } PbsFat_t;
+typedef struct { uint8_t leadSignature[4]; uint8_t reserved1[480]; uint8_t structSignature[4]; uint8_t freeCount[4]; uint8_t nextFree[4]; uint8_t reserved2[12]; uint8_t trailSignature[4]; } FsInfo_t;
+typedef struct { uint8_t mustBeZero[53]; uint8_t partitionOffset[8]; uint8_t volumeLength[8]; uint8_t fatOffset[4]; uint8_t fatLength[4]; uint8_t clusterHeapOffset[4]; uint8_t clusterCount[4]; uint8_t rootDirectoryCluster[4]; uint8_t volumeSerialNumber[4]; uint8_t fileSystemRevision[2]; uint8_t volumeFlags[2]; uint8_t bytesPerSectorShift; uint8_t sectorsPerClusterShift; uint8_t numberOfFats; uint8_t driveSelect; uint8_t percentInUse; uint8_t reserved[7]; } BpbExFat_t;
+typedef struct { uint8_t jmpInstruction[3]; char oemName[8]; BpbExFat_t bpb; uint8_t bootCode[390]; uint8_t signature[2]; } ExFatPbs_t;
+typedef struct { uint8_t type; uint8_t reserved1[3]; uint8_t checksum[4]; uint8_t reserved2[12]; uint8_t firstCluster[4]; uint8_t size[8]; } DirUpcase_t;
+typedef struct { uint8_t type; uint8_t flags; uint8_t reserved[18]; uint8_t firstCluster[4]; uint8_t size[8]; } DirBitmap_t;
+typedef struct { uint8_t type; uint8_t labelLength; uint8_t unicode[22]; uint8_t reserved[8]; } DirLabel_t;
+
+inline uint16_t getLe16(const uint8_t *src) { return src[0] | (src[1] << 8); }
+inline uint32_t getLe32(const uint8_t *src) { return getLe16(src) | ((uint32_t)getLe16(src + 2) << 16); }
+inline uint64_t getLe64(const uint8_t *src) { return getLe32(src) | ((uint64_t)getLe32(src + 4) << 32); }
+inline void setLe16(uint8_t *dst, uint16_t src) { dst[0] = src; dst[1] = src >> 8; }
+inline void setLe32(uint8_t *dst, uint32_t src) { setLe16(dst, src); setLe16(dst + 2, src >> 16); }
+inline void setLe64(uint8_t *dst, uint64_t src) { setLe32(dst, src); setLe32(dst + 4, src >> 32); }
+inline uint32_t exFatChecksum(uint32_t sum, uint8_t data) { return (sum << 31) + (sum >> 1) + data; }
+inline void lbaToMbrChs(uint8_t *chs, uint32_t capacityMB, uint32_t lba) { memset(chs, 0, 3); }
+
+class FsVolume;
+
+class FsFile {
+public:
+	FsFile() { }
+	operator bool() { return isOpen(); }
+	bool close();
+	size_t write(const void *buf, size_t n);
+	int peek();
+	int available();
+	void flush() { sync(); }
+	size_t read(void *buf, size_t n);
+	bool truncate(uint64_t length);
+	bool seekSet(uint64_t pos);
+	bool preAllocate(uint64_t length);
+	bool contiguousRange(uint32_t *bgnSector, uint32_t *endSector);
+	bool sync();
+	bool seekCur(int64_t offset) { return seekSet(position_ + offset); }
+	bool seekEnd(int64_t offset = 0) { return seekSet(size_ + offset); }
+	uint64_t curPosition() { return position_; }
+	uint64_t size() { return size_; }
+	bool isOpen() { return vol_ != nullptr; }
+	size_t getName(char *name, size_t len);
+	bool isDirectory() { return isOpen() && directory_; }
+	FsFile openNextFile();
+	void rewindDirectory() { next_entry_ = 0; }
+	// No timestamps are kept
+	bool getCreateDateTime(uint16_t *pdate, uint16_t *ptime) { return false; }
+	bool getModifyDateTime(uint16_t *pdate, uint16_t *ptime) { return false; }
+	bool timestamp(uint8_t flags, uint16_t year, uint8_t month, uint8_t day,
+		uint8_t hour, uint8_t minute, uint8_t second) { return false; }
+
+private:
+	friend class FsVolume;
+	bool openEntry(FsVolume *vol, uint32_t index, oflag_t oflag);
+	bool writable() { return isOpen() && !directory_ && (flags_ & O_ACCMODE) != O_RDONLY; }
+	bool seekCluster(bool allocate);
+	uint32_t contiguousSectors(uint32_t max);
+
+	// Copied by value (MSCFile keeps its own), so all of it is here
+	FsVolume *vol_ = nullptr;
+	bool directory_ = false;        // the root directory
+	oflag_t flags_ = 0;
+	uint32_t entry_ = 0;            // root directory entry index
+	uint32_t first_cluster_ = 0;
+	uint32_t contiguous_clusters_ = 0;  // known to follow first_cluster_
+	uint32_t size_ = 0;
+	uint32_t position_ = 0;
+	uint32_t cluster_ = 0;          // cluster_index_ of the chain, 0 if unknown
+	uint32_t cluster_index_ = 0;
+	bool dirty_ = false;            // directory entry to update
+	uint32_t next_entry_ = 0;       // openNextFile()
+};
+
+class FsVolume {
+public:
+	bool begin(FsBlockDeviceInterface *blockDev, bool setCwv = true, uint32_t firstSector = 0, uint32_t numSectors = 0);
+	void end();
+	bool getVolumeLabel(char *volume_label, size_t cb);
+	bool setVolumeLabel(const char *volume_label) { return false; }
+	FsFile open(const char *path, oflag_t oflag);
+	bool exists(const char *path);
+	bool mkdir(const char *path) { return false; }
+	bool rename(const char *oldPath, const char *newPath);
+	bool remove(const char *path);
+	bool rmdir(const char *path) { return false; }
+	uint32_t clusterCount() { return cluster_count_; }
+	uint32_t freeClusterCount();
+	uint32_t bytesPerCluster() { return sectors_per_cluster_ * 512; }
+	uint8_t fatType() { return fat_type_; }
+	uint32_t dataStartSector() { return data_start_; }
+	uint32_t sectorsPerCluster() { return sectors_per_cluster_; }
+	uint32_t fatStartSector() { return fat_start_; }
+	bool ls(uint8_t flags) { return false; }
+
+private:
+	friend class FsFile;
+	uint8_t *cacheSector(uint32_t sector, bool dirty);
+	bool cacheFlush();
+	uint8_t *fatCacheSector(uint32_t index, bool dirty);
+	bool fatCacheFlush();
+	bool readDirect(uint32_t sector, uint8_t *dst, uint32_t count);
+	bool writeDirect(uint32_t sector, const uint8_t *src, uint32_t count);
+	bool sync();
+	bool fatGet(uint32_t cluster, uint32_t *value);
+	bool fatPut(uint32_t cluster, uint32_t value);
+	bool validCluster(uint32_t cluster) { return cluster >= 2 && cluster < cluster_count_ + 2; }
+	uint32_t endOfChain() { return fat_type_ == 16 ? 0xFFFF : 0x0FFFFFFF; }
+	uint32_t clusterSector(uint32_t cluster) { return data_start_ + (cluster - 2) * sectors_per_cluster_; }
+	bool allocate(uint32_t count, uint32_t *first);
+	bool freeChain(uint32_t cluster);
+	uint8_t *dirEntry(uint32_t index, bool dirty);
+	bool findEntry(const uint8_t name[11], uint32_t *index, uint32_t *free_index);
+
+	FsBlockDeviceInterface *dev_ = nullptr;
+	uint8_t fat_type_ = 0;
+	uint8_t fat_count_ = 0;
+	uint32_t sectors_per_cluster_ = 0;
+	uint32_t fat_start_ = 0;
+	uint32_t fat_size_ = 0;         // sectors in each FAT
+	uint32_t root_start_ = 0;       // FAT16 root directory sectors
+	uint32_t root_entries_ = 0;
+	uint32_t root_cluster_ = 0;     // FAT32 root directory chain
+	uint32_t data_start_ = 0;
+	uint32_t cluster_count_ = 0;
+	uint32_t alloc_start_ = 2;      // where the next free cluster search starts
+	int32_t free_clusters_ = -1;    // -1 until counted
+	// One sector of directory or file data and one of the FAT
+	uint8_t cache_[512];
+	uint32_t cache_sector_ = 0xFFFFFFFF;
+	bool cache_dirty_ = false;
+	uint8_t fat_cache_[512];
+	uint32_t fat_cache_index_ = 0xFFFFFFFF;
+	bool fat_cache_dirty_ = false;
+};
+
+#endif
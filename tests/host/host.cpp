@@ -0,0 +1,105 @@
+/* Host build of the USBHost_t36 library: Print, Serial, EEPROM and the key
+ * layout table.  Time and interrupts are in ../sim/sim_core.cpp.
+ */
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <keylayouts.h>
+
+uint32_t F_CPU_ACTUAL = 600000000;
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+	size_t count = 0;
+	while (size--) count += write(*buffer++);
+	return count;
+}
+
+int Print::printf(const char *format, ...)
+{
+	char buf[512];
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	if (n > 0) write((const uint8_t *)buf, ((size_t)n < sizeof(buf)) ? n : sizeof(buf) - 1);
+	return n;
+}
+
+static size_t print_number(Print *p, unsigned long long n, int base, bool negative)
+{
+	char buf[68];
+	char *s = &buf[sizeof(buf) - 1];
+	*s = 0;
+	if (base < 2) base = 10;
+	do {
+		int digit = n % base;
+		*--s = (digit < 10) ? '0' + digit : 'A' + digit - 10;
+		n /= base;
+	} while (n);
+	if (negative) *--s = '-';
+	return p->write(s);
+}
+
+size_t Print::print(long n, int base)
+{
+	if (base == 10 && n < 0) return print_number(this, -(long long)n, base, true);
+	return print_number(this, (unsigned long)n, base, false);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+	return print_number(this, n, base, false);
+}
+
+size_t Print::print(long long n, int base)
+{
+	if (base == 10 && n < 0) return print_number(this, -(unsigned long long)n, base, true);
+	return print_number(this, (unsigned long long)n, base, false);
+}
+
+size_t Print::print(unsigned long long n, int base)
+{
+	return print_number(this, n, base, false);
+}
+
+size_t Print::print(double n, int digits)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%.*f", digits, n);
+	return write(buf);
+}
+
+static bool serial_verbose()
+{
+	static int verbose = -1;
+	if (verbose < 0) verbose = getenv("USBHOST_SIM_VERBOSE") ? 1 : 0;
+	return verbose;
+}
+
+size_t HardwareSerial::write(uint8_t b)
+{
+	if (serial_verbose()) fputc(b, stdout);
+	return 1;
+}
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+
+EEPROMClass EEPROM;
+
+// US English, ASCII 32 to 127
+const KEYCODE_TYPE keycodes_ascii[96] = {
+	0x2C, 0x5E, 0x74, 0x60, 0x61, 0x62, 0x64, 0x34,
+	0x66, 0x67, 0x65, 0x6E, 0x36, 0x2D, 0x37, 0x38,
+	0x27, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24,
+	0x25, 0x26, 0x73, 0x33, 0x76, 0x2E, 0x77, 0x78,
+	0x5F, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A,
+	0x4B, 0x4C, 0x4D, 0x4E, 0x4F, 0x50, 0x51, 0x52,
+	0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A,
+	0x5B, 0x5C, 0x5D, 0x2F, 0x31, 0x30, 0x63, 0x6D,
+	0x35, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A,
+	0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12,
+	0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A,
+	0x1B, 0x1C, 0x1D, 0x6F, 0x71, 0x70, 0x75, 0x00
+};
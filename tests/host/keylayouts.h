@@ -0,0 +1,68 @@
+/* Host build of the USBHost_t36 library: the US English key layout.
+ *
+ * Only the names keyboard.cpp uses.  Key codes are the HID usage with
+ * 0xF000 set, and keycodes_ascii[] (host.cpp) maps ASCII 32-127 to the
+ * usage, with SHIFT_MASK set when shift is needed, as the Teensy core does.
+ */
+
+#ifndef KEYLAYOUTS_H__
+#define KEYLAYOUTS_H__
+
+#include <stdint.h>
+
+#define KEYCODE_TYPE		uint8_t
+#define KEYCODE_MASK		0x007F
+#define SHIFT_MASK		0x0040
+
+#define KEY_ENTER		(  40 | 0xF000 )
+#define KEY_ESC			(  41 | 0xF000 )
+#define KEY_BACKSPACE		(  42 | 0xF000 )
+#define KEY_TAB			(  43 | 0xF000 )
+#define KEY_SPACE		(  44 | 0xF000 )
+#define KEY_CAPS_LOCK		(  57 | 0xF000 )
+#define KEY_F1			(  58 | 0xF000 )
+#define KEY_F2			(  59 | 0xF000 )
+#define KEY_F3			(  60 | 0xF000 )
+#define KEY_F4			(  61 | 0xF000 )
+#define KEY_F5			(  62 | 0xF000 )
+#define KEY_F6			(  63 | 0xF000 )
+#define KEY_F7			(  64 | 0xF000 )
+#define KEY_F8			(  65 | 0xF000 )
+#define KEY_F9			(  66 | 0xF000 )
+#define KEY_F10			(  67 | 0xF000 )
+#define KEY_F11			(  68 | 0xF000 )
+#define KEY_F12			(  69 | 0xF000 )
+#define KEY_PRINTSCREEN		(  70 | 0xF000 )
+#define KEY_SCROLL_LOCK		(  71 | 0xF000 )
+#define KEY_PAUSE		(  72 | 0xF000 )
+#define KEY_INSERT		(  73 | 0xF000 )
+#define KEY_HOME		(  74 | 0xF000 )
+#define KEY_PAGE_UP		(  75 | 0xF000 )
+#define KEY_DELETE		(  76 | 0xF000 )
+#define KEY_END			(  77 | 0xF000 )
+#define KEY_PAGE_DOWN		(  78 | 0xF000 )
+#define KEY_RIGHT		(  79 | 0xF000 )
+#define KEY_LEFT		(  80 | 0xF000 )
+#define KEY_DOWN		(  81 | 0xF000 )
+#define KEY_UP			(  82 | 0xF000 )
+#define KEY_NUM_LOCK		(  83 | 0xF000 )
+#define KEYPAD_SLASH		(  84 | 0xF000 )
+#define KEYPAD_ASTERIX		(  85 | 0xF000 )
+#define KEYPAD_MINUS		(  86 | 0xF000 )
+#define KEYPAD_PLUS		(  87 | 0xF000 )
+#define KEYPAD_ENTER		(  88 | 0xF000 )
+#define KEYPAD_1		(  89 | 0xF000 )
+#define KEYPAD_2		(  90 | 0xF000 )
+#define KEYPAD_3		(  91 | 0xF000 )
+#define KEYPAD_4		(  92 | 0xF000 )
+#define KEYPAD_5		(  93 | 0xF000 )
+#define KEYPAD_6		(  94 | 0xF000 )
+#define KEYPAD_7		(  95 | 0xF000 )
+#define KEYPAD_8		(  96 | 0xF000 )
+#define KEYPAD_9		(  97 | 0xF000 )
+#define KEYPAD_0		(  98 | 0xF000 )
+#define KEYPAD_PERIOD		(  99 | 0xF000 )
+
+extern const KEYCODE_TYPE keycodes_ascii[96];
+
+#endif
@@ -0,0 +1,110 @@
+/* Simulated USB host controller for host builds of the USBHost_t36 library.
+ *
+ * sim_ehci.cpp stands in for ehci.cpp: transfers queued by the library go to
+ * a sim::Device on the root port instead of the EHCI schedules, and complete
+ * from sim::run_us() / sim::run_until() after the device's latency.  The USB
+ * interrupt (USBHost::isr) then runs the callbacks and USBDriverTimer events
+ * as on the Teensy.
+ *
+ * Time is simulated.  micros() and millis() only move while events run, or
+ * when something calls delay() or yield(), which runs the next event as the
+ * time a sketch spends waiting on the USB interrupt.  A delay() from the USB
+ * interrupt is counted (counters.isr_delay_calls) and just moves the clock,
+ * as it would stall the interrupt on the Teensy.
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <set>
+#include <vector>
+
+namespace sim {
+
+extern uint64_t now_us;
+
+// Run fn at now_us + delay_us, in the order scheduled for the same time.
+void schedule(uint64_t delay_us, std::function<void()> fn);
+// Run events for us microseconds of simulated time.
+void run_us(uint64_t us);
+// Run events until done() is true, false if timeout_us passed first.
+bool run_until(std::function<bool()> done, uint64_t timeout_us);
+
+// The USB interrupt, called now if enabled and not already running,
+// otherwise as soon as it is re-enabled.
+void raise_irq();
+bool in_isr();
+
+typedef struct {
+	uint32_t isr_calls;
+	uint64_t isr_ns;            // host time spent in the USB interrupt
+	uint64_t isr_ns_max;
+	uint32_t isr_delay_calls;   // delay()/delayMicroseconds() from the USB interrupt
+	uint64_t isr_delay_us;
+	uint32_t timer_restarts;    // USBDriverTimer::start of a timer already running
+	uint32_t transfers;         // transfers completed
+	uint32_t qh_resets;         // halted queue heads reset by cancel_Transfers()
+} counters_t;
+extern counters_t counters;
+void reset_counters();
+
+// A device on the root port.  Standard requests (descriptors, address,
+// configuration) are answered from the descriptors, the rest go to
+// control_request().  Data for IN end points is queued with send_in() and
+// goes out in max packet size pieces as the host reads it.
+//
+// stall() halts a bulk end point: each transfer the host has on it completes
+// halted, with nothing moved, until CLEAR_FEATURE(ENDPOINT_HALT).  As in the
+// EHCI, the halted transfer also halts the pipe's queue head: nothing more
+// queued on the pipe runs until USBHost::cancel_Transfers() resets it.
+class Device {
+public:
+	Device() { }
+	virtual ~Device() { }
+
+	virtual const uint8_t *device_descriptor() = 0;     // 18 bytes
+	virtual const uint8_t *config_descriptor(uint16_t &length) = 0;
+
+	// setup is the 8 byte SETUP packet.  For IN requests fill data (up to
+	// wLength) and return the byte count, for OUT data holds the data
+	// stage.  Return -1 to stall.
+	virtual int control_request(const uint8_t *setup, uint8_t *data) { return -1; }
+
+	// A transfer the host sent on an OUT end point.
+	virtual void out(uint8_t ep, const uint8_t *data, uint32_t length) { }
+
+	// Queue one IN transfer, split into packets of the end point's max
+	// packet size.  No zero length packet is added.
+	void send_in(uint8_t ep, const uint8_t *data, uint32_t length);
+	void send_in(uint8_t ep, const std::vector<uint8_t> &data) { send_in(ep, data.data(), data.size()); }
+	uint32_t pending_in(uint8_t ep) { return in_packets_[ep & 15].size(); }
+
+	void set_max_packet(uint8_t ep, uint16_t size) { max_packet_[ep & 15] = size; }
+
+	// ep is the end point address, 0x80 set for IN
+	void stall(uint8_t ep);
+	bool halted(uint8_t ep) const { return halted_.count(ep & 0x8F) != 0; }
+	uint32_t clear_halts = 0;           // CLEAR_FEATURE(ENDPOINT_HALT) requests
+
+	uint32_t control_latency_us = 250;  // SETUP to status stage done
+	uint32_t in_latency_us = 125;       // IN data available to transfer done
+	uint32_t out_latency_us = 125;
+
+private:
+	friend class Host;
+	uint16_t max_packet_[16] = {};
+	std::deque<std::vector<uint8_t>> in_packets_[16];
+	std::set<uint8_t> halted_;
+};
+
+// Connect a device to the root port, or unplug it.  Enumeration starts after
+// the port debounce and reset time, as on the Teensy (about 110ms).
+void attach(Device *device, uint8_t speed = 0);
+void detach();
+
+} // namespace sim
+
+#endif
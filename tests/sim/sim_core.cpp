@@ -0,0 +1,188 @@
+/* Simulated time, event queue and USB interrupt for the host builds.
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include <queue>
+#include "sim.h"
+
+namespace sim {
+
+uint64_t now_us = 0;
+counters_t counters;
+
+namespace {
+
+typedef struct {
+	uint64_t when;
+	uint64_t order;
+	std::function<void()> fn;
+} event_t;
+
+struct event_later {
+	bool operator()(const event_t &a, const event_t &b) const {
+		return (a.when != b.when) ? (a.when > b.when) : (a.order > b.order);
+	}
+};
+
+std::priority_queue<event_t, std::vector<event_t>, event_later> events;
+uint64_t event_order = 0;
+
+bool irq_enabled = false;
+bool irq_masked = false;    // __disable_irq()
+bool irq_pending = false;
+bool irq_active = false;
+void (*irq_vector)(void) = nullptr;
+
+uint64_t host_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void service_irq()
+{
+	if (irq_active || !irq_enabled || irq_masked || !irq_vector) return;
+	while (irq_pending) {
+		irq_pending = false;
+		irq_active = true;
+		uint64_t start = host_ns();
+		irq_vector();
+		uint64_t ns = host_ns() - start;
+		irq_active = false;
+		counters.isr_calls++;
+		counters.isr_ns += ns;
+		if (ns > counters.isr_ns_max) counters.isr_ns_max = ns;
+	}
+}
+
+// Run the next event if it is due by end, false if there is none.
+bool run_next(uint64_t end)
+{
+	if (events.empty() || events.top().when > end) return false;
+	event_t ev = events.top();
+	events.pop();
+	if (ev.when > now_us) now_us = ev.when;
+	ev.fn();
+	return true;
+}
+
+} // namespace
+
+void schedule(uint64_t delay_us, std::function<void()> fn)
+{
+	events.push(event_t{now_us + delay_us, event_order++, std::move(fn)});
+}
+
+void run_us(uint64_t us)
+{
+	uint64_t end = now_us + us;
+	while (run_next(end)) ;
+	if (end > now_us) now_us = end;
+}
+
+bool run_until(std::function<bool()> done, uint64_t timeout_us)
+{
+	uint64_t end = now_us + timeout_us;
+	while (!done()) {
+		if (!run_next(end)) {
+			if (end > now_us) now_us = end;
+			return done();
+		}
+	}
+	return true;
+}
+
+void raise_irq()
+{
+	irq_pending = true;
+	service_irq();
+}
+
+bool in_isr()
+{
+	return irq_active;
+}
+
+void reset_counters()
+{
+	counters = counters_t();
+}
+
+} // namespace sim
+
+//----------------------------------------------------------------------------
+// Arduino time and interrupt functions
+
+uint32_t micros()
+{
+	return (uint32_t)sim::now_us;
+}
+
+uint32_t millis()
+{
+	return (uint32_t)(sim::now_us / 1000);
+}
+
+void delayMicroseconds(uint32_t usec)
+{
+	if (sim::in_isr()) {
+		// Would stall the USB interrupt on the Teensy, so count it.
+		sim::counters.isr_delay_calls++;
+		sim::counters.isr_delay_us += usec;
+		sim::now_us += usec;
+		return;
+	}
+	sim::run_us(usec);
+}
+
+void delay(uint32_t msec)
+{
+	delayMicroseconds(msec * 1000);
+}
+
+// Library code waiting for the USB interrupt (the mass storage commands)
+// spins on yield(): let the time pass to the next event.
+void yield()
+{
+	if (sim::in_isr()) return;
+	if (!sim::run_next(UINT64_MAX)) sim::now_us++;
+}
+
+bool host_nvic_is_enabled(int irq)
+{
+	return (irq == IRQ_USB2) && sim::irq_enabled;
+}
+
+void host_nvic_enable(int irq)
+{
+	if (irq != IRQ_USB2) return;
+	sim::irq_enabled = true;
+	sim::service_irq();
+}
+
+void host_nvic_disable(int irq)
+{
+	if (irq == IRQ_USB2) sim::irq_enabled = false;
+}
+
+void host_disable_irq()
+{
+	sim::irq_masked = true;
+}
+
+void host_enable_irq()
+{
+	sim::irq_masked = false;
+	sim::service_irq();
+}
+
+void attachInterruptVector(int irq, void (*function)(void))
+{
+	if (irq == IRQ_USB2) sim::irq_vector = function;
+}
+
+uint32_t host_cycle_count()
+{
+	return (uint32_t)sim::host_ns();
+}
@@ -0,0 +1,464 @@
+/* Simulated USB host controller, replaces ehci.cpp in the host builds.
+ *
+ * Transfers are allocated from the library's Transfer_t pool and handed back
+ * in the USB interrupt exactly as ehci.cpp does, so the pools run out the
+ * same way they would on the Teensy.  The qTD chains themselves are not
+ * built: each queued transfer is kept in a per pipe queue here and moved
+ * through the device model by scheduled events.
+ */
+
+#include <Arduino.h>
+#include <map>
+#include <set>
+#include "USBHost_t36.h"
+#include "sim.h"
+
+namespace sim {
+
+// State of the simulated controller.  Anything that needs the private
+// parts of USBHost (the Transfer_t pool, new_Device, driver timers) is done
+// in the USBHost functions below, as only USBHost is their friend.
+class Host {
+public:
+	typedef struct {
+		Pipe_t *pipe;
+		std::vector<Transfer_t *> qtds;     // the last one carries the callback
+		uint8_t *buffer;
+		uint32_t length;
+		uint8_t setup[8];
+	} request_t;
+
+	static std::map<Pipe_t *, std::deque<request_t>> queued;
+	static std::set<Pipe_t *> busy;     // a request is being moved through the device
+	static std::set<Pipe_t *> halted;   // queue head halted by a STALL
+	static std::map<Pipe_t *, Transfer_t *> halt;
+	static std::deque<request_t> done;
+	static std::map<USBDriverTimer *, uint64_t> timers;
+	static Device *root;
+	static uint8_t root_speed;
+	static Device_t *rootdev;
+	static uint32_t port_event;     // 1 connect, 2 disconnect
+
+	static Device *device_for(Pipe_t *pipe) { return (pipe->device && root) ? root : nullptr; }
+	static uint8_t endpoint(Pipe_t *pipe) { return pipe->unused1; }
+	static uint16_t max_packet(Pipe_t *pipe) { return pipe->unused2; }
+	static uint8_t address(Pipe_t *pipe) { return endpoint(pipe) | (pipe->direction ? 0x80 : 0); }
+
+	static void start(Pipe_t *pipe);
+	static void finish(Pipe_t *pipe, request_t &req, uint32_t actual);
+	static void halt_request(Pipe_t *pipe, request_t &req);
+	static void run_control(Pipe_t *pipe);
+	static void run_in(Pipe_t *pipe);
+	static void run_out(Pipe_t *pipe);
+	static std::vector<Transfer_t *> cancel(Pipe_t *pipe);
+	static void port_change(uint32_t event);
+};
+
+std::map<Pipe_t *, std::deque<Host::request_t>> Host::queued;
+std::set<Pipe_t *> Host::busy;
+std::set<Pipe_t *> Host::halted;
+std::map<Pipe_t *, Transfer_t *> Host::halt;
+std::deque<Host::request_t> Host::done;
+std::map<USBDriverTimer *, uint64_t> Host::timers;
+Device *Host::root = nullptr;
+uint8_t Host::root_speed = 0;
+Device_t *Host::rootdev = nullptr;
+uint32_t Host::port_event = 0;
+
+void Device::send_in(uint8_t ep, const uint8_t *data, uint32_t length)
+{
+	ep &= 15;
+	uint16_t size = max_packet_[ep] ? max_packet_[ep] : 64;
+	do {
+		uint32_t n = (length < size) ? length : size;
+		in_packets_[ep].emplace_back(data, data + n);
+		data += n;
+		length -= n;
+	} while (length);
+	for (auto &q : Host::queued) {
+		if (q.first->direction == 1 && q.first->type != 0 && Host::endpoint(q.first) == ep) {
+			Host::start(q.first);
+		}
+	}
+}
+
+void Device::stall(uint8_t ep)
+{
+	halted_.insert(ep & 0x8F);
+	for (auto &q : Host::queued) {
+		if (q.first->type != 0 && Host::address(q.first) == (ep & 0x8F)) Host::start(q.first);
+	}
+}
+
+// Start the request at the head of a pipe's queue, if it can go.
+void Host::start(Pipe_t *pipe)
+{
+	if (busy.count(pipe) || halted.count(pipe)) return;
+	auto it = queued.find(pipe);
+	if (it == queued.end() || it->second.empty()) return;
+	Device *dev = device_for(pipe);
+	if (!dev) return;
+	if (pipe->type == 0) {
+		busy.insert(pipe);
+		schedule(dev->control_latency_us, [pipe]() { run_control(pipe); });
+	} else if (pipe->direction == 0) {
+		busy.insert(pipe);
+		schedule(dev->out_latency_us, [pipe]() { run_out(pipe); });
+	} else if (!dev->in_packets_[endpoint(pipe)].empty() || dev->halted(address(pipe))) {
+		busy.insert(pipe);
+		schedule(dev->in_latency_us, [pipe]() { run_in(pipe); });
+	}
+}
+
+// The end point STALLed: the request completes halted with nothing moved.
+// A control pipe goes on with the next SETUP, any other stays halted.
+void Host::halt_request(Pipe_t *pipe, request_t &req)
+{
+	for (Transfer_t *t : req.qtds) t->qtd.token |= 0x40;
+	if (pipe->type != 0) halted.insert(pipe);
+	finish(pipe, req, 0);
+}
+
+// The request is done: write back the qTD tokens (active off, residual in
+// the last one) and let the interrupt hand it to the driver.
+void Host::finish(Pipe_t *pipe, request_t &req, uint32_t actual)
+{
+	for (Transfer_t *t : req.qtds) t->qtd.token &= ~0x80;
+	Transfer_t *last = req.qtds.back();
+	uint32_t residual = (req.length > actual) ? req.length - actual : 0;
+	last->qtd.token = (last->qtd.token & 0x8000FFFF & ~0x80) | (residual << 16);
+	done.push_back(req);
+	queued[pipe].pop_front();
+	busy.erase(pipe);
+	counters.transfers++;
+	raise_irq();
+	start(pipe);
+}
+
+void Host::run_control(Pipe_t *pipe)
+{
+	if (!busy.count(pipe) || queued[pipe].empty()) return;
+	request_t &req = queued[pipe].front();
+	Device *dev = device_for(pipe);
+	uint16_t wLength = req.setup[6] | (req.setup[7] << 8);
+	int actual = -1;
+	uint8_t type = req.setup[0];
+	uint8_t request = req.setup[1];
+	uint16_t wValue = req.setup[2] | (req.setup[3] << 8);
+	if ((type & 0x60) == 0 && request == 6 && (type & 0x80)) {
+		// GET_DESCRIPTOR
+		const uint8_t *desc = nullptr;
+		uint16_t size = 0;
+		if ((wValue >> 8) == 1) {
+			desc = dev->device_descriptor();
+			size = 18;
+		} else if ((wValue >> 8) == 2) {
+			desc = dev->config_descriptor(size);
+		}
+		if (desc) {
+			actual = (size < wLength) ? size : wLength;
+			memcpy(req.buffer, desc, actual);
+		}
+	} else if (type == 0 && (request == 5 || request == 9)) {
+		actual = 0;     // SET_ADDRESS, SET_CONFIGURATION
+	} else if (type == 2 && request == 1 && wValue == 0) {
+		// CLEAR_FEATURE(ENDPOINT_HALT)
+		dev->halted_.erase(req.setup[4] & 0x8F);
+		dev->clear_halts++;
+		actual = 0;
+	} else {
+		actual = dev->control_request(req.setup, req.buffer);
+		if (!(type & 0x80) && actual >= 0) actual = wLength;
+	}
+	if (actual < 0) {
+		halt_request(pipe, req);
+		return;
+	}
+	finish(pipe, req, actual);
+}
+
+void Host::run_in(Pipe_t *pipe)
+{
+	if (!busy.count(pipe) || queued[pipe].empty()) return;
+	request_t &req = queued[pipe].front();
+	Device *dev = device_for(pipe);
+	if (dev->halted(address(pipe))) {
+		halt_request(pipe, req);
+		return;
+	}
+	auto &packets = dev->in_packets_[endpoint(pipe)];
+	uint16_t size = max_packet(pipe);
+	uint32_t actual = 0;
+	while (!packets.empty() && actual < req.length) {
+		std::vector<uint8_t> &p = packets.front();
+		uint32_t n = p.size();
+		if (n > req.length - actual) n = req.length - actual;   // babble, drop the rest
+		memcpy(req.buffer + actual, p.data(), n);
+		actual += n;
+		bool short_packet = (p.size() < size);
+		packets.pop_front();
+		if (short_packet) break;
+	}
+	finish(pipe, req, actual);
+}
+
+void Host::run_out(Pipe_t *pipe)
+{
+	if (!busy.count(pipe) || queued[pipe].empty()) return;
+	request_t &req = queued[pipe].front();
+	Device *dev = device_for(pipe);
+	if (dev->halted(address(pipe))) {
+		halt_request(pipe, req);
+		return;
+	}
+	dev->out(endpoint(pipe), req.buffer, req.length);
+	finish(pipe, req, req.length);
+}
+
+// Drop a pipe's queued requests without callbacks and reset its queue
+// head, returns their transfers for USBHost to free.
+std::vector<Transfer_t *> Host::cancel(Pipe_t *pipe)
+{
+	std::vector<Transfer_t *> transfers;
+	auto it = queued.find(pipe);
+	if (it != queued.end()) {
+		for (request_t &req : it->second) {
+			transfers.insert(transfers.end(), req.qtds.begin(), req.qtds.end());
+		}
+		queued.erase(it);
+	}
+	busy.erase(pipe);
+	if (halted.erase(pipe)) counters.qh_resets++;
+	for (auto d = done.begin(); d != done.end(); ) {
+		if (d->pipe == pipe) {
+			transfers.insert(transfers.end(), d->qtds.begin(), d->qtds.end());
+			d = done.erase(d);
+		} else {
+			++d;
+		}
+	}
+	return transfers;
+}
+
+void Host::port_change(uint32_t event)
+{
+	port_event = event;
+	raise_irq();
+}
+
+void attach(Device *device, uint8_t speed)
+{
+	Host::root = device;
+	Host::root_speed = speed;
+	// port debounce (100ms) then reset and recovery (10ms)
+	schedule(110000, []() { Host::port_change(1); });
+}
+
+void detach()
+{
+	schedule(0, []() {
+		Host::port_change(2);
+		Host::root = nullptr;
+	});
+}
+
+} // namespace sim
+
+using sim::Host;
+
+//----------------------------------------------------------------------------
+// USBHost, the parts ehci.cpp has
+
+void USBHost::begin()
+{
+	init_Device_Pipe_Transfer_memory();
+	attachInterruptVector(IRQ_USBHS, isr);
+	NVIC_ENABLE_IRQ(IRQ_USBHS);
+}
+
+void USBHost::isr()
+{
+	// completed transfers, callback from the one with IOC set
+	while (!Host::done.empty()) {
+		Host::request_t req = Host::done.front();
+		Host::done.pop_front();
+		for (Transfer_t *t : req.qtds) {
+			if ((t->qtd.token & 0x8000) && t->pipe->callback_function) {
+				(*(t->pipe->callback_function))(t);
+			}
+			free_Transfer(t);
+		}
+	}
+	// root port
+	if (Host::port_event == 1) {
+		Host::port_event = 0;
+		Host::rootdev = new_Device(Host::root_speed, 0, 0);
+	} else if (Host::port_event == 2) {
+		Host::port_event = 0;
+		disconnect_Device(Host::rootdev);
+		Host::rootdev = nullptr;
+	}
+	// USBDriverTimer events that are due, earliest first.  Each is removed
+	// before its event runs, which may start it again.
+	while (1) {
+		USBDriverTimer *timer = nullptr;
+		uint64_t when = 0;
+		for (auto &t : Host::timers) {
+			if (t.second <= sim::now_us && (!timer || t.second < when)) {
+				timer = t.first;
+				when = t.second;
+			}
+		}
+		if (!timer) break;
+		Host::timers.erase(timer);
+		if (timer->driver) timer->driver->timer_event(timer);
+	}
+}
+
+Pipe_t * USBHost::new_Pipe(Device_t *dev, uint32_t type, uint32_t endpoint,
+	uint32_t direction, uint32_t maxlen, uint32_t interval)
+{
+	Pipe_t *pipe = allocate_Pipe();
+	if (!pipe) return NULL;
+	Transfer_t *halt = allocate_Transfer();
+	if (!halt) {
+		free_Pipe(pipe);
+		return NULL;
+	}
+	memset(pipe, 0, sizeof(Pipe_t));
+	memset(halt, 0, sizeof(Transfer_t));
+	pipe->device = dev;
+	pipe->direction = direction;
+	pipe->type = type;
+	pipe->periodic_interval = interval;
+	pipe->unused1 = endpoint;
+	pipe->unused2 = maxlen;
+	Host::halt[pipe] = halt;
+	if (endpoint > 0) {
+		Pipe_t *p = dev->data_pipes;
+		if (p == NULL) {
+			dev->data_pipes = pipe;
+		} else {
+			while (p->next) p = p->next;
+			p->next = pipe;
+		}
+	}
+	return pipe;
+}
+
+bool USBHost::queue_Control_Transfer(Device_t *dev, setup_t *setup, void *buf, USBDriver *driver)
+{
+	Transfer_t *transfer, *data = NULL, *status;
+
+	if (setup->wLength > 16384) return false; // max 16K data for control
+	transfer = allocate_Transfer();
+	if (!transfer) return false;
+	status = allocate_Transfer();
+	if (!status) {
+		free_Transfer(transfer);
+		return false;
+	}
+	if (setup->wLength > 0) {
+		data = allocate_Transfer();
+		if (!data) {
+			free_Transfer(transfer);
+			free_Transfer(status);
+			return false;
+		}
+		memset(data, 0, sizeof(Transfer_t));
+		data->qtd.token = 0x80;
+	}
+	memset(transfer, 0, sizeof(Transfer_t));
+	memset(status, 0, sizeof(Transfer_t));
+	transfer->qtd.token = 0x80;
+	status->qtd.token = 0x8080;
+	status->pipe = dev->control_pipe;
+	status->buffer = buf;
+	status->length = setup->wLength;
+	status->setup.word1 = setup->word1;
+	status->setup.word2 = setup->word2;
+	status->driver = driver;
+
+	Host::request_t req;
+	req.pipe = dev->control_pipe;
+	req.qtds.push_back(transfer);
+	if (data) req.qtds.push_back(data);
+	req.qtds.push_back(status);
+	req.buffer = (uint8_t *)buf;
+	req.length = setup->wLength;
+	memcpy(req.setup, setup, 8);
+	for (Transfer_t *t : req.qtds) t->pipe = dev->control_pipe;
+	Host::queued[dev->control_pipe].push_back(req);
+	Host::start(dev->control_pipe);
+	return true;
+}
+
+bool USBHost::queue_Data_Transfer(Pipe_t *pipe, void *buffer, uint32_t len, USBDriver *driver)
+{
+	bool irq_was_enabled = NVIC_IS_ENABLED(IRQ_USBHS);
+	NVIC_DISABLE_IRQ(IRQ_USBHS);
+
+	// One qTD per 16K, as ehci.cpp builds them
+	Host::request_t req;
+	for (uint32_t count = ((len - 1) >> 14) + 1; count; count--) {
+		Transfer_t *t = allocate_Transfer();
+		if (!t) {
+			for (Transfer_t *p : req.qtds) free_Transfer(p);
+			if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+			return false;
+		}
+		memset(t, 0, sizeof(Transfer_t));
+		t->qtd.token = 0x80;
+		t->pipe = pipe;
+		req.qtds.push_back(t);
+	}
+	Transfer_t *last = req.qtds.back();
+	last->qtd.token |= 0x8000;
+	last->buffer = buffer;
+	last->length = len;
+	last->driver = driver;
+	req.pipe = pipe;
+	req.buffer = (uint8_t *)buffer;
+	req.length = len;
+	Host::queued[pipe].push_back(req);
+	Host::start(pipe);
+	if (irq_was_enabled) NVIC_ENABLE_IRQ(IRQ_USBHS);
+	return true;
+}
+
+void USBHost::delete_Pipe(Pipe_t *pipe)
+{
+	for (Transfer_t *t : Host::cancel(pipe)) free_Transfer(t);
+	auto it = Host::halt.find(pipe);
+	if (it != Host::halt.end()) {
+		free_Transfer(it->second);
+		Host::halt.erase(it);
+	}
+	free_Pipe(pipe);
+}
+
+void USBHost::cancel_Transfers(Pipe_t *pipe)
+{
+	for (Transfer_t *t : Host::cancel(pipe)) free_Transfer(t);
+}
+
+//----------------------------------------------------------------------------
+// USBDriverTimer
+
+void USBDriverTimer::start(uint32_t microseconds)
+{
+	if (!driver) return;
+	if (microseconds < 100) return; // minimum timer duration
+	started_micros = micros();
+	// Starting a timer that is already running corrupts the timer list in
+	// ehci.cpp, here it is counted and restarted.
+	if (Host::timers.count(this)) sim::counters.timer_restarts++;
+	uint64_t when = sim::now_us + microseconds;
+	Host::timers[this] = when;
+	sim::schedule(microseconds, []() { sim::raise_irq(); });
+}
+
+void USBDriverTimer::stop()
+{
+	Host::timers.erase(this);
+}
@@ -0,0 +1,111 @@
+/* RAM file system for host builds of the USBHost_t36 library.
+ */
+
+#include <string.h>
+#include "sim_fs.h"
+
+namespace sim {
+
+namespace {
+
+class RamFile : public FileImpl {
+public:
+	RamFile(RamFS *fs, const std::string &name, uint64_t position)
+		: fs_(fs), name_(name), position_(position) { }
+
+protected:
+	size_t read(void *buf, size_t nbyte) override {
+		std::vector<uint8_t> &data = fs_->files[name_];
+		fs_->counters.reads++;
+		if (position_ >= data.size()) return 0;
+		if (nbyte > data.size() - position_) nbyte = data.size() - position_;
+		memcpy(buf, &data[position_], nbyte);
+		position_ += nbyte;
+		fs_->counters.bytes_read += nbyte;
+		return nbyte;
+	}
+	size_t write(const void *buf, size_t size) override {
+		std::vector<uint8_t> &data = fs_->files[name_];
+		fs_->counters.writes++;
+		if (position_ + size > data.size()) data.resize(position_ + size);
+		memcpy(&data[position_], buf, size);
+		position_ += size;
+		fs_->counters.bytes_written += size;
+		return size;
+	}
+	int available() override {
+		uint64_t size = fs_->files[name_].size();
+		return (position_ < size) ? size - position_ : 0;
+	}
+	int peek() override {
+		std::vector<uint8_t> &data = fs_->files[name_];
+		return (position_ < data.size()) ? data[position_] : -1;
+	}
+	void flush() override { }
+	bool truncate(uint64_t size) override {
+		fs_->files[name_].resize(size);
+		return true;
+	}
+	bool seek(uint64_t pos, int mode) override {
+		fs_->counters.seeks++;
+		uint64_t size = fs_->files[name_].size();
+		if (mode == SeekCur) pos += position_;
+		else if (mode == SeekEnd) pos += size;
+		if (pos > size) return false;
+		position_ = pos;
+		return true;
+	}
+	uint64_t position() override { return position_; }
+	uint64_t size() override { return fs_->files[name_].size(); }
+	void close() override { open_ = false; }
+	bool isOpen() override { return open_; }
+	const char *name() override { return name_.c_str(); }
+	bool isDirectory() override { return false; }
+	File openNextFile(uint8_t mode) override { return File(); }
+	void rewindDirectory(void) override { }
+
+private:
+	RamFS *fs_;
+	std::string name_;
+	uint64_t position_;
+	bool open_ = true;
+};
+
+} // namespace
+
+File RamFS::open(const char *filename, uint8_t mode)
+{
+	counters.opens++;
+	auto it = files.find(filename);
+	if (it == files.end()) {
+		if (mode == FILE_READ) return File();
+		it = files.emplace(filename, std::vector<uint8_t>()).first;
+	}
+	// FILE_WRITE appends, FILE_WRITE_BEGIN starts at the front
+	return File(new RamFile(this, filename, (mode == FILE_WRITE) ? it->second.size() : 0));
+}
+
+bool RamFS::rename(const char *oldfilepath, const char *newfilepath)
+{
+	auto it = files.find(oldfilepath);
+	if (it == files.end()) return false;
+	std::vector<uint8_t> data = it->second;
+	files.erase(it);
+	files[newfilepath] = data;
+	return true;
+}
+
+bool RamFS::remove(const char *filepath)
+{
+	counters.removes++;
+	return files.erase(filepath) != 0;
+}
+
+uint64_t RamFS::usedSize()
+{
+	uint64_t used = 0;
+	for (auto &file : files) used += file.second.size();
+	return used;
+}
+
+} // namespace sim
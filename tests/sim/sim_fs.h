@@ -0,0 +1,47 @@
+/* RAM file system for host builds of the USBHost_t36 library.
+ *
+ * RamFS is a FS with flat file names and no directories, enough for the
+ * library's own files (the link key store).  It counts what is done to it
+ * so the tests can check how often the library goes to storage.
+ */
+
+#ifndef SIM_FS_H_
+#define SIM_FS_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <FS.h>
+
+namespace sim {
+
+class RamFS : public FS {
+public:
+	File open(const char *filename, uint8_t mode = FILE_READ) override;
+	bool exists(const char *filepath) override { return files.count(filepath) != 0; }
+	bool mkdir(const char *filepath) override { return false; }
+	bool rename(const char *oldfilepath, const char *newfilepath) override;
+	bool remove(const char *filepath) override;
+	bool rmdir(const char *filepath) override { return false; }
+	uint64_t usedSize() override;
+	uint64_t totalSize() override { return 1 << 20; }
+
+	std::map<std::string, std::vector<uint8_t>> files;
+
+	// What the library did
+	typedef struct {
+		uint32_t opens;
+		uint32_t reads;         // read() calls
+		uint32_t writes;        // write() calls
+		uint32_t seeks;
+		uint32_t removes;
+		uint64_t bytes_read;
+		uint64_t bytes_written;
+	} counters_t;
+	counters_t counters = {};
+	void reset_counters() { counters = {}; }
+};
+
+} // namespace sim
+
+#endif
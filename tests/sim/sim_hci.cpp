@@ -0,0 +1,709 @@
+/* Simulated USB Bluetooth dongle: HCI command handling, events and ACL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "sim_hci.h"
+
+namespace sim {
+
+// With USBHOST_SIM_VERBOSE set, print what crosses the HCI transport along
+// with the library's own debug output.
+static void trace(const char *what, const uint8_t *data, uint32_t length)
+{
+	static int verbose = -1;
+	if (verbose < 0) verbose = getenv("USBHOST_SIM_VERBOSE") ? 1 : 0;
+	if (!verbose) return;
+	printf("%10llu %s", (unsigned long long)now_us, what);
+	for (uint32_t i = 0; i < length; i++) printf(" %02X", data[i]);
+	printf("\n");
+}
+
+Peer::Peer(const uint8_t addr[6], uint32_t cod, const char *remote_name)
+	: class_of_device(cod), name(remote_name)
+{
+	memcpy(bdaddr, addr, 6);
+}
+
+void Peer::send_l2cap(uint16_t cid, const uint8_t *data, uint16_t length)
+{
+	if (!controller || !handle) return;
+	std::vector<uint8_t> packet;
+	put16(packet, length);
+	put16(packet, cid);
+	packet.insert(packet.end(), data, data + length);
+	uint16_t h = handle;
+	schedule(air_latency_us, [this, h, packet]() {
+		if (handle == h) controller->send_acl(h, packet.data(), packet.size());
+	});
+}
+
+//----------------------------------------------------------------------------
+
+HCIController::HCIController()
+{
+	static const uint8_t device[18] = {
+		18, 1, 0x00, 0x02, 0xE0, 0x01, 0x01, 64,    // Wireless, RF, Bluetooth programming
+		0x12, 0x0A, 0x01, 0x00, 0x91, 0x88,         // 0A12:0001 like a CSR dongle
+		0, 0, 0, 1                                  // no strings, one configuration
+	};
+	memcpy(descriptor_, device, sizeof(descriptor_));
+}
+
+const uint8_t *HCIController::device_descriptor()
+{
+	return descriptor_;
+}
+
+const uint8_t *HCIController::config_descriptor(uint16_t &length)
+{
+	const uint8_t config[39] = {
+		9, 2, sizeof(config_), 0, 1, 1, 0, 0x80, 50,
+		9, 4, 0, 0, 3, 0xE0, 0x01, 0x01, 0,
+		7, 5, 0x81, 3, event_packet_size, 0, 1,     // HCI events
+		7, 5, 0x82, 2, 64, 0, 0,                    // ACL in
+		7, 5, 0x02, 2, 64, 0, 0                     // ACL out
+	};
+	memcpy(config_, config, sizeof(config_));
+	set_max_packet(1, event_packet_size);
+	set_max_packet(2, 64);
+	length = sizeof(config_);
+	return config_;
+}
+
+void HCIController::add_peer(Peer *peer)
+{
+	peer->controller = this;
+	peers_.push_back(peer);
+}
+
+Peer *HCIController::peer_for(uint16_t handle)
+{
+	for (Peer *peer : peers_) {
+		if (peer->handle && peer->handle == handle) return peer;
+	}
+	return nullptr;
+}
+
+Peer *HCIController::peer_for(const uint8_t *addr)
+{
+	for (Peer *peer : peers_) {
+		if (memcmp(peer->bdaddr, addr, 6) == 0) return peer;
+	}
+	return nullptr;
+}
+
+int HCIController::count(uint16_t opcode) const
+{
+	int n = 0;
+	for (const command_t &c : commands) {
+		if (c.opcode == opcode) n++;
+	}
+	return n;
+}
+
+const HCIController::command_t *HCIController::last(uint16_t opcode) const
+{
+	for (auto c = commands.rbegin(); c != commands.rend(); ++c) {
+		if (c->opcode == opcode) return &*c;
+	}
+	return nullptr;
+}
+
+uint64_t HCIController::first_us(uint16_t opcode) const
+{
+	for (const command_t &c : commands) {
+		if (c.opcode == opcode) return c.us;
+	}
+	return 0;
+}
+
+//----------------------------------------------------------------------------
+// HCI commands: class request 0x20/0x00 on the control pipe
+
+int HCIController::control_request(const uint8_t *setup, uint8_t *data)
+{
+	if (setup[0] != 0x20 || setup[1] != 0) return -1;
+	uint16_t wLength = setup[6] | (setup[7] << 8);
+	if (wLength < 3 || data[2] + 3 > wLength) return -1;
+	uint16_t opcode = get16(data);
+	uint8_t length = data[2];
+	trace("CMD >", data, length + 3);
+	commands.push_back(command_t{now_us, opcode, std::vector<uint8_t>(data + 3, data + 3 + length)});
+	if (credits_ == 0) command_overruns++;
+	else credits_--;
+	commands_outstanding_++;
+	if (commands_outstanding_ > commands_max_outstanding) commands_max_outstanding = commands_outstanding_;
+	std::vector<uint8_t> params(data + 3, data + 3 + length);
+	schedule(command_latency_us, [this, opcode, params]() {
+		command(opcode, params.data(), params.size());
+	});
+	return 0;
+}
+
+void HCIController::send_event(uint8_t code, const std::vector<uint8_t> &params)
+{
+	std::vector<uint8_t> ev;
+	ev.push_back(code);
+	ev.push_back(params.size());
+	ev.insert(ev.end(), params.begin(), params.end());
+	trace("EV  <", ev.data(), ev.size());
+	send_in(1, ev);
+}
+
+void HCIController::command_complete(uint16_t opcode, const std::vector<uint8_t> &ret)
+{
+	if (commands_outstanding_) commands_outstanding_--;
+	if (credits_ < command_credits) credits_++;
+	std::vector<uint8_t> params;
+	params.push_back(credits_);
+	put16(params, opcode);
+	params.insert(params.end(), ret.begin(), ret.end());
+	send_event(0x0E, params);
+}
+
+void HCIController::command_status(uint16_t opcode, uint8_t status)
+{
+	if (commands_outstanding_) commands_outstanding_--;
+	if (credits_ < command_credits) credits_++;
+	std::vector<uint8_t> params;
+	params.push_back(status);
+	params.push_back(credits_);
+	put16(params, opcode);
+	send_event(0x0F, params);
+}
+
+void HCIController::command(uint16_t opcode, const uint8_t *p, uint8_t length)
+{
+	if (on_command && on_command(opcode, p, length)) return;
+
+	std::vector<uint8_t> ret;
+	ret.push_back(0);   // status
+	Peer *peer = nullptr;
+
+	switch (opcode) {
+	case 0x0C03:    // Reset
+		for (Peer *pr : peers_) {
+			if (pr->handle) {
+				pr->handle = 0;
+				pr->link_down();
+			}
+		}
+		acl_outstanding_ = 0;
+		le_acl_outstanding_ = 0;
+		handle_outstanding_.clear();
+		incoming_.clear();
+		from_host_.clear();
+		to_host_.clear();
+		scan_enable = 0;
+		inquiry_active_ = false;
+		le_scanning = false;
+		credits_ = command_credits - 1;
+		commands_outstanding_ = 1;
+		command_complete(opcode, ret);
+		return;
+
+	case 0x1001:    // Read_Local_Version_Information
+		ret.push_back(0x06);                    // HCI 4.0
+		put16(ret, 0x2ec6);
+		ret.push_back(0x06);                    // LMP 4.0
+		put16(ret, 0x000A);                     // CSR
+		put16(ret, 0x2ec6);
+		break;
+	case 0x1002:    // Read_Local_Supported_Commands
+		ret.insert(ret.end(), 64, 0xff);
+		break;
+	case 0x1003: {  // Read_Local_Supported_Features
+		static const uint8_t features[8] = {0xff, 0xff, 0x8f, 0xfe, 0xdb, 0xff, 0x5b, 0x87};
+		ret.insert(ret.end(), features, features + 8);
+		break;
+	}
+	case 0x1005:    // Read_Buffer_Size
+		put16(ret, acl_mtu);
+		ret.push_back(64);
+		put16(ret, acl_buffers);
+		put16(ret, 8);
+		break;
+	case 0x1009:    // Read_BD_ADDR
+		ret.insert(ret.end(), bdaddr, bdaddr + 6);
+		break;
+	case 0x2002:    // LE_Read_Buffer_Size
+		put16(ret, le_acl_mtu);
+		ret.push_back(le_acl_buffers);
+		break;
+	case 0x0C0D:    // Read_Stored_Link_Key
+		put16(ret, 8);
+		put16(ret, 0);
+		break;
+	case 0x0C11:    // Write_Stored_Link_Key
+		ret.push_back(length ? p[0] : 0);
+		break;
+	case 0x0C12:    // Delete_Stored_Link_Key
+		put16(ret, 0);
+		break;
+	case 0x0C1A:    // Write_Scan_Enable
+		scan_enable = length ? p[0] : 0;
+		break;
+	case 0x0C45:    // Write_Inquiry_Mode
+		inquiry_mode_ = length ? p[0] : 0;
+		break;
+
+	case 0x0401: {  // Inquiry
+		command_status(opcode, 0);
+		uint32_t generation = ++inquiry_;
+		inquiry_active_ = true;
+		schedule(event_latency_us, [this, generation]() { inquiry(generation, 0, 0); });
+		uint64_t inquiry_us = (uint64_t)((length > 3) ? p[3] : 8) * 1280000;
+		schedule(inquiry_us, [this, generation]() {
+			if (generation != inquiry_ || !inquiry_active_) return;
+			inquiry_active_ = false;
+			send_event(0x01, {0});
+		});
+		return;
+	}
+	case 0x0402:    // Inquiry_Cancel
+		inquiry_active_ = false;
+		break;
+
+	case 0x0419:    // Remote_Name_Request
+	case 0x041A: {  // Remote_Name_Request_Cancel
+		std::vector<uint8_t> addr(p, p + 6);
+		peer = peer_for(p);
+		if (opcode == 0x041A) {
+			ret.insert(ret.end(), addr.begin(), addr.end());
+			break;
+		}
+		command_status(opcode, 0);
+		schedule(event_latency_us, [this, peer, addr]() {
+			std::vector<uint8_t> ev;
+			ev.push_back(peer ? 0x00 : 0x04);   // page timeout if not in range
+			ev.insert(ev.end(), addr.begin(), addr.end());
+			std::vector<uint8_t> remote_name(248, 0);
+			if (peer) memcpy(remote_name.data(), peer->name.data(), std::min<size_t>(peer->name.size(), 247));
+			ev.insert(ev.end(), remote_name.begin(), remote_name.end());
+			send_event(0x07, ev);
+		});
+		return;
+	}
+
+	case 0x0409:    // Accept_Connection_Request
+	case 0x040A:    // Reject_Connection_Request
+		peer = peer_for(p);
+		command_status(opcode, (peer && incoming_.count(peer)) ? 0 : 0x02);
+		if (peer && incoming_.count(peer)) {
+			incoming_.erase(peer);
+			if (opcode == 0x0409) {
+				schedule(event_latency_us, [this, peer]() { link_up(peer, false); });
+			} else {
+				uint8_t reason = (length > 6) ? p[6] : 0x0F;
+				schedule(event_latency_us, [this, peer, reason]() {
+					std::vector<uint8_t> ev = {reason, 0, 0};
+					ev.insert(ev.end(), peer->bdaddr, peer->bdaddr + 6);
+					ev.push_back(1);
+					ev.push_back(0);
+					send_event(0x03, ev);
+				});
+			}
+		}
+		return;
+	case 0x0405:    // Create_Connection
+		peer = peer_for(p);
+		command_status(opcode, 0);
+		if (peer && !peer->le && !peer->handle) {
+			schedule(event_latency_us, [this, peer]() { link_up(peer, true); });
+		} else {
+			std::vector<uint8_t> ev = {0x04, 0, 0};     // page timeout
+			ev.insert(ev.end(), p, p + 6);
+			ev.push_back(1);
+			ev.push_back(0);
+			schedule(5120000, [this, ev]() { send_event(0x03, ev); });
+		}
+		return;
+	case 0x0406:    // Disconnect
+		peer = peer_for(get16(p));
+		command_status(opcode, peer ? 0 : 0x02);
+		if (peer) {
+			schedule(event_latency_us, [this, peer]() {
+				if (peer->handle) link_down(peer, 0x16);
+			});
+		}
+		return;
+
+	case 0x041B:    // Read_Remote_Supported_Features
+	case 0x041C:    // Read_Remote_Extended_Features
+	case 0x041D: {  // Read_Remote_Version_Information
+		uint16_t h = get16(p);
+		peer = peer_for(h);
+		command_status(opcode, peer ? 0 : 0x02);
+		if (!peer) return;
+		std::vector<uint8_t> ev = {0};
+		put16(ev, h);
+		uint8_t code = 0x0B;
+		if (opcode == 0x041D) {
+			code = 0x0C;
+			ev.push_back(0x06);
+			put16(ev, 0x000F);
+			put16(ev, 0x0001);
+		} else {
+			if (opcode == 0x041C) {
+				code = 0x23;
+				ev.push_back((length > 2) ? p[2] : 0);
+				ev.push_back(1);
+			}
+			uint8_t features[8] = {0xbc, 0x02, 0x04, 0x38, 0x08, 0x00, 0x00, 0x00};
+			if (peer->ssp) {
+				if (opcode == 0x041B) features[6] |= 0x08;
+				else features[0] |= 0x01;
+			}
+			ev.insert(ev.end(), features, features + 8);
+		}
+		schedule(event_latency_us, [this, code, ev]() { send_event(code, ev); });
+		return;
+	}
+
+	case 0x0411: {  // Authentication_Requested
+		peer = peer_for(get16(p));
+		command_status(opcode, peer ? 0 : 0x02);
+		if (!peer) return;
+		std::vector<uint8_t> ev(peer->bdaddr, peer->bdaddr + 6);
+		schedule(event_latency_us, [this, ev]() { send_event(0x17, ev); });
+		return;
+	}
+	case 0x040B:    // Link_Key_Request_Reply
+	case 0x040C:    // Link_Key_Request_Negative_Reply
+	case 0x040D: {  // PIN_Code_Request_Reply
+		peer = peer_for(p);
+		ret.insert(ret.end(), p, p + 6);
+		command_complete(opcode, ret);
+		if (!peer || !peer->handle) return;
+		std::vector<uint8_t> addr(p, p + 6);
+		std::vector<uint8_t> auth = {0};
+		put16(auth, peer->handle);
+		if (opcode == 0x040C) {
+			schedule(event_latency_us, [this, addr]() { send_event(0x16, addr); });
+			return;
+		}
+		if (opcode == 0x040D) {
+			std::vector<uint8_t> key = addr;
+			for (uint8_t i = 0; i < 16; i++) key.push_back(0xA0 + i);
+			key.push_back(0);   // combination key
+			schedule(event_latency_us, [this, key]() { send_event(0x18, key); });
+		}
+		schedule(event_latency_us, [this, auth]() { send_event(0x06, auth); });
+		return;
+	}
+	case 0x0413: {  // Set_Connection_Encryption
+		uint16_t h = get16(p);
+		command_status(opcode, 0);
+		std::vector<uint8_t> ev = {0};
+		put16(ev, h);
+		ev.push_back((length > 2) ? p[2] : 1);
+		schedule(event_latency_us, [this, ev]() { send_event(0x08, ev); });
+		return;
+	}
+	case 0x042B:    // IO_Capability_Request_Reply
+	case 0x042C:    // User_Confirmation_Request_Reply
+		ret.insert(ret.end(), p, p + 6);
+		break;
+
+	case 0x0809:    // Role_Discovery
+		put16(ret, get16(p));
+		ret.push_back(0);   // central
+		break;
+	case 0x080D:    // Write_Link_Policy_Settings
+	case 0x0C28:    // Write_Automatic_Flush_Timeout
+		put16(ret, get16(p));
+		break;
+	case 0x0803:    // Sniff_Mode
+	case 0x0804: {  // Exit_Sniff_Mode
+		uint16_t h = get16(p);
+		peer = peer_for(h);
+		command_status(opcode, peer ? 0 : 0x02);
+		if (!peer) return;
+		std::vector<uint8_t> ev = {0};
+		put16(ev, h);
+		ev.push_back((opcode == 0x0803) ? 2 : 0);
+		put16(ev, (opcode == 0x0803) ? get16(p + 2) : 0);
+		schedule(event_latency_us, [this, ev]() { send_event(0x14, ev); });
+		return;
+	}
+	case 0x0807: {  // QoS_Setup
+		uint16_t h = get16(p);
+		peer = peer_for(h);
+		command_status(opcode, peer ? 0 : 0x02);
+		if (!peer || length < 20) return;
+		std::vector<uint8_t> ev = {0};
+		put16(ev, h);
+		ev.insert(ev.end(), p + 2, p + 20);     // flags, service type, rates, latency
+		schedule(event_latency_us, [this, ev]() { send_event(0x0D, ev); });
+		return;
+	}
+
+	case 0x200C:    // LE_Set_Scan_Enable
+		le_scanning = length && p[0];
+		if (le_scanning) {
+			uint32_t generation = ++le_scan_;
+			schedule(advertising_us, [this, generation]() { advertise(generation); });
+		}
+		break;
+	case 0x200D: {  // LE_Create_Connection
+		peer = (length >= 17) ? peer_for(p + 6) : nullptr;
+		command_status(opcode, 0);
+		if (!peer || !peer->le || peer->handle) return;
+		uint16_t interval = get16(p + 15);
+		schedule(event_latency_us, [this, peer, interval]() {
+			if (peer->handle) return;
+			uint16_t h = next_handle();
+			peer->handle = h;
+			std::vector<uint8_t> ev = {0x01, 0};
+			put16(ev, h);
+			ev.push_back(0);    // central
+			ev.push_back(peer->address_type);
+			ev.insert(ev.end(), peer->bdaddr, peer->bdaddr + 6);
+			put16(ev, interval);
+			put16(ev, 0);
+			put16(ev, 0x01F4);
+			ev.push_back(0);
+			send_event(0x3E, ev);
+			peer->link_up(true);
+		});
+		return;
+	}
+	case 0x2013: {  // LE_Connection_Update
+		uint16_t h = get16(p);
+		command_status(opcode, peer_for(h) ? 0 : 0x02);
+		if (!peer_for(h) || length < 10) return;
+		std::vector<uint8_t> ev = {0x03, 0};
+		put16(ev, h);
+		put16(ev, get16(p + 4));
+		put16(ev, get16(p + 6));
+		put16(ev, get16(p + 8));
+		schedule(event_latency_us, [this, ev]() { send_event(0x3E, ev); });
+		return;
+	}
+
+	default:
+		break;
+	}
+	command_complete(opcode, ret);
+}
+
+//----------------------------------------------------------------------------
+// Links
+
+bool HCIController::connect_in(Peer *peer)
+{
+	if (!(scan_enable & 2) || peer->handle || peer->le) return false;
+	incoming_.insert(peer);
+	std::vector<uint8_t> ev(peer->bdaddr, peer->bdaddr + 6);
+	ev.push_back(peer->class_of_device & 0xff);
+	ev.push_back((peer->class_of_device >> 8) & 0xff);
+	ev.push_back((peer->class_of_device >> 16) & 0xff);
+	ev.push_back(1);    // ACL
+	send_event(0x04, ev);
+	return true;
+}
+
+void HCIController::disconnect(Peer *peer, uint8_t reason)
+{
+	schedule(0, [this, peer, reason]() {
+		if (peer->handle) link_down(peer, reason);
+	});
+}
+
+uint16_t HCIController::next_handle()
+{
+	uint16_t h = next_handle_;
+	next_handle_ = (next_handle_ + handle_step) & 0x0fff;
+	return h;
+}
+
+void HCIController::link_up(Peer *peer, bool host_initiated)
+{
+	if (peer->handle) return;
+	uint16_t h = next_handle();
+	peer->handle = h;
+	std::vector<uint8_t> ev = {0};
+	put16(ev, h);
+	ev.insert(ev.end(), peer->bdaddr, peer->bdaddr + 6);
+	ev.push_back(1);    // ACL
+	ev.push_back(0);    // not encrypted
+	send_event(0x03, ev);
+	peer->link_up(host_initiated);
+}
+
+void HCIController::link_down(Peer *peer, uint8_t reason)
+{
+	uint16_t h = peer->handle;
+	// Buffers of a dropped link are free without Number Of Completed Packets
+	uint32_t &outstanding = peer->le && le_acl_buffers ? le_acl_outstanding_ : acl_outstanding_;
+	outstanding -= std::min(outstanding, handle_outstanding_[h]);
+	handle_outstanding_.erase(h);
+	from_host_.erase(h);
+	to_host_.erase(h);
+	peer->handle = 0;
+	std::vector<uint8_t> ev = {0};
+	put16(ev, h);
+	ev.push_back(reason);
+	send_event(0x05, ev);
+	peer->link_down();
+}
+
+//----------------------------------------------------------------------------
+// ACL data
+
+void HCIController::out(uint8_t ep, const uint8_t *data, uint32_t length)
+{
+	if (ep != 2 || length < 4) return;
+	uint16_t h = get16(data) & 0x0fff;
+	uint8_t pb = (data[1] >> 4) & 3;
+	uint16_t hci_length = get16(data + 2);
+	if (hci_length + 4u != length) return;
+	trace("ACL >", data, length);
+	acl_from_host.push_back(acl_t{now_us, h, pb, std::vector<uint8_t>(data + 4, data + length)});
+
+	Peer *peer = peer_for(h);
+	bool le = peer && peer->le && le_acl_buffers;
+	uint32_t &outstanding = le ? le_acl_outstanding_ : acl_outstanding_;
+	uint32_t buffers = le ? le_acl_buffers : acl_buffers;
+	uint16_t mtu = le ? le_acl_mtu : acl_mtu;
+	if (hci_length > mtu) acl_oversize++;
+	if (outstanding >= buffers) acl_overruns++;
+	outstanding++;
+	if (outstanding > acl_max_outstanding) acl_max_outstanding = outstanding;
+	if (!peer) return;
+	handle_outstanding_[h]++;
+	schedule(completed_latency_us, [this, h, le]() { completed(h, le); });
+	acl_from(h, pb, data + 4, hci_length);
+}
+
+void HCIController::completed(uint16_t handle, bool le)
+{
+	auto it = handle_outstanding_.find(handle);
+	if (it == handle_outstanding_.end() || it->second == 0) return;
+	it->second--;
+	uint32_t &outstanding = le ? le_acl_outstanding_ : acl_outstanding_;
+	if (outstanding) outstanding--;
+	std::vector<uint8_t> ev = {1};
+	put16(ev, handle);
+	put16(ev, 1);
+	send_event(0x13, ev);
+}
+
+void HCIController::acl_from(uint16_t handle, uint8_t pb, const uint8_t *data, uint16_t length)
+{
+	std::vector<uint8_t> &packet = from_host_[handle];
+	if (pb != 1) packet.clear();
+	packet.insert(packet.end(), data, data + length);
+	if (packet.size() < 4 || packet.size() < get16(packet.data()) + 4u) return;
+	uint16_t cid = get16(packet.data() + 2);
+	std::vector<uint8_t> payload(packet.begin() + 4, packet.begin() + 4 + get16(packet.data()));
+	packet.clear();
+	Peer *peer = peer_for(handle);
+	schedule(peer->air_latency_us, [peer, handle, cid, payload]() {
+		if (peer->handle == handle) peer->l2cap(cid, payload.data(), payload.size());
+	});
+}
+
+void HCIController::send_acl(uint16_t handle, const uint8_t *l2cap, uint16_t length)
+{
+	auto &queue = to_host_[handle];
+	if (std::find(to_host_order_.begin(), to_host_order_.end(), handle) == to_host_order_.end()) {
+		to_host_order_.push_back(handle);
+	}
+	bool first = true;
+	while (length) {
+		uint16_t n = length;
+		if (fragment_size) n = std::max<uint16_t>(1, fragment_size());
+		else if (acl_fragment) n = acl_fragment;
+		if (n > length) n = length;
+		std::vector<uint8_t> fragment;
+		fragment.push_back(handle & 0xff);
+		fragment.push_back(((handle >> 8) & 0x0f) | (first ? 0x20 : 0x10));
+		put16(fragment, n);
+		fragment.insert(fragment.end(), l2cap, l2cap + n);
+		queue.push_back(fragment);
+		l2cap += n;
+		length -= n;
+		first = false;
+	}
+	if (!pump_scheduled_) {
+		pump_scheduled_ = true;
+		schedule(0, [this]() { pump_acl(); });
+	}
+}
+
+// One fragment from each handle with data queued per round.
+void HCIController::pump_acl()
+{
+	pump_scheduled_ = false;
+	bool more;
+	do {
+		more = false;
+		for (uint16_t h : to_host_order_) {
+			auto it = to_host_.find(h);
+			if (it == to_host_.end() || it->second.empty()) continue;
+			trace("ACL <", it->second.front().data(), it->second.front().size());
+			send_in(2, it->second.front());
+			it->second.pop_front();
+			acl_to_host++;
+			if (!it->second.empty()) more = true;
+		}
+		if (more && acl_gap_us) {
+			pump_scheduled_ = true;
+			schedule(acl_gap_us, [this]() { pump_acl(); });
+			return;
+		}
+	} while (more);
+}
+
+//----------------------------------------------------------------------------
+// Inquiry and LE advertising
+
+void HCIController::inquiry(uint32_t generation, uint32_t index, uint32_t repeat)
+{
+	if (generation != inquiry_ || !inquiry_active_) return;
+	std::vector<Peer *> found;
+	for (Peer *peer : peers_) {
+		if (!peer->le && peer->discoverable && !peer->handle) found.push_back(peer);
+	}
+	if (index >= found.size()) {
+		if (++repeat >= inquiry_result_repeats || found.empty()) return;
+		index = 0;
+	}
+	Peer *peer = found[index];
+	std::vector<uint8_t> ev = {1};
+	ev.insert(ev.end(), peer->bdaddr, peer->bdaddr + 6);
+	ev.push_back(1);    // page scan repetition mode R1
+	ev.push_back(0);
+	if (!inquiry_mode_) ev.push_back(0);
+	ev.push_back(peer->class_of_device & 0xff);
+	ev.push_back((peer->class_of_device >> 8) & 0xff);
+	ev.push_back((peer->class_of_device >> 16) & 0xff);
+	put16(ev, 0x1234);  // clock offset
+	if (inquiry_mode_) ev.push_back((uint8_t)-50);  // RSSI
+	send_event(inquiry_mode_ ? 0x22 : 0x02, ev);
+	schedule(inquiry_result_us, [this, generation, index, repeat]() {
+		inquiry(generation, index + 1, repeat);
+	});
+}
+
+void HCIController::advertise(uint32_t generation)
+{
+	if (generation != le_scan_ || !le_scanning) return;
+	for (Peer *peer : peers_) {
+		if (!peer->le || !peer->discoverable || peer->handle) continue;
+		std::vector<uint8_t> ev = {0x02, 1, 0x00};  // one ADV_IND
+		ev.push_back(peer->address_type);
+		ev.insert(ev.end(), peer->bdaddr, peer->bdaddr + 6);
+		ev.push_back(peer->advertising.size());
+		ev.insert(ev.end(), peer->advertising.begin(), peer->advertising.end());
+		ev.push_back((uint8_t)-60);
+		send_event(0x3E, ev);
+	}
+	schedule(advertising_us, [this, generation]() { advertise(generation); });
+}
+
+} // namespace sim
@@ -0,0 +1,175 @@
+/* Simulated USB Bluetooth dongle for host builds of the USBHost_t36 library.
+ *
+ * HCIController is a sim::Device with the end points of a Bluetooth class
+ * (E0/01/01) dongle: HCI commands come in on the control pipe, events go
+ * out on the interrupt end point (rx) and ACL data on the bulk IN end point
+ * (rx2), host ACL data comes in on the bulk OUT end point (tx).
+ *
+ * The controller answers the commands BluetoothController uses with the
+ * Command Complete / Command Status and the events a real controller sends,
+ * holds Num_HCI_Command_Packets and ACL buffer credits like one (and counts
+ * it when the host sends past them), and carries L2CAP between the host and
+ * the sim::Peer devices in range.
+ */
+
+#ifndef SIM_HCI_H_
+#define SIM_HCI_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include "sim.h"
+
+namespace sim {
+
+class HCIController;
+
+// A remote Bluetooth device in range of the controller.  Subclasses script
+// what the device does with the L2CAP packets the host sends it.
+class Peer {
+public:
+	Peer(const uint8_t addr[6], uint32_t cod, const char *remote_name);
+	virtual ~Peer() { }
+
+	uint8_t bdaddr[6];
+	uint32_t class_of_device;
+	std::string name;
+	bool le = false;                // LE only device, found by LE scans
+	uint8_t address_type = 0;       // LE address type
+	std::vector<uint8_t> advertising;   // LE advertising data
+	bool discoverable = true;       // answers inquiries (classic) or advertises (LE)
+	bool ssp = false;               // LMP features say Secure Simple Pairing
+	uint32_t air_latency_us = 1250; // L2CAP packet to the other side
+
+	HCIController *controller = nullptr;
+	uint16_t handle = 0;            // 0 when there is no link
+	bool connected() const { return handle != 0; }
+
+	// Send a complete L2CAP packet (header added here) to the host
+	void send_l2cap(uint16_t cid, const uint8_t *data, uint16_t length);
+	void send_l2cap(uint16_t cid, const std::vector<uint8_t> &data) { send_l2cap(cid, data.data(), data.size()); }
+
+	// From the controller
+	virtual void link_up(bool host_initiated) { }
+	virtual void link_down() { }
+	virtual void l2cap(uint16_t cid, const uint8_t *data, uint16_t length) { }
+};
+
+class HCIController : public Device {
+public:
+	HCIController();
+
+	const uint8_t *device_descriptor() override;
+	const uint8_t *config_descriptor(uint16_t &length) override;
+	int control_request(const uint8_t *setup, uint8_t *data) override;
+	void out(uint8_t ep, const uint8_t *data, uint32_t length) override;
+
+	// Configuration, set before attach()
+	uint8_t bdaddr[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+	uint8_t event_packet_size = 16;     // interrupt IN end point
+	uint8_t command_credits = 1;        // Num_HCI_Command_Packets
+	uint32_t command_latency_us = 400;  // command to its Command Complete / Status
+	uint32_t event_latency_us = 2000;   // Command Status to the event that follows
+	uint16_t acl_mtu = 1021;            // HCI_Read_Buffer_Size
+	uint16_t acl_buffers = 8;
+	uint16_t le_acl_mtu = 0;            // HCI_LE_Read_Buffer_Size, 0 shares the above
+	uint8_t le_acl_buffers = 0;
+	uint32_t completed_latency_us = 2500;   // host ACL packet to its Number Of Completed Packets
+	// Largest ACL fragment sent to the host, 0 sends whole L2CAP packets.
+	// fragment_size, when set, picks each fragment's size instead.
+	uint16_t acl_fragment = 0;
+	std::function<uint16_t()> fragment_size;
+	uint32_t acl_gap_us = 0;            // between rounds of fragments to the host
+	uint32_t inquiry_result_us = 20000; // between inquiry results
+	uint32_t inquiry_result_repeats = 1;    // times each device answers one inquiry
+	uint32_t advertising_us = 20000;    // between LE advertising reports
+	uint16_t handle_step = 1;           // between connection handles handed out
+
+	// Devices in range
+	void add_peer(Peer *peer);
+	// The peer pages the host, as when a paired device comes back on.
+	// false if the host's page scan is off.
+	bool connect_in(Peer *peer);
+	// The peer drops the link.
+	void disconnect(Peer *peer, uint8_t reason = 0x13);
+
+	void send_event(uint8_t code, const std::vector<uint8_t> &params);
+	// Answer a command; each gives its Num_HCI_Command_Packets credit back.
+	void command_complete(uint16_t opcode, const std::vector<uint8_t> &ret);
+	void command_status(uint16_t opcode, uint8_t status);
+	// Queue an L2CAP packet for the host, fragmented by acl_fragment or
+	// fragment_size.  Fragments of different handles are interleaved.
+	void send_acl(uint16_t handle, const uint8_t *l2cap, uint16_t length);
+
+	// A test may take over a command: return true if it was handled.
+	std::function<bool(uint16_t opcode, const uint8_t *params, uint8_t length)> on_command;
+
+	// What the host did
+	typedef struct {
+		uint64_t us;
+		uint16_t opcode;
+		std::vector<uint8_t> params;
+	} command_t;
+	std::vector<command_t> commands;
+	typedef struct {
+		uint64_t us;
+		uint16_t handle;
+		uint8_t pb;
+		std::vector<uint8_t> data;  // HCI payload
+	} acl_t;
+	std::vector<acl_t> acl_from_host;
+	uint32_t acl_to_host = 0;           // ACL fragments sent to the host
+	uint32_t command_overruns = 0;      // commands sent without a credit
+	uint32_t commands_max_outstanding = 0;
+	uint32_t acl_overruns = 0;          // ACL packets sent with no buffer free
+	uint32_t acl_max_outstanding = 0;
+	uint32_t acl_oversize = 0;          // ACL packets longer than the MTU
+	uint8_t scan_enable = 0;            // HCI_Write_Scan_Enable
+	bool le_scanning = false;
+	bool inquiring() const { return inquiry_ != 0 && inquiry_active_; }
+
+	int count(uint16_t opcode) const;
+	const command_t *last(uint16_t opcode) const;
+	uint64_t first_us(uint16_t opcode) const;   // 0 if never sent
+	Peer *peer_for(uint16_t handle);
+	Peer *peer_for(const uint8_t *addr);
+
+private:
+	void command(uint16_t opcode, const uint8_t *p, uint8_t length);
+	void link_up(Peer *peer, bool host_initiated);
+	void link_down(Peer *peer, uint8_t reason);
+	void acl_from(uint16_t handle, uint8_t pb, const uint8_t *data, uint16_t length);
+	void completed(uint16_t handle, bool le);
+	void pump_acl();
+	void inquiry(uint32_t generation, uint32_t index, uint32_t repeat);
+	void advertise(uint32_t generation);
+	uint16_t next_handle();
+
+	uint8_t descriptor_[18];
+	uint8_t config_[39];
+	uint32_t credits_ = 1;
+	uint32_t commands_outstanding_ = 0;
+	uint32_t acl_outstanding_ = 0;
+	uint32_t le_acl_outstanding_ = 0;
+	std::map<uint16_t, uint32_t> handle_outstanding_;
+	uint16_t next_handle_ = 0x0040;
+	uint8_t inquiry_mode_ = 0;
+	uint32_t inquiry_ = 0;              // generation of the current inquiry
+	bool inquiry_active_ = false;
+	uint32_t le_scan_ = 0;
+	std::set<Peer *> incoming_;         // paged the host, not yet accepted
+	std::vector<Peer *> peers_;
+	std::map<uint16_t, std::vector<uint8_t>> from_host_;    // L2CAP reassembly
+	std::map<uint16_t, std::deque<std::vector<uint8_t>>> to_host_;
+	std::vector<uint16_t> to_host_order_;
+	bool pump_scheduled_ = false;
+};
+
+// Little helpers for building packets
+inline void put16(std::vector<uint8_t> &v, uint16_t x) { v.push_back(x & 0xff); v.push_back(x >> 8); }
+inline void put32(std::vector<uint8_t> &v, uint32_t x) { put16(v, x & 0xffff); put16(v, x >> 16); }
+inline uint16_t get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+} // namespace sim
+
+#endif
@@ -0,0 +1,314 @@
+/* Simulated USB mass storage device: Bulk-Only Transport and the SCSI
+ * commands USBDrive uses, over a RAM or file disk image.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim_msc.h"
+
+namespace sim {
+
+static uint32_t le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void put_le32(std::vector<uint8_t> &v, uint32_t x)
+{
+	for (int i = 0; i < 32; i += 8) v.push_back(x >> i);
+}
+
+static void put_be32(std::vector<uint8_t> &v, uint32_t x)
+{
+	for (int i = 24; i >= 0; i -= 8) v.push_back(x >> i);
+}
+
+// Time to move this much data at bytes_per_second
+static uint32_t transfer_us(uint32_t bytes, uint32_t bytes_per_second)
+{
+	return bytes_per_second ? (uint64_t)bytes * 1000000 / bytes_per_second : 0;
+}
+
+MassStorage::MassStorage(uint32_t disk_blocks) : blocks(disk_blocks)
+{
+	static const uint8_t device[18] = {
+		18, 1, 0x00, 0x02, 0x00, 0x00, 0x00, 64,    // class in the interface
+		0x81, 0x07, 0x81, 0x55, 0x00, 0x01,         // 0781:5581 like a SanDisk stick
+		0, 0, 0, 1                                  // no strings, one configuration
+	};
+	memcpy(descriptor_, device, sizeof(descriptor_));
+	image.resize((size_t)blocks * 512);
+}
+
+MassStorage::~MassStorage()
+{
+	if (file_) fclose(file_);
+}
+
+const uint8_t *MassStorage::device_descriptor()
+{
+	return descriptor_;
+}
+
+const uint8_t *MassStorage::config_descriptor(uint16_t &length)
+{
+	const uint8_t config[32] = {
+		9, 2, sizeof(config_), 0, 1, 1, 0, 0x80, 100,
+		9, 4, 0, 0, 2, 0x08, 0x06, 0x50, 0,         // SCSI transparent, Bulk-Only
+		7, 5, 0x81, 2, 0x00, 0x02, 0,               // bulk IN, 512
+		7, 5, 0x02, 2, 0x00, 0x02, 0                // bulk OUT, 512
+	};
+	memcpy(config_, config, sizeof(config_));
+	set_max_packet(1, 512);
+	set_max_packet(2, 512);
+	length = sizeof(config_);
+	return config_;
+}
+
+bool MassStorage::open_image(const char *path)
+{
+	if (file_) fclose(file_);
+	file_ = fopen(path, "r+b");
+	if (!file_) file_ = fopen(path, "w+b");
+	if (!file_) return false;
+	fseeko(file_, 0, SEEK_END);
+	off_t size = (off_t)blocks * 512;
+	if (ftello(file_) < size) {
+		fseeko(file_, size - 1, SEEK_SET);
+		fputc(0, file_);
+	}
+	image.clear();
+	image.shrink_to_fit();
+	return true;
+}
+
+void MassStorage::read_blocks(uint32_t lba, uint32_t count, uint8_t *dst)
+{
+	if (!file_) {
+		memcpy(dst, &image[(size_t)lba * 512], (size_t)count * 512);
+		return;
+	}
+	fseeko(file_, (off_t)lba * 512, SEEK_SET);
+	size_t n = fread(dst, 1, (size_t)count * 512, file_);
+	memset(dst + n, 0, (size_t)count * 512 - n);
+}
+
+void MassStorage::write_blocks(uint32_t lba, uint32_t count, const uint8_t *src)
+{
+	if (!file_) {
+		memcpy(&image[(size_t)lba * 512], src, (size_t)count * 512);
+		return;
+	}
+	fseeko(file_, (off_t)lba * 512, SEEK_SET);
+	fwrite(src, 1, (size_t)count * 512, file_);
+}
+
+int MassStorage::control_request(const uint8_t *setup, uint8_t *data)
+{
+	if (setup[0] == 0xA1 && setup[1] == 0xFE) {
+		data[0] = 0;        // GET MAX LUN: one LUN
+		return 1;
+	}
+	if (setup[0] == 0x21 && setup[1] == 0xFF) {
+		// Bulk-Only Mass Storage Reset, ready for a CBW again
+		collecting_ = false;
+		data_out_.clear();
+		counters.resets++;
+		return 0;
+	}
+	return -1;
+}
+
+void MassStorage::out(uint8_t ep, const uint8_t *data, uint32_t length)
+{
+	if (collecting_) {
+		data_out_.insert(data_out_.end(), data, data + length);
+		if (data_out_.size() >= transfer_length_) {
+			collecting_ = false;
+			command();
+		}
+		return;
+	}
+	if (length != 31 || le32(data) != 0x43425355) {
+		counters.bad_cbws++;
+		return;
+	}
+	memcpy(cbw_, data, sizeof(cbw_));
+	tag_ = le32(&cbw_[4]);
+	transfer_length_ = le32(&cbw_[8]);
+	data_in_ = (cbw_[12] & 0x80) != 0;
+	data_out_.clear();
+	uint8_t opcode = cbw_[15];
+	counters.commands++;
+	opcodes[opcode]++;
+
+	fault_t fault = FAULT_NONE;
+	if (opcode == 0x28 || opcode == 0x2A) fault = fault_for(opcode);
+	if (fault == FAULT_UNIT_ATTENTION) unit_attention_ = 0x28;
+	if (fault == FAULT_SHORT_READ && opcode == 0x28) short_read_ = true;
+	if (fault == FAULT_STALL) {
+		// Refuse the WRITE data, or give up on the READ after trying
+		counters.stalls++;
+		bool read = (opcode == 0x28);
+		fail(read ? command_latency_us + read_latency_us : 0, 0x03, read ? 0x11 : 0x0C, read ? 0x81 : 0x02);
+		return;
+	}
+	if (!data_in_ && transfer_length_) {
+		collecting_ = true;
+		return;
+	}
+	command();
+}
+
+MassStorage::fault_t MassStorage::fault_for(uint8_t opcode)
+{
+	read_writes_++;
+	if (opcode == 0x28) reads_++;
+	auto it = injected_.find(opcode);
+	if (it != injected_.end()) {
+		fault_t fault = it->second;
+		injected_.erase(it);
+		return fault;
+	}
+	if (stall_every && (read_writes_ % stall_every) == 0) return FAULT_STALL;
+	if (unit_attention_every && (read_writes_ % unit_attention_every) == 0) return FAULT_UNIT_ATTENTION;
+	if (short_read_every && (opcode == 0x28) && (reads_ % short_read_every) == 0) return FAULT_SHORT_READ;
+	return FAULT_NONE;
+}
+
+// 0 to jitter_us, the same every run
+uint32_t MassStorage::jitter()
+{
+	random_ = random_ * 1103515245 + 12345;
+	return jitter_us ? (random_ >> 8) % (jitter_us + 1) : 0;
+}
+
+void MassStorage::command()
+{
+	const uint8_t *cdb = &cbw_[15];
+	uint8_t opcode = cdb[0];
+	bool short_read = short_read_;
+	short_read_ = false;
+
+	if (unit_attention_ && opcode != 0x12 && opcode != 0x03) {
+		counters.unit_attentions++;
+		uint8_t asc = unit_attention_;
+		unit_attention_ = 0;
+		fail(command_latency_us, 0x06, asc);
+		return;
+	}
+	if (!medium && opcode != 0x12 && opcode != 0x03) {
+		fail(command_latency_us, 0x02, 0x3A);
+		return;
+	}
+	switch (opcode) {
+	case 0x00:      // TEST UNIT READY
+	case 0x1B:      // START STOP UNIT
+		respond(command_latency_us, {}, 0);
+		break;
+	case 0x03: {    // REQUEST SENSE, fixed format
+		std::vector<uint8_t> sense(18, 0);
+		sense[0] = 0x70;
+		sense[2] = sense_key_;
+		sense[7] = 10;
+		sense[12] = sense_asc_;
+		sense_key_ = 0;
+		sense_asc_ = 0;
+		respond(command_latency_us, sense, 0);
+		break;
+	}
+	case 0x12: {    // INQUIRY: SPC-2, so no VPD pages are asked for
+		std::vector<uint8_t> inquiry = {0x00, 0x80, 0x04, 0x02, 31, 0, 0, 0};
+		const char *id = "USBHost Simulated Disk  1.0 ";
+		inquiry.insert(inquiry.end(), id, id + 28);
+		respond(command_latency_us, inquiry, 0);
+		break;
+	}
+	case 0x25: {    // READ CAPACITY(10)
+		std::vector<uint8_t> capacity;
+		put_be32(capacity, blocks - 1);
+		put_be32(capacity, 512);
+		respond(command_latency_us, capacity, 0);
+		break;
+	}
+	case 0x28:      // READ(10)
+	case 0x2A: {    // WRITE(10)
+		uint32_t lba = be32(&cdb[2]);
+		uint32_t count = (cdb[7] << 8) | cdb[8];
+		uint32_t bytes = count * 512;
+		if ((uint64_t)lba + count > blocks) {
+			fail(command_latency_us, 0x05, 0x21);   // LBA out of range
+			break;
+		}
+		if ((bytes != transfer_length_) || (data_in_ != (opcode == 0x28))) {
+			fail(command_latency_us, 0x05, 0x24);   // invalid field in CDB
+			break;
+		}
+		if (opcode == 0x28) {
+			counters.reads++;
+			uint32_t delay = command_latency_us + read_latency_us + jitter() + transfer_us(bytes, read_bandwidth);
+			if (short_read) {
+				counters.short_reads++;
+				count /= 2;
+			}
+			std::vector<uint8_t> data((size_t)count * 512);
+			read_blocks(lba, count, data.data());
+			counters.bytes_read += data.size();
+			respond(delay, data, 0);
+		} else {
+			counters.writes++;
+			write_blocks(lba, count, data_out_.data());
+			counters.bytes_written += bytes;
+			respond(command_latency_us + write_latency_us + jitter() + transfer_us(bytes, write_bandwidth), {}, 0);
+		}
+		break;
+	}
+	default:
+		fail(command_latency_us, 0x05, 0x20);       // invalid command operation code
+		break;
+	}
+}
+
+// The data stage (if the host asked for one) and then the CSW, delay_us
+// from now.  IN data shorter than the host asked for ends with a short
+// packet, a zero length one if need be.  With stall_ep the data stage is
+// STALLed instead.
+void MassStorage::respond(uint32_t delay_us, const std::vector<uint8_t> &data, uint8_t status, uint8_t stall_ep)
+{
+	std::vector<uint8_t> in = data;
+	if (in.size() > transfer_length_) in.resize(transfer_length_);
+	uint32_t residue;
+	if (data_in_) residue = transfer_length_ - in.size();
+	else residue = (status || stall_ep) ? transfer_length_ : 0;
+	if (status) counters.failed++;
+
+	std::vector<uint8_t> csw;
+	put_le32(csw, 0x53425355);
+	put_le32(csw, tag_);
+	put_le32(csw, residue);
+	csw.push_back(status);
+	bool data_stage = data_in_ && transfer_length_;
+	schedule(delay_us, [this, in, csw, data_stage, stall_ep]() {
+		if (stall_ep) {
+			stall(stall_ep);
+		} else if (data_stage) {
+			if (!in.empty()) send_in(1, in);
+			if (in.size() < transfer_length_ && (in.size() % 512) == 0) send_in(1, nullptr, 0);
+		}
+		send_in(1, csw);
+	});
+}
+
+void MassStorage::fail(uint32_t delay_us, uint8_t key, uint8_t asc, uint8_t stall_ep)
+{
+	sense_key_ = key;
+	sense_asc_ = asc;
+	respond(delay_us, {}, 1, stall_ep);
+}
+
+} // namespace sim
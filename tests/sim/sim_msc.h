@@ -0,0 +1,120 @@
+/* Simulated USB mass storage device for host builds of the USBHost_t36
+ * library.
+ *
+ * MassStorage is a sim::Device with one Bulk-Only Transport interface
+ * (08/06/50): each command comes in as a CBW on the bulk OUT end point, WRITE
+ * data follows it there, READ data and the CSW go out on the bulk IN end
+ * point.  Behind it is a disk of 512 byte blocks, in RAM or in a file image,
+ * answering the SCSI commands USBDrive sends.
+ *
+ * A command takes command_latency_us, READ(10) and WRITE(10) also their
+ * own latency, up to jitter_us at random, and the time to move their data
+ * at the read or write bandwidth, so one model can stand in for a slow
+ * stick or a fast SSD.  Errors are injected into READ(10) and WRITE(10):
+ * the data stage STALLed with a medium error, a UNIT ATTENTION or a short
+ * read.
+ */
+
+#ifndef SIM_MSC_H_
+#define SIM_MSC_H_
+
+#include <stdio.h>
+#include <map>
+#include "sim.h"
+
+namespace sim {
+
+class MassStorage : public Device {
+public:
+	MassStorage(uint32_t disk_blocks);
+	~MassStorage();
+
+	const uint8_t *device_descriptor() override;
+	const uint8_t *config_descriptor(uint16_t &length) override;
+	int control_request(const uint8_t *setup, uint8_t *data) override;
+	void out(uint8_t ep, const uint8_t *data, uint32_t length) override;
+
+	// The disk, blocks * 512 bytes in image unless a file image is used
+	uint32_t blocks;
+	std::vector<uint8_t> image;
+	// Use this file as the disk, made blocks long if it is shorter.
+	bool open_image(const char *path);
+	void read_blocks(uint32_t lba, uint32_t count, uint8_t *dst);
+	void write_blocks(uint32_t lba, uint32_t count, const uint8_t *src);
+
+	// Timing
+	uint32_t command_latency_us = 100;  // CBW (or WRITE data) to the response
+	uint32_t read_latency_us = 150;     // more for READ(10) and WRITE(10)
+	uint32_t write_latency_us = 300;
+	uint32_t read_bandwidth = 35000000;     // bytes per second
+	uint32_t write_bandwidth = 20000000;
+	uint32_t jitter_us = 0;             // READ/WRITE take up to this much more
+
+	// Error injection.  STALL fails the command with a medium error, the
+	// data end point halted.  UNIT ATTENTION (medium changed) fails it
+	// before it runs, the host is expected to retry.  A short read sends
+	// half of the blocks and says so in the CSW residue.
+	enum fault_t {FAULT_NONE = 0, FAULT_STALL, FAULT_UNIT_ATTENTION, FAULT_SHORT_READ};
+	// The next command with this opcode gets the fault
+	void inject(uint8_t opcode, fault_t fault) { injected_[opcode] = fault; }
+	// ... or every n-th READ(10)/WRITE(10), 0 for never.  Short reads
+	// count reads only.
+	uint32_t stall_every = 0;
+	uint32_t unit_attention_every = 0;
+	uint32_t short_read_every = 0;
+	// The next command but INQUIRY and REQUEST SENSE fails with UNIT
+	// ATTENTION, as after a medium change or a reset.
+	void unit_attention(uint8_t asc = 0x28) { unit_attention_ = asc; }
+	// A card reader slot: without a medium every command but INQUIRY and
+	// REQUEST SENSE fails NOT READY, MEDIUM NOT PRESENT.  Inserting one
+	// raises a UNIT ATTENTION.
+	bool medium = true;
+	void insert_medium() { medium = true; unit_attention(0x28); }
+
+	// What the host did
+	typedef struct {
+		uint32_t commands;
+		uint32_t reads;             // READ(10)
+		uint32_t writes;            // WRITE(10)
+		uint64_t bytes_read;
+		uint64_t bytes_written;
+		uint32_t failed;            // CSW status 1
+		uint32_t stalls;
+		uint32_t unit_attentions;
+		uint32_t short_reads;
+		uint32_t bad_cbws;          // wrong signature or length
+		uint32_t resets;            // Bulk-Only Mass Storage Reset
+	} counters_t;
+	counters_t counters = {};
+	std::map<uint8_t, uint32_t> opcodes;    // commands by opcode
+	void reset_counters() { counters = {}; opcodes.clear(); clear_halts = 0; }
+
+private:
+	void command();
+	fault_t fault_for(uint8_t opcode);
+	uint32_t jitter();
+	void respond(uint32_t delay_us, const std::vector<uint8_t> &data, uint8_t status, uint8_t stall_ep = 0);
+	void fail(uint32_t delay_us, uint8_t key, uint8_t asc, uint8_t stall_ep = 0);
+
+	uint8_t descriptor_[18];
+	uint8_t config_[32];
+	FILE *file_ = nullptr;
+	uint8_t cbw_[31];
+	uint32_t tag_ = 0;
+	uint32_t transfer_length_ = 0;      // dCBWDataTransferLength
+	bool data_in_ = false;
+	std::vector<uint8_t> data_out_;     // WRITE data as it comes in
+	bool collecting_ = false;
+	uint8_t sense_key_ = 0;
+	uint8_t sense_asc_ = 0;
+	uint8_t unit_attention_ = 0;
+	bool short_read_ = false;
+	uint32_t random_ = 1;
+	std::map<uint8_t, fault_t> injected_;
+	uint32_t read_writes_ = 0;
+	uint32_t reads_ = 0;
+};
+
+} // namespace sim
+
+#endif
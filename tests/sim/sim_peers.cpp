@@ -0,0 +1,845 @@
+/* Scripted Bluetooth HID devices: L2CAP, SDP and HID transactions, and
+ * the ATT server of the BLE ones.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include "sim_peers.h"
+
+namespace sim {
+
+HIDPeer::HIDPeer(const uint8_t addr[6], uint32_t cod, const char *remote_name)
+	: Peer(addr, cod, remote_name)
+{
+}
+
+HIDPeer::channel_t *HIDPeer::channel_psm(uint16_t psm)
+{
+	if (psm == ctrl_.psm) return &ctrl_;
+	if (psm == intr_.psm) return &intr_;
+	if (psm == sdp_.psm) return &sdp_;
+	return nullptr;
+}
+
+HIDPeer::channel_t *HIDPeer::channel_cid(uint16_t cid)
+{
+	for (channel_t *ch : {&ctrl_, &intr_, &sdp_}) {
+		if (ch->local == cid) return ch;
+	}
+	for (channel_t *ch : {&ctrl_, &intr_, &sdp_}) {
+		if (ch->remote && ch->remote == cid) return ch;
+	}
+	return nullptr;
+}
+
+void HIDPeer::link_up(bool host_initiated)
+{
+	for (channel_t *ch : {&ctrl_, &intr_, &sdp_}) {
+		ch->remote = 0;
+		ch->config_in = ch->config_out = ch->requested = false;
+	}
+	was_open_ = false;
+	link_up_us = now_us;
+	if (opens_control && !host_initiated) {
+		uint16_t h = handle;
+		schedule(open_delay_us, [this, h]() {
+			if (handle == h && !ctrl_.remote) open_channel(ctrl_);
+		});
+	}
+}
+
+void HIDPeer::link_down()
+{
+	stop_stream();
+	for (channel_t *ch : {&ctrl_, &intr_, &sdp_}) {
+		ch->remote = 0;
+		ch->config_in = ch->config_out = ch->requested = false;
+	}
+	was_open_ = false;
+}
+
+void HIDPeer::open_channel(channel_t &ch)
+{
+	ch.requested = true;
+	std::vector<uint8_t> req = {0x02, ++signal_id_, 4, 0};
+	put16(req, ch.psm);
+	put16(req, ch.local);
+	send_l2cap(1, req);
+}
+
+void HIDPeer::send_config(channel_t &ch)
+{
+	std::vector<uint8_t> req = {0x04, ++signal_id_, 8, 0};
+	put16(req, ch.remote);
+	put16(req, 0);
+	req.insert(req.end(), {0x01, 0x02, 0xA0, 0x02});    // MTU 672
+	send_l2cap(1, req);
+}
+
+void HIDPeer::check_open()
+{
+	if (ctrl_.open() && opens_interrupt && !intr_.remote && !intr_.requested) open_channel(intr_);
+	if (ctrl_.open() && intr_.open() && !was_open_) {
+		was_open_ = true;
+		channels_open();
+	}
+}
+
+void HIDPeer::l2cap(uint16_t cid, const uint8_t *data, uint16_t length)
+{
+	if (cid == 1) {
+		signaling(data, length);
+	} else if (cid == ctrl_.local) {
+		transactions.emplace_back(data, data + length);
+		control(data, length);
+	} else if (cid == intr_.local) {
+		if (length && data[0] == 0xA2) {
+			outputs.emplace_back(data + 1, data + length);
+			output(data + 1, length - 1);
+		}
+	} else if (cid == sdp_.local) {
+		sdp(data, length);
+	}
+}
+
+void HIDPeer::signaling(const uint8_t *data, uint16_t length)
+{
+	if (length < 4) return;
+	uint8_t code = data[0];
+	uint8_t id = data[1];
+	channel_t *ch;
+	std::vector<uint8_t> rsp;
+
+	switch (code) {
+	case 0x02:  // Connection Request
+		ch = channel_psm(get16(data + 4));
+		rsp = {0x03, id, 8, 0};
+		put16(rsp, ch ? ch->local : 0);
+		put16(rsp, get16(data + 6));
+		put16(rsp, ch ? 0 : 2);     // PSM not supported
+		put16(rsp, 0);
+		send_l2cap(1, rsp);
+		if (ch) {
+			ch->remote = get16(data + 6);
+			ch->config_in = ch->config_out = false;
+			send_config(*ch);
+		}
+		break;
+	case 0x03:  // Connection Response
+		ch = channel_cid(get16(data + 6));
+		if (ch && get16(data + 8) == 0) {
+			ch->remote = get16(data + 4);
+			send_config(*ch);
+		}
+		break;
+	case 0x04:  // Configuration Request
+		ch = channel_cid(get16(data + 4));
+		if (!ch) break;
+		rsp = {0x05, id, 6, 0};
+		put16(rsp, ch->remote);
+		put16(rsp, 0);
+		put16(rsp, 0);
+		send_l2cap(1, rsp);
+		ch->config_in = true;
+		check_open();
+		break;
+	case 0x05:  // Configuration Response
+		ch = channel_cid(get16(data + 4));
+		if (!ch || get16(data + 8) != 0) break;
+		ch->config_out = true;
+		check_open();
+		break;
+	case 0x06:  // Disconnection Request
+		ch = channel_cid(get16(data + 4));
+		rsp = {0x07, id, 4, 0};
+		rsp.insert(rsp.end(), data + 4, data + 8);
+		send_l2cap(1, rsp);
+		if (ch) {
+			ch->remote = 0;
+			ch->config_in = ch->config_out = ch->requested = false;
+		}
+		break;
+	case 0x0A:  // Information Request
+		rsp = {0x0B, id, 4, 0, data[4], data[5], 1, 0};    // not supported
+		send_l2cap(1, rsp);
+		break;
+	}
+}
+
+//----------------------------------------------------------------------------
+// SDP: one HID record with its report descriptor (attribute 0x0206)
+
+static std::vector<uint8_t> sdp_sequence(const std::vector<uint8_t> &content)
+{
+	std::vector<uint8_t> seq;
+	if (content.size() < 256) {
+		seq = {0x35, (uint8_t)content.size()};
+	} else {
+		seq = {0x36, (uint8_t)(content.size() >> 8), (uint8_t)content.size()};
+	}
+	seq.insert(seq.end(), content.begin(), content.end());
+	return seq;
+}
+
+std::vector<uint8_t> HIDPeer::sdp_attributes()
+{
+	// 0x0206 HIDDescriptorList: ((0x22 report descriptor, <descriptor>))
+	std::vector<uint8_t> desc = {0x08, 0x22};
+	if (descriptor.size() < 256) {
+		desc.push_back(0x25);
+		desc.push_back(descriptor.size());
+	} else {
+		desc.push_back(0x26);
+		desc.push_back(descriptor.size() >> 8);
+		desc.push_back(descriptor.size() & 0xff);
+	}
+	desc.insert(desc.end(), descriptor.begin(), descriptor.end());
+	std::vector<uint8_t> attr = {0x09, 0x02, 0x06};
+	std::vector<uint8_t> list = sdp_sequence(sdp_sequence(desc));
+	attr.insert(attr.end(), list.begin(), list.end());
+	return sdp_sequence(sdp_sequence(attr));
+}
+
+static uint32_t sdp_element_size(const uint8_t *p)
+{
+	switch (p[0] & 7) {
+	case 5: return 2 + p[1];
+	case 6: return 3 + ((p[1] << 8) | p[2]);
+	default: return 1 + (1 << (p[0] & 7));
+	}
+}
+
+void HIDPeer::sdp(const uint8_t *data, uint16_t length)
+{
+	if (length < 7 || data[0] != 0x06 || !sdp_.remote) return;
+	sdp_requests++;
+	// search pattern, maximum byte count, attribute list, continuation
+	uint32_t offset = 5;
+	offset += sdp_element_size(data + offset);
+	offset += 2;
+	offset += sdp_element_size(data + offset);
+	uint32_t start = 0;
+	if (offset < length && data[offset] == 2) start = (data[offset + 1] << 8) | data[offset + 2];
+
+	std::vector<uint8_t> attributes = descriptor.empty() ? sdp_sequence({}) : sdp_attributes();
+	if (start > attributes.size()) start = attributes.size();
+	uint32_t count = attributes.size() - start;
+	if (count > sdp_chunk) count = sdp_chunk;
+	uint32_t next = start + count;
+
+	std::vector<uint8_t> rsp = {0x07, data[1], data[2]};
+	uint16_t plen = 2 + count + 1 + ((next < attributes.size()) ? 2 : 0);
+	rsp.push_back(plen >> 8);
+	rsp.push_back(plen & 0xff);
+	rsp.push_back(count >> 8);
+	rsp.push_back(count & 0xff);
+	rsp.insert(rsp.end(), attributes.begin() + start, attributes.begin() + next);
+	if (next < attributes.size()) {
+		rsp.insert(rsp.end(), {2, (uint8_t)(next >> 8), (uint8_t)next});
+	} else {
+		rsp.push_back(0);
+	}
+	send_l2cap(sdp_.remote, rsp);
+}
+
+//----------------------------------------------------------------------------
+// HID
+
+void HIDPeer::send_control(const std::vector<uint8_t> &data)
+{
+	if (ctrl_.remote) send_l2cap(ctrl_.remote, data);
+}
+
+void HIDPeer::control(const uint8_t *data, uint16_t length)
+{
+	if (!length) return;
+	switch (data[0] & 0xF0) {
+	case 0x70:  // SET_PROTOCOL
+		protocol = data[0] & 1;
+		send_control({0x00});
+		break;
+	case 0x50:  // SET_REPORT
+		send_control({0x00});
+		break;
+	case 0x40: {    // GET_REPORT
+		std::vector<uint8_t> r = get_report(data[0] & 3, (length > 1) ? data[1] : 0);
+		if (r.empty()) {
+			send_control({0x02});   // invalid report ID
+		} else {
+			r.insert(r.begin(), 0xA0 | (data[0] & 3));
+			send_control(r);
+		}
+		break;
+	}
+	case 0xA0:  // DATA
+		if ((data[0] & 3) == 2) output(data + 1, length - 1);
+		break;
+	}
+}
+
+std::vector<uint8_t> HIDPeer::get_report(uint8_t type, uint8_t id)
+{
+	return std::vector<uint8_t>();
+}
+
+std::vector<uint8_t> HIDPeer::report(uint32_t n)
+{
+	return std::vector<uint8_t>();
+}
+
+void HIDPeer::send_report(const std::vector<uint8_t> &data)
+{
+	if (!intr_.remote) return;
+	std::vector<uint8_t> packet = {0xA1};
+	packet.insert(packet.end(), data.begin(), data.end());
+	send_l2cap(intr_.remote, packet);
+	reports_sent++;
+}
+
+void HIDPeer::stream(uint32_t count, uint32_t interval_us)
+{
+	uint32_t generation = ++stream_generation_;
+	auto step = std::make_shared<std::function<void(uint32_t)>>();
+	// The pending event keeps the stream alive, the step itself only
+	// refers to it weakly so that a finished stream is freed.
+	std::weak_ptr<std::function<void(uint32_t)>> weak = step;
+	*step = [this, generation, interval_us, weak](uint32_t left) {
+		if (generation != stream_generation_ || !left || !intr_.open()) return;
+		send_report(report(reports_sent));
+		auto next = weak.lock();
+		schedule(interval_us, [next, left]() { (*next)(left - 1); });
+	};
+	(*step)(count);
+}
+
+//----------------------------------------------------------------------------
+// DS4
+
+DS4Peer::DS4Peer(const uint8_t addr[6])
+	: HIDPeer(addr, 0x002508, "Wireless Controller")
+{
+}
+
+std::vector<uint8_t> DS4Peer::report(uint32_t n)
+{
+	uint8_t lx = n & 0xff;
+	uint8_t ly = 0xff - lx;
+	if (!extended_reports) {
+		//       ID    LX  LY  RX    RY    BT    BT    PS           LT  RT
+		return {0x01, lx, ly, 0x80, 0x80, 0x08, 0x00, (uint8_t)(n << 2), 0, 0};
+	}
+	std::vector<uint8_t> r(78, 0);
+	r[0] = 0x11;
+	r[1] = 0xC0;
+	r[3] = lx;
+	r[4] = ly;
+	r[5] = 0x80;
+	r[6] = 0x80;
+	r[7] = 0x08;    // D-pad released
+	r[9] = n << 2;
+	return r;
+}
+
+std::vector<uint8_t> DS4Peer::get_report(uint8_t type, uint8_t id)
+{
+	if (type != 3 || id != 0x02) return std::vector<uint8_t>();
+	// Reading the calibration feature report switches the DS4 to 0x11 reports
+	extended_reports = true;
+	std::vector<uint8_t> r(37, 0);
+	r[0] = 0x02;
+	return r;
+}
+
+//----------------------------------------------------------------------------
+// Switch Pro
+
+SwitchProPeer::SwitchProPeer(const uint8_t addr[6])
+	: HIDPeer(addr, 0x002508, "Pro Controller")
+{
+	opens_control = false;
+	opens_interrupt = false;
+}
+
+std::vector<uint8_t> SwitchProPeer::report(uint32_t n)
+{
+	uint16_t x = 0x800 + (n & 0xff);
+	uint16_t y = 0x800;
+	if (report_mode == 0x3F) {
+		std::vector<uint8_t> r = {0x3F, 0x00, 0x00, 0x08};
+		put16(r, x << 4);
+		put16(r, y << 4);
+		put16(r, 0x8000);
+		put16(r, 0x8000);
+		return r;
+	}
+	std::vector<uint8_t> r(49, 0);
+	r[0] = 0x30;
+	r[1] = n;
+	r[2] = 0x8E;
+	r[6] = x & 0xff;
+	r[7] = ((x >> 8) & 0x0f) | ((y & 0x0f) << 4);
+	r[8] = y >> 4;
+	r[9] = 0x00;
+	r[10] = 0x08;
+	r[11] = 0x80;
+	r[13] = n;      // accelerometer X, counts reports
+	return r;
+}
+
+void SwitchProPeer::output(const uint8_t *data, uint16_t length)
+{
+	// 01 <packet #> <rumble 8> <subcommand> <data>
+	if (length < 11 || data[0] != 0x01) return;
+	uint8_t sub = data[10];
+	subcommands.push_back(sub);
+	std::vector<uint8_t> r(49, 0);
+	r[0] = 0x21;
+	r[1] = data[1];
+	r[2] = 0x8E;
+	r[6] = 0x00; r[7] = 0x08; r[8] = 0x80;
+	r[9] = 0x00; r[10] = 0x08; r[11] = 0x80;
+	r[13] = 0x80;
+	r[14] = sub;
+	switch (sub) {
+	case 0x02:  // device info
+		r[13] = 0x82;
+		r[15] = 0x03; r[16] = 0x8B; r[17] = 0x03; r[18] = 0x02;
+		memcpy(&r[19], bdaddr, 6);
+		break;
+	case 0x03:  // set input report mode
+		if (length > 11) report_mode = data[11];
+		break;
+	case 0x10: {    // SPI flash read: echo address and size, then the data
+		static const uint8_t stick_cal[18] = {
+			0xBA, 0xF5, 0x62, 0x6F, 0xC8, 0x77, 0xED, 0x95, 0x5B,
+			0x16, 0xD8, 0x7D, 0xF2, 0xB5, 0x5F, 0x86, 0x65, 0x5E
+		};
+		r[13] = 0x90;
+		if (length < 16) break;
+		memcpy(&r[15], data + 11, 5);
+		uint32_t addr = data[11] | (data[12] << 8);
+		uint8_t size = data[15];
+		if (size > 29) size = 29;
+		if (addr == 0x603D) memcpy(&r[20], stick_cal, (size < 18) ? size : 18);
+		break;
+	}
+	}
+	send_report(r);
+	reports_sent--;     // replies are not part of the input stream
+}
+
+//----------------------------------------------------------------------------
+// Keyboard
+
+static const uint8_t keyboard_descriptor[] = {
+	0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01,             // Keyboard, report 1
+	0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, // modifiers
+	0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+	0x95, 0x01, 0x75, 0x08, 0x81, 0x01,                         // reserved
+	0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, // LEDs
+	0x91, 0x02, 0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+	0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65,             // keys
+	0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00,
+	0xC0
+};
+
+KeyboardPeer::KeyboardPeer(const uint8_t addr[6])
+	: HIDPeer(addr, 0x002540, "Bluetooth Keyboard")
+{
+	descriptor.assign(keyboard_descriptor, keyboard_descriptor + sizeof(keyboard_descriptor));
+	typing = {0x0B, 0x08, 0x0F, 0x0F, 0x12};   // h e l l o
+}
+
+std::vector<uint8_t> KeyboardPeer::report(uint32_t n)
+{
+	std::vector<uint8_t> r = {0x01, 0, 0, 0, 0, 0, 0, 0, 0};
+	if (!(n & 1) && !typing.empty()) r[3] = typing[(n / 2) % typing.size()];
+	return r;
+}
+
+//----------------------------------------------------------------------------
+// Generic gamepad
+
+static const uint8_t gamepad_descriptor[] = {
+	0x05, 0x01, 0x09, 0x05, 0xA1, 0x01, 0x85, 0x01,             // Game Pad, report 1
+	0x09, 0x30, 0x09, 0x31, 0x09, 0x32, 0x09, 0x35,             // X Y Z Rz
+	0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x04, 0x81, 0x02,
+	0x09, 0x39, 0x15, 0x00, 0x25, 0x07, 0x35, 0x00, 0x46, 0x3B, 0x01, // hat
+	0x65, 0x14, 0x75, 0x04, 0x95, 0x01, 0x81, 0x42,
+	0x65, 0x00, 0x05, 0x09, 0x19, 0x01, 0x29, 0x0C,             // 12 buttons
+	0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x0C, 0x81, 0x02,
+	0x05, 0x01, 0x09, 0x33, 0x09, 0x34,                         // Rx Ry triggers
+	0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x02, 0x81, 0x02,
+	0xC0
+};
+
+GamepadPeer::GamepadPeer(const uint8_t addr[6], const char *remote_name)
+	: HIDPeer(addr, 0x002508, remote_name)
+{
+	descriptor.assign(gamepad_descriptor, gamepad_descriptor + sizeof(gamepad_descriptor));
+}
+
+std::vector<uint8_t> GamepadPeer::report(uint32_t n)
+{
+	uint8_t x = n & 0xff;
+	//       ID    X  Y          Z     Rz    hat/buttons  buttons  Rx Ry
+	return {0x01, x, (uint8_t)~x, 0x80, 0x80, 0x08, 0x00, 0x00, 0x00};
+}
+
+//----------------------------------------------------------------------------
+// HID over GATT
+
+GATTPeer::GATTPeer(const uint8_t addr[6], const char *remote_name)
+	: Peer(addr, 0, remote_name)
+{
+	le = true;
+	address_type = 1;   // random
+	// Flags, incomplete list of 16 bit UUIDs: HID, Appearance, name
+	advertising = {0x02, 0x01, 0x06, 0x03, 0x02, 0x12, 0x18, 0x03, 0x19, 0xC0, 0x03};
+	advertising.push_back(name.size() + 1);
+	advertising.push_back(0x09);
+	advertising.insert(advertising.end(), name.begin(), name.end());
+}
+
+uint16_t GATTPeer::add_attribute(uint16_t type, const std::vector<uint8_t> &value)
+{
+	attributes_.push_back(attribute_t{next_handle_, type, value, 0});
+	return next_handle_++;
+}
+
+// Declaration then value, returns the value handle
+uint16_t GATTPeer::add_characteristic(uint8_t properties, uint16_t uuid, const std::vector<uint8_t> &value)
+{
+	std::vector<uint8_t> declaration = {properties};
+	put16(declaration, next_handle_ + 1);
+	put16(declaration, uuid);
+	add_attribute(0x2803, declaration);
+	return add_attribute(uuid, value);
+}
+
+void GATTPeer::build_database()
+{
+	attributes_.clear();
+	next_handle_ = 1;
+	std::vector<uint8_t> name_value(name.begin(), name.end());
+
+	add_attribute(0x2800, {0x00, 0x18});    // GAP
+	add_characteristic(0x02, 0x2A00, name_value);
+	attributes_[0].group_end = next_handle_ - 1;
+
+	// HID, not straight after GAP
+	next_handle_ = 0x0010;
+	size_t hid = attributes_.size();
+	add_attribute(0x2800, {0x12, 0x18});
+	add_characteristic(0x02, 0x2A4A, {0x11, 0x01, 0x00, 0x02});     // HID Information
+	report_map_handle_ = add_characteristic(0x02, 0x2A4B, descriptor);
+	for (report_t &r : reports) {
+		uint8_t properties;
+		switch (r.type) {
+		case 1: properties = indications ? 0x22 : 0x12; break;  // read, indicate or notify
+		case 2: properties = 0x0E; break;                       // read, write, write without response
+		default: properties = 0x0A; break;                      // read, write
+		}
+		r.value_handle = add_characteristic(properties, 0x2A4D, std::vector<uint8_t>(8, 0));
+		r.cccd_handle = (r.type == 1) ? add_attribute(0x2902, {0x00, 0x00}) : 0;
+		r.cccd = 0;
+		add_attribute(0x2908, {r.id, r.type});
+	}
+	add_characteristic(0x04, 0x2A4C, {0x00});   // HID Control Point
+	attributes_[hid].group_end = next_handle_ - 1;
+
+	// Battery, its level notifies too
+	size_t battery = attributes_.size();
+	add_attribute(0x2800, {0x0F, 0x18});
+	add_characteristic(0x12, 0x2A19, {100});
+	add_attribute(0x2902, {0x00, 0x00});
+	attributes_[battery].group_end = next_handle_ - 1;
+}
+
+GATTPeer::attribute_t *GATTPeer::attribute(uint16_t handle)
+{
+	for (attribute_t &a : attributes_) {
+		if (a.handle == handle) return &a;
+	}
+	return nullptr;
+}
+
+GATTPeer::report_t *GATTPeer::report_for(uint16_t handle, bool cccd)
+{
+	for (report_t &r : reports) {
+		if ((cccd ? r.cccd_handle : r.value_handle) == handle) return &r;
+	}
+	return nullptr;
+}
+
+bool GATTPeer::reports_enabled() const
+{
+	for (const report_t &r : reports) {
+		if (r.type == 1 && !r.cccd) return false;
+	}
+	return true;
+}
+
+void GATTPeer::link_up(bool host_initiated)
+{
+	if (attributes_.empty()) build_database();
+	// Not bonded, so nothing is kept from the last connection
+	for (report_t &r : reports) r.cccd = 0;
+	att_mtu_ = 23;
+	indication_pending_ = false;
+	indications_.clear();
+}
+
+void GATTPeer::link_down()
+{
+	stop_stream();
+	indication_pending_ = false;
+	indications_.clear();
+}
+
+void GATTPeer::l2cap(uint16_t cid, const uint8_t *data, uint16_t length)
+{
+	switch (cid) {
+	case 0x0004:
+		att_from_host.emplace_back(data, data + length);
+		att(data, length);
+		break;
+	case 0x0005:
+		signaling.emplace_back(data, data + length);
+		break;
+	case 0x0006:
+		smp.emplace_back(data, data + length);
+		break;
+	}
+}
+
+void GATTPeer::att_error(uint8_t opcode, uint16_t handle, uint8_t error)
+{
+	std::vector<uint8_t> pdu = {0x01, opcode};
+	put16(pdu, handle);
+	pdu.push_back(error);
+	send_att(pdu);
+}
+
+void GATTPeer::att(const uint8_t *data, uint16_t length)
+{
+	if (!length) return;
+	uint8_t opcode = data[0];
+	uint16_t start = (length >= 3) ? get16(data + 1) : 0;
+	uint16_t end = (length >= 5) ? get16(data + 3) : 0;
+	std::vector<uint8_t> rsp;
+
+	switch (opcode) {
+	case 0x02:  // Exchange MTU
+		if (length < 3) break;
+		host_mtu = start;
+		att_mtu_ = std::max<uint16_t>(23, std::min(mtu, host_mtu));
+		rsp = {0x03};
+		put16(rsp, mtu);
+		send_att(rsp);
+		break;
+
+	case 0x04:  // Find Information: 16 bit UUIDs only
+		rsp = {0x05, 0x01};
+		for (const attribute_t &a : attributes_) {
+			if (a.handle < start || a.handle > end) continue;
+			if (rsp.size() + 4 > att_mtu_) break;
+			put16(rsp, a.handle);
+			put16(rsp, a.type);
+		}
+		if (rsp.size() == 2) att_error(opcode, start, 0x0A);     // attribute not found
+		else send_att(rsp);
+		break;
+
+	case 0x06:  // Find By Type Value: primary services by UUID
+		rsp = {0x07};
+		if (length >= 9 && get16(data + 5) == 0x2800) {
+			for (const attribute_t &a : attributes_) {
+				if (a.handle < start || a.handle > end || a.type != 0x2800) continue;
+				if (a.value.size() != 2 || get16(a.value.data()) != get16(data + 7)) continue;
+				if (rsp.size() + 4 > att_mtu_) break;
+				put16(rsp, a.handle);
+				put16(rsp, a.group_end);
+			}
+		}
+		if (rsp.size() == 1) att_error(opcode, start, 0x0A);
+		else send_att(rsp);
+		break;
+
+	case 0x08: {    // Read By Type: as many of the same length as fit
+		if (length < 7) break;
+		uint16_t type = get16(data + 5);
+		rsp = {0x09, 0};
+		for (const attribute_t &a : attributes_) {
+			if (a.handle < start || a.handle > end || a.type != type) continue;
+			uint8_t entry = std::min<size_t>(2 + a.value.size(), att_mtu_ - 2);
+			if (rsp[1] && (entry != rsp[1] || rsp.size() + entry > att_mtu_)) break;
+			rsp[1] = entry;
+			put16(rsp, a.handle);
+			rsp.insert(rsp.end(), a.value.begin(), a.value.begin() + entry - 2);
+		}
+		if (!rsp[1]) att_error(opcode, start, 0x0A);
+		else send_att(rsp);
+		break;
+	}
+
+	case 0x0A:      // Read
+	case 0x0C: {    // Read Blob
+		attribute_t *a = attribute(start);
+		uint16_t offset = (opcode == 0x0C && length >= 5) ? end : 0;
+		if (!a) {
+			att_error(opcode, start, 0x01);     // invalid handle
+			break;
+		}
+		if (start == report_map_handle_) {
+			report_map_reads++;
+			if (report_map_error) {
+				att_error(opcode, start, report_map_error);
+				break;
+			}
+		}
+		if (offset > a->value.size()) {
+			att_error(opcode, start, 0x07);     // invalid offset
+			break;
+		}
+		rsp = {(uint8_t)(opcode + 1)};
+		size_t n = std::min<size_t>(a->value.size() - offset, att_mtu_ - 1);
+		rsp.insert(rsp.end(), a->value.begin() + offset, a->value.begin() + offset + n);
+		send_att(rsp);
+		break;
+	}
+
+	case 0x12:      // Write Request
+	case 0x52: {    // Write Command
+		attribute_t *a = attribute(start);
+		if (!a) {
+			if (opcode == 0x12) att_error(opcode, start, 0x01);
+			break;
+		}
+		a->value.assign(data + 3, data + length);
+		report_t *r = report_for(start, true);
+		if (r && length >= 5) r->cccd = get16(data + 3);
+		if (report_for(start, false)) writes.emplace_back(data + 3, data + length);
+		if (opcode == 0x12) send_att({0x13});
+		break;
+	}
+
+	case 0x1E:  // Handle Value Confirmation
+		confirmations++;
+		indication_pending_ = false;
+		if (!indications_.empty()) {
+			indication_pending_ = true;
+			send_att(indications_.front());
+			indications_.pop_front();
+		}
+		break;
+
+	default:
+		// Anything else we are asked is not supported, responses to what
+		// we asked the host are only logged.
+		if (!(opcode & 1) && !(opcode & 0x40)) att_error(opcode, start, 0x06);
+		break;
+	}
+}
+
+void GATTPeer::send_value(uint8_t opcode, uint16_t handle, const std::vector<uint8_t> &value)
+{
+	std::vector<uint8_t> pdu = {opcode};
+	put16(pdu, handle);
+	pdu.insert(pdu.end(), value.begin(), value.begin() + std::min<size_t>(value.size(), att_mtu_ - 3));
+	if (opcode == 0x1B) {
+		send_att(pdu);
+	} else if (indication_pending_) {
+		indications_.push_back(pdu);
+	} else {
+		indication_pending_ = true;
+		send_att(pdu);
+	}
+}
+
+void GATTPeer::send_report(uint8_t id, const std::vector<uint8_t> &value)
+{
+	for (report_t &r : reports) {
+		if (r.type != 1 || r.id != id) continue;
+		if (r.cccd & 0x0001) send_value(0x1B, r.value_handle, value);
+		else if (r.cccd & 0x0002) send_value(0x1D, r.value_handle, value);
+		else return;
+		attribute(r.value_handle)->value = value;
+		reports_sent++;
+		return;
+	}
+}
+
+std::vector<uint8_t> GATTPeer::report(uint32_t n)
+{
+	return std::vector<uint8_t>();
+}
+
+void GATTPeer::stream(uint32_t count, uint32_t interval_us)
+{
+	uint8_t id = 0;
+	for (const report_t &r : reports) {
+		if (r.type == 1) {
+			id = r.id;
+			break;
+		}
+	}
+	uint32_t generation = ++stream_generation_;
+	auto step = std::make_shared<std::function<void(uint32_t)>>();
+	std::weak_ptr<std::function<void(uint32_t)>> weak = step;
+	*step = [this, generation, interval_us, weak, id](uint32_t left) {
+		if (generation != stream_generation_ || !left || !handle) return;
+		send_report(id, report(reports_sent));
+		auto next = weak.lock();
+		schedule(interval_us, [next, left]() { (*next)(left - 1); });
+	};
+	(*step)(count);
+}
+
+void GATTPeer::request_connection_parameters(uint16_t min_interval, uint16_t max_interval, uint16_t latency, uint16_t timeout)
+{
+	std::vector<uint8_t> req = {0x12, ++signal_id_, 8, 0};
+	put16(req, min_interval);
+	put16(req, max_interval);
+	put16(req, latency);
+	put16(req, timeout);
+	send_l2cap(0x0005, req);
+}
+
+void GATTPeer::request_pairing()
+{
+	// Pairing Request: no input no output, no OOB, bonding, key size 16
+	send_l2cap(0x0006, {0x01, 0x03, 0x00, 0x01, 0x10, 0x01, 0x01});
+}
+
+LEGamepadPeer::LEGamepadPeer(const uint8_t addr[6], const char *remote_name)
+	: GATTPeer(addr, remote_name)
+{
+	descriptor.assign(gamepad_descriptor, gamepad_descriptor + sizeof(gamepad_descriptor));
+	reports = {{1, 1, 0, 0, 0}};
+}
+
+std::vector<uint8_t> LEGamepadPeer::report(uint32_t n)
+{
+	uint8_t x = n & 0xff;
+	//       X  Y          Z     Rz    hat/buttons  buttons  Rx Ry
+	return {x, (uint8_t)~x, 0x80, 0x80, 0x08, 0x00, 0x00, 0x00};
+}
+
+LEKeyboardPeer::LEKeyboardPeer(const uint8_t addr[6])
+	: GATTPeer(addr, "BLE Keyboard")
+{
+	descriptor.assign(keyboard_descriptor, keyboard_descriptor + sizeof(keyboard_descriptor));
+	reports = {{1, 1, 0, 0, 0}, {1, 2, 0, 0, 0}};
+	typing = {0x0B, 0x08, 0x0F, 0x0F, 0x12};   // h e l l o
+}
+
+std::vector<uint8_t> LEKeyboardPeer::report(uint32_t n)
+{
+	std::vector<uint8_t> r(8, 0);
+	if (!(n & 1) && !typing.empty()) r[2] = typing[(n / 2) % typing.size()];
+	return r;
+}
+
+} // namespace sim
@@ -0,0 +1,230 @@
+/* Scripted Bluetooth HID devices for the simulated dongle.
+ *
+ * HIDPeer is a classic (BR/EDR) HID device: it answers or opens the HID
+ * control and interrupt L2CAP channels, serves its report descriptor over
+ * SDP (split with continuation state), answers HID control transactions and
+ * streams input reports on the interrupt channel.  The profiles below act
+ * like the devices the library has drivers for.
+ *
+ * GATTPeer is a BLE HID device (HID over GATT): an ATT server holding the
+ * HID service, sending its input reports as notifications or indications.
+ */
+
+#ifndef SIM_PEERS_H_
+#define SIM_PEERS_H_
+
+#include <deque>
+#include "sim_hci.h"
+
+namespace sim {
+
+class HIDPeer : public Peer {
+public:
+	HIDPeer(const uint8_t addr[6], uint32_t cod, const char *remote_name);
+
+	// How the device brings up its channels after the link comes up.  A
+	// device that opens neither waits for the host to do it.
+	bool opens_control = true;
+	bool opens_interrupt = true;    // once the control channel is up
+	uint32_t open_delay_us = 10000;
+	std::vector<uint8_t> descriptor;    // HID report descriptor, served over SDP
+	uint16_t sdp_chunk = 100;       // attribute bytes per SDP response
+
+	// Input reports: report() gives the n'th report of a stream, starting
+	// with its report ID (no 0xA1 header).
+	virtual std::vector<uint8_t> report(uint32_t n);
+	void send_report(const std::vector<uint8_t> &data);
+	void stream(uint32_t count, uint32_t interval_us);
+	void stop_stream() { stream_generation_++; }
+	uint32_t reports_sent = 0;
+
+	bool control_open() const { return ctrl_.open(); }
+	bool interrupt_open() const { return intr_.open(); }
+	bool sdp_open() const { return sdp_.open(); }
+	uint32_t sdp_requests = 0;
+	uint64_t link_up_us = 0;
+	uint8_t protocol = 1;           // from HID SET_PROTOCOL
+	std::vector<std::vector<uint8_t>> outputs;      // 0xA2 DATA on the interrupt channel
+	std::vector<std::vector<uint8_t>> transactions; // HID control channel packets
+
+	void link_up(bool host_initiated) override;
+	void link_down() override;
+	void l2cap(uint16_t cid, const uint8_t *data, uint16_t length) override;
+
+protected:
+	// HID control channel transaction, the default answers SET_* with a
+	// successful handshake and GET_REPORT from get_report().
+	virtual void control(const uint8_t *data, uint16_t length);
+	virtual std::vector<uint8_t> get_report(uint8_t type, uint8_t id);
+	// DATA output report (after the 0xA2)
+	virtual void output(const uint8_t *data, uint16_t length) { }
+	virtual void channels_open() { }
+	void send_control(const std::vector<uint8_t> &data);
+
+private:
+	typedef struct channel {
+		uint16_t psm;
+		uint16_t local;     // our CID
+		uint16_t remote;    // the host's CID, 0 until known
+		bool config_in;     // host's configuration accepted
+		bool config_out;    // our configuration accepted
+		bool requested;     // we sent the connection request
+		bool open() const { return remote && config_in && config_out; }
+	} channel_t;
+
+	channel_t *channel_psm(uint16_t psm);
+	channel_t *channel_cid(uint16_t cid);
+	void open_channel(channel_t &ch);
+	void send_config(channel_t &ch);
+	void signaling(const uint8_t *data, uint16_t length);
+	void sdp(const uint8_t *data, uint16_t length);
+	void check_open();
+	std::vector<uint8_t> sdp_attributes();
+
+	channel_t ctrl_ = {0x11, 0x0044, 0, false, false, false};
+	channel_t intr_ = {0x13, 0x0045, 0, false, false, false};
+	channel_t sdp_ = {0x01, 0x0046, 0, false, false, false};
+	uint8_t signal_id_ = 0;
+	bool was_open_ = false;
+	uint32_t stream_generation_ = 0;
+};
+
+// Sony DualShock 4: "Wireless Controller".  Reconnects by opening the
+// control and interrupt channels itself.  Sends short
+// 0x01 reports until the host reads feature report 0x02, then 0x11 ones.
+class DS4Peer : public HIDPeer {
+public:
+	DS4Peer(const uint8_t addr[6]);
+	std::vector<uint8_t> report(uint32_t n) override;
+	bool extended_reports = false;
+protected:
+	std::vector<uint8_t> get_report(uint8_t type, uint8_t id) override;
+};
+
+// Nintendo Switch Pro Controller.  Acks the 0x01 subcommands the host sends
+// with 0x21 replies, streams 0x3F reports until the host sets report mode
+// 0x30.
+class SwitchProPeer : public HIDPeer {
+public:
+	SwitchProPeer(const uint8_t addr[6]);
+	std::vector<uint8_t> report(uint32_t n) override;
+	uint8_t report_mode = 0x3F;
+	std::vector<uint8_t> subcommands;   // in the order the host sent them
+protected:
+	void output(const uint8_t *data, uint16_t length) override;
+};
+
+// Boot protocol keyboard (report ID 1) with a report descriptor over SDP.
+// Each report presses one key of typing[] then releases it.
+class KeyboardPeer : public HIDPeer {
+public:
+	KeyboardPeer(const uint8_t addr[6]);
+	std::vector<uint8_t> report(uint32_t n) override;
+	std::vector<uint8_t> typing;    // HID usage codes
+};
+
+// A gamepad with no special driver: "Generic Gamepad", class 0x2508, with
+// a DS4 style report descriptor over SDP for the compiled report path.
+class GamepadPeer : public HIDPeer {
+public:
+	GamepadPeer(const uint8_t addr[6], const char *remote_name = "Generic Gamepad");
+	std::vector<uint8_t> report(uint32_t n) override;
+};
+
+// A BLE HID device: an ATT server with a GAP service, the HID service
+// (HID Information, Report Map, one Report characteristic per report with
+// its Report Reference and, for input reports, a CCCD, and the HID Control
+// Point) and a Battery service after it.  Input reports go out once the
+// host has turned them on in their CCCD.
+class GATTPeer : public Peer {
+public:
+	GATTPeer(const uint8_t addr[6], const char *remote_name);
+
+	typedef struct {
+		uint8_t id;
+		uint8_t type;               // 1 input, 2 output, 3 feature
+		uint16_t value_handle;      // set when the database is built
+		uint16_t cccd_handle;       // input reports only
+		uint16_t cccd;              // as written by the host
+	} report_t;
+	std::vector<uint8_t> descriptor;    // the Report Map
+	std::vector<report_t> reports;
+	uint16_t mtu = 23;              // our receive MTU, for Exchange MTU
+	bool indications = false;       // input reports indicate instead of notify
+	uint8_t report_map_error = 0;   // ATT error for reads of the report map, as an encrypted device
+
+	// Input reports: report() gives the value of the n'th report of a
+	// stream, for the first input report.
+	virtual std::vector<uint8_t> report(uint32_t n);
+	void send_report(uint8_t id, const std::vector<uint8_t> &value);
+	void stream(uint32_t count, uint32_t interval_us);
+	void stop_stream() { stream_generation_++; }
+	uint32_t reports_sent = 0;
+	bool reports_enabled() const;   // every input report's CCCD written
+
+	// The device asks the host for other connection parameters, to pair,
+	// or sends it any ATT PDU.
+	void request_connection_parameters(uint16_t min_interval, uint16_t max_interval, uint16_t latency, uint16_t timeout);
+	void request_pairing();
+	void send_att(const std::vector<uint8_t> &pdu) { send_l2cap(0x0004, pdu); }
+
+	// What the host did
+	std::vector<std::vector<uint8_t>> att_from_host;    // every ATT PDU, in order
+	std::vector<std::vector<uint8_t>> signaling;        // LE signaling channel
+	std::vector<std::vector<uint8_t>> smp;              // Security Manager
+	std::vector<std::vector<uint8_t>> writes;           // values written to output reports
+	uint16_t host_mtu = 0;          // from its Exchange MTU request
+	uint32_t report_map_reads = 0;  // Read and Read Blob requests for the report map
+	uint32_t confirmations = 0;     // of our indications
+
+	void link_up(bool host_initiated) override;
+	void link_down() override;
+	void l2cap(uint16_t cid, const uint8_t *data, uint16_t length) override;
+
+private:
+	typedef struct {
+		uint16_t handle;
+		uint16_t type;              // 16 bit UUIDs only
+		std::vector<uint8_t> value;
+		uint16_t group_end;         // primary services
+	} attribute_t;
+
+	void build_database();
+	uint16_t add_attribute(uint16_t type, const std::vector<uint8_t> &value);
+	uint16_t add_characteristic(uint8_t properties, uint16_t uuid, const std::vector<uint8_t> &value);
+	attribute_t *attribute(uint16_t handle);
+	report_t *report_for(uint16_t handle, bool cccd);
+	void att(const uint8_t *data, uint16_t length);
+	void att_error(uint8_t opcode, uint16_t handle, uint8_t error);
+	void send_value(uint8_t opcode, uint16_t handle, const std::vector<uint8_t> &value);
+
+	std::vector<attribute_t> attributes_;
+	uint16_t next_handle_ = 1;
+	uint16_t report_map_handle_ = 0;
+	uint16_t att_mtu_ = 23;
+	uint8_t signal_id_ = 0;
+	uint32_t stream_generation_ = 0;
+	bool indication_pending_ = false;
+	std::deque<std::vector<uint8_t>> indications_;  // waiting for the confirmation of the one before
+};
+
+// A BLE gamepad with the generic gamepad's report map, report ID 1
+class LEGamepadPeer : public GATTPeer {
+public:
+	LEGamepadPeer(const uint8_t addr[6], const char *remote_name = "BLE Gamepad");
+	std::vector<uint8_t> report(uint32_t n) override;
+};
+
+// A BLE keyboard with the keyboard's report map: input report 1 and the
+// LED output report 1.  Each report presses one key of typing[] then
+// releases it.
+class LEKeyboardPeer : public GATTPeer {
+public:
+	LEKeyboardPeer(const uint8_t addr[6]);
+	std::vector<uint8_t> report(uint32_t n) override;
+	std::vector<uint8_t> typing;    // HID usage codes
+};
+
+} // namespace sim
+
+#endif
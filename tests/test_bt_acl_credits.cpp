@@ -0,0 +1,117 @@
+/* ACL buffer credits: with a dongle that has only two ACL buffers, bursts of
+ * output reports to two devices go out as fast as Number Of Completed
+ * Packets hands the buffers back, never more than two at a time, and a
+ * device that drops with packets still in the controller does not take
+ * those buffers with it.
+ */
+
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+JoystickController joystick1(myusb);
+KeyboardController keyboard1(myusb);
+
+static const uint8_t ds4_addr[6] = {0x41, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t keyboard_addr[6] = {0x42, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+static sim::HCIController dongle;
+static sim::DS4Peer ds4(ds4_addr);
+static sim::KeyboardPeer keyboard_peer(keyboard_addr);
+
+// The devices' interrupt channel CID (HIDPeer's own)
+static const uint16_t interrupt_cid = 0x0045;
+
+// Output report seq for a device, sent by its handle
+static void send_output(sim::HIDPeer &peer, uint8_t seq)
+{
+	uint8_t packet[] = {0xA2, 0x05, seq, (uint8_t)~seq};
+	bluet.sendL2CapCommand(peer.handle, packet, sizeof(packet), interrupt_cid & 0xff, interrupt_cid >> 8);
+}
+
+static bool outputs_in_order(const sim::HIDPeer &peer, size_t from, uint8_t count)
+{
+	if (peer.outputs.size() - from != count) return false;
+	for (uint8_t i = 0; i < count; i++) {
+		if (peer.outputs[from + i] != std::vector<uint8_t>({0x05, i, (uint8_t)~i})) return false;
+	}
+	return true;
+}
+
+static void test_bursts()
+{
+	// Four rounds of three reports to each, each round as the ring allows
+	bluet.resetStatistics();
+	size_t ds4_from = ds4.outputs.size(), keyboard_from = keyboard_peer.outputs.size();
+	uint64_t start = sim::now_us;
+	for (uint8_t round = 0; round < 4; round++) {
+		for (uint8_t i = 0; i < 3; i++) {
+			send_output(ds4, round * 3 + i);
+			send_output(keyboard_peer, round * 3 + i);
+		}
+		CHECK(sim::run_until([&]() {
+			return ds4.outputs.size() - ds4_from == round * 3u + 3 &&
+				keyboard_peer.outputs.size() - keyboard_from == round * 3u + 3;
+		}, 100000));
+	}
+	uint64_t us = sim::now_us - start;
+	CHECK(outputs_in_order(ds4, ds4_from, 12));
+	CHECK(outputs_in_order(keyboard_peer, keyboard_from, 12));
+	CHECK_EQ(dongle.acl_overruns, 0);
+	CHECK_EQ(dongle.acl_max_outstanding, 2);
+
+	BluetoothStatistics_t stats;
+	bluet.getStatistics(stats);
+	CHECK_EQ(stats.tx_acl_dropped, 0);
+	// 24 packets, two buffers: twelve buffer round trips and not many more
+	CHECK(us < 12 * (dongle.completed_latency_us + 1000));
+	printf("24 packets through 2 buffers: %llu us\n", (unsigned long long)us);
+}
+
+static void test_drop_with_packets_outstanding()
+{
+	// The keyboard goes while its packets fill both buffers: the controller
+	// flushes them and sends no completions for them, and the two still in
+	// the ring are dropped.
+	sim::run_us(10000);
+	bluet.resetStatistics();
+	size_t sent = dongle.acl_from_host.size();
+	for (uint8_t i = 0; i < 4; i++) send_output(keyboard_peer, i);
+	sim::run_us(500);
+	CHECK_EQ(dongle.acl_from_host.size() - sent, 2);
+	dongle.disconnect(&keyboard_peer);
+	sim::run_us(100000);
+
+	size_t from = ds4.outputs.size();
+	for (uint8_t i = 0; i < 6; i++) send_output(ds4, i);
+	sim::run_us(100000);
+	CHECK(outputs_in_order(ds4, from, 6));
+	CHECK_EQ(dongle.acl_overruns, 0);
+	BluetoothStatistics_t stats;
+	bluet.getStatistics(stats);
+	CHECK_EQ(stats.tx_acl_dropped, 2);
+}
+
+int main()
+{
+	dongle.acl_buffers = 2;
+	dongle.add_peer(&ds4);
+	dongle.add_peer(&keyboard_peer);
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+	CHECK(dongle.connect_in(&ds4));
+	CHECK(sim::run_until([]() { return ds4.extended_reports && ds4.interrupt_open(); }, 2000000));
+	sim::run_us(100000);
+	CHECK(dongle.connect_in(&keyboard_peer));
+	CHECK(sim::run_until([]() { return keyboard_peer.interrupt_open(); }, 2000000));
+	sim::run_us(200000);
+	CHECK_EQ(dongle.acl_overruns, 0);
+
+	test_bursts();
+	test_drop_with_packets_outstanding();
+	return TEST_MAIN_RESULT();
+}
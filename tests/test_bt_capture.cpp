@@ -0,0 +1,209 @@
+/* HCI capture: everything the host and the dongle exchange while a DS4
+ * connects and streams is captured and written out as a btsnoop file.  The
+ * file is parsed back and checked record by record against what the
+ * simulated dongle saw: the header, the lengths, the flags for each H4
+ * packet type, the timestamps and the commands in the order sent.  A small
+ * buffer fills up and counts the packets it had no room for.
+ */
+
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+JoystickController joystick1(myusb);
+
+static const uint8_t ds4_addr[6] = {0xD1, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+static sim::HCIController dongle;
+static sim::DS4Peer ds4(ds4_addr);
+
+static uint8_t capture_buffer[256 * 1024];
+
+// Collects what is written, as a file on an SD card would
+class CapturePrint : public Print {
+public:
+	size_t write(uint8_t b) { data.push_back(b); return 1; }
+	size_t write(const uint8_t *buffer, size_t size) {
+		for (size_t i = 0; i < size; i++) data.push_back(buffer[i]);
+		return size;
+	}
+	std::vector<uint8_t> data;
+};
+
+typedef struct {
+	uint32_t original_length;
+	uint32_t included_length;
+	uint32_t flags;
+	uint64_t timestamp;
+	std::vector<uint8_t> packet;    // H4 type byte and the packet
+} btsnoop_record_t;
+
+static uint32_t be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Checks the file header and the framing of every record.
+static std::vector<btsnoop_record_t> parse_btsnoop(const std::vector<uint8_t> &file)
+{
+	std::vector<btsnoop_record_t> records;
+	CHECK(file.size() >= 16);
+	if (file.size() < 16) return records;
+	CHECK(memcmp(file.data(), "btsnoop\0", 8) == 0);
+	CHECK_EQ(be32(&file[8]), 1);
+	CHECK_EQ(be32(&file[12]), 1002);
+	size_t offset = 16;
+	while (offset + 24 <= file.size()) {
+		btsnoop_record_t r;
+		r.original_length = be32(&file[offset]);
+		r.included_length = be32(&file[offset + 4]);
+		r.flags = be32(&file[offset + 8]);
+		CHECK_EQ(be32(&file[offset + 12]), 0);      // cumulative drops
+		r.timestamp = ((uint64_t)be32(&file[offset + 16]) << 32) | be32(&file[offset + 20]);
+		offset += 24;
+		CHECK(offset + r.included_length <= file.size());
+		if (offset + r.included_length > file.size()) break;
+		r.packet.assign(file.begin() + offset, file.begin() + offset + r.included_length);
+		offset += r.included_length;
+		records.push_back(r);
+	}
+	CHECK_EQ(offset, file.size());
+	return records;
+}
+
+typedef struct {
+	uint32_t commands;
+	uint32_t events;
+	uint32_t acl_sent;
+	uint32_t acl_received;
+	uint32_t truncated;
+} record_counts_t;
+
+// Each record is consistent with its H4 type: the flags, and the length
+// fields of the HCI header against the record lengths.
+static record_counts_t check_records(const std::vector<btsnoop_record_t> &records)
+{
+	const uint64_t btsnoop_epoch_delta = 0x00dcddb30f2f8000ull;
+	record_counts_t counts = {};
+	uint64_t prev_timestamp = btsnoop_epoch_delta;
+	for (const btsnoop_record_t &r : records) {
+		CHECK(r.included_length >= 1 && r.included_length <= r.original_length);
+		CHECK(r.timestamp >= prev_timestamp);
+		prev_timestamp = r.timestamp;
+		if (r.packet.empty()) continue;
+		const uint8_t *hci = &r.packet[1];
+		uint32_t hci_captured = r.included_length - 1;
+		uint32_t hci_length = r.original_length - 1;
+		switch (r.packet[0]) {
+		case 0x01:      // command: <opcode><length><params>
+			CHECK_EQ(r.flags, 0x02);
+			CHECK(hci_captured >= 3 && hci_length == hci_captured);
+			if (hci_captured >= 3) CHECK_EQ(hci[2] + 3u, hci_length);
+			counts.commands++;
+			break;
+		case 0x04:      // event: <code><length><params>
+			CHECK_EQ(r.flags, 0x03);
+			CHECK(hci_captured >= 2 && hci_length == hci_captured);
+			if (hci_captured >= 2) CHECK_EQ(hci[1] + 2u, hci_length);
+			counts.events++;
+			break;
+		case 0x02:      // ACL: <handle><length 16><data>
+			CHECK(r.flags == 0x00 || r.flags == 0x01);
+			CHECK(hci_captured >= 4);
+			if (hci_captured >= 4) CHECK_EQ(hci[2] + ((uint32_t)hci[3] << 8) + 4, hci_length);
+			if (r.flags & 0x01) counts.acl_received++;
+			else counts.acl_sent++;
+			if (hci_captured < hci_length) counts.truncated++;
+			break;
+		default:
+			CHECK(false);
+			break;
+		}
+	}
+	return counts;
+}
+
+int main()
+{
+	dongle.add_peer(&ds4);
+	bluet.startHCICapture(capture_buffer, sizeof(capture_buffer));
+	bluet.resetStatistics();
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+	CHECK(dongle.connect_in(&ds4));
+	CHECK(sim::run_until([]() { return ds4.extended_reports && ds4.interrupt_open(); }, 3000000));
+	sim::run_us(100000);
+	ds4.stream(200, 4000);
+	sim::run_us(1000000);
+	uint64_t capture_us = sim::now_us;
+	bluet.stopHCICapture();
+
+	// Nothing more once stopped
+	uint32_t used = bluet.HCICaptureSize();
+	ds4.stream(20, 4000);
+	sim::run_us(200000);
+	CHECK_EQ(bluet.HCICaptureSize(), used);
+	CHECK_EQ(bluet.HCICaptureDropped(), 0);
+
+	CapturePrint file;
+	size_t cb = bluet.writeHCICapture(file);
+	CHECK_EQ(cb, file.data.size());
+	std::vector<btsnoop_record_t> records = parse_btsnoop(file.data);
+	record_counts_t counts = check_records(records);
+
+	// Every command in the order the dongle got them, with their parameters
+	std::vector<const btsnoop_record_t *> commands;
+	for (const btsnoop_record_t &r : records) {
+		if (r.packet[0] == 0x01) commands.push_back(&r);
+	}
+	CHECK_EQ(commands.size(), dongle.commands.size());
+	for (size_t i = 0; i < commands.size() && i < dongle.commands.size(); i++) {
+		const std::vector<uint8_t> &packet = commands[i]->packet;
+		const sim::HCIController::command_t &command = dongle.commands[i];
+		CHECK_EQ(packet[1] + (packet[2] << 8), command.opcode);
+		CHECK(std::vector<uint8_t>(packet.begin() + 4, packet.end()) == command.params);
+	}
+
+	// Every event the host handled and every ACL packet either way
+	BluetoothStatistics_t stats;
+	bluet.getStatistics(stats);
+	CHECK_EQ(counts.events, stats.events);
+	CHECK_EQ(counts.acl_sent, dongle.acl_from_host.size());
+	CHECK(counts.acl_received >= 200);
+	// The extended reports are longer than the bulk endpoint's packets
+	CHECK(counts.truncated >= 200);
+
+	// Time since the first record, on the simulated clock
+	CHECK(records.back().timestamp - records.front().timestamp <= capture_us);
+	CHECK(records.back().timestamp - records.front().timestamp >= 199 * 4000);
+	printf("capture: %u bytes, %u records (%u commands, %u events, %u ACL out, %u ACL in, %u truncated), %u byte file\n",
+		used, (unsigned)records.size(), counts.commands, counts.events, counts.acl_sent,
+		counts.acl_received, counts.truncated, (unsigned)cb);
+
+	// A buffer too small for the stream keeps what fits and counts the rest
+	static uint8_t small_buffer[1000];
+	bluet.startHCICapture(small_buffer, sizeof(small_buffer));
+	ds4.stream(50, 4000);
+	sim::run_us(300000);
+	CHECK(bluet.HCICaptureSize() <= sizeof(small_buffer));
+	CHECK(bluet.HCICaptureDropped() > 0);
+	CapturePrint small_file;
+	cb = bluet.writeHCICapture(small_file);
+	CHECK_EQ(cb, small_file.data.size());
+	records = parse_btsnoop(small_file.data);
+	check_records(records);
+	CHECK(!records.empty());
+	CHECK_EQ(records.size() + bluet.HCICaptureDropped(), 50);
+	printf("small buffer: %u records kept, %u dropped\n", (unsigned)records.size(), bluet.HCICaptureDropped());
+
+	// Without a buffer there is nothing to write
+	bluet.startHCICapture(nullptr, 0);
+	CapturePrint empty_file;
+	CHECK_EQ(bluet.writeHCICapture(empty_file), 0);
+	CHECK(empty_file.data.empty());
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,57 @@
+/* HCI command credits: the host never sends a command the controller has
+ * not granted a credit for, and with a controller that grants several the
+ * init sequence runs ahead and page scan is on sooner.
+ */
+
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+
+// Plugged in until page and inquiry scan are on.  Most of that is USB
+// enumeration, so the HCI part, Reset to Write Scan Enable, is returned too.
+static uint64_t cold_start(sim::HCIController &dongle, uint64_t &hci_us)
+{
+	uint64_t start = sim::now_us;
+	sim::attach(&dongle);
+	CHECK(sim::run_until([&dongle]() { return dongle.scan_enable == 2; }, 2000000));
+	uint64_t us = sim::now_us - start;
+	hci_us = dongle.first_us(0x0C1A) - dongle.first_us(0x0C03);
+	sim::run_us(100000);
+	CHECK_EQ(dongle.command_overruns, 0);
+	CHECK(dongle.commands_max_outstanding <= dongle.command_credits);
+	CHECK_EQ(dongle.count(0x0C03), 1);
+	return us;
+}
+
+int main()
+{
+	myusb.begin();
+
+	static sim::HCIController one;
+	uint64_t one_hci_us;
+	uint64_t one_us = cold_start(one, one_hci_us);
+	CHECK_EQ(one.commands_max_outstanding, 1);
+	sim::detach();
+	sim::run_us(200000);
+
+	static sim::HCIController several;
+	several.command_credits = 4;
+	uint64_t several_hci_us;
+	uint64_t several_us = cold_start(several, several_hci_us);
+	CHECK(several.commands_max_outstanding > 1);
+	// The same commands in the same order, only sooner
+	CHECK_EQ(several.commands.size(), one.commands.size());
+	for (size_t i = 0; i < one.commands.size() && i < several.commands.size(); i++) {
+		CHECK_EQ(several.commands[i].opcode, one.commands[i].opcode);
+	}
+	CHECK(several_us < one_us);
+	CHECK(several_hci_us < one_hci_us * 3 / 4);
+
+	printf("cold start to scan: %llu us (HCI %llu us) with 1 credit, %llu us (HCI %llu us) with %u\n",
+		(unsigned long long)one_us, (unsigned long long)one_hci_us,
+		(unsigned long long)several_us, (unsigned long long)several_hci_us, several.command_credits);
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,152 @@
+/* Bluetooth bring-up and connections through the simulated dongle: the HCI
+ * init sequence, then a DS4, a keyboard, a Switch Pro Controller and a
+ * generic gamepad connecting and sending reports, and a new keyboard found
+ * by inquiry and paired with a PIN.
+ */
+
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+JoystickController joystick1(myusb);
+JoystickController joystick2(myusb);
+JoystickController joystick3(myusb);
+KeyboardController keyboard1(myusb);
+
+static const uint8_t ds4_addr[6] = {0x01, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t keyboard_addr[6] = {0x02, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t switch_addr[6] = {0x03, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t gamepad_addr[6] = {0x04, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t new_keyboard_addr[6] = {0x05, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+static sim::HCIController dongle;
+static sim::DS4Peer ds4(ds4_addr);
+static sim::KeyboardPeer keyboard_peer(keyboard_addr);
+static sim::SwitchProPeer switch_pro(switch_addr);
+static sim::GamepadPeer gamepad(gamepad_addr);
+static sim::KeyboardPeer new_keyboard(new_keyboard_addr);
+
+static void test_init()
+{
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+	static const uint16_t init[] = {0x0C03, 0x1002, 0x1003, 0x0C01, 0x2001, 0x2002, 0x1005,
+		0x0C24, 0x1009, 0x1001, 0x0C1A};
+	size_t n = 0;
+	for (const auto &c : dongle.commands) {
+		if (n < sizeof(init) / sizeof(init[0]) && c.opcode == init[n]) n++;
+	}
+	CHECK_EQ(n, sizeof(init) / sizeof(init[0]));
+	CHECK_EQ(dongle.command_overruns, 0);
+	sim::run_us(100000);
+}
+
+static void test_ds4()
+{
+	dongle.add_peer(&ds4);
+	CHECK(dongle.connect_in(&ds4));
+	CHECK(sim::run_until([]() { return ds4.extended_reports && ds4.interrupt_open(); }, 2000000));
+	ds4.stream(50, 1250);
+	sim::run_us(100000);
+	CHECK_EQ(ds4.reports_sent, 50);
+	JoystickController *joy = joystick_for({&joystick1, &joystick2, &joystick3}, JoystickController::PS4);
+	CHECK(joy != nullptr);
+	if (!joy) return;
+	CHECK(joy->available());
+	// report 49: LX 49, LY 0xff - 49
+	CHECK_EQ(joy->getAxis(0), 49);
+	CHECK_EQ(joy->getAxis(1), 0xff - 49);
+	joy->joystickDataClear();
+}
+
+static void test_keyboard()
+{
+	keyboard1.attachPress(OnPress);
+	dongle.add_peer(&keyboard_peer);
+	CHECK(dongle.connect_in(&keyboard_peer));
+	CHECK(sim::run_until([]() { return keyboard1 && keyboard_peer.interrupt_open()
+		&& keyboard_peer.sdp_requests > 0; }, 2000000));
+	sim::run_us(50000);
+	keyboard_peer.stream(10, 10000);
+	sim::run_us(200000);
+	CHECK(typed == "hello");
+}
+
+static void test_switch()
+{
+	dongle.add_peer(&switch_pro);
+	CHECK(dongle.connect_in(&switch_pro));
+	CHECK(sim::run_until([]() { return switch_pro.report_mode == 0x30; }, 3000000));
+	CHECK(switch_pro.subcommands.size() >= 8);
+	if (!switch_pro.subcommands.empty()) CHECK_EQ(switch_pro.subcommands[0], 0x02);
+	sim::run_us(100000);
+	switch_pro.stream(20, 15000);
+	sim::run_us(400000);
+	CHECK_EQ(switch_pro.reports_sent, 20);
+	JoystickController *joy = joystick_for({&joystick1, &joystick2, &joystick3}, JoystickController::SWITCH);
+	CHECK(joy != nullptr);
+	if (!joy) return;
+	CHECK(joy->available());
+}
+
+static void test_gamepad()
+{
+	gamepad.sdp_chunk = 40;
+	dongle.add_peer(&gamepad);
+	CHECK(dongle.connect_in(&gamepad));
+	CHECK(sim::run_until([]() { return gamepad.interrupt_open() && gamepad.sdp_requests > 0; }, 3000000));
+	sim::run_us(50000);
+	gamepad.stream(30, 5000);
+	sim::run_us(300000);
+	JoystickController *joy = joystick_for({&joystick1, &joystick2, &joystick3}, JoystickController::UNKNOWN);
+	CHECK(joy != nullptr);
+	if (!joy) return;
+	CHECK(joy->available());
+	CHECK_EQ(joy->getAxis(0), 29);
+	CHECK_EQ(joy->getAxis(1), 0xff - 29);
+	// more than one SDP response: the descriptor was sent with continuation
+	CHECK(gamepad.sdp_requests > 1);
+}
+
+static void test_pairing()
+{
+	// Make room for the keyboard driver, the old keyboard stays out of range.
+	dongle.disconnect(&keyboard_peer);
+	keyboard_peer.discoverable = false;
+	sim::run_us(100000);
+
+	// A device being paired waits for the host to open its channels
+	new_keyboard.opens_control = false;
+	new_keyboard.opens_interrupt = false;
+	dongle.add_peer(&new_keyboard);
+	CHECK(bluet.startDevicePairing("0000"));
+	CHECK(sim::run_until([]() { return new_keyboard.interrupt_open(); }, 15000000));
+	CHECK(dongle.count(0x0401) > 0);    // Inquiry
+	CHECK(dongle.count(0x0405) > 0);    // Create_Connection
+	const sim::HCIController::command_t *pin = dongle.last(0x040D);
+	CHECK(pin != nullptr);
+	if (pin) CHECK(pin->params.size() >= 11 && memcmp(&pin->params[7], "0000", 4) == 0);
+	sim::run_us(200000);
+
+	size_t pressed = typed.size();
+	new_keyboard.stream(2, 10000);
+	sim::run_us(100000);
+	CHECK(typed.substr(pressed) == "h");
+}
+
+int main()
+{
+	test_init();
+	test_ds4();
+	test_keyboard();
+	test_switch();
+	test_gamepad();
+	test_pairing();
+	CHECK_EQ(dongle.acl_overruns, 0);
+	CHECK_EQ(dongle.command_overruns, 0);
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,161 @@
+/* Inquiry result flood: while pairing, the dongle reports every device in
+ * range over and over, with RSSI, and more devices than the host's
+ * inquiry table holds.  Each peripheral is offered to the pairing callback
+ * once, the one accepted gets one name request and one connection, and
+ * the page scan mode and clock offset from its inquiry result are used
+ * for both.
+ */
+
+#include <map>
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+KeyboardController keyboard1(myusb);
+
+#define PHONES 3
+#define INJECTED_PHONES 12
+
+static const uint8_t gamepad_addr[6] = {0xE4, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t keyboard_addr[6] = {0xE5, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+static sim::HCIController dongle;
+static std::vector<sim::Peer *> phones;
+static sim::GamepadPeer gamepad(gamepad_addr);
+static sim::KeyboardPeer keyboard_peer(keyboard_addr);
+
+// Inquiry Result with RSSI for several devices, each field an array
+static std::vector<uint8_t> inquiry_results(const std::vector<std::vector<uint8_t>> &addrs,
+	uint32_t class_of_device, uint16_t clock_offset)
+{
+	std::vector<uint8_t> ev = {(uint8_t)addrs.size()};
+	for (const std::vector<uint8_t> &addr : addrs) ev.insert(ev.end(), addr.begin(), addr.end());
+	for (size_t i = 0; i < addrs.size(); i++) ev.push_back(1);         // page scan repetition mode
+	for (size_t i = 0; i < addrs.size(); i++) ev.push_back(0);         // reserved
+	for (size_t i = 0; i < addrs.size(); i++) {
+		uint32_t cod = class_of_device + i;
+		ev.insert(ev.end(), {(uint8_t)cod, (uint8_t)(cod >> 8), (uint8_t)(cod >> 16)});
+	}
+	for (size_t i = 0; i < addrs.size(); i++) {
+		ev.insert(ev.end(), {(uint8_t)(clock_offset + i), (uint8_t)((clock_offset + i) >> 8)});
+	}
+	for (size_t i = 0; i < addrs.size(); i++) ev.push_back((uint8_t)(-70 + i));   // RSSI
+	return ev;
+}
+
+static std::vector<uint8_t> addr_for(uint8_t a0)
+{
+	return {a0, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+}
+
+// Offered devices and their class; only the keyboard is taken
+class PairingCB : public BluetoothPairingCB {
+public:
+	bool useInquireResult(uint8_t bdaddr[6], uint32_t bluetooth_class, const uint8_t *name) {
+		offered[bdaddr[0]]++;
+		class_of_device[bdaddr[0]] = bluetooth_class;
+		return memcmp(bdaddr, keyboard_addr, 6) == 0;
+	}
+	std::map<uint8_t, uint32_t> offered;
+	std::map<uint8_t, uint32_t> class_of_device;
+};
+static PairingCB pairing_cb;
+
+// Commands sent for this device, by the bdaddr at the start of their parameters
+static int commands_for(uint16_t opcode, const uint8_t *bdaddr)
+{
+	int n = 0;
+	for (const sim::HCIController::command_t &c : dongle.commands) {
+		if (c.opcode == opcode && c.params.size() >= 6 && memcmp(c.params.data(), bdaddr, 6) == 0) n++;
+	}
+	return n;
+}
+
+int main()
+{
+	for (uint8_t i = 0; i < PHONES; i++) {
+		const uint8_t addr[6] = {(uint8_t)(0xE1 + i), 0x00, 0x00, 0xA0, 0x1D, 0x00};
+		phones.push_back(new sim::Peer(addr, 0x5A020C, "Phone"));
+		dongle.add_peer(phones.back());
+	}
+	dongle.add_peer(&gamepad);
+	keyboard_peer.discoverable = false;
+	keyboard_peer.opens_control = false;
+	keyboard_peer.opens_interrupt = false;
+	dongle.add_peer(&keyboard_peer);
+	dongle.inquiry_result_us = 500;
+	dongle.inquiry_result_repeats = 1000;
+	bluet.setBluetoothPairingCB(&pairing_cb);
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+
+	CHECK(bluet.startDevicePairing("0000"));
+	CHECK(sim::run_until([]() { return dongle.inquiring(); }, 1000000));
+	sim::run_us(20000);
+
+	// Two devices in one result, the fields of each at their own stride
+	dongle.send_event(0x22, inquiry_results({addr_for(0xF0), addr_for(0xF1)}, 0x002508, 0x0100));
+	sim::run_us(20000);
+	CHECK_EQ(pairing_cb.offered[0xF0], 1);
+	CHECK_EQ(pairing_cb.offered[0xF1], 1);
+	CHECK_EQ(pairing_cb.class_of_device[0xF0], 0x002508);
+	CHECK_EQ(pairing_cb.class_of_device[0xF1], 0x002509);
+
+	// More devices than the table holds: the two seen least recently make
+	// room and are new again when they come back
+	std::vector<std::vector<uint8_t>> injected;
+	for (uint8_t i = 0; i < INJECTED_PHONES; i++) injected.push_back(addr_for(0xF2 + i));
+	dongle.send_event(0x22, inquiry_results(injected, 0x5A020C, 0x0200));
+	sim::run_us(20000);
+	dongle.send_event(0x22, inquiry_results({addr_for(0xF0), addr_for(0xF1)}, 0x002508, 0x0100));
+	sim::run_us(200000);
+	CHECK_EQ(pairing_cb.offered[0xF0], 2);
+	CHECK_EQ(pairing_cb.offered[0xF1], 2);
+
+	// The gamepad has been reported hundreds of times and offered once,
+	// the phones are not peripherals and never offered
+	CHECK_EQ(pairing_cb.offered[gamepad_addr[0]], 1);
+	for (uint8_t i = 0; i < PHONES; i++) CHECK_EQ(pairing_cb.offered[0xE1 + i], 0);
+	CHECK_EQ(dongle.count(0x0419), 0);      // Remote_Name_Request
+	CHECK_EQ(dongle.count(0x0405), 0);      // Create_Connection
+
+	// The keyboard comes in range and more results for it arrive after the
+	// host cancelled the inquiry
+	keyboard_peer.discoverable = true;
+	CHECK(sim::run_until([]() { return pairing_cb.offered[keyboard_addr[0]] > 0; }, 1000000));
+	for (uint32_t i = 0; i < 20; i++) {
+		sim::schedule(i * 300, []() {
+			dongle.send_event(0x22, inquiry_results({addr_for(keyboard_addr[0])}, 0x002540, 0x1234));
+		});
+	}
+	CHECK(sim::run_until([]() { return keyboard_peer.interrupt_open(); }, 15000000));
+	sim::run_us(200000);
+	CHECK_EQ(pairing_cb.offered[keyboard_addr[0]], 1);
+	CHECK_EQ(commands_for(0x0419, keyboard_addr), 1);
+	CHECK_EQ(commands_for(0x0405, keyboard_addr), 1);
+	CHECK_EQ(dongle.count(0x0419), 1);
+	CHECK_EQ(dongle.count(0x0405), 1);
+
+	// Page scan mode R1 and the clock offset reported, marked valid
+	const sim::HCIController::command_t *name = dongle.last(0x0419);
+	CHECK(name && name->params.size() == 10);
+	if (name) {
+		CHECK_EQ(name->params[6], 1);
+		CHECK_EQ(name->params[8] + (name->params[9] << 8), 0x9234);
+	}
+	const sim::HCIController::command_t *create = dongle.last(0x0405);
+	CHECK(create && create->params.size() == 13);
+	if (create) {
+		CHECK_EQ(create->params[8], 1);
+		CHECK_EQ(create->params[10] + (create->params[11] << 8), 0x9234);
+	}
+	CHECK(keyboard1);
+	CHECK_EQ(dongle.command_overruns, 0);
+
+	for (sim::Peer *phone : phones) delete phone;
+	return TEST_MAIN_RESULT();
+}
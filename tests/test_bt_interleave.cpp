@@ -0,0 +1,95 @@
+/* ACL demultiplexing: a DS4, a Switch Pro Controller, a keyboard and a
+ * generic gamepad stream at once, their fragments interleaved, on handles
+ * that differ only in their high bits.  Each device's reports must reach
+ * its own driver, and a packet on a handle with no connection none.
+ */
+
+#include <random>
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+JoystickController joystick1(myusb);
+JoystickController joystick2(myusb);
+JoystickController joystick3(myusb);
+KeyboardController keyboard1(myusb);
+
+static const uint8_t ds4_addr[6] = {0x61, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t switch_addr[6] = {0x62, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t keyboard_addr[6] = {0x63, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t gamepad_addr[6] = {0x64, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+static sim::HCIController dongle;
+static sim::DS4Peer ds4(ds4_addr);
+static sim::SwitchProPeer switch_pro(switch_addr);
+static sim::KeyboardPeer keyboard_peer(keyboard_addr);
+static sim::GamepadPeer gamepad(gamepad_addr);
+
+static std::mt19937 rng(90);
+int main()
+{
+	keyboard_peer.typing.clear();
+	for (uint8_t usage = 0x04; usage <= 0x1D; usage++) keyboard_peer.typing.push_back(usage);
+	gamepad.sdp_chunk = 40;
+	// 0x040, 0x140, 0x240, 0x340: the same low byte, the same table slot
+	dongle.handle_step = 0x100;
+	dongle.fragment_size = []() -> uint16_t { return 1 + rng() % 24; };
+	for (sim::HIDPeer *peer : std::initializer_list<sim::HIDPeer *>{&ds4, &switch_pro, &keyboard_peer, &gamepad}) {
+		dongle.add_peer(peer);
+	}
+	keyboard1.attachPress(OnPress);
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+
+	connect(dongle, ds4, []() { return ds4.extended_reports && ds4.interrupt_open(); });
+	connect(dongle, switch_pro, []() { return switch_pro.report_mode == 0x30; });
+	connect(dongle, keyboard_peer, []() { return keyboard_peer.interrupt_open(); });
+	connect(dongle, gamepad, []() { return gamepad.interrupt_open() && gamepad.sdp_requests > 1; });
+	CHECK_EQ(gamepad.handle, 0x340);
+
+	bluet.resetStatistics();
+	ds4.stream(400, 1250);
+	switch_pro.stream(33, 15000);
+	keyboard_peer.stream(52, 9000);
+	gamepad.stream(250, 2000);
+	sim::run_us(600000);
+
+	BluetoothStatistics_t stats;
+	bluet.getStatistics(stats);
+	CHECK_EQ(stats.acl_packets, 400 + 33 + 52 + 250);
+	CHECK(typed == "abcdefghijklmnopqrstuvwxyz");
+
+	JoystickController *ds4_joy = joystick_for({&joystick1, &joystick2, &joystick3}, JoystickController::PS4);
+	JoystickController *switch_joy = joystick_for({&joystick1, &joystick2, &joystick3}, JoystickController::SWITCH);
+	JoystickController *gamepad_joy = joystick_for({&joystick1, &joystick2, &joystick3}, JoystickController::UNKNOWN);
+	CHECK(ds4_joy && switch_joy && gamepad_joy);
+	if (!ds4_joy || !switch_joy || !gamepad_joy) return TEST_MAIN_RESULT();
+	uint8_t lx = (ds4.reports_sent - 1) & 0xff;
+	CHECK_EQ(ds4_joy->getAxis(0), lx);
+	CHECK_EQ(ds4_joy->getAxis(1), 0xff - lx);
+	uint8_t x = (gamepad.reports_sent - 1) & 0xff;
+	CHECK_EQ(gamepad_joy->getAxis(0), x);
+	CHECK_EQ(gamepad_joy->getAxis(1), 0xff - x);
+	CHECK_EQ(switch_joy->getAxis(8), (uint8_t)(switch_pro.reports_sent - 1));
+
+	// A report on 0x440, a handle with no connection, is dropped and not
+	// handed to the gamepad's connection that took the last packet
+	gamepad.send_report(gamepad.report(gamepad.reports_sent));
+	sim::run_us(10000);
+	uint8_t last = gamepad_joy->getAxis(0);
+	bluet.resetStatistics();
+	uint16_t handle = gamepad.handle;
+	gamepad.handle = 0x440;
+	gamepad.send_report(gamepad.report(last + 1));
+	sim::run_us(10000);
+	gamepad.handle = handle;
+	bluet.getStatistics(stats);
+	CHECK_EQ(stats.rx_acl_dropped, 1);
+	CHECK_EQ(stats.acl_packets, 0);
+	CHECK_EQ(gamepad_joy->getAxis(0), last);
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,120 @@
+/* L2CAP channel setup is paced by the connection's step timer rather than
+ * delay(1) in the USB interrupt: the signaling the host sends keeps its
+ * order and spacing, and nothing delays in the interrupt while a device
+ * connects.
+ */
+
+#include <string>
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+JoystickController joystick1(myusb);
+JoystickController joystick2(myusb);
+KeyboardController keyboard1(myusb);
+
+static const uint8_t ds4_addr[6] = {0x21, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t switch_addr[6] = {0x22, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t keyboard_addr[6] = {0x23, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+static sim::HCIController dongle;
+static sim::DS4Peer ds4(ds4_addr);
+static sim::SwitchProPeer switch_pro(switch_addr);
+static sim::KeyboardPeer keyboard_peer(keyboard_addr);
+
+typedef struct {
+	uint64_t us;
+	std::string what;   // code, and the result for connection responses
+} signal_t;
+
+// The L2CAP signaling commands the host sent on a link, from index first
+static std::vector<signal_t> host_signaling(uint16_t handle, size_t first = 0)
+{
+	std::vector<signal_t> s;
+	for (size_t i = first; i < dongle.acl_from_host.size(); i++) {
+		const sim::HCIController::acl_t &a = dongle.acl_from_host[i];
+		if (a.handle != handle || a.data.size() < 8 || sim::get16(&a.data[2]) != 0x0001) continue;
+		char buf[16];
+		uint8_t code = a.data[4];
+		if (code == 0x03 && a.data.size() >= 16) snprintf(buf, sizeof(buf), "%02X/%u", code, sim::get16(&a.data[12]));
+		else snprintf(buf, sizeof(buf), "%02X", code);
+		s.push_back(signal_t{a.us, buf});
+	}
+	return s;
+}
+
+static std::string joined(const std::vector<signal_t> &s)
+{
+	std::string r;
+	for (const signal_t &x : s) r += (r.empty() ? "" : " ") + x.what;
+	return r;
+}
+
+static void test_device_opens_channels()
+{
+	// The DS4 opens both channels: the host answers pending, then success,
+	// then sends its configuration, for each.
+	size_t first = dongle.acl_from_host.size();
+	sim::reset_counters();
+	CHECK(dongle.connect_in(&ds4));
+	CHECK(sim::run_until([]() { return ds4.extended_reports && ds4.interrupt_open(); }, 2000000));
+	sim::run_us(100000);
+	CHECK_EQ(sim::counters.isr_delay_calls, 0);
+	CHECK_EQ(sim::counters.isr_delay_us, 0);
+
+	std::vector<signal_t> s = host_signaling(ds4.handle, first);
+	CHECK(joined(s) == "03/1 03/0 04 05 03/1 03/0 04 05");
+	if (s.size() < 8) return;
+	// Each step one L2CAP_STEP_DELAY_US after the last, as with delay(1)
+	for (size_t i : {1, 2, 5, 6}) {
+		CHECK(s[i].us - s[i - 1].us >= 1000);
+		CHECK(s[i].us - s[i - 1].us < 2000);
+	}
+}
+
+static void test_host_opens_channels()
+{
+	// The Switch opens nothing: the host's connection timer opens the
+	// control channel, its config response the interrupt channel, and that
+	// one's SDP.
+	size_t first = dongle.acl_from_host.size();
+	sim::reset_counters();
+	CHECK(dongle.connect_in(&switch_pro));
+	CHECK(sim::run_until([]() { return switch_pro.report_mode == 0x30; }, 3000000));
+	sim::run_us(100000);
+	CHECK_EQ(sim::counters.isr_delay_calls, 0);
+
+	CHECK(joined(host_signaling(switch_pro.handle, first)) == "02 04 05 02 04 05 02 04 05");
+	// The Switch driver runs its init sequence from the connection timer,
+	// which the L2CAP steps no longer share.
+	CHECK(switch_pro.subcommands.size() >= 8);
+}
+
+static void test_keyboard()
+{
+	// SET_PROTOCOL on the control channel, then the interrupt channel
+	sim::reset_counters();
+	CHECK(dongle.connect_in(&keyboard_peer));
+	CHECK(sim::run_until([]() { return keyboard_peer.interrupt_open() && !keyboard_peer.transactions.empty(); }, 2000000));
+	sim::run_us(100000);
+	CHECK_EQ(sim::counters.isr_delay_calls, 0);
+	CHECK(!keyboard_peer.transactions.empty() && (keyboard_peer.transactions[0][0] & 0xF0) == 0x70);
+}
+
+int main()
+{
+	dongle.add_peer(&ds4);
+	dongle.add_peer(&switch_pro);
+	dongle.add_peer(&keyboard_peer);
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+
+	test_device_opens_channels();
+	test_host_opens_channels();
+	test_keyboard();
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,242 @@
+/* HID over GATT through the simulated dongle and scripted BLE devices: a
+ * gamepad found by an LE scan is connected at a 7.5ms interval, its HID
+ * service discovered over ATT with the default 23 byte MTU and its reports
+ * streamed as notifications to the joystick driver.  A keyboard with a
+ * larger MTU sends its reports as indications.  The devices' own requests
+ * are answered: connection parameters within what the host asked for are
+ * applied, pairing and ATT requests are refused.  A reconnect takes the
+ * report map from the cache.  Devices that want encryption fail without
+ * getting their reports turned on or keeping a descriptor buffer.
+ */
+
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+JoystickController joystick1(myusb);
+KeyboardController keyboard1(myusb);
+
+// Random static addresses
+static const uint8_t gamepad_addr[6] = {0xB1, 0x00, 0x00, 0xA0, 0x1D, 0xC1};
+static const uint8_t keyboard_addr[6] = {0xB2, 0x00, 0x00, 0xA0, 0x1D, 0xC1};
+static const uint8_t locked_addr[2][6] = {
+	{0xB3, 0x00, 0x00, 0xA0, 0x1D, 0xC1},
+	{0xB4, 0x00, 0x00, 0xA0, 0x1D, 0xC1}};
+
+static sim::HCIController dongle;
+static sim::LEGamepadPeer gamepad(gamepad_addr);
+static sim::LEKeyboardPeer keyboard_peer(keyboard_addr);
+static sim::LEGamepadPeer locked0(locked_addr[0], "Locked Gamepad");
+static sim::LEGamepadPeer locked1(locked_addr[1], "Locked Gamepad");
+
+// ATT PDUs the host sent with this opcode
+static std::vector<std::vector<uint8_t>> att_sent(const sim::GATTPeer &peer, uint8_t opcode)
+{
+	std::vector<std::vector<uint8_t>> found;
+	for (const std::vector<uint8_t> &pdu : peer.att_from_host) {
+		if (!pdu.empty() && pdu[0] == opcode) found.push_back(pdu);
+	}
+	return found;
+}
+
+static void test_scan()
+{
+	// Found by the HID service in its advertising
+	bluet.setLEAdvertisingUUIDFilter(0x1812);
+	bluet.setLEScanParameters(0, 0x10, 0x10, 0, 0);
+	bluet.setLEScanEnable(1, 0);
+	BLEAdvertisingReport_t report;
+	bool found = false;
+	CHECK(sim::run_until([&]() {
+		while (bluet.readLEAdvertisingReport(report)) {
+			if (memcmp(report.bdaddr, gamepad_addr, 6) == 0) found = true;
+		}
+		return found;
+	}, 1000000));
+	CHECK_EQ(report.address_type, 1);
+}
+
+static void test_gamepad()
+{
+	uint64_t start_us = sim::now_us;
+	connect(bluet, gamepad, []() { return gamepad.reports_enabled(); });
+	CHECK(!dongle.le_scanning);
+	const sim::HCIController::command_t *create = dongle.last(0x200D);
+	CHECK(create && create->params.size() == 25);
+	if (create) {
+		CHECK_EQ(create->params[5], 1);
+		CHECK(memcmp(&create->params[6], gamepad_addr, 6) == 0);
+		CHECK_EQ(create->params[13] + (create->params[14] << 8), 6);    // 7.5ms
+		CHECK_EQ(create->params[15] + (create->params[16] << 8), 12);
+	}
+
+	// MTU first, then the HID service and its characteristics; the report
+	// map takes a Read and then Read Blobs of 22 bytes
+	CHECK_EQ(gamepad.host_mtu, 64);
+	CHECK(!gamepad.att_from_host.empty() && gamepad.att_from_host[0][0] == 0x02);
+	std::vector<std::vector<uint8_t>> find_service = att_sent(gamepad, 0x06);
+	CHECK_EQ(find_service.size(), 1);
+	if (!find_service.empty()) CHECK(find_service[0] == std::vector<uint8_t>({0x06, 0x01, 0x00, 0xFF, 0xFF, 0x00, 0x28, 0x12, 0x18}));
+	CHECK_EQ(att_sent(gamepad, 0x0C).size() + 1, (gamepad.descriptor.size() + 21) / 22);
+	CHECK_EQ(gamepad.report_map_reads, att_sent(gamepad, 0x0C).size() + 1);
+
+	// Only the input report is turned on, not the battery level after the
+	// HID service
+	std::vector<std::vector<uint8_t>> writes = att_sent(gamepad, 0x12);
+	CHECK_EQ(writes.size(), 1);
+	if (!writes.empty()) {
+		CHECK_EQ(writes[0][1] + (writes[0][2] << 8), gamepad.reports[0].cccd_handle);
+		CHECK_EQ(writes[0][3], 0x01);   // notifications
+	}
+	BluetoothStatistics_t stats;
+	bluet.getStatistics(stats);
+	uint32_t connect_us = stats.connect_us;
+	CHECK(connect_us > 0 && connect_us < sim::now_us - start_us);
+
+	bluet.resetStatistics();
+	gamepad.stream(200, 7500);
+	sim::run_us(200 * 7500 + 50000);
+	bluet.getStatistics(stats);
+	CHECK(joystick1);
+	CHECK_EQ(stats.acl_packets, 200);
+	CHECK_EQ(joystick1.getAxis(0), (gamepad.reports_sent - 1) & 0xff);
+	CHECK_EQ(joystick1.getAxis(1), 0xff - ((gamepad.reports_sent - 1) & 0xff));
+	printf("gamepad: connected and reports on in %u us, %u ATT requests, %u report map reads\n",
+		connect_us, (unsigned)gamepad.att_from_host.size(), gamepad.report_map_reads);
+}
+
+static void test_device_requests()
+{
+	BluetoothConnection *connection = joystick1.bluetoothConnection();
+	CHECK(connection && connection->LEConnection());
+	if (!connection) return;
+	CHECK_EQ(connection->LEConnectionInterval(), 12);
+
+	// Longer intervals are accepted up to the 15ms the host asked for
+	int updates = dongle.count(0x2013);
+	gamepad.request_connection_parameters(9, 24, 0, 300);
+	CHECK(sim::run_until([]() { return !gamepad.signaling.empty(); }, 100000));
+	CHECK(gamepad.signaling.back() == std::vector<uint8_t>({0x13, 1, 2, 0, 0, 0}));
+	CHECK(sim::run_until([updates]() { return dongle.count(0x2013) > updates; }, 100000));
+	const sim::HCIController::command_t *update = dongle.last(0x2013);
+	CHECK(update && update->params.size() == 14);
+	if (update) {
+		CHECK_EQ(update->params[0] + (update->params[1] << 8), gamepad.handle);
+		CHECK_EQ(update->params[2] + (update->params[3] << 8), 9);
+		CHECK_EQ(update->params[4] + (update->params[5] << 8), 12);
+		CHECK_EQ(update->params[8] + (update->params[9] << 8), 300);
+	}
+	sim::run_us(20000);
+	CHECK_EQ(connection->LEConnectionInterval(), 12);
+
+	// ... and refused beyond that
+	updates = dongle.count(0x2013);
+	gamepad.request_connection_parameters(80, 100, 4, 600);
+	CHECK(sim::run_until([]() { return gamepad.signaling.size() == 2; }, 100000));
+	CHECK(gamepad.signaling.back() == std::vector<uint8_t>({0x13, 2, 2, 0, 1, 0}));
+	sim::run_us(20000);
+	CHECK_EQ(dongle.count(0x2013), updates);
+
+	// No LE pairing, and nothing in the host's GATT server
+	gamepad.request_pairing();
+	CHECK(sim::run_until([]() { return !gamepad.smp.empty(); }, 100000));
+	CHECK(gamepad.smp.back() == std::vector<uint8_t>({0x05, 0x05}));
+	gamepad.send_att({0x0A, 0x03, 0x00});
+	CHECK(sim::run_until([]() { return gamepad.att_from_host.back()[0] == 0x01; }, 100000));
+	CHECK(gamepad.att_from_host.back() == std::vector<uint8_t>({0x01, 0x0A, 0x03, 0x00, 0x06}));
+
+	// Reports keep coming after all that
+	uint32_t sent = gamepad.reports_sent;
+	gamepad.stream(10, 15000);
+	sim::run_us(200000);
+	CHECK_EQ(gamepad.reports_sent, sent + 10);
+	CHECK_EQ(joystick1.getAxis(0), (gamepad.reports_sent - 1) & 0xff);
+}
+
+static void test_keyboard()
+{
+	keyboard_peer.indications = true;
+	keyboard_peer.mtu = 100;
+	keyboard1.attachPress(OnPress);
+	connect(bluet, keyboard_peer, []() { return keyboard_peer.reports_enabled(); });
+	CHECK_EQ(keyboard_peer.host_mtu, 64);
+	std::vector<std::vector<uint8_t>> writes = att_sent(keyboard_peer, 0x12);
+	CHECK_EQ(writes.size(), 1);
+	if (!writes.empty()) CHECK_EQ(writes[0][3], 0x02);  // indications
+	// 63 bytes at a time with the 64 byte MTU
+	CHECK_EQ(keyboard_peer.report_map_reads, (keyboard_peer.descriptor.size() + 62) / 63);
+
+	// Both devices at once, the gamepad's notifications between the
+	// keyboard's indications
+	keyboard_peer.stream(10, 20000);
+	gamepad.stream(30, 7500);
+	sim::run_us(300000);
+	CHECK(typed == "hello");
+	CHECK_EQ(keyboard_peer.confirmations, keyboard_peer.reports_sent);
+	CHECK_EQ(joystick1.getAxis(0), (gamepad.reports_sent - 1) & 0xff);
+}
+
+static void test_reconnect()
+{
+	dongle.disconnect(&gamepad);
+	sim::run_us(100000);
+	CHECK(!joystick1);
+	uint32_t reads = gamepad.report_map_reads;
+	connect(bluet, gamepad, []() { return gamepad.reports_enabled(); });
+	CHECK_EQ(gamepad.report_map_reads, reads);
+	gamepad.stream(20, 7500);
+	sim::run_us(200000);
+	CHECK(joystick1);
+	CHECK_EQ(joystick1.getAxis(0), (gamepad.reports_sent - 1) & 0xff);
+	dongle.disconnect(&gamepad);
+	sim::run_us(100000);
+}
+
+static void test_encrypted()
+{
+	// Insufficient Authentication reading the report map: nothing turned on
+	for (sim::LEGamepadPeer *locked : {&locked0, &locked1}) {
+		locked->report_map_error = 0x05;
+		CHECK(bluet.connectLE(locked->bdaddr, locked->address_type));
+		CHECK(sim::run_until([locked]() { return locked->report_map_reads > 0; }, 2000000));
+		sim::run_us(200000);
+		CHECK_EQ(locked->report_map_reads, 1);
+		CHECK(att_sent(*locked, 0x12).empty());
+	}
+	CHECK(!joystick1);
+
+	// They stay connected, but have given their descriptor buffers back
+	connect(bluet, gamepad, []() { return gamepad.reports_enabled(); });
+	gamepad.stream(5, 7500);
+	sim::run_us(100000);
+	CHECK(joystick1);
+	CHECK_EQ(joystick1.getAxis(0), (gamepad.reports_sent - 1) & 0xff);
+}
+
+int main()
+{
+	// LE links with their own, smaller, buffers
+	dongle.le_acl_mtu = 27;
+	dongle.le_acl_buffers = 3;
+	dongle.add_peer(&gamepad);
+	dongle.add_peer(&keyboard_peer);
+	dongle.add_peer(&locked0);
+	dongle.add_peer(&locked1);
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+
+	test_scan();
+	test_gamepad();
+	test_device_requests();
+	test_keyboard();
+	test_reconnect();
+	test_encrypted();
+	CHECK_EQ(dongle.acl_overruns, 0);
+	CHECK_EQ(dongle.acl_oversize, 0);
+	CHECK_EQ(dongle.command_overruns, 0);
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,171 @@
+/* Link key store: keys kept in EEPROM or in a file are read once, Link Key
+ * Requests are answered from RAM after that, and a Link Key Notification
+ * only goes to storage when the key is new or has changed.  A file with
+ * more keys than the cache holds is still searched for the rest.
+ */
+
+#include <EEPROM.h>
+#include <USBHost_t36.h>
+#include "sim_fs.h"
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+JoystickController joystick1(myusb);
+
+#define STORED_KEYS 20  // in the file, more than LINK_KEY_CACHE_SIZE
+
+static const uint8_t gamepad_addr[6] = {0x80, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+static sim::HCIController dongle;
+static sim::GamepadPeer gamepad(gamepad_addr);
+static sim::RamFS ramfs;
+
+static std::vector<uint8_t> key_for(const uint8_t bdaddr[6], uint8_t version = 0)
+{
+	std::vector<uint8_t> key;
+	for (uint8_t i = 0; i < 16; i++) key.push_back(bdaddr[0] + i * 7 + version);
+	return key;
+}
+
+static void store_record(std::vector<uint8_t> &records, const uint8_t bdaddr[6])
+{
+	std::vector<uint8_t> key = key_for(bdaddr);
+	records.insert(records.end(), bdaddr, bdaddr + 6);
+	records.insert(records.end(), key.begin(), key.end());
+}
+
+// The device asks for authentication, as one that was paired before does
+// when it comes back: the host answers from the store.  Returns the key
+// sent, empty for a negative reply.
+static std::vector<uint8_t> link_key_request(const uint8_t bdaddr[6])
+{
+	int replies = dongle.count(0x040B), negative = dongle.count(0x040C);
+	dongle.send_event(0x17, std::vector<uint8_t>(bdaddr, bdaddr + 6));
+	CHECK(sim::run_until([&]() {
+		return dongle.count(0x040B) + dongle.count(0x040C) == replies + negative + 1;
+	}, 100000));
+	if (dongle.count(0x040B) == replies) return std::vector<uint8_t>();
+	const sim::HCIController::command_t *reply = dongle.last(0x040B);
+	CHECK(memcmp(reply->params.data(), bdaddr, 6) == 0);
+	return std::vector<uint8_t>(reply->params.begin() + 6, reply->params.end());
+}
+
+static void link_key_notification(const uint8_t bdaddr[6], const std::vector<uint8_t> &key)
+{
+	std::vector<uint8_t> params(bdaddr, bdaddr + 6);
+	for (uint8_t b : key) params.push_back(b);
+	params.push_back(0);    // combination key
+	dongle.send_event(0x18, params);
+	sim::run_us(10000);
+}
+
+// Three of the five default slots, which end a byte short of the end of
+// the EEPROM, in use
+static uint8_t *slots = &EEPROM.data[E2END - 5 * 22];
+
+static void test_eeprom()
+{
+	uint8_t bdaddr[6] = {0x81, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+	// All five slots read for the first request, none after
+	for (int i = 0; i < 30; i++) {
+		bdaddr[0] = 0x81 + (i % 3);
+		CHECK(link_key_request(bdaddr) == key_for(bdaddr));
+	}
+	CHECK_EQ(EEPROM.read_count, 5 * 22);
+	bdaddr[0] = 0x84;
+	CHECK(link_key_request(bdaddr).empty());
+	CHECK_EQ(EEPROM.read_count, 5 * 22);
+
+	// A new key goes into a free slot and is served from RAM
+	link_key_notification(bdaddr, key_for(bdaddr));
+	CHECK_EQ(EEPROM.write_count, 22);
+	CHECK(memcmp(&slots[3 * 22], bdaddr, 6) == 0);
+	uint32_t reads = EEPROM.read_count;
+	CHECK(link_key_request(bdaddr) == key_for(bdaddr));
+	CHECK_EQ(EEPROM.read_count, reads);
+
+	// The same key again is not written, a changed one is written over
+	link_key_notification(bdaddr, key_for(bdaddr));
+	CHECK_EQ(EEPROM.write_count, 22);
+	link_key_notification(bdaddr, key_for(bdaddr, 1));
+	CHECK_EQ(EEPROM.write_count, 22 + 16);
+	CHECK(memcmp(&slots[3 * 22 + 6], key_for(bdaddr, 1).data(), 16) == 0);
+	reads = EEPROM.read_count;
+	CHECK(link_key_request(bdaddr) == key_for(bdaddr, 1));
+	CHECK_EQ(EEPROM.read_count, reads);
+
+	// Deleted keys are gone from RAM as well
+	bluet.writeLinkKey(bdaddr, nullptr);
+	CHECK(link_key_request(bdaddr).empty());
+	bluet.writeLinkKey(nullptr, nullptr);
+	bdaddr[0] = 0x81;
+	CHECK(link_key_request(bdaddr).empty());
+	CHECK(slots[0] == 0xff);
+	printf("EEPROM: %u reads, %u writes\n", EEPROM.read_count, EEPROM.write_count);
+}
+
+static void test_file()
+{
+	std::vector<uint8_t> records;
+	uint8_t bdaddr[6] = {0x90, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+	for (uint8_t i = 0; i < STORED_KEYS; i++, bdaddr[0]++) store_record(records, bdaddr);
+	ramfs.files["PairingKeys.dat"] = records;
+	bluet.setPairingKeyStorageLocation(&ramfs);
+	ramfs.reset_counters();
+	EEPROM.read_count = 0;
+
+	// The first request loads the file once, the cached keys need no more
+	bdaddr[0] = 0x90;
+	CHECK(link_key_request(bdaddr) == key_for(bdaddr));
+	CHECK_EQ(ramfs.counters.opens, 1);
+	for (int i = 0; i < 100; i++) {
+		bdaddr[0] = 0x90 + (i % 16);
+		CHECK(link_key_request(bdaddr) == key_for(bdaddr));
+	}
+	CHECK_EQ(ramfs.counters.opens, 1);
+	CHECK_EQ(EEPROM.read_count, 0);
+
+	// The ones that did not fit are found in the file
+	for (uint8_t i = 16; i < STORED_KEYS; i++) {
+		bdaddr[0] = 0x90 + i;
+		CHECK(link_key_request(bdaddr) == key_for(bdaddr));
+	}
+	CHECK_EQ(ramfs.counters.opens, 1 + STORED_KEYS - 16);
+
+	// A changed key is written in place
+	ramfs.reset_counters();
+	bdaddr[0] = 0x93;
+	link_key_notification(bdaddr, key_for(bdaddr));
+	CHECK_EQ(ramfs.counters.opens, 0);
+	link_key_notification(bdaddr, key_for(bdaddr, 2));
+	CHECK_EQ(ramfs.counters.opens, 1);
+	CHECK_EQ(ramfs.files["PairingKeys.dat"].size(), STORED_KEYS * 22);
+	CHECK(memcmp(&ramfs.files["PairingKeys.dat"][3 * 22 + 6], key_for(bdaddr, 2).data(), 16) == 0);
+	CHECK(link_key_request(bdaddr) == key_for(bdaddr, 2));
+	CHECK_EQ(ramfs.counters.opens, 1);
+	printf("file: %u opens, %u reads, %u writes\n", ramfs.counters.opens, ramfs.counters.reads, ramfs.counters.writes);
+}
+
+int main()
+{
+	std::vector<uint8_t> records;
+	uint8_t bdaddr[6] = {0x81, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+	for (uint8_t i = 0; i < 3; i++, bdaddr[0]++) store_record(records, bdaddr);
+	memcpy(slots, records.data(), records.size());
+
+	dongle.add_peer(&gamepad);
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+	CHECK(dongle.connect_in(&gamepad));
+	CHECK(sim::run_until([]() { return gamepad.interrupt_open(); }, 2000000));
+	sim::run_us(100000);
+
+	test_eeprom();
+	test_file();
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,160 @@
+/* Link policy, sniff mode and QoS: the commands each BluetoothConnection
+ * call sends, byte for byte, on connection handles with their high bits
+ * set, and the Mode Change and QoS Setup Complete events updating only the
+ * connection they name.  Failed and unknown-handle events change nothing,
+ * and a new connection starts active again.
+ */
+
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+JoystickController joystick1(myusb);
+KeyboardController keyboard1(myusb);
+
+static const uint8_t ds4_addr[6] = {0xD2, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t keyboard_addr[6] = {0xD3, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+static sim::HCIController dongle;
+static sim::DS4Peer ds4(ds4_addr);
+static sim::KeyboardPeer keyboard_peer(keyboard_addr);
+
+// The parameters of the last command with this opcode, after it was sent
+static std::vector<uint8_t> sent(uint16_t opcode)
+{
+	int n = dongle.count(opcode);
+	CHECK(sim::run_until([opcode, n]() { return dongle.count(opcode) > n; }, 100000));
+	const sim::HCIController::command_t *c = dongle.last(opcode);
+	return c ? c->params : std::vector<uint8_t>();
+}
+
+// Each call is checked as soon as it returns, so the commands are awaited
+// in the same order they are queued.
+static std::vector<uint8_t> sent_after(uint16_t opcode, std::function<bool()> call)
+{
+	int n = dongle.count(opcode);
+	CHECK(call());
+	CHECK(sim::run_until([opcode, n]() { return dongle.count(opcode) > n; }, 100000));
+	const sim::HCIController::command_t *c = dongle.last(opcode);
+	return c ? c->params : std::vector<uint8_t>();
+}
+
+static void test_encoding(BluetoothConnection *connection, uint16_t h)
+{
+	uint8_t h0 = h & 0xff, h1 = h >> 8;
+
+	CHECK(sent_after(0x080D, [&]() {
+		return connection->setLinkPolicy(BluetoothConnection::LINK_POLICY_ROLE_SWITCH | BluetoothConnection::LINK_POLICY_SNIFF);
+	}) == std::vector<uint8_t>({h0, h1, 0x05, 0x00}));
+
+	CHECK(sent_after(0x0803, [&]() { return connection->setSniffMode(0x0320, 0x0012, 8, 2); }) ==
+		std::vector<uint8_t>({h0, h1, 0x20, 0x03, 0x12, 0x00, 0x08, 0x00, 0x02, 0x00}));
+
+	CHECK(sent_after(0x0804, [&]() { return connection->exitSniffMode(); }) ==
+		std::vector<uint8_t>({h0, h1}));
+
+	// flags 0, guaranteed, token rate and peak bandwidth don't care, then
+	// latency and delay variation
+	CHECK(sent_after(0x0807, [&]() { return connection->setQoS(0x00012345, 0x000ABCDE, 2); }) ==
+		std::vector<uint8_t>({h0, h1, 0x00, 0x02, 0, 0, 0, 0, 0, 0, 0, 0,
+			0x45, 0x23, 0x01, 0x00, 0xDE, 0xBC, 0x0A, 0x00}));
+	std::vector<uint8_t> qos_default = sent_after(0x0807, [&]() { return connection->setQoS(1250); });
+	CHECK(qos_default.size() == 20 && qos_default[3] == 2 &&
+		memcmp(&qos_default[16], "\xff\xff\xff\xff", 4) == 0);
+
+	CHECK(sent_after(0x0C28, [&]() { return connection->setFlushTimeout(0x0020); }) ==
+		std::vector<uint8_t>({h0, h1, 0x20, 0x00}));
+}
+
+static void test_events(BluetoothConnection *ds4_connection, BluetoothConnection *keyboard_connection, uint16_t h)
+{
+	// The dongle grants what was asked, for the DS4's link only
+	ds4_connection->setSniffMode(0x0012, 0x000A);
+	sent(0x0803);
+	CHECK(sim::run_until([&]() { return ds4_connection->linkMode() == BluetoothConnection::LINK_MODE_SNIFF; }, 100000));
+	CHECK_EQ(ds4_connection->linkModeInterval(), 0x0012);
+	CHECK_EQ(keyboard_connection->linkMode(), BluetoothConnection::LINK_MODE_ACTIVE);
+
+	ds4_connection->setQoS(2500);
+	CHECK(sim::run_until([&]() { return ds4_connection->QoSLatency() == 2500; }, 100000));
+	CHECK_EQ(keyboard_connection->QoSLatency(), 1250);    // from test_encoding
+
+	// Reports still arrive in sniff mode
+	int x = joystick1.getAxis(0);
+	ds4.stream(10, 11250);
+	sim::run_us(150000);
+	CHECK(joystick1.getAxis(0) != x);
+
+	ds4_connection->exitSniffMode();
+	CHECK(sim::run_until([&]() { return ds4_connection->linkMode() == BluetoothConnection::LINK_MODE_ACTIVE; }, 100000));
+	CHECK_EQ(ds4_connection->linkModeInterval(), 0);
+
+	// The device going to sniff on its own, a failed change, and one for a
+	// handle that is not connected
+	dongle.send_event(0x14, {0x00, (uint8_t)h, (uint8_t)(h >> 8), 0x02, 0x40, 0x00});
+	sim::run_us(10000);
+	CHECK_EQ(ds4_connection->linkMode(), BluetoothConnection::LINK_MODE_SNIFF);
+	CHECK_EQ(ds4_connection->linkModeInterval(), 0x0040);
+	dongle.send_event(0x14, {0x0C, (uint8_t)h, (uint8_t)(h >> 8), 0x00, 0x00, 0x00});
+	sim::run_us(10000);
+	CHECK_EQ(ds4_connection->linkMode(), BluetoothConnection::LINK_MODE_SNIFF);
+	dongle.send_event(0x14, {0x00, 0xFE, 0x0E, 0x00, 0x00, 0x00});
+	sim::run_us(10000);
+	CHECK_EQ(ds4_connection->linkMode(), BluetoothConnection::LINK_MODE_SNIFF);
+	CHECK_EQ(keyboard_connection->linkMode(), BluetoothConnection::LINK_MODE_ACTIVE);
+
+	// A QoS the controller could not set keeps the last one granted
+	std::vector<uint8_t> qos = {0x0C, (uint8_t)h, (uint8_t)(h >> 8), 0x00, 0x02};
+	qos.resize(21, 0);
+	qos[13] = 0x10;     // latency 16 us
+	dongle.send_event(0x0D, qos);
+	sim::run_us(10000);
+	CHECK_EQ(ds4_connection->QoSLatency(), 2500);
+}
+
+int main()
+{
+	// 0x040 and 0x140: the high bits are part of the handle sent
+	dongle.handle_step = 0x100;
+	dongle.add_peer(&ds4);
+	dongle.add_peer(&keyboard_peer);
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+
+	// Nothing to send for a connection not in use
+	BluetoothConnection unused;
+	CHECK(!unused.setSniffMode(0x12, 0x0A));
+	CHECK(!unused.exitSniffMode());
+	CHECK(!unused.setQoS(1250));
+	CHECK(!joystick1.bluetoothConnection());
+
+	connect(dongle, ds4, []() { return ds4.extended_reports && ds4.interrupt_open(); });
+	connect(dongle, keyboard_peer, []() { return keyboard_peer.interrupt_open(); });
+	BluetoothConnection *ds4_connection = joystick1.bluetoothConnection();
+	BluetoothConnection *keyboard_connection = keyboard1.bluetoothConnection();
+	CHECK(ds4_connection && keyboard_connection && ds4_connection != keyboard_connection);
+	if (!ds4_connection || !keyboard_connection) return TEST_MAIN_RESULT();
+	CHECK_EQ(keyboard_peer.handle, ds4.handle + 0x100);
+	CHECK_EQ(ds4_connection->linkMode(), BluetoothConnection::LINK_MODE_ACTIVE);
+
+	test_encoding(keyboard_connection, keyboard_peer.handle);
+	test_events(ds4_connection, keyboard_connection, ds4.handle);
+
+	// Back to active and no QoS on the next connection
+	dongle.disconnect(&ds4);
+	sim::run_us(200000);
+	connect(dongle, ds4, []() { return ds4.extended_reports && ds4.interrupt_open(); });
+	ds4_connection = joystick1.bluetoothConnection();
+	CHECK(ds4_connection);
+	if (ds4_connection) {
+		CHECK_EQ(ds4_connection->linkMode(), BluetoothConnection::LINK_MODE_ACTIVE);
+		CHECK_EQ(ds4_connection->linkModeInterval(), 0);
+		CHECK_EQ(ds4_connection->QoSLatency(), 0);
+	}
+	CHECK_EQ(dongle.command_overruns, 0);
+	return TEST_MAIN_RESULT();
+}
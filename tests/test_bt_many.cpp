@@ -0,0 +1,77 @@
+/* More devices than DEFAULT_CONNECTIONS: the sketch adds two connections to
+ * the pool, then six gamepads that are set up from their report
+ * descriptors page the host at once, more of them than there are
+ * descriptor buffers, and all stream together.
+ */
+
+#include <algorithm>
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+#define DEVICES 6
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+BluetoothConnection more_connections[DEVICES - BluetoothController::DEFAULT_CONNECTIONS];
+JoystickController joysticks[DEVICES] = {
+	JoystickController(myusb), JoystickController(myusb), JoystickController(myusb),
+	JoystickController(myusb), JoystickController(myusb), JoystickController(myusb)};
+
+static sim::HCIController dongle;
+static std::vector<sim::GamepadPeer *> gamepads;
+
+int main()
+{
+	for (uint8_t i = 0; i < DEVICES; i++) {
+		const uint8_t addr[6] = {(uint8_t)(0x71 + i), 0x00, 0x00, 0xA0, 0x1D, 0x00};
+		gamepads.push_back(new sim::GamepadPeer(addr));
+		gamepads.back()->sdp_chunk = 40;
+		dongle.add_peer(gamepads.back());
+	}
+	dongle.fragment_size = []() -> uint16_t { return 17; };
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+
+	// A millisecond apart, each one's setup overlapping the others'
+	for (sim::GamepadPeer *g : gamepads) {
+		CHECK(dongle.connect_in(g));
+		sim::run_us(1000);
+	}
+	CHECK(sim::run_until([]() {
+		return std::all_of(gamepads.begin(), gamepads.end(), [](sim::GamepadPeer *g) {
+			return g->interrupt_open() && g->sdp_requests > 1; });
+	}, 5000000));
+	sim::run_us(200000);
+
+	// Each streams a different number of reports, so each ends on its own X
+	bluet.resetStatistics();
+	uint32_t total = 0;
+	std::vector<int> expect;
+	for (uint8_t i = 0; i < DEVICES; i++) {
+		uint32_t count = 100 + 10 * i;
+		expect.push_back((gamepads[i]->reports_sent + count - 1) & 0xff);
+		gamepads[i]->stream(count, 2000);
+		total += count;
+	}
+	sim::run_us(500000);
+
+	BluetoothStatistics_t stats;
+	bluet.getStatistics(stats);
+	CHECK_EQ(stats.acl_packets, total);
+	std::vector<int> got;
+	for (JoystickController &joy : joysticks) {
+		CHECK(joy);
+		got.push_back(joy.getAxis(0));
+	}
+	std::sort(expect.begin(), expect.end());
+	std::sort(got.begin(), got.end());
+	CHECK(got == expect);
+	CHECK_EQ(dongle.command_overruns, 0);
+	CHECK_EQ(dongle.acl_overruns, 0);
+
+	for (sim::GamepadPeer *g : gamepads) delete g;
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,107 @@
+/* L2CAP reassembly: the dongle splits everything it sends the host into ACL
+ * fragments of random sizes, interleaving a keyboard's and a DS4's, while
+ * both connect (SDP included) and then stream.  Every key typed must come
+ * through, a report longer than 255 bytes must arrive whole, and one too
+ * long for the reassembly buffer must be dropped without upsetting the
+ * packets after it.
+ */
+
+#include <random>
+#include <string>
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+JoystickController joystick1(myusb);
+KeyboardController keyboard1(myusb);
+
+static const uint8_t ds4_addr[6] = {0x51, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t keyboard_addr[6] = {0x52, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+static sim::HCIController dongle;
+static sim::DS4Peer ds4(ds4_addr);
+static sim::KeyboardPeer keyboard_peer(keyboard_addr);
+
+static std::mt19937 rng;
+static void fragment_randomly(uint32_t seed)
+{
+	rng.seed(seed);
+	// Mostly small, some a single byte, now and then a whole packet
+	dongle.fragment_size = []() -> uint16_t {
+		uint32_t r = rng() % 100;
+		if (r < 10) return 1;
+		if (r < 90) return 2 + rng() % 48;
+		return 1021;
+	};
+}
+
+static void test_streams(uint32_t seed)
+{
+	// Two reports per key, 26 keys; the DS4 meanwhile at its full rate
+	fragment_randomly(seed);
+	typed.clear();
+	bluet.resetStatistics();
+	keyboard_peer.stream(52, 3000);
+	ds4.stream(400, 1250);
+	sim::run_us(600000);
+	CHECK(typed == "abcdefghijklmnopqrstuvwxyz");
+	BluetoothStatistics_t stats;
+	bluet.getStatistics(stats);
+	CHECK_EQ(stats.acl_packets, 52 + 400);
+	uint8_t lx = (ds4.reports_sent - 1) & 0xff;
+	CHECK_EQ(joystick1.getAxis(0), lx);
+	CHECK_EQ(joystick1.getAxis(1), 0xff - lx);
+}
+
+static void test_long_packets()
+{
+	fragment_randomly(89);
+	bluet.resetStatistics();
+
+	// Longer than 255 bytes: the HCI length's high byte matters
+	std::vector<uint8_t> r = ds4.report(0x42);
+	r.resize(400, 0x5A);
+	ds4.send_report(r);
+	sim::run_us(20000);
+	CHECK_EQ(joystick1.getAxis(0), 0x42);
+
+	// Longer than the reassembly buffer: dropped, the next one is fine
+	r = ds4.report(0x43);
+	r.resize(1500, 0x5A);
+	ds4.send_report(r);
+	ds4.send_report(ds4.report(0x44));
+	sim::run_us(20000);
+	CHECK_EQ(joystick1.getAxis(0), 0x44);
+
+	BluetoothStatistics_t stats;
+	bluet.getStatistics(stats);
+	CHECK_EQ(stats.acl_packets, 2);
+}
+
+int main()
+{
+	keyboard_peer.typing.clear();
+	for (uint8_t usage = 0x04; usage <= 0x1D; usage++) keyboard_peer.typing.push_back(usage);
+	keyboard_peer.sdp_chunk = 40;
+	dongle.add_peer(&ds4);
+	dongle.add_peer(&keyboard_peer);
+	keyboard1.attachPress(OnPress);
+	fragment_randomly(1);
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+	CHECK(dongle.connect_in(&ds4));
+	CHECK(sim::run_until([]() { return ds4.extended_reports && ds4.interrupt_open(); }, 2000000));
+	sim::run_us(100000);
+	CHECK(dongle.connect_in(&keyboard_peer));
+	CHECK(sim::run_until([]() { return keyboard_peer.interrupt_open(); }, 2000000));
+	sim::run_us(200000);
+
+	for (uint32_t seed = 1; seed <= 8; seed++) test_streams(seed);
+	test_long_packets();
+	CHECK(dongle.acl_to_host > 1000);
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,75 @@
+/* Reconnect to first report: a gamepad set up from its report descriptor
+ * comes back after dropping and streams as soon as its interrupt channel is
+ * open.  With its descriptor still cached the host skips SDP and takes the
+ * reports sooner than on the first connection or once other devices have
+ * pushed the descriptor out of the cache.
+ */
+
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+JoystickController joystick1(myusb);
+
+static const uint8_t gamepad_addr[6] = {0xA1, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+static const uint8_t other_addr[2][6] = {
+	{0xA2, 0x00, 0x00, 0xA0, 0x1D, 0x00},
+	{0xA3, 0x00, 0x00, 0xA0, 0x1D, 0x00}};
+
+static sim::HCIController dongle;
+static sim::GamepadPeer gamepad(gamepad_addr);
+static sim::GamepadPeer other0(other_addr[0]);
+static sim::GamepadPeer other1(other_addr[1]);
+
+// Page the host, stream from when the interrupt channel opens, and return
+// the time to the first report the joystick sees.  The device drops after.
+static uint64_t connect_to_first_report(sim::GamepadPeer &peer)
+{
+	joystick1.joystickDataClear();
+	uint64_t start = sim::now_us;
+	CHECK(dongle.connect_in(&peer));
+	CHECK(sim::run_until([&peer]() { return peer.interrupt_open(); }, 2000000));
+	peer.stream(1000, 8000);
+	CHECK(sim::run_until([]() { return joystick1.available(); }, 2000000));
+	uint64_t us = sim::now_us - start;
+	CHECK_EQ(joystick1.getAxis(0), (peer.reports_sent - 1) & 0xff);
+
+	dongle.disconnect(&peer);
+	sim::run_us(200000);
+	CHECK(!joystick1);
+	return us;
+}
+
+int main()
+{
+	for (sim::GamepadPeer *peer : {&gamepad, &other0, &other1}) {
+		peer->sdp_chunk = 40;
+		dongle.add_peer(peer);
+	}
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+
+	uint64_t first_us = connect_to_first_report(gamepad);
+	uint32_t sdp_requests = gamepad.sdp_requests;
+	CHECK(sdp_requests > 1);
+
+	// Straight back: the descriptor comes from the cache, no SDP
+	uint64_t cached_us = connect_to_first_report(gamepad);
+	CHECK_EQ(gamepad.sdp_requests, sdp_requests);
+
+	// Two other devices take both descriptor buffers, then back again
+	connect_to_first_report(other0);
+	connect_to_first_report(other1);
+	uint64_t evicted_us = connect_to_first_report(gamepad);
+	CHECK(gamepad.sdp_requests > sdp_requests);
+
+	CHECK(cached_us < evicted_us);
+	CHECK(cached_us < first_us);
+	printf("connect to first report: first %llu us, cached %llu us, evicted %llu us\n",
+		(unsigned long long)first_us, (unsigned long long)cached_us, (unsigned long long)evicted_us);
+	return TEST_MAIN_RESULT();
+}
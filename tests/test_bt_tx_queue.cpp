@@ -0,0 +1,133 @@
+/* The ACL transmit ring: outputs queued faster than they go out reach the
+ * device whole and in order, a full ring drops and counts, and a keyboard
+ * LED update from the USB interrupt no longer waits there.
+ */
+
+#include <USBHost_t36.h>
+#include "sim_hci.h"
+#include "sim_peers.h"
+#include "test_util.h"
+
+USBHost myusb;
+BluetoothController bluet(myusb);
+KeyboardController keyboard1(myusb);
+
+static const uint8_t keyboard_addr[6] = {0x31, 0x00, 0x00, 0xA0, 0x1D, 0x00};
+
+// BluetoothController's TX_ACL_QUEUE_DEPTH
+static const uint8_t tx_queue_depth = 8;
+
+static sim::HCIController dongle;
+static sim::KeyboardPeer keyboard_peer(keyboard_addr);
+
+// Output report seq, its bytes numbered from seq so that any mix up shows
+static std::vector<uint8_t> output_report(uint8_t seq, uint8_t length)
+{
+	std::vector<uint8_t> r = {0xA2, 0x05, seq};
+	while (r.size() < length) r.push_back(seq + r.size());
+	return r;
+}
+
+static void send_outputs(uint8_t first, uint8_t count)
+{
+	for (uint8_t i = 0; i < count; i++) {
+		uint8_t seq = first + i;
+		std::vector<uint8_t> r = output_report(seq, 3 + (seq * 37) % 200);
+		bluet.sendL2CapCommand(r.data(), r.size(), BluetoothController::INTERRUPT_SCID);
+	}
+}
+
+static void check_outputs(size_t from, uint8_t first, uint8_t count)
+{
+	CHECK_EQ(keyboard_peer.outputs.size() - from, count);
+	for (size_t i = 0; i < count && from + i < keyboard_peer.outputs.size(); i++) {
+		uint8_t seq = first + i;
+		std::vector<uint8_t> expect = output_report(seq, 3 + (seq * 37) % 200);
+		expect.erase(expect.begin());   // outputs are recorded without the 0xA2
+		CHECK(keyboard_peer.outputs[from + i] == expect);
+	}
+}
+
+static void test_queued_outputs()
+{
+	// A ring's worth at once, all but the first wait for the one before
+	bluet.resetStatistics();
+	size_t from = keyboard_peer.outputs.size();
+	send_outputs(0, tx_queue_depth);
+	sim::run_us(100000);
+	check_outputs(from, 0, tx_queue_depth);
+
+	// Many more, a few at a time as a sketch's loop would, no faster than
+	// the dongle hands back its buffers
+	from = keyboard_peer.outputs.size();
+	for (uint8_t seq = 0; seq < 200; seq += 4) {
+		send_outputs(seq, 4);
+		sim::run_us(2000);
+	}
+	sim::run_us(100000);
+	check_outputs(from, 0, 200);
+
+	BluetoothStatistics_t stats;
+	bluet.getStatistics(stats);
+	CHECK_EQ(stats.tx_acl_dropped, 0);
+}
+
+static void test_full_ring()
+{
+	// Two more than the ring holds: those are dropped, the rest go out
+	bluet.resetStatistics();
+	size_t from = keyboard_peer.outputs.size();
+	send_outputs(0, tx_queue_depth + 2);
+	sim::run_us(100000);
+	BluetoothStatistics_t stats;
+	bluet.getStatistics(stats);
+	CHECK_EQ(stats.tx_acl_dropped, 2);
+	check_outputs(from, 0, tx_queue_depth);
+}
+
+static void test_leds()
+{
+	// From the sketch
+	size_t from = keyboard_peer.outputs.size();
+	keyboard1.numLock(true);
+	keyboard1.capsLock(true);
+	keyboard1.scrollLock(true);
+	keyboard1.numLock(false);
+	sim::run_us(100000);
+	CHECK_EQ(keyboard_peer.outputs.size() - from, 4);
+	static const uint8_t leds[4] = {0x01, 0x03, 0x07, 0x06};
+	for (size_t i = 0; i < 4 && from + i < keyboard_peer.outputs.size(); i++) {
+		CHECK(keyboard_peer.outputs[from + i] == std::vector<uint8_t>({0x01, leds[i]}));
+	}
+
+	// Caps Lock typed on the keyboard toggles the LED from the USB interrupt
+	from = keyboard_peer.outputs.size();
+	sim::reset_counters();
+	keyboard_peer.typing = {0x39};
+	keyboard_peer.stream(2, 10000);
+	sim::run_us(100000);
+	CHECK_EQ(sim::counters.isr_delay_calls, 0);
+	CHECK(!keyboard1.capsLock());
+	CHECK_EQ(keyboard_peer.outputs.size() - from, 1);
+	if (keyboard_peer.outputs.size() > from) {
+		CHECK(keyboard_peer.outputs[from] == std::vector<uint8_t>({0x01, 0x04}));
+	}
+}
+
+int main()
+{
+	dongle.add_peer(&keyboard_peer);
+	myusb.begin();
+	sim::attach(&dongle);
+	CHECK(sim::run_until([]() { return dongle.scan_enable == 2; }, 2000000));
+	CHECK(dongle.connect_in(&keyboard_peer));
+	CHECK(sim::run_until([]() { return keyboard_peer.interrupt_open(); }, 2000000));
+	sim::run_us(200000);
+
+	test_queued_outputs();
+	test_full_ring();
+	test_leds();
+	CHECK_EQ(dongle.acl_overruns, 0);
+	CHECK_EQ(dongle.acl_oversize, 0);
+	return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,46 @@
+/* A card reader with an empty slot: USBDrive::Task() starts the drive
+ * once, finds no medium and then only checks for one every
+ * MEDIA_POLL_INTERVAL with a Test Unit Ready, instead of starting over on
+ * every Task().  The medium is mounted soon after it is inserted.
+ */
+
+#include <USBHost_t36.h>
+#include "sim_msc.h"
+#include "test_util.h"
+
+USBHost myusb;
+USBDrive myDrive(myusb);
+
+static sim::MassStorage disk(4096);
+
+int main()
+{
+	disk.medium = false;
+	myusb.begin();
+	sim::attach(&disk, 2);
+	CHECK(task_until(myusb, []() { return disk.opcodes[0x00] > 0; }, 2000));
+
+	// Three seconds of Task() with the slot empty
+	disk.reset_counters();
+	CHECK(!task_until(myusb, []() { return myDrive.filesystemsStarted(); }, 3000));
+	printf("No medium for 3000 ms: %u commands, %u Test Unit Ready\n",
+		disk.counters.commands, disk.opcodes[0x00]);
+	CHECK(disk.opcodes[0x00] >= 3000 / MEDIA_POLL_INTERVAL - 1);
+	CHECK(disk.opcodes[0x00] <= 3000 / MEDIA_POLL_INTERVAL + 1);
+	CHECK_EQ(disk.opcodes[0x1B], 0);    // START STOP UNIT
+	CHECK_EQ(disk.opcodes[0x12], 0);    // INQUIRY
+	CHECK_EQ(disk.opcodes[0x03], disk.opcodes[0x00]);
+	CHECK_EQ(disk.counters.commands, disk.opcodes[0x00] + disk.opcodes[0x03]);
+	CHECK_EQ(myDrive.errorCode(), MS_NO_MEDIA_ERR);
+
+	// Insert one: up and running within the next poll
+	disk.insert_medium();
+	uint64_t inserted = sim::now_us;
+	CHECK(task_until(myusb, []() { return myDrive.filesystemsStarted(); }, MEDIA_POLL_INTERVAL + 100));
+	printf("Medium inserted: mounted in %llu ms\n", (unsigned long long)(sim::now_us - inserted) / 1000);
+	CHECK(myDrive.msDriveInfo.initialized);
+	CHECK_EQ(myDrive.errorCode(), MS_CBW_PASS);
+	CHECK_EQ(disk.counters.unit_attentions, 1);
+	CHECK_EQ(disk.counters.bad_cbws, 0);
+	return TEST_MAIN_RESULT();
+}
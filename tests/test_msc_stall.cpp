@@ -0,0 +1,101 @@
+/* A STALLed data stage on the Bulk-Only Transport: the device halts the
+ * bulk endpoint instead of moving the READ or WRITE data, then sends the
+ * CSW.  The STALL halts the pipe's queue head in the EHCI as well, so the
+ * driver has to clear the endpoint halt and reset the queue head before it
+ * can read the CSW.  The command fails with the sense data, and the next
+ * one works without a Bulk-Only reset.
+ */
+
+#include <USBHost_t36.h>
+#include "sim_msc.h"
+#include "test_util.h"
+
+USBHost myusb;
+USBDrive myDrive(myusb);
+
+static sim::MassStorage disk(4096);
+static uint8_t buffer[32768] __attribute__((aligned(32)));
+
+static void fill(uint8_t *data, uint32_t sector, uint32_t count, uint8_t seed)
+{
+	for (uint32_t i = 0; i < count * 512; i++) data[i] = (uint8_t)((sector + i / 512) * 13 + i * 7 + seed);
+}
+
+static bool check(const uint8_t *data, uint32_t sector, uint32_t count, uint8_t seed)
+{
+	for (uint32_t i = 0; i < count * 512; i++) {
+		if (data[i] != (uint8_t)((sector + i / 512) * 13 + i * 7 + seed)) return false;
+	}
+	return true;
+}
+
+int main()
+{
+	typedef sim::MassStorage M;
+	myusb.begin();
+	sim::attach(&disk, 2);
+	CHECK(task_until(myusb, []() { return myDrive.filesystemsStarted(); }, 2000));
+	fill(buffer, 0, 64, 1);
+	CHECK(myDrive.writeSectors(0, buffer, 64));
+
+	// READ: the IN pipe halts with the data stage
+	disk.reset_counters();
+	sim::reset_counters();
+	disk.inject(0x28, M::FAULT_STALL);
+	CHECK(!myDrive.readSectors(8, buffer, 8));
+	CHECK_EQ(disk.clear_halts, 1);
+	CHECK_EQ(sim::counters.qh_resets, 1);
+	CHECK_EQ(myDrive.msSense.SenseKey, 0x03);
+	CHECK_EQ(myDrive.msSense.AdditionalSenseCode, 0x11);
+	CHECK(myDrive.readSectors(8, buffer, 8));
+	CHECK(check(buffer, 8, 8, 1));
+	CHECK_EQ(disk.counters.resets, 0);
+
+	// A 32KB READ, two qTDs on the halted queue head
+	disk.inject(0x28, M::FAULT_STALL);
+	CHECK(!myDrive.readSectors(0, buffer, 64));
+	CHECK_EQ(sim::counters.qh_resets, 2);
+	CHECK(myDrive.readSectors(0, buffer, 64));
+	CHECK(check(buffer, 0, 64, 1));
+
+	// WRITE: the OUT pipe halts, the data never reaches the disk
+	disk.reset_counters();
+	sim::reset_counters();
+	disk.inject(0x2A, M::FAULT_STALL);
+	fill(buffer, 16, 8, 2);
+	CHECK(!myDrive.writeSectors(16, buffer, 8));
+	CHECK_EQ(disk.clear_halts, 1);
+	CHECK_EQ(sim::counters.qh_resets, 1);
+	CHECK_EQ(myDrive.msSense.SenseKey, 0x03);
+	CHECK_EQ(myDrive.msSense.AdditionalSenseCode, 0x0C);
+	CHECK_EQ(disk.counters.writes, 0);
+	CHECK(myDrive.writeSectors(16, buffer, 8));
+	CHECK(myDrive.readSectors(16, buffer, 8));
+	CHECK(check(buffer, 16, 8, 2));
+	CHECK_EQ(disk.counters.resets, 0);
+
+	// Every third READ or WRITE STALLs: each fails once and works again
+	disk.reset_counters();
+	sim::reset_counters();
+	disk.stall_every = 3;
+	uint32_t failed = 0;
+	bool ok = true;
+	for (uint32_t i = 0; i < 30; i++) {
+		uint32_t sector = (i * 40) % 4000;
+		bool write = (i & 1) != 0;
+		if (write) fill(buffer, sector, 8, 3);
+		bool done = write ? myDrive.writeSectors(sector, buffer, 8) : myDrive.readSectors(sector, buffer, 8);
+		if (!done) {
+			failed++;
+			done = write ? myDrive.writeSectors(sector, buffer, 8) : myDrive.readSectors(sector, buffer, 8);
+		}
+		if (!done) ok = false;
+	}
+	disk.stall_every = 0;
+	CHECK(ok);
+	CHECK_EQ(failed, disk.counters.stalls);
+	CHECK_EQ(sim::counters.qh_resets, disk.counters.stalls);
+	CHECK_EQ(disk.counters.resets, 0);
+	CHECK_EQ(disk.counters.bad_cbws, 0);
+	return TEST_MAIN_RESULT();
+}
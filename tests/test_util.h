@@ -0,0 +1,81 @@
+/* Checks for the host tests: failures are printed and counted, main()
+ * returns TEST_MAIN_RESULT().  Then the fixtures the Bluetooth tests share.
+ */
+
+#ifndef TEST_UTIL_H_
+#define TEST_UTIL_H_
+
+#include <stdio.h>
+#include <string>
+#include <USBHost_t36.h>
+#include "sim.h"
+#include "sim_hci.h"
+#include "sim_peers.h"
+
+inline int test_failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: CHECK(%s) failed at %llu us\n", __FILE__, __LINE__, #cond, \
+			(unsigned long long)sim::now_us); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+	long long a_ = (long long)(a), b_ = (long long)(b); \
+	if (a_ != b_) { \
+		printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld at %llu us\n", __FILE__, __LINE__, \
+			#a, #b, a_, b_, (unsigned long long)sim::now_us); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define TEST_MAIN_RESULT() (printf("%s\n", test_failures ? "FAILED" : "passed"), test_failures ? 1 : 0)
+
+// The sketch's loop(): host.Task() every millisecond until done()
+inline bool task_until(USBHost &host, std::function<bool()> done, uint32_t timeout_ms)
+{
+	for (uint32_t ms = 0; ms < timeout_ms; ms++) {
+		host.Task();
+		if (done()) return true;
+		sim::run_us(1000);
+	}
+	return false;
+}
+
+// The keys a KeyboardController reports, with keyboard.attachPress(OnPress)
+inline std::string typed;
+inline void OnPress(int key)
+{
+	typed += (char)key;
+}
+
+// The one of these joysticks that has had reports from a device of this type
+inline JoystickController *joystick_for(std::initializer_list<JoystickController *> joysticks,
+	JoystickController::joytype_t type)
+{
+	for (JoystickController *joy : joysticks) {
+		if (*joy && joy->joystickType() == type) return joy;
+	}
+	return nullptr;
+}
+
+// The device pages the host; wait until ready() and a little more, for
+// the drivers to settle.
+inline void connect(sim::HCIController &dongle, sim::HIDPeer &peer, std::function<bool()> ready)
+{
+	CHECK(dongle.connect_in(&peer));
+	CHECK(sim::run_until(ready, 3000000));
+	sim::run_us(100000);
+}
+
+// The host connects to an LE device
+inline void connect(BluetoothController &bluet, sim::GATTPeer &peer, std::function<bool()> ready)
+{
+	CHECK(bluet.connectLE(peer.bdaddr, peer.address_type));
+	CHECK(sim::run_until(ready, 2000000));
+	sim::run_us(50000);
+}
+
+#endif
@@ -15,6 +15,9 @@ private:
   bool makeFat32(USBDrive &m_dev);
   bool writeFatMbr(USBDrive &m_dev);
   bool initFatDir(USBDrive &m_dev, uint8_t fatType, uint32_t sectorCount);
+  bool zeroSectors(USBDrive &m_dev, uint32_t sector, uint32_t sectorCount);
+  void discardFreeSpace(USBDrive &m_dev, uint32_t sector, uint32_t sectorCount);
+  void reportPhase(const char *phase);
   void initPbs();
   void setWriteSandBox(uint32_t min_sector, uint32_t max_sector) {
     m_minSector = min_sector;
@@ -23,10 +26,7 @@ private:
   bool writeSector(USBDrive &m_dev, uint32_t sector, const uint8_t* src);
 
   bool writeExFatMbr(USBDrive &m_dev);
-  bool syncUpcase(USBDrive &m_dev);
-  bool writeUpcaseByte(USBDrive &m_dev, uint8_t b);
   bool writeUpcase(USBDrive &m_dev, uint32_t sector);
-  bool writeUpcaseUnicode(USBDrive &m_dev, uint16_t unicode);
     
   uint32_t m_capacityMB;
   uint32_t m_dataStart;
@@ -46,12 +46,12 @@ private:
   uint32_t m_part_relativeSectors;
   uint32_t m_minSector = 0;
   uint32_t m_maxSector = (uint32_t)-1;
+  bool m_useWriteSame = false;
+  elapsedMillis m_emPhase;
+  elapsedMillis m_emFormat;
 
   uint32_t volumeLength;
   uint32_t partitionOffset;
-  uint32_t m_upcaseSector;
-  uint32_t m_upcaseChecksum;
-  uint32_t m_upcaseSize;
   uint32_t bitmapSize;
 
 };
@@ -0,0 +1,498 @@
+#ifndef USBFilesystemUpcase_h
+#define USBFilesystemUpcase_h
+
+// The compressed exFAT up-case table, the same on every format: each BMP
+// character's simple Unicode uppercase mapping, with runs of 512 or more
+// characters that map to themselves written as 0XFFFF and the run length.
+// Generated from the Unicode 14.0 case mappings; 7576 bytes, 15 sectors.
+static constexpr uint16_t upcaseTable[] PROGMEM = {
+  0X0000, 0X0001, 0X0002, 0X0003, 0X0004, 0X0005, 0X0006, 0X0007,
+  0X0008, 0X0009, 0X000A, 0X000B, 0X000C, 0X000D, 0X000E, 0X000F,
+  0X0010, 0X0011, 0X0012, 0X0013, 0X0014, 0X0015, 0X0016, 0X0017,
+  0X0018, 0X0019, 0X001A, 0X001B, 0X001C, 0X001D, 0X001E, 0X001F,
+  0X0020, 0X0021, 0X0022, 0X0023, 0X0024, 0X0025, 0X0026, 0X0027,
+  0X0028, 0X0029, 0X002A, 0X002B, 0X002C, 0X002D, 0X002E, 0X002F,
+  0X0030, 0X0031, 0X0032, 0X0033, 0X0034, 0X0035, 0X0036, 0X0037,
+  0X0038, 0X0039, 0X003A, 0X003B, 0X003C, 0X003D, 0X003E, 0X003F,
+  0X0040, 0X0041, 0X0042, 0X0043, 0X0044, 0X0045, 0X0046, 0X0047,
+  0X0048, 0X0049, 0X004A, 0X004B, 0X004C, 0X004D, 0X004E, 0X004F,
+  0X0050, 0X0051, 0X0052, 0X0053, 0X0054, 0X0055, 0X0056, 0X0057,
+  0X0058, 0X0059, 0X005A, 0X005B, 0X005C, 0X005D, 0X005E, 0X005F,
+  0X0060, 0X0041, 0X0042, 0X0043, 0X0044, 0X0045, 0X0046, 0X0047,
+  0X0048, 0X0049, 0X004A, 0X004B, 0X004C, 0X004D, 0X004E, 0X004F,
+  0X0050, 0X0051, 0X0052, 0X0053, 0X0054, 0X0055, 0X0056, 0X0057,
+  0X0058, 0X0059, 0X005A, 0X007B, 0X007C, 0X007D, 0X007E, 0X007F,
+  0X0080, 0X0081, 0X0082, 0X0083, 0X0084, 0X0085, 0X0086, 0X0087,
+  0X0088, 0X0089, 0X008A, 0X008B, 0X008C, 0X008D, 0X008E, 0X008F,
+  0X0090, 0X0091, 0X0092, 0X0093, 0X0094, 0X0095, 0X0096, 0X0097,
+  0X0098, 0X0099, 0X009A, 0X009B, 0X009C, 0X009D, 0X009E, 0X009F,
+  0X00A0, 0X00A1, 0X00A2, 0X00A3, 0X00A4, 0X00A5, 0X00A6, 0X00A7,
+  0X00A8, 0X00A9, 0X00AA, 0X00AB, 0X00AC, 0X00AD, 0X00AE, 0X00AF,
+  0X00B0, 0X00B1, 0X00B2, 0X00B3, 0X00B4, 0X039C, 0X00B6, 0X00B7,
+  0X00B8, 0X00B9, 0X00BA, 0X00BB, 0X00BC, 0X00BD, 0X00BE, 0X00BF,
+  0X00C0, 0X00C1, 0X00C2, 0X00C3, 0X00C4, 0X00C5, 0X00C6, 0X00C7,
+  0X00C8, 0X00C9, 0X00CA, 0X00CB, 0X00CC, 0X00CD, 0X00CE, 0X00CF,
+  0X00D0, 0X00D1, 0X00D2, 0X00D3, 0X00D4, 0X00D5, 0X00D6, 0X00D7,
+  0X00D8, 0X00D9, 0X00DA, 0X00DB, 0X00DC, 0X00DD, 0X00DE, 0X00DF,
+  0X00C0, 0X00C1, 0X00C2, 0X00C3, 0X00C4, 0X00C5, 0X00C6, 0X00C7,
+  0X00C8, 0X00C9, 0X00CA, 0X00CB, 0X00CC, 0X00CD, 0X00CE, 0X00CF,
+  0X00D0, 0X00D1, 0X00D2, 0X00D3, 0X00D4, 0X00D5, 0X00D6, 0X00F7,
+  0X00D8, 0X00D9, 0X00DA, 0X00DB, 0X00DC, 0X00DD, 0X00DE, 0X0178,
+  0X0100, 0X0100, 0X0102, 0X0102, 0X0104, 0X0104, 0X0106, 0X0106,
+  0X0108, 0X0108, 0X010A, 0X010A, 0X010C, 0X010C, 0X010E, 0X010E,
+  0X0110, 0X0110, 0X0112, 0X0112, 0X0114, 0X0114, 0X0116, 0X0116,
+  0X0118, 0X0118, 0X011A, 0X011A, 0X011C, 0X011C, 0X011E, 0X011E,
+  0X0120, 0X0120, 0X0122, 0X0122, 0X0124, 0X0124, 0X0126, 0X0126,
+  0X0128, 0X0128, 0X012A, 0X012A, 0X012C, 0X012C, 0X012E, 0X012E,
+  0X0130, 0X0049, 0X0132, 0X0132, 0X0134, 0X0134, 0X0136, 0X0136,
+  0X0138, 0X0139, 0X0139, 0X013B, 0X013B, 0X013D, 0X013D, 0X013F,
+  0X013F, 0X0141, 0X0141, 0X0143, 0X0143, 0X0145, 0X0145, 0X0147,
+  0X0147, 0X0149, 0X014A, 0X014A, 0X014C, 0X014C, 0X014E, 0X014E,
+  0X0150, 0X0150, 0X0152, 0X0152, 0X0154, 0X0154, 0X0156, 0X0156,
+  0X0158, 0X0158, 0X015A, 0X015A, 0X015C, 0X015C, 0X015E, 0X015E,
+  0X0160, 0X0160, 0X0162, 0X0162, 0X0164, 0X0164, 0X0166, 0X0166,
+  0X0168, 0X0168, 0X016A, 0X016A, 0X016C, 0X016C, 0X016E, 0X016E,
+  0X0170, 0X0170, 0X0172, 0X0172, 0X0174, 0X0174, 0X0176, 0X0176,
+  0X0178, 0X0179, 0X0179, 0X017B, 0X017B, 0X017D, 0X017D, 0X0053,
+  0X0243, 0X0181, 0X0182, 0X0182, 0X0184, 0X0184, 0X0186, 0X0187,
+  0X0187, 0X0189, 0X018A, 0X018B, 0X018B, 0X018D, 0X018E, 0X018F,
+  0X0190, 0X0191, 0X0191, 0X0193, 0X0194, 0X01F6, 0X0196, 0X0197,
+  0X0198, 0X0198, 0X023D, 0X019B, 0X019C, 0X019D, 0X0220, 0X019F,
+  0X01A0, 0X01A0, 0X01A2, 0X01A2, 0X01A4, 0X01A4, 0X01A6, 0X01A7,
+  0X01A7, 0X01A9, 0X01AA, 0X01AB, 0X01AC, 0X01AC, 0X01AE, 0X01AF,
+  0X01AF, 0X01B1, 0X01B2, 0X01B3, 0X01B3, 0X01B5, 0X01B5, 0X01B7,
+  0X01B8, 0X01B8, 0X01BA, 0X01BB, 0X01BC, 0X01BC, 0X01BE, 0X01F7,
+  0X01C0, 0X01C1, 0X01C2, 0X01C3, 0X01C4, 0X01C4, 0X01C4, 0X01C7,
+  0X01C7, 0X01C7, 0X01CA, 0X01CA, 0X01CA, 0X01CD, 0X01CD, 0X01CF,
+  0X01CF, 0X01D1, 0X01D1, 0X01D3, 0X01D3, 0X01D5, 0X01D5, 0X01D7,
+  0X01D7, 0X01D9, 0X01D9, 0X01DB, 0X01DB, 0X018E, 0X01DE, 0X01DE,
+  0X01E0, 0X01E0, 0X01E2, 0X01E2, 0X01E4, 0X01E4, 0X01E6, 0X01E6,
+  0X01E8, 0X01E8, 0X01EA, 0X01EA, 0X01EC, 0X01EC, 0X01EE, 0X01EE,
+  0X01F0, 0X01F1, 0X01F1, 0X01F1, 0X01F4, 0X01F4, 0X01F6, 0X01F7,
+  0X01F8, 0X01F8, 0X01FA, 0X01FA, 0X01FC, 0X01FC, 0X01FE, 0X01FE,
+  0X0200, 0X0200, 0X0202, 0X0202, 0X0204, 0X0204, 0X0206, 0X0206,
+  0X0208, 0X0208, 0X020A, 0X020A, 0X020C, 0X020C, 0X020E, 0X020E,
+  0X0210, 0X0210, 0X0212, 0X0212, 0X0214, 0X0214, 0X0216, 0X0216,
+  0X0218, 0X0218, 0X021A, 0X021A, 0X021C, 0X021C, 0X021E, 0X021E,
+  0X0220, 0X0221, 0X0222, 0X0222, 0X0224, 0X0224, 0X0226, 0X0226,
+  0X0228, 0X0228, 0X022A, 0X022A, 0X022C, 0X022C, 0X022E, 0X022E,
+  0X0230, 0X0230, 0X0232, 0X0232, 0X0234, 0X0235, 0X0236, 0X0237,
+  0X0238, 0X0239, 0X023A, 0X023B, 0X023B, 0X023D, 0X023E, 0X2C7E,
+  0X2C7F, 0X0241, 0X0241, 0X0243, 0X0244, 0X0245, 0X0246, 0X0246,
+  0X0248, 0X0248, 0X024A, 0X024A, 0X024C, 0X024C, 0X024E, 0X024E,
+  0X2C6F, 0X2C6D, 0X2C70, 0X0181, 0X0186, 0X0255, 0X0189, 0X018A,
+  0X0258, 0X018F, 0X025A, 0X0190, 0XA7AB, 0X025D, 0X025E, 0X025F,
+  0X0193, 0XA7AC, 0X0262, 0X0194, 0X0264, 0XA78D, 0XA7AA, 0X0267,
+  0X0197, 0X0196, 0XA7AE, 0X2C62, 0XA7AD, 0X026D, 0X026E, 0X019C,
+  0X0270, 0X2C6E, 0X019D, 0X0273, 0X0274, 0X019F, 0X0276, 0X0277,
+  0X0278, 0X0279, 0X027A, 0X027B, 0X027C, 0X2C64, 0X027E, 0X027F,
+  0X01A6, 0X0281, 0XA7C5, 0X01A9, 0X0284, 0X0285, 0X0286, 0XA7B1,
+  0X01AE, 0X0244, 0X01B1, 0X01B2, 0X0245, 0X028D, 0X028E, 0X028F,
+  0X0290, 0X0291, 0X01B7, 0X0293, 0X0294, 0X0295, 0X0296, 0X0297,
+  0X0298, 0X0299, 0X029A, 0X029B, 0X029C, 0XA7B2, 0XA7B0, 0X029F,
+  0X02A0, 0X02A1, 0X02A2, 0X02A3, 0X02A4, 0X02A5, 0X02A6, 0X02A7,
+  0X02A8, 0X02A9, 0X02AA, 0X02AB, 0X02AC, 0X02AD, 0X02AE, 0X02AF,
+  0X02B0, 0X02B1, 0X02B2, 0X02B3, 0X02B4, 0X02B5, 0X02B6, 0X02B7,
+  0X02B8, 0X02B9, 0X02BA, 0X02BB, 0X02BC, 0X02BD, 0X02BE, 0X02BF,
+  0X02C0, 0X02C1, 0X02C2, 0X02C3, 0X02C4, 0X02C5, 0X02C6, 0X02C7,
+  0X02C8, 0X02C9, 0X02CA, 0X02CB, 0X02CC, 0X02CD, 0X02CE, 0X02CF,
+  0X02D0, 0X02D1, 0X02D2, 0X02D3, 0X02D4, 0X02D5, 0X02D6, 0X02D7,
+  0X02D8, 0X02D9, 0X02DA, 0X02DB, 0X02DC, 0X02DD, 0X02DE, 0X02DF,
+  0X02E0, 0X02E1, 0X02E2, 0X02E3, 0X02E4, 0X02E5, 0X02E6, 0X02E7,
+  0X02E8, 0X02E9, 0X02EA, 0X02EB, 0X02EC, 0X02ED, 0X02EE, 0X02EF,
+  0X02F0, 0X02F1, 0X02F2, 0X02F3, 0X02F4, 0X02F5, 0X02F6, 0X02F7,
+  0X02F8, 0X02F9, 0X02FA, 0X02FB, 0X02FC, 0X02FD, 0X02FE, 0X02FF,
+  0X0300, 0X0301, 0X0302, 0X0303, 0X0304, 0X0305, 0X0306, 0X0307,
+  0X0308, 0X0309, 0X030A, 0X030B, 0X030C, 0X030D, 0X030E, 0X030F,
+  0X0310, 0X0311, 0X0312, 0X0313, 0X0314, 0X0315, 0X0316, 0X0317,
+  0X0318, 0X0319, 0X031A, 0X031B, 0X031C, 0X031D, 0X031E, 0X031F,
+  0X0320, 0X0321, 0X0322, 0X0323, 0X0324, 0X0325, 0X0326, 0X0327,
+  0X0328, 0X0329, 0X032A, 0X032B, 0X032C, 0X032D, 0X032E, 0X032F,
+  0X0330, 0X0331, 0X0332, 0X0333, 0X0334, 0X0335, 0X0336, 0X0337,
+  0X0338, 0X0339, 0X033A, 0X033B, 0X033C, 0X033D, 0X033E, 0X033F,
+  0X0340, 0X0341, 0X0342, 0X0343, 0X0344, 0X0399, 0X0346, 0X0347,
+  0X0348, 0X0349, 0X034A, 0X034B, 0X034C, 0X034D, 0X034E, 0X034F,
+  0X0350, 0X0351, 0X0352, 0X0353, 0X0354, 0X0355, 0X0356, 0X0357,
+  0X0358, 0X0359, 0X035A, 0X035B, 0X035C, 0X035D, 0X035E, 0X035F,
+  0X0360, 0X0361, 0X0362, 0X0363, 0X0364, 0X0365, 0X0366, 0X0367,
+  0X0368, 0X0369, 0X036A, 0X036B, 0X036C, 0X036D, 0X036E, 0X036F,
+  0X0370, 0X0370, 0X0372, 0X0372, 0X0374, 0X0375, 0X0376, 0X0376,
+  0X0378, 0X0379, 0X037A, 0X03FD, 0X03FE, 0X03FF, 0X037E, 0X037F,
+  0X0380, 0X0381, 0X0382, 0X0383, 0X0384, 0X0385, 0X0386, 0X0387,
+  0X0388, 0X0389, 0X038A, 0X038B, 0X038C, 0X038D, 0X038E, 0X038F,
+  0X0390, 0X0391, 0X0392, 0X0393, 0X0394, 0X0395, 0X0396, 0X0397,
+  0X0398, 0X0399, 0X039A, 0X039B, 0X039C, 0X039D, 0X039E, 0X039F,
+  0X03A0, 0X03A1, 0X03A2, 0X03A3, 0X03A4, 0X03A5, 0X03A6, 0X03A7,
+  0X03A8, 0X03A9, 0X03AA, 0X03AB, 0X0386, 0X0388, 0X0389, 0X038A,
+  0X03B0, 0X0391, 0X0392, 0X0393, 0X0394, 0X0395, 0X0396, 0X0397,
+  0X0398, 0X0399, 0X039A, 0X039B, 0X039C, 0X039D, 0X039E, 0X039F,
+  0X03A0, 0X03A1, 0X03A3, 0X03A3, 0X03A4, 0X03A5, 0X03A6, 0X03A7,
+  0X03A8, 0X03A9, 0X03AA, 0X03AB, 0X038C, 0X038E, 0X038F, 0X03CF,
+  0X0392, 0X0398, 0X03D2, 0X03D3, 0X03D4, 0X03A6, 0X03A0, 0X03CF,
+  0X03D8, 0X03D8, 0X03DA, 0X03DA, 0X03DC, 0X03DC, 0X03DE, 0X03DE,
+  0X03E0, 0X03E0, 0X03E2, 0X03E2, 0X03E4, 0X03E4, 0X03E6, 0X03E6,
+  0X03E8, 0X03E8, 0X03EA, 0X03EA, 0X03EC, 0X03EC, 0X03EE, 0X03EE,
+  0X039A, 0X03A1, 0X03F9, 0X037F, 0X03F4, 0X0395, 0X03F6, 0X03F7,
+  0X03F7, 0X03F9, 0X03FA, 0X03FA, 0X03FC, 0X03FD, 0X03FE, 0X03FF,
+  0X0400, 0X0401, 0X0402, 0X0403, 0X0404, 0X0405, 0X0406, 0X0407,
+  0X0408, 0X0409, 0X040A, 0X040B, 0X040C, 0X040D, 0X040E, 0X040F,
+  0X0410, 0X0411, 0X0412, 0X0413, 0X0414, 0X0415, 0X0416, 0X0417,
+  0X0418, 0X0419, 0X041A, 0X041B, 0X041C, 0X041D, 0X041E, 0X041F,
+  0X0420, 0X0421, 0X0422, 0X0423, 0X0424, 0X0425, 0X0426, 0X0427,
+  0X0428, 0X0429, 0X042A, 0X042B, 0X042C, 0X042D, 0X042E, 0X042F,
+  0X0410, 0X0411, 0X0412, 0X0413, 0X0414, 0X0415, 0X0416, 0X0417,
+  0X0418, 0X0419, 0X041A, 0X041B, 0X041C, 0X041D, 0X041E, 0X041F,
+  0X0420, 0X0421, 0X0422, 0X0423, 0X0424, 0X0425, 0X0426, 0X0427,
+  0X0428, 0X0429, 0X042A, 0X042B, 0X042C, 0X042D, 0X042E, 0X042F,
+  0X0400, 0X0401, 0X0402, 0X0403, 0X0404, 0X0405, 0X0406, 0X0407,
+  0X0408, 0X0409, 0X040A, 0X040B, 0X040C, 0X040D, 0X040E, 0X040F,
+  0X0460, 0X0460, 0X0462, 0X0462, 0X0464, 0X0464, 0X0466, 0X0466,
+  0X0468, 0X0468, 0X046A, 0X046A, 0X046C, 0X046C, 0X046E, 0X046E,
+  0X0470, 0X0470, 0X0472, 0X0472, 0X0474, 0X0474, 0X0476, 0X0476,
+  0X0478, 0X0478, 0X047A, 0X047A, 0X047C, 0X047C, 0X047E, 0X047E,
+  0X0480, 0X0480, 0X0482, 0X0483, 0X0484, 0X0485, 0X0486, 0X0487,
+  0X0488, 0X0489, 0X048A, 0X048A, 0X048C, 0X048C, 0X048E, 0X048E,
+  0X0490, 0X0490, 0X0492, 0X0492, 0X0494, 0X0494, 0X0496, 0X0496,
+  0X0498, 0X0498, 0X049A, 0X049A, 0X049C, 0X049C, 0X049E, 0X049E,
+  0X04A0, 0X04A0, 0X04A2, 0X04A2, 0X04A4, 0X04A4, 0X04A6, 0X04A6,
+  0X04A8, 0X04A8, 0X04AA, 0X04AA, 0X04AC, 0X04AC, 0X04AE, 0X04AE,
+  0X04B0, 0X04B0, 0X04B2, 0X04B2, 0X04B4, 0X04B4, 0X04B6, 0X04B6,
+  0X04B8, 0X04B8, 0X04BA, 0X04BA, 0X04BC, 0X04BC, 0X04BE, 0X04BE,
+  0X04C0, 0X04C1, 0X04C1, 0X04C3, 0X04C3, 0X04C5, 0X04C5, 0X04C7,
+  0X04C7, 0X04C9, 0X04C9, 0X04CB, 0X04CB, 0X04CD, 0X04CD, 0X04C0,
+  0X04D0, 0X04D0, 0X04D2, 0X04D2, 0X04D4, 0X04D4, 0X04D6, 0X04D6,
+  0X04D8, 0X04D8, 0X04DA, 0X04DA, 0X04DC, 0X04DC, 0X04DE, 0X04DE,
+  0X04E0, 0X04E0, 0X04E2, 0X04E2, 0X04E4, 0X04E4, 0X04E6, 0X04E6,
+  0X04E8, 0X04E8, 0X04EA, 0X04EA, 0X04EC, 0X04EC, 0X04EE, 0X04EE,
+  0X04F0, 0X04F0, 0X04F2, 0X04F2, 0X04F4, 0X04F4, 0X04F6, 0X04F6,
+  0X04F8, 0X04F8, 0X04FA, 0X04FA, 0X04FC, 0X04FC, 0X04FE, 0X04FE,
+  0X0500, 0X0500, 0X0502, 0X0502, 0X0504, 0X0504, 0X0506, 0X0506,
+  0X0508, 0X0508, 0X050A, 0X050A, 0X050C, 0X050C, 0X050E, 0X050E,
+  0X0510, 0X0510, 0X0512, 0X0512, 0X0514, 0X0514, 0X0516, 0X0516,
+  0X0518, 0X0518, 0X051A, 0X051A, 0X051C, 0X051C, 0X051E, 0X051E,
+  0X0520, 0X0520, 0X0522, 0X0522, 0X0524, 0X0524, 0X0526, 0X0526,
+  0X0528, 0X0528, 0X052A, 0X052A, 0X052C, 0X052C, 0X052E, 0X052E,
+  0X0530, 0X0531, 0X0532, 0X0533, 0X0534, 0X0535, 0X0536, 0X0537,
+  0X0538, 0X0539, 0X053A, 0X053B, 0X053C, 0X053D, 0X053E, 0X053F,
+  0X0540, 0X0541, 0X0542, 0X0543, 0X0544, 0X0545, 0X0546, 0X0547,
+  0X0548, 0X0549, 0X054A, 0X054B, 0X054C, 0X054D, 0X054E, 0X054F,
+  0X0550, 0X0551, 0X0552, 0X0553, 0X0554, 0X0555, 0X0556, 0X0557,
+  0X0558, 0X0559, 0X055A, 0X055B, 0X055C, 0X055D, 0X055E, 0X055F,
+  0X0560, 0X0531, 0X0532, 0X0533, 0X0534, 0X0535, 0X0536, 0X0537,
+  0X0538, 0X0539, 0X053A, 0X053B, 0X053C, 0X053D, 0X053E, 0X053F,
+  0X0540, 0X0541, 0X0542, 0X0543, 0X0544, 0X0545, 0X0546, 0X0547,
+  0X0548, 0X0549, 0X054A, 0X054B, 0X054C, 0X054D, 0X054E, 0X054F,
+  0X0550, 0X0551, 0X0552, 0X0553, 0X0554, 0X0555, 0X0556, 0XFFFF,
+  0X0B49, 0X1C90, 0X1C91, 0X1C92, 0X1C93, 0X1C94, 0X1C95, 0X1C96,
+  0X1C97, 0X1C98, 0X1C99, 0X1C9A, 0X1C9B, 0X1C9C, 0X1C9D, 0X1C9E,
+  0X1C9F, 0X1CA0, 0X1CA1, 0X1CA2, 0X1CA3, 0X1CA4, 0X1CA5, 0X1CA6,
+  0X1CA7, 0X1CA8, 0X1CA9, 0X1CAA, 0X1CAB, 0X1CAC, 0X1CAD, 0X1CAE,
+  0X1CAF, 0X1CB0, 0X1CB1, 0X1CB2, 0X1CB3, 0X1CB4, 0X1CB5, 0X1CB6,
+  0X1CB7, 0X1CB8, 0X1CB9, 0X1CBA, 0X10FB, 0X10FC, 0X1CBD, 0X1CBE,
+  0X1CBF, 0XFFFF, 0X02F8, 0X13F0, 0X13F1, 0X13F2, 0X13F3, 0X13F4,
+  0X13F5, 0XFFFF, 0X0882, 0X0412, 0X0414, 0X041E, 0X0421, 0X0422,
+  0X0422, 0X042A, 0X0462, 0XA64A, 0X1C89, 0X1C8A, 0X1C8B, 0X1C8C,
+  0X1C8D, 0X1C8E, 0X1C8F, 0X1C90, 0X1C91, 0X1C92, 0X1C93, 0X1C94,
+  0X1C95, 0X1C96, 0X1C97, 0X1C98, 0X1C99, 0X1C9A, 0X1C9B, 0X1C9C,
+  0X1C9D, 0X1C9E, 0X1C9F, 0X1CA0, 0X1CA1, 0X1CA2, 0X1CA3, 0X1CA4,
+  0X1CA5, 0X1CA6, 0X1CA7, 0X1CA8, 0X1CA9, 0X1CAA, 0X1CAB, 0X1CAC,
+  0X1CAD, 0X1CAE, 0X1CAF, 0X1CB0, 0X1CB1, 0X1CB2, 0X1CB3, 0X1CB4,
+  0X1CB5, 0X1CB6, 0X1CB7, 0X1CB8, 0X1CB9, 0X1CBA, 0X1CBB, 0X1CBC,
+  0X1CBD, 0X1CBE, 0X1CBF, 0X1CC0, 0X1CC1, 0X1CC2, 0X1CC3, 0X1CC4,
+  0X1CC5, 0X1CC6, 0X1CC7, 0X1CC8, 0X1CC9, 0X1CCA, 0X1CCB, 0X1CCC,
+  0X1CCD, 0X1CCE, 0X1CCF, 0X1CD0, 0X1CD1, 0X1CD2, 0X1CD3, 0X1CD4,
+  0X1CD5, 0X1CD6, 0X1CD7, 0X1CD8, 0X1CD9, 0X1CDA, 0X1CDB, 0X1CDC,
+  0X1CDD, 0X1CDE, 0X1CDF, 0X1CE0, 0X1CE1, 0X1CE2, 0X1CE3, 0X1CE4,
+  0X1CE5, 0X1CE6, 0X1CE7, 0X1CE8, 0X1CE9, 0X1CEA, 0X1CEB, 0X1CEC,
+  0X1CED, 0X1CEE, 0X1CEF, 0X1CF0, 0X1CF1, 0X1CF2, 0X1CF3, 0X1CF4,
+  0X1CF5, 0X1CF6, 0X1CF7, 0X1CF8, 0X1CF9, 0X1CFA, 0X1CFB, 0X1CFC,
+  0X1CFD, 0X1CFE, 0X1CFF, 0X1D00, 0X1D01, 0X1D02, 0X1D03, 0X1D04,
+  0X1D05, 0X1D06, 0X1D07, 0X1D08, 0X1D09, 0X1D0A, 0X1D0B, 0X1D0C,
+  0X1D0D, 0X1D0E, 0X1D0F, 0X1D10, 0X1D11, 0X1D12, 0X1D13, 0X1D14,
+  0X1D15, 0X1D16, 0X1D17, 0X1D18, 0X1D19, 0X1D1A, 0X1D1B, 0X1D1C,
+  0X1D1D, 0X1D1E, 0X1D1F, 0X1D20, 0X1D21, 0X1D22, 0X1D23, 0X1D24,
+  0X1D25, 0X1D26, 0X1D27, 0X1D28, 0X1D29, 0X1D2A, 0X1D2B, 0X1D2C,
+  0X1D2D, 0X1D2E, 0X1D2F, 0X1D30, 0X1D31, 0X1D32, 0X1D33, 0X1D34,
+  0X1D35, 0X1D36, 0X1D37, 0X1D38, 0X1D39, 0X1D3A, 0X1D3B, 0X1D3C,
+  0X1D3D, 0X1D3E, 0X1D3F, 0X1D40, 0X1D41, 0X1D42, 0X1D43, 0X1D44,
+  0X1D45, 0X1D46, 0X1D47, 0X1D48, 0X1D49, 0X1D4A, 0X1D4B, 0X1D4C,
+  0X1D4D, 0X1D4E, 0X1D4F, 0X1D50, 0X1D51, 0X1D52, 0X1D53, 0X1D54,
+  0X1D55, 0X1D56, 0X1D57, 0X1D58, 0X1D59, 0X1D5A, 0X1D5B, 0X1D5C,
+  0X1D5D, 0X1D5E, 0X1D5F, 0X1D60, 0X1D61, 0X1D62, 0X1D63, 0X1D64,
+  0X1D65, 0X1D66, 0X1D67, 0X1D68, 0X1D69, 0X1D6A, 0X1D6B, 0X1D6C,
+  0X1D6D, 0X1D6E, 0X1D6F, 0X1D70, 0X1D71, 0X1D72, 0X1D73, 0X1D74,
+  0X1D75, 0X1D76, 0X1D77, 0X1D78, 0XA77D, 0X1D7A, 0X1D7B, 0X1D7C,
+  0X2C63, 0X1D7E, 0X1D7F, 0X1D80, 0X1D81, 0X1D82, 0X1D83, 0X1D84,
+  0X1D85, 0X1D86, 0X1D87, 0X1D88, 0X1D89, 0X1D8A, 0X1D8B, 0X1D8C,
+  0X1D8D, 0XA7C6, 0X1D8F, 0X1D90, 0X1D91, 0X1D92, 0X1D93, 0X1D94,
+  0X1D95, 0X1D96, 0X1D97, 0X1D98, 0X1D99, 0X1D9A, 0X1D9B, 0X1D9C,
+  0X1D9D, 0X1D9E, 0X1D9F, 0X1DA0, 0X1DA1, 0X1DA2, 0X1DA3, 0X1DA4,
+  0X1DA5, 0X1DA6, 0X1DA7, 0X1DA8, 0X1DA9, 0X1DAA, 0X1DAB, 0X1DAC,
+  0X1DAD, 0X1DAE, 0X1DAF, 0X1DB0, 0X1DB1, 0X1DB2, 0X1DB3, 0X1DB4,
+  0X1DB5, 0X1DB6, 0X1DB7, 0X1DB8, 0X1DB9, 0X1DBA, 0X1DBB, 0X1DBC,
+  0X1DBD, 0X1DBE, 0X1DBF, 0X1DC0, 0X1DC1, 0X1DC2, 0X1DC3, 0X1DC4,
+  0X1DC5, 0X1DC6, 0X1DC7, 0X1DC8, 0X1DC9, 0X1DCA, 0X1DCB, 0X1DCC,
+  0X1DCD, 0X1DCE, 0X1DCF, 0X1DD0, 0X1DD1, 0X1DD2, 0X1DD3, 0X1DD4,
+  0X1DD5, 0X1DD6, 0X1DD7, 0X1DD8, 0X1DD9, 0X1DDA, 0X1DDB, 0X1DDC,
+  0X1DDD, 0X1DDE, 0X1DDF, 0X1DE0, 0X1DE1, 0X1DE2, 0X1DE3, 0X1DE4,
+  0X1DE5, 0X1DE6, 0X1DE7, 0X1DE8, 0X1DE9, 0X1DEA, 0X1DEB, 0X1DEC,
+  0X1DED, 0X1DEE, 0X1DEF, 0X1DF0, 0X1DF1, 0X1DF2, 0X1DF3, 0X1DF4,
+  0X1DF5, 0X1DF6, 0X1DF7, 0X1DF8, 0X1DF9, 0X1DFA, 0X1DFB, 0X1DFC,
+  0X1DFD, 0X1DFE, 0X1DFF, 0X1E00, 0X1E00, 0X1E02, 0X1E02, 0X1E04,
+  0X1E04, 0X1E06, 0X1E06, 0X1E08, 0X1E08, 0X1E0A, 0X1E0A, 0X1E0C,
+  0X1E0C, 0X1E0E, 0X1E0E, 0X1E10, 0X1E10, 0X1E12, 0X1E12, 0X1E14,
+  0X1E14, 0X1E16, 0X1E16, 0X1E18, 0X1E18, 0X1E1A, 0X1E1A, 0X1E1C,
+  0X1E1C, 0X1E1E, 0X1E1E, 0X1E20, 0X1E20, 0X1E22, 0X1E22, 0X1E24,
+  0X1E24, 0X1E26, 0X1E26, 0X1E28, 0X1E28, 0X1E2A, 0X1E2A, 0X1E2C,
+  0X1E2C, 0X1E2E, 0X1E2E, 0X1E30, 0X1E30, 0X1E32, 0X1E32, 0X1E34,
+  0X1E34, 0X1E36, 0X1E36, 0X1E38, 0X1E38, 0X1E3A, 0X1E3A, 0X1E3C,
+  0X1E3C, 0X1E3E, 0X1E3E, 0X1E40, 0X1E40, 0X1E42, 0X1E42, 0X1E44,
+  0X1E44, 0X1E46, 0X1E46, 0X1E48, 0X1E48, 0X1E4A, 0X1E4A, 0X1E4C,
+  0X1E4C, 0X1E4E, 0X1E4E, 0X1E50, 0X1E50, 0X1E52, 0X1E52, 0X1E54,
+  0X1E54, 0X1E56, 0X1E56, 0X1E58, 0X1E58, 0X1E5A, 0X1E5A, 0X1E5C,
+  0X1E5C, 0X1E5E, 0X1E5E, 0X1E60, 0X1E60, 0X1E62, 0X1E62, 0X1E64,
+  0X1E64, 0X1E66, 0X1E66, 0X1E68, 0X1E68, 0X1E6A, 0X1E6A, 0X1E6C,
+  0X1E6C, 0X1E6E, 0X1E6E, 0X1E70, 0X1E70, 0X1E72, 0X1E72, 0X1E74,
+  0X1E74, 0X1E76, 0X1E76, 0X1E78, 0X1E78, 0X1E7A, 0X1E7A, 0X1E7C,
+  0X1E7C, 0X1E7E, 0X1E7E, 0X1E80, 0X1E80, 0X1E82, 0X1E82, 0X1E84,
+  0X1E84, 0X1E86, 0X1E86, 0X1E88, 0X1E88, 0X1E8A, 0X1E8A, 0X1E8C,
+  0X1E8C, 0X1E8E, 0X1E8E, 0X1E90, 0X1E90, 0X1E92, 0X1E92, 0X1E94,
+  0X1E94, 0X1E96, 0X1E97, 0X1E98, 0X1E99, 0X1E9A, 0X1E60, 0X1E9C,
+  0X1E9D, 0X1E9E, 0X1E9F, 0X1EA0, 0X1EA0, 0X1EA2, 0X1EA2, 0X1EA4,
+  0X1EA4, 0X1EA6, 0X1EA6, 0X1EA8, 0X1EA8, 0X1EAA, 0X1EAA, 0X1EAC,
+  0X1EAC, 0X1EAE, 0X1EAE, 0X1EB0, 0X1EB0, 0X1EB2, 0X1EB2, 0X1EB4,
+  0X1EB4, 0X1EB6, 0X1EB6, 0X1EB8, 0X1EB8, 0X1EBA, 0X1EBA, 0X1EBC,
+  0X1EBC, 0X1EBE, 0X1EBE, 0X1EC0, 0X1EC0, 0X1EC2, 0X1EC2, 0X1EC4,
+  0X1EC4, 0X1EC6, 0X1EC6, 0X1EC8, 0X1EC8, 0X1ECA, 0X1ECA, 0X1ECC,
+  0X1ECC, 0X1ECE, 0X1ECE, 0X1ED0, 0X1ED0, 0X1ED2, 0X1ED2, 0X1ED4,
+  0X1ED4, 0X1ED6, 0X1ED6, 0X1ED8, 0X1ED8, 0X1EDA, 0X1EDA, 0X1EDC,
+  0X1EDC, 0X1EDE, 0X1EDE, 0X1EE0, 0X1EE0, 0X1EE2, 0X1EE2, 0X1EE4,
+  0X1EE4, 0X1EE6, 0X1EE6, 0X1EE8, 0X1EE8, 0X1EEA, 0X1EEA, 0X1EEC,
+  0X1EEC, 0X1EEE, 0X1EEE, 0X1EF0, 0X1EF0, 0X1EF2, 0X1EF2, 0X1EF4,
+  0X1EF4, 0X1EF6, 0X1EF6, 0X1EF8, 0X1EF8, 0X1EFA, 0X1EFA, 0X1EFC,
+  0X1EFC, 0X1EFE, 0X1EFE, 0X1F08, 0X1F09, 0X1F0A, 0X1F0B, 0X1F0C,
+  0X1F0D, 0X1F0E, 0X1F0F, 0X1F08, 0X1F09, 0X1F0A, 0X1F0B, 0X1F0C,
+  0X1F0D, 0X1F0E, 0X1F0F, 0X1F18, 0X1F19, 0X1F1A, 0X1F1B, 0X1F1C,
+  0X1F1D, 0X1F16, 0X1F17, 0X1F18, 0X1F19, 0X1F1A, 0X1F1B, 0X1F1C,
+  0X1F1D, 0X1F1E, 0X1F1F, 0X1F28, 0X1F29, 0X1F2A, 0X1F2B, 0X1F2C,
+  0X1F2D, 0X1F2E, 0X1F2F, 0X1F28, 0X1F29, 0X1F2A, 0X1F2B, 0X1F2C,
+  0X1F2D, 0X1F2E, 0X1F2F, 0X1F38, 0X1F39, 0X1F3A, 0X1F3B, 0X1F3C,
+  0X1F3D, 0X1F3E, 0X1F3F, 0X1F38, 0X1F39, 0X1F3A, 0X1F3B, 0X1F3C,
+  0X1F3D, 0X1F3E, 0X1F3F, 0X1F48, 0X1F49, 0X1F4A, 0X1F4B, 0X1F4C,
+  0X1F4D, 0X1F46, 0X1F47, 0X1F48, 0X1F49, 0X1F4A, 0X1F4B, 0X1F4C,
+  0X1F4D, 0X1F4E, 0X1F4F, 0X1F50, 0X1F59, 0X1F52, 0X1F5B, 0X1F54,
+  0X1F5D, 0X1F56, 0X1F5F, 0X1F58, 0X1F59, 0X1F5A, 0X1F5B, 0X1F5C,
+  0X1F5D, 0X1F5E, 0X1F5F, 0X1F68, 0X1F69, 0X1F6A, 0X1F6B, 0X1F6C,
+  0X1F6D, 0X1F6E, 0X1F6F, 0X1F68, 0X1F69, 0X1F6A, 0X1F6B, 0X1F6C,
+  0X1F6D, 0X1F6E, 0X1F6F, 0X1FBA, 0X1FBB, 0X1FC8, 0X1FC9, 0X1FCA,
+  0X1FCB, 0X1FDA, 0X1FDB, 0X1FF8, 0X1FF9, 0X1FEA, 0X1FEB, 0X1FFA,
+  0X1FFB, 0X1F7E, 0X1F7F, 0X1F80, 0X1F81, 0X1F82, 0X1F83, 0X1F84,
+  0X1F85, 0X1F86, 0X1F87, 0X1F88, 0X1F89, 0X1F8A, 0X1F8B, 0X1F8C,
+  0X1F8D, 0X1F8E, 0X1F8F, 0X1F90, 0X1F91, 0X1F92, 0X1F93, 0X1F94,
+  0X1F95, 0X1F96, 0X1F97, 0X1F98, 0X1F99, 0X1F9A, 0X1F9B, 0X1F9C,
+  0X1F9D, 0X1F9E, 0X1F9F, 0X1FA0, 0X1FA1, 0X1FA2, 0X1FA3, 0X1FA4,
+  0X1FA5, 0X1FA6, 0X1FA7, 0X1FA8, 0X1FA9, 0X1FAA, 0X1FAB, 0X1FAC,
+  0X1FAD, 0X1FAE, 0X1FAF, 0X1FB8, 0X1FB9, 0X1FB2, 0X1FB3, 0X1FB4,
+  0X1FB5, 0X1FB6, 0X1FB7, 0X1FB8, 0X1FB9, 0X1FBA, 0X1FBB, 0X1FBC,
+  0X1FBD, 0X0399, 0X1FBF, 0X1FC0, 0X1FC1, 0X1FC2, 0X1FC3, 0X1FC4,
+  0X1FC5, 0X1FC6, 0X1FC7, 0X1FC8, 0X1FC9, 0X1FCA, 0X1FCB, 0X1FCC,
+  0X1FCD, 0X1FCE, 0X1FCF, 0X1FD8, 0X1FD9, 0X1FD2, 0X1FD3, 0X1FD4,
+  0X1FD5, 0X1FD6, 0X1FD7, 0X1FD8, 0X1FD9, 0X1FDA, 0X1FDB, 0X1FDC,
+  0X1FDD, 0X1FDE, 0X1FDF, 0X1FE8, 0X1FE9, 0X1FE2, 0X1FE3, 0X1FE4,
+  0X1FEC, 0X1FE6, 0X1FE7, 0X1FE8, 0X1FE9, 0X1FEA, 0X1FEB, 0X1FEC,
+  0X1FED, 0X1FEE, 0X1FEF, 0X1FF0, 0X1FF1, 0X1FF2, 0X1FF3, 0X1FF4,
+  0X1FF5, 0X1FF6, 0X1FF7, 0X1FF8, 0X1FF9, 0X1FFA, 0X1FFB, 0X1FFC,
+  0X1FFD, 0X1FFE, 0X1FFF, 0X2000, 0X2001, 0X2002, 0X2003, 0X2004,
+  0X2005, 0X2006, 0X2007, 0X2008, 0X2009, 0X200A, 0X200B, 0X200C,
+  0X200D, 0X200E, 0X200F, 0X2010, 0X2011, 0X2012, 0X2013, 0X2014,
+  0X2015, 0X2016, 0X2017, 0X2018, 0X2019, 0X201A, 0X201B, 0X201C,
+  0X201D, 0X201E, 0X201F, 0X2020, 0X2021, 0X2022, 0X2023, 0X2024,
+  0X2025, 0X2026, 0X2027, 0X2028, 0X2029, 0X202A, 0X202B, 0X202C,
+  0X202D, 0X202E, 0X202F, 0X2030, 0X2031, 0X2032, 0X2033, 0X2034,
+  0X2035, 0X2036, 0X2037, 0X2038, 0X2039, 0X203A, 0X203B, 0X203C,
+  0X203D, 0X203E, 0X203F, 0X2040, 0X2041, 0X2042, 0X2043, 0X2044,
+  0X2045, 0X2046, 0X2047, 0X2048, 0X2049, 0X204A, 0X204B, 0X204C,
+  0X204D, 0X204E, 0X204F, 0X2050, 0X2051, 0X2052, 0X2053, 0X2054,
+  0X2055, 0X2056, 0X2057, 0X2058, 0X2059, 0X205A, 0X205B, 0X205C,
+  0X205D, 0X205E, 0X205F, 0X2060, 0X2061, 0X2062, 0X2063, 0X2064,
+  0X2065, 0X2066, 0X2067, 0X2068, 0X2069, 0X206A, 0X206B, 0X206C,
+  0X206D, 0X206E, 0X206F, 0X2070, 0X2071, 0X2072, 0X2073, 0X2074,
+  0X2075, 0X2076, 0X2077, 0X2078, 0X2079, 0X207A, 0X207B, 0X207C,
+  0X207D, 0X207E, 0X207F, 0X2080, 0X2081, 0X2082, 0X2083, 0X2084,
+  0X2085, 0X2086, 0X2087, 0X2088, 0X2089, 0X208A, 0X208B, 0X208C,
+  0X208D, 0X208E, 0X208F, 0X2090, 0X2091, 0X2092, 0X2093, 0X2094,
+  0X2095, 0X2096, 0X2097, 0X2098, 0X2099, 0X209A, 0X209B, 0X209C,
+  0X209D, 0X209E, 0X209F, 0X20A0, 0X20A1, 0X20A2, 0X20A3, 0X20A4,
+  0X20A5, 0X20A6, 0X20A7, 0X20A8, 0X20A9, 0X20AA, 0X20AB, 0X20AC,
+  0X20AD, 0X20AE, 0X20AF, 0X20B0, 0X20B1, 0X20B2, 0X20B3, 0X20B4,
+  0X20B5, 0X20B6, 0X20B7, 0X20B8, 0X20B9, 0X20BA, 0X20BB, 0X20BC,
+  0X20BD, 0X20BE, 0X20BF, 0X20C0, 0X20C1, 0X20C2, 0X20C3, 0X20C4,
+  0X20C5, 0X20C6, 0X20C7, 0X20C8, 0X20C9, 0X20CA, 0X20CB, 0X20CC,
+  0X20CD, 0X20CE, 0X20CF, 0X20D0, 0X20D1, 0X20D2, 0X20D3, 0X20D4,
+  0X20D5, 0X20D6, 0X20D7, 0X20D8, 0X20D9, 0X20DA, 0X20DB, 0X20DC,
+  0X20DD, 0X20DE, 0X20DF, 0X20E0, 0X20E1, 0X20E2, 0X20E3, 0X20E4,
+  0X20E5, 0X20E6, 0X20E7, 0X20E8, 0X20E9, 0X20EA, 0X20EB, 0X20EC,
+  0X20ED, 0X20EE, 0X20EF, 0X20F0, 0X20F1, 0X20F2, 0X20F3, 0X20F4,
+  0X20F5, 0X20F6, 0X20F7, 0X20F8, 0X20F9, 0X20FA, 0X20FB, 0X20FC,
+  0X20FD, 0X20FE, 0X20FF, 0X2100, 0X2101, 0X2102, 0X2103, 0X2104,
+  0X2105, 0X2106, 0X2107, 0X2108, 0X2109, 0X210A, 0X210B, 0X210C,
+  0X210D, 0X210E, 0X210F, 0X2110, 0X2111, 0X2112, 0X2113, 0X2114,
+  0X2115, 0X2116, 0X2117, 0X2118, 0X2119, 0X211A, 0X211B, 0X211C,
+  0X211D, 0X211E, 0X211F, 0X2120, 0X2121, 0X2122, 0X2123, 0X2124,
+  0X2125, 0X2126, 0X2127, 0X2128, 0X2129, 0X212A, 0X212B, 0X212C,
+  0X212D, 0X212E, 0X212F, 0X2130, 0X2131, 0X2132, 0X2133, 0X2134,
+  0X2135, 0X2136, 0X2137, 0X2138, 0X2139, 0X213A, 0X213B, 0X213C,
+  0X213D, 0X213E, 0X213F, 0X2140, 0X2141, 0X2142, 0X2143, 0X2144,
+  0X2145, 0X2146, 0X2147, 0X2148, 0X2149, 0X214A, 0X214B, 0X214C,
+  0X214D, 0X2132, 0X214F, 0X2150, 0X2151, 0X2152, 0X2153, 0X2154,
+  0X2155, 0X2156, 0X2157, 0X2158, 0X2159, 0X215A, 0X215B, 0X215C,
+  0X215D, 0X215E, 0X215F, 0X2160, 0X2161, 0X2162, 0X2163, 0X2164,
+  0X2165, 0X2166, 0X2167, 0X2168, 0X2169, 0X216A, 0X216B, 0X216C,
+  0X216D, 0X216E, 0X216F, 0X2160, 0X2161, 0X2162, 0X2163, 0X2164,
+  0X2165, 0X2166, 0X2167, 0X2168, 0X2169, 0X216A, 0X216B, 0X216C,
+  0X216D, 0X216E, 0X216F, 0X2180, 0X2181, 0X2182, 0X2183, 0X2183,
+  0XFFFF, 0X034B, 0X24B6, 0X24B7, 0X24B8, 0X24B9, 0X24BA, 0X24BB,
+  0X24BC, 0X24BD, 0X24BE, 0X24BF, 0X24C0, 0X24C1, 0X24C2, 0X24C3,
+  0X24C4, 0X24C5, 0X24C6, 0X24C7, 0X24C8, 0X24C9, 0X24CA, 0X24CB,
+  0X24CC, 0X24CD, 0X24CE, 0X24CF, 0XFFFF, 0X0746, 0X2C00, 0X2C01,
+  0X2C02, 0X2C03, 0X2C04, 0X2C05, 0X2C06, 0X2C07, 0X2C08, 0X2C09,
+  0X2C0A, 0X2C0B, 0X2C0C, 0X2C0D, 0X2C0E, 0X2C0F, 0X2C10, 0X2C11,
+  0X2C12, 0X2C13, 0X2C14, 0X2C15, 0X2C16, 0X2C17, 0X2C18, 0X2C19,
+  0X2C1A, 0X2C1B, 0X2C1C, 0X2C1D, 0X2C1E, 0X2C1F, 0X2C20, 0X2C21,
+  0X2C22, 0X2C23, 0X2C24, 0X2C25, 0X2C26, 0X2C27, 0X2C28, 0X2C29,
+  0X2C2A, 0X2C2B, 0X2C2C, 0X2C2D, 0X2C2E, 0X2C2F, 0X2C60, 0X2C60,
+  0X2C62, 0X2C63, 0X2C64, 0X023A, 0X023E, 0X2C67, 0X2C67, 0X2C69,
+  0X2C69, 0X2C6B, 0X2C6B, 0X2C6D, 0X2C6E, 0X2C6F, 0X2C70, 0X2C71,
+  0X2C72, 0X2C72, 0X2C74, 0X2C75, 0X2C75, 0X2C77, 0X2C78, 0X2C79,
+  0X2C7A, 0X2C7B, 0X2C7C, 0X2C7D, 0X2C7E, 0X2C7F, 0X2C80, 0X2C80,
+  0X2C82, 0X2C82, 0X2C84, 0X2C84, 0X2C86, 0X2C86, 0X2C88, 0X2C88,
+  0X2C8A, 0X2C8A, 0X2C8C, 0X2C8C, 0X2C8E, 0X2C8E, 0X2C90, 0X2C90,
+  0X2C92, 0X2C92, 0X2C94, 0X2C94, 0X2C96, 0X2C96, 0X2C98, 0X2C98,
+  0X2C9A, 0X2C9A, 0X2C9C, 0X2C9C, 0X2C9E, 0X2C9E, 0X2CA0, 0X2CA0,
+  0X2CA2, 0X2CA2, 0X2CA4, 0X2CA4, 0X2CA6, 0X2CA6, 0X2CA8, 0X2CA8,
+  0X2CAA, 0X2CAA, 0X2CAC, 0X2CAC, 0X2CAE, 0X2CAE, 0X2CB0, 0X2CB0,
+  0X2CB2, 0X2CB2, 0X2CB4, 0X2CB4, 0X2CB6, 0X2CB6, 0X2CB8, 0X2CB8,
+  0X2CBA, 0X2CBA, 0X2CBC, 0X2CBC, 0X2CBE, 0X2CBE, 0X2CC0, 0X2CC0,
+  0X2CC2, 0X2CC2, 0X2CC4, 0X2CC4, 0X2CC6, 0X2CC6, 0X2CC8, 0X2CC8,
+  0X2CCA, 0X2CCA, 0X2CCC, 0X2CCC, 0X2CCE, 0X2CCE, 0X2CD0, 0X2CD0,
+  0X2CD2, 0X2CD2, 0X2CD4, 0X2CD4, 0X2CD6, 0X2CD6, 0X2CD8, 0X2CD8,
+  0X2CDA, 0X2CDA, 0X2CDC, 0X2CDC, 0X2CDE, 0X2CDE, 0X2CE0, 0X2CE0,
+  0X2CE2, 0X2CE2, 0X2CE4, 0X2CE5, 0X2CE6, 0X2CE7, 0X2CE8, 0X2CE9,
+  0X2CEA, 0X2CEB, 0X2CEB, 0X2CED, 0X2CED, 0X2CEF, 0X2CF0, 0X2CF1,
+  0X2CF2, 0X2CF2, 0X2CF4, 0X2CF5, 0X2CF6, 0X2CF7, 0X2CF8, 0X2CF9,
+  0X2CFA, 0X2CFB, 0X2CFC, 0X2CFD, 0X2CFE, 0X2CFF, 0X10A0, 0X10A1,
+  0X10A2, 0X10A3, 0X10A4, 0X10A5, 0X10A6, 0X10A7, 0X10A8, 0X10A9,
+  0X10AA, 0X10AB, 0X10AC, 0X10AD, 0X10AE, 0X10AF, 0X10B0, 0X10B1,
+  0X10B2, 0X10B3, 0X10B4, 0X10B5, 0X10B6, 0X10B7, 0X10B8, 0X10B9,
+  0X10BA, 0X10BB, 0X10BC, 0X10BD, 0X10BE, 0X10BF, 0X10C0, 0X10C1,
+  0X10C2, 0X10C3, 0X10C4, 0X10C5, 0X2D26, 0X10C7, 0X2D28, 0X2D29,
+  0X2D2A, 0X2D2B, 0X2D2C, 0X10CD, 0XFFFF, 0X7913, 0XA640, 0XA642,
+  0XA642, 0XA644, 0XA644, 0XA646, 0XA646, 0XA648, 0XA648, 0XA64A,
+  0XA64A, 0XA64C, 0XA64C, 0XA64E, 0XA64E, 0XA650, 0XA650, 0XA652,
+  0XA652, 0XA654, 0XA654, 0XA656, 0XA656, 0XA658, 0XA658, 0XA65A,
+  0XA65A, 0XA65C, 0XA65C, 0XA65E, 0XA65E, 0XA660, 0XA660, 0XA662,
+  0XA662, 0XA664, 0XA664, 0XA666, 0XA666, 0XA668, 0XA668, 0XA66A,
+  0XA66A, 0XA66C, 0XA66C, 0XA66E, 0XA66F, 0XA670, 0XA671, 0XA672,
+  0XA673, 0XA674, 0XA675, 0XA676, 0XA677, 0XA678, 0XA679, 0XA67A,
+  0XA67B, 0XA67C, 0XA67D, 0XA67E, 0XA67F, 0XA680, 0XA680, 0XA682,
+  0XA682, 0XA684, 0XA684, 0XA686, 0XA686, 0XA688, 0XA688, 0XA68A,
+  0XA68A, 0XA68C, 0XA68C, 0XA68E, 0XA68E, 0XA690, 0XA690, 0XA692,
+  0XA692, 0XA694, 0XA694, 0XA696, 0XA696, 0XA698, 0XA698, 0XA69A,
+  0XA69A, 0XA69C, 0XA69D, 0XA69E, 0XA69F, 0XA6A0, 0XA6A1, 0XA6A2,
+  0XA6A3, 0XA6A4, 0XA6A5, 0XA6A6, 0XA6A7, 0XA6A8, 0XA6A9, 0XA6AA,
+  0XA6AB, 0XA6AC, 0XA6AD, 0XA6AE, 0XA6AF, 0XA6B0, 0XA6B1, 0XA6B2,
+  0XA6B3, 0XA6B4, 0XA6B5, 0XA6B6, 0XA6B7, 0XA6B8, 0XA6B9, 0XA6BA,
+  0XA6BB, 0XA6BC, 0XA6BD, 0XA6BE, 0XA6BF, 0XA6C0, 0XA6C1, 0XA6C2,
+  0XA6C3, 0XA6C4, 0XA6C5, 0XA6C6, 0XA6C7, 0XA6C8, 0XA6C9, 0XA6CA,
+  0XA6CB, 0XA6CC, 0XA6CD, 0XA6CE, 0XA6CF, 0XA6D0, 0XA6D1, 0XA6D2,
+  0XA6D3, 0XA6D4, 0XA6D5, 0XA6D6, 0XA6D7, 0XA6D8, 0XA6D9, 0XA6DA,
+  0XA6DB, 0XA6DC, 0XA6DD, 0XA6DE, 0XA6DF, 0XA6E0, 0XA6E1, 0XA6E2,
+  0XA6E3, 0XA6E4, 0XA6E5, 0XA6E6, 0XA6E7, 0XA6E8, 0XA6E9, 0XA6EA,
+  0XA6EB, 0XA6EC, 0XA6ED, 0XA6EE, 0XA6EF, 0XA6F0, 0XA6F1, 0XA6F2,
+  0XA6F3, 0XA6F4, 0XA6F5, 0XA6F6, 0XA6F7, 0XA6F8, 0XA6F9, 0XA6FA,
+  0XA6FB, 0XA6FC, 0XA6FD, 0XA6FE, 0XA6FF, 0XA700, 0XA701, 0XA702,
+  0XA703, 0XA704, 0XA705, 0XA706, 0XA707, 0XA708, 0XA709, 0XA70A,
+  0XA70B, 0XA70C, 0XA70D, 0XA70E, 0XA70F, 0XA710, 0XA711, 0XA712,
+  0XA713, 0XA714, 0XA715, 0XA716, 0XA717, 0XA718, 0XA719, 0XA71A,
+  0XA71B, 0XA71C, 0XA71D, 0XA71E, 0XA71F, 0XA720, 0XA721, 0XA722,
+  0XA722, 0XA724, 0XA724, 0XA726, 0XA726, 0XA728, 0XA728, 0XA72A,
+  0XA72A, 0XA72C, 0XA72C, 0XA72E, 0XA72E, 0XA730, 0XA731, 0XA732,
+  0XA732, 0XA734, 0XA734, 0XA736, 0XA736, 0XA738, 0XA738, 0XA73A,
+  0XA73A, 0XA73C, 0XA73C, 0XA73E, 0XA73E, 0XA740, 0XA740, 0XA742,
+  0XA742, 0XA744, 0XA744, 0XA746, 0XA746, 0XA748, 0XA748, 0XA74A,
+  0XA74A, 0XA74C, 0XA74C, 0XA74E, 0XA74E, 0XA750, 0XA750, 0XA752,
+  0XA752, 0XA754, 0XA754, 0XA756, 0XA756, 0XA758, 0XA758, 0XA75A,
+  0XA75A, 0XA75C, 0XA75C, 0XA75E, 0XA75E, 0XA760, 0XA760, 0XA762,
+  0XA762, 0XA764, 0XA764, 0XA766, 0XA766, 0XA768, 0XA768, 0XA76A,
+  0XA76A, 0XA76C, 0XA76C, 0XA76E, 0XA76E, 0XA770, 0XA771, 0XA772,
+  0XA773, 0XA774, 0XA775, 0XA776, 0XA777, 0XA778, 0XA779, 0XA779,
+  0XA77B, 0XA77B, 0XA77D, 0XA77E, 0XA77E, 0XA780, 0XA780, 0XA782,
+  0XA782, 0XA784, 0XA784, 0XA786, 0XA786, 0XA788, 0XA789, 0XA78A,
+  0XA78B, 0XA78B, 0XA78D, 0XA78E, 0XA78F, 0XA790, 0XA790, 0XA792,
+  0XA792, 0XA7C4, 0XA795, 0XA796, 0XA796, 0XA798, 0XA798, 0XA79A,
+  0XA79A, 0XA79C, 0XA79C, 0XA79E, 0XA79E, 0XA7A0, 0XA7A0, 0XA7A2,
+  0XA7A2, 0XA7A4, 0XA7A4, 0XA7A6, 0XA7A6, 0XA7A8, 0XA7A8, 0XA7AA,
+  0XA7AB, 0XA7AC, 0XA7AD, 0XA7AE, 0XA7AF, 0XA7B0, 0XA7B1, 0XA7B2,
+  0XA7B3, 0XA7B4, 0XA7B4, 0XA7B6, 0XA7B6, 0XA7B8, 0XA7B8, 0XA7BA,
+  0XA7BA, 0XA7BC, 0XA7BC, 0XA7BE, 0XA7BE, 0XA7C0, 0XA7C0, 0XA7C2,
+  0XA7C2, 0XA7C4, 0XA7C5, 0XA7C6, 0XA7C7, 0XA7C7, 0XA7C9, 0XA7C9,
+  0XA7CB, 0XA7CC, 0XA7CD, 0XA7CE, 0XA7CF, 0XA7D0, 0XA7D0, 0XA7D2,
+  0XA7D3, 0XA7D4, 0XA7D5, 0XA7D6, 0XA7D6, 0XA7D8, 0XA7D8, 0XA7DA,
+  0XA7DB, 0XA7DC, 0XA7DD, 0XA7DE, 0XA7DF, 0XA7E0, 0XA7E1, 0XA7E2,
+  0XA7E3, 0XA7E4, 0XA7E5, 0XA7E6, 0XA7E7, 0XA7E8, 0XA7E9, 0XA7EA,
+  0XA7EB, 0XA7EC, 0XA7ED, 0XA7EE, 0XA7EF, 0XA7F0, 0XA7F1, 0XA7F2,
+  0XA7F3, 0XA7F4, 0XA7F5, 0XA7F5, 0XFFFF, 0X035C, 0XA7B3, 0XAB54,
+  0XAB55, 0XAB56, 0XAB57, 0XAB58, 0XAB59, 0XAB5A, 0XAB5B, 0XAB5C,
+  0XAB5D, 0XAB5E, 0XAB5F, 0XAB60, 0XAB61, 0XAB62, 0XAB63, 0XAB64,
+  0XAB65, 0XAB66, 0XAB67, 0XAB68, 0XAB69, 0XAB6A, 0XAB6B, 0XAB6C,
+  0XAB6D, 0XAB6E, 0XAB6F, 0X13A0, 0X13A1, 0X13A2, 0X13A3, 0X13A4,
+  0X13A5, 0X13A6, 0X13A7, 0X13A8, 0X13A9, 0X13AA, 0X13AB, 0X13AC,
+  0X13AD, 0X13AE, 0X13AF, 0X13B0, 0X13B1, 0X13B2, 0X13B3, 0X13B4,
+  0X13B5, 0X13B6, 0X13B7, 0X13B8, 0X13B9, 0X13BA, 0X13BB, 0X13BC,
+  0X13BD, 0X13BE, 0X13BF, 0X13C0, 0X13C1, 0X13C2, 0X13C3, 0X13C4,
+  0X13C5, 0X13C6, 0X13C7, 0X13C8, 0X13C9, 0X13CA, 0X13CB, 0X13CC,
+  0X13CD, 0X13CE, 0X13CF, 0X13D0, 0X13D1, 0X13D2, 0X13D3, 0X13D4,
+  0X13D5, 0X13D6, 0X13D7, 0X13D8, 0X13D9, 0X13DA, 0X13DB, 0X13DC,
+  0X13DD, 0X13DE, 0X13DF, 0X13E0, 0X13E1, 0X13E2, 0X13E3, 0X13E4,
+  0X13E5, 0X13E6, 0X13E7, 0X13E8, 0X13E9, 0X13EA, 0X13EB, 0X13EC,
+  0X13ED, 0X13EE, 0X13EF, 0XFFFF, 0X5381, 0XFF21, 0XFF22, 0XFF23,
+  0XFF24, 0XFF25, 0XFF26, 0XFF27, 0XFF28, 0XFF29, 0XFF2A, 0XFF2B,
+  0XFF2C, 0XFF2D, 0XFF2E, 0XFF2F, 0XFF30, 0XFF31, 0XFF32, 0XFF33,
+  0XFF34, 0XFF35, 0XFF36, 0XFF37, 0XFF38, 0XFF39, 0XFF3A, 0XFF5B,
+  0XFF5C, 0XFF5D, 0XFF5E, 0XFF5F, 0XFF60, 0XFF61, 0XFF62, 0XFF63,
+  0XFF64, 0XFF65, 0XFF66, 0XFF67, 0XFF68, 0XFF69, 0XFF6A, 0XFF6B,
+  0XFF6C, 0XFF6D, 0XFF6E, 0XFF6F, 0XFF70, 0XFF71, 0XFF72, 0XFF73,
+  0XFF74, 0XFF75, 0XFF76, 0XFF77, 0XFF78, 0XFF79, 0XFF7A, 0XFF7B,
+  0XFF7C, 0XFF7D, 0XFF7E, 0XFF7F, 0XFF80, 0XFF81, 0XFF82, 0XFF83,
+  0XFF84, 0XFF85, 0XFF86, 0XFF87, 0XFF88, 0XFF89, 0XFF8A, 0XFF8B,
+  0XFF8C, 0XFF8D, 0XFF8E, 0XFF8F, 0XFF90, 0XFF91, 0XFF92, 0XFF93,
+  0XFF94, 0XFF95, 0XFF96, 0XFF97, 0XFF98, 0XFF99, 0XFF9A, 0XFF9B,
+  0XFF9C, 0XFF9D, 0XFF9E, 0XFF9F, 0XFFA0, 0XFFA1, 0XFFA2, 0XFFA3,
+  0XFFA4, 0XFFA5, 0XFFA6, 0XFFA7, 0XFFA8, 0XFFA9, 0XFFAA, 0XFFAB,
+  0XFFAC, 0XFFAD, 0XFFAE, 0XFFAF, 0XFFB0, 0XFFB1, 0XFFB2, 0XFFB3,
+  0XFFB4, 0XFFB5, 0XFFB6, 0XFFB7, 0XFFB8, 0XFFB9, 0XFFBA, 0XFFBB,
+  0XFFBC, 0XFFBD, 0XFFBE, 0XFFBF, 0XFFC0, 0XFFC1, 0XFFC2, 0XFFC3,
+  0XFFC4, 0XFFC5, 0XFFC6, 0XFFC7, 0XFFC8, 0XFFC9, 0XFFCA, 0XFFCB,
+  0XFFCC, 0XFFCD, 0XFFCE, 0XFFCF, 0XFFD0, 0XFFD1, 0XFFD2, 0XFFD3,
+  0XFFD4, 0XFFD5, 0XFFD6, 0XFFD7, 0XFFD8, 0XFFD9, 0XFFDA, 0XFFDB,
+  0XFFDC, 0XFFDD, 0XFFDE, 0XFFDF, 0XFFE0, 0XFFE1, 0XFFE2, 0XFFE3,
+  0XFFE4, 0XFFE5, 0XFFE6, 0XFFE7, 0XFFE8, 0XFFE9, 0XFFEA, 0XFFEB,
+  0XFFEC, 0XFFED, 0XFFEE, 0XFFEF, 0XFFF0, 0XFFF1, 0XFFF2, 0XFFF3,
+  0XFFF4, 0XFFF5, 0XFFF6, 0XFFF7, 0XFFF8, 0XFFF9, 0XFFFA, 0XFFFB,
+  0XFFFC, 0XFFFD, 0XFFFE, 0XFFFF,
+};
+constexpr uint32_t UPCASE_TABLE_SIZE = sizeof(upcaseTable);
+constexpr uint32_t UPCASE_TABLE_SECTORS = (UPCASE_TABLE_SIZE + 511)/512;
+
+// The table checksum for its directory entry, worked out by the compiler.
+static constexpr uint32_t upcaseTableChecksum() {
+  uint32_t checksum = 0;
+  for (uint32_t i = 0; i < UPCASE_TABLE_SIZE; i++) {
+    uint8_t b = (i & 1) ? upcaseTable[i/2] >> 8 : upcaseTable[i/2] & 0XFF;
+    checksum = ((checksum << 31) | (checksum >> 1)) + b;
+  }
+  return checksum;
+}
+constexpr uint32_t UPCASE_TABLE_CHECKSUM = upcaseTableChecksum();
+
+#endif  // USBFilesystemUpcase_h
@@ -49,7 +49,11 @@
 #define HCI_IO_CAPABILITY_REQUEST_REPLY		0x042B
 #define HCI_USER_CONFIRMATION_REQUEST		0x042C
 
+#define HCI_SNIFF_MODE                      0x0803
+#define HCI_EXIT_SNIFF_MODE                 0x0804
+#define HCI_QOS_SETUP                       0x0807
 #define HCI_OP_ROLE_DISCOVERY               0x0809
+#define HCI_WRITE_LINK_POLICY_SETTINGS      0x080d
 
 
 #define HCI_Write_Default_Link_Policy_Settings  0x080f
@@ -67,6 +71,7 @@
 #define HCI_READ_CLASS_OF_DEVICE            0x0c23
 #define HCI_WRITE_CLASS_OF_DEV              0x0C24
 #define HCI_Read_Voice_Setting              0x0c25
+#define HCI_WRITE_AUTOMATIC_FLUSH_TIMEOUT   0x0c28
 #define HCI_Read_Number_Of_Supported_IAC    0x0c38
 #define HCI_Read_Current_IAC_LAP            0x0c39
 #define HCI_WRITE_INQUIRY_MODE              0x0c45
@@ -95,7 +100,10 @@
 #define HCI_LE_SET_SCAN_PARAMETERS          0x200B
 #define HCI_LE_SET_SCAN_ENABLE              0x200C
 #define HCI_LE_READ_WHITE_LIST_SIZE         0x200f
+#define HCI_LE_CREATE_CONNECTION            0x200D
+#define HCI_LE_CREATE_CONNECTION_CANCEL     0x200E
 #define HCI_LE_CLEAR_WHITE_LIST             0x2010
+#define HCI_LE_CONNECTION_UPDATE            0x2013
 #define HCI_LE_Supported_States             0x201c
 
 /* Bluetooth L2CAP PSM - see http://www.bluetooth.org/Technical/AssignedNumbers/logical_link.htm */
@@ -126,6 +134,61 @@
 #define L2CAP_CMD_INFORMATION_REQUEST   0x0A
 #define L2CAP_CMD_INFORMATION_RESPONSE  0x0B
 
+/* LE fixed L2CAP channels */
+#define L2CAP_ATT_CID                   0x0004
+#define L2CAP_LE_SIGNALING_CID          0x0005
+#define L2CAP_SMP_CID                   0x0006
+
+/* LE signaling commands */
+#define L2CAP_CMD_CONN_PARAM_UPDATE_REQUEST     0x12
+#define L2CAP_CMD_CONN_PARAM_UPDATE_RESPONSE    0x13
+
+/* SMP */
+#define SMP_PAIRING_FAILED              0x05
+#define SMP_PAIRING_NOT_SUPPORTED       0x05
+
+/* ATT opcodes */
+#define ATT_ERROR_RSP                   0x01
+#define ATT_EXCHANGE_MTU_REQ            0x02
+#define ATT_EXCHANGE_MTU_RSP            0x03
+#define ATT_FIND_INFORMATION_REQ        0x04
+#define ATT_FIND_INFORMATION_RSP        0x05
+#define ATT_FIND_BY_TYPE_VALUE_REQ      0x06
+#define ATT_FIND_BY_TYPE_VALUE_RSP      0x07
+#define ATT_READ_BY_TYPE_REQ            0x08
+#define ATT_READ_BY_TYPE_RSP            0x09
+#define ATT_READ_REQ                    0x0A
+#define ATT_READ_RSP                    0x0B
+#define ATT_READ_BLOB_REQ               0x0C
+#define ATT_READ_BLOB_RSP               0x0D
+#define ATT_READ_MULTIPLE_REQ           0x0E
+#define ATT_READ_BY_GROUP_TYPE_REQ      0x10
+#define ATT_WRITE_REQ                   0x12
+#define ATT_WRITE_RSP                   0x13
+#define ATT_PREPARE_WRITE_REQ           0x16
+#define ATT_EXECUTE_WRITE_REQ           0x18
+#define ATT_HANDLE_VALUE_NTF            0x1B
+#define ATT_HANDLE_VALUE_IND            0x1D
+#define ATT_HANDLE_VALUE_CFM            0x1E
+
+/* ATT error codes */
+#define ATT_ERROR_INSUFFICIENT_AUTHENTICATION   0x05
+#define ATT_ERROR_REQUEST_NOT_SUPPORTED         0x06
+#define ATT_ERROR_INSUFFICIENT_AUTHORIZATION    0x08
+#define ATT_ERROR_ATTRIBUTE_NOT_FOUND           0x0A
+#define ATT_ERROR_ATTRIBUTE_NOT_LONG            0x0B
+#define ATT_ERROR_INSUFFICIENT_KEY_SIZE         0x0C
+#define ATT_ERROR_INSUFFICIENT_ENCRYPTION       0x0F
+
+/* GATT UUIDs used for HID over GATT */
+#define GATT_PRIMARY_SERVICE_UUID       0x2800
+#define GATT_CHARACTERISTIC_UUID        0x2803
+#define GATT_CCCD_UUID                  0x2902
+#define GATT_REPORT_REFERENCE_UUID      0x2908
+#define GATT_HID_SERVICE_UUID           0x1812
+#define GATT_HID_REPORT_MAP_UUID        0x2A4B
+#define GATT_HID_REPORT_UUID            0x2A4D
+
 #define HID_THDR_DATA_INPUT             0xa1
 // HID stuff
 #define HID_BOOT_PROTOCOL               0x00
@@ -153,6 +216,7 @@ enum {EV_INQUIRY_COMPLETE = 0x01, EV_INQUIRY_RESULT = 0x02, EV_CONNECT_COMPLETE
     EV_LE_CONNECTION_UPDATE_COMPLETE = 0x03,
     EV_LE_READ_REMOTE_FEATURES_COMPLETE = 0x04,
     EV_LE_LONG_TERM_KEY_REQUEST = 0x05,
+    EV_LE_ENHANCED_CONNECTION_COMPLETE = 0x0A,
  };
 
 
@@ -161,7 +225,7 @@ enum {EV_INQUIRY_COMPLETE = 0x01, EV_INQUIRY_RESULT = 0x02, EV_CONNECT_COMPLETE
 
 // different modes
 enum {PC_RESET = 1, PC_READ_LOCAL_SUPPORTED_COMMANDS, PC_READ_LOCAL_SUPPORTED_FEATURES, PC_SEND_SET_EVENT_MASK, 
-      PC_SET_LE_EVENT_MASK, PC_LE_READ_BUFFER_SIZE,
+      PC_SET_LE_EVENT_MASK, PC_LE_READ_BUFFER_SIZE, PC_READ_BUFFER_SIZE,
       PC_WRITE_CLASS_DEVICE, 
       PC_MAYBE_WRITE_SIMPLE_PAIR, PC_MAYBE_READ_SIMPLE_PAIR,
       PC_READ_BDADDR, PC_READ_LOCAL_VERSION,
@@ -194,4 +258,9 @@ enum {STATE_TX_SEND_CONNECT_INT = 200, STATE_TX_SEND_CONECT_RSP_SUCCESS, STATE_T
       STATE_TX_SEND_CONECT_SDP_RSP_SUCCESS, STATE_TX_SEND_CONFIG_SDP_REQ
      };
 
+// HID over GATT discovery on LE connections, one ATT request at a time
+enum {GATT_IDLE = 0, GATT_EXCHANGE_MTU, GATT_FIND_HID_SERVICE, GATT_DISCOVER_CHARACTERISTICS, GATT_DISCOVER_DESCRIPTORS,
+      GATT_READ_REPORT_REFERENCE, GATT_READ_REPORT_MAP, GATT_ENABLE_NOTIFICATIONS, GATT_READY, GATT_FAILED
+     };
+
 #endif
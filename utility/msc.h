@@ -41,6 +41,11 @@
 #define CMD_REQUEST_SENSE   0x03
 #define CMD_START_STOP_UNIT 0x1B
 #define CMD_REPORT_LUNS     0xA0
+#define CMD_WRITE_SAME_10   0x41
+#define CMD_UNMAP           0x42
+#define CMD_WRITE_SAME_16   0x93
+#define CMD_INQUIRY_EVPD    0x01 // Byte 1 of INQUIRY, ask for a VPD page
+#define CMD_WRITE_SAME_UNMAP 0x08 // Byte 1 of WRITE SAME, unmap the blocks
 #define NO_RD_WR			0x00 // transfer type is not read or write blocks.
 
 // Command Status Wrapper Error Codes
@@ -59,6 +64,7 @@
 #define MS_LBA_OUT_OF_RANGE 0x21
 #define MS_MEDIA_CHANGED    0x28
 #define MS_MEDIUM_NOT_PRESENT  0x3A
+#define MS_POWER_ON_RESET   0x29
 
 // SCSI Error Codes
 #define MS_MEDIA_CHANGED_ERR 0x2A
@@ -66,6 +72,13 @@
 #define MS_UNIT_NOT_READY	0x23
 #define MS_BAD_LBA_ERR		0x29
 #define MS_CMD_ERR			0x26
+#define MS_TRANSPORT_BUSY	0x2B // another LUN held the shared transport too long
+#define MS_SHORT_TRANSFER	0x2C // READ/WRITE passed with a non-zero DataResidue
+
+// Vital Product Data pages
+#define VPD_SUPPORTED_PAGES	0x00
+#define VPD_BLOCK_LIMITS	0xB0
+#define VPD_LOGICAL_BLOCK_PROVISIONING 0xB2
 
 #define	MS_INIT_PASS 		0
 #define MAXLUNS				16
@@ -73,7 +86,13 @@
 // These two defines are timeouts for detecting a connected drive
 // and waiting for it to be operational.
 #define MEDIA_READY_TIMEOUT	5000 // 1000
+// Test Unit Ready polling backs off from 1ms up to this between tries.
+#define MEDIA_READY_MAX_BACKOFF 64
+// Without a medium, Task() checks for one this often (ms).
+#define MEDIA_POLL_INTERVAL 500
 #define MSC_CONNECT_TIMEOUT	5000 // 4000
+// How long a command waits for another LUN's command on the same transport.
+#define MSC_TRANSPORT_WAIT_TIMEOUT 5000
 
 // Command Block Wrapper Struct
 typedef struct
@@ -151,6 +170,45 @@ typedef struct
 	uint8_t  padding[234];
 }  __attribute__((packed)) msRequestSenseResponse_t;
 
+// What the Block Limits and Logical Block Provisioning VPD pages told us.
+// Lengths are in blocks, 0 = not reported.
+typedef struct
+{
+	bool     unmap;            // LBPU: UNMAP command supported
+	bool     writeSame16Unmap; // LBPWS: WRITE SAME(16) with UNMAP bit
+	bool     writeSame10Unmap; // LBPWS10: WRITE SAME(10) with UNMAP bit
+	bool     unmapReadsZero;   // LBPRZ: unmapped blocks read back as zeros
+	uint32_t maxTransferLength;
+	uint32_t optimalTransferLength;
+	uint32_t maxUnmapLBACount;
+	uint32_t maxUnmapDescriptorCount;
+	uint32_t unmapGranularity;
+	uint64_t maxWriteSameLength;
+} msBlockLimits_t;
+
+// I/O statistics kept by USBDrive for each kind of command.
+// latency[i] counts commands taking 2^i to 2^(i+1)-1 microseconds, the first
+// bucket also counts the faster ones and the last one the slower ones.
+#define MS_STATS_LATENCY_BUCKETS 20	// last bucket: 0.5 seconds and up
+typedef struct
+{
+	uint32_t count;
+	uint32_t errors;
+	uint64_t bytes;
+	uint32_t maxLatency;	// microseconds
+	uint32_t latency[MS_STATS_LATENCY_BUCKETS];
+} msCommandStats_t;
+
+// Failed commands counted by their sense data.
+#define MS_STATS_SENSE_ENTRIES 8
+typedef struct
+{
+	uint8_t  senseKey;
+	uint8_t  asc;
+	uint8_t  ascq;
+	uint32_t count;
+} msSenseStats_t;
+
 // MSC Drive status/info struct
 typedef struct {
 	bool connected;    // Device is connected